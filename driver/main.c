@@ -135,7 +135,6 @@ TRACEPOINT_PROBE(sched_switch_probe, struct task_struct *prev, struct task_struc
 TRACEPOINT_PROBE(signal_deliver_probe, int sig, struct siginfo *info, struct k_sigaction *ka);
 #endif
 
-DECLARE_BITMAP(g_events_mask, PPM_EVENT_MAX);
 static struct ppm_device *g_ppm_devs;
 static struct class *g_ppm_class;
 static unsigned int g_ppm_numdevs;
@@ -397,7 +396,7 @@ static int ppm_open(struct inode *inode, struct file *filp)
 	consumer->do_dynamic_snaplen = false;
 	consumer->need_to_insert_drop_e = 0;
 	consumer->need_to_insert_drop_x = 0;
-	bitmap_fill(g_events_mask, PPM_EVENT_MAX); /* Enable all syscall to be passed to userspace */
+	bitmap_fill(consumer->events_mask, PPM_EVENT_MAX); /* Enable all syscall to be passed to userspace */
 	ring->info->head = 0;
 	ring->info->tail = 0;
 	ring->nevents = 0;
@@ -713,11 +712,11 @@ static long ppm_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
 	{
 		vpr_info("PPM_IOCTL_MASK_ZERO_EVENTS, consumer %p\n", consumer_id);
 
-		bitmap_zero(g_events_mask, PPM_EVENT_MAX);
+		bitmap_zero(consumer->events_mask, PPM_EVENT_MAX);
 
 		/* Used for dropping events so they must stay on */
-		set_bit(PPME_DROP_E, g_events_mask);
-		set_bit(PPME_DROP_X, g_events_mask);
+		set_bit(PPME_DROP_E, consumer->events_mask);
+		set_bit(PPME_DROP_X, consumer->events_mask);
 
 		ret = 0;
 		goto cleanup_ioctl;
@@ -728,12 +727,12 @@ static long ppm_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
 
 		vpr_info("PPM_IOCTL_MASK_SET_EVENT (%u), consumer %p\n", syscall_to_set, consumer_id);
 
-		if (syscall_to_set > PPM_EVENT_MAX) {
+		if (syscall_to_set >= PPM_EVENT_MAX) {
 			pr_err("invalid syscall %u\n", syscall_to_set);
 			return -EINVAL;
 		}
 
-		set_bit(syscall_to_set, g_events_mask);
+		set_bit(syscall_to_set, consumer->events_mask);
 
 		ret = 0;
 		goto cleanup_ioctl;
@@ -744,12 +743,38 @@ static long ppm_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
 
 		vpr_info("PPM_IOCTL_MASK_UNSET_EVENT (%u), consumer %p\n", syscall_to_unset, consumer_id);
 
-		if (syscall_to_unset > NR_syscalls) {
+		if (syscall_to_unset >= PPM_EVENT_MAX) {
 			pr_err("invalid syscall %u\n", syscall_to_unset);
 			return -EINVAL;
 		}
 
-		clear_bit(syscall_to_unset, g_events_mask);
+		clear_bit(syscall_to_unset, consumer->events_mask);
+
+		ret = 0;
+		goto cleanup_ioctl;
+	}
+	case PPM_IOCTL_MASK_SET_EVENTS:
+	{
+		u8 mask[PPM_EVENTMASK_SIZE];
+		u32 j;
+
+		vpr_info("PPM_IOCTL_MASK_SET_EVENTS, consumer %p\n", consumer_id);
+
+		if (copy_from_user(mask, (void *)arg, sizeof(mask))) {
+			ret = -EFAULT;
+			goto cleanup_ioctl;
+		}
+
+		for (j = 0; j < PPM_EVENT_MAX; j++) {
+			if (mask[j / 8] & (1 << (j % 8)))
+				set_bit(j, consumer->events_mask);
+			else
+				clear_bit(j, consumer->events_mask);
+		}
+
+		/* Used for dropping events so they must stay on */
+		set_bit(PPME_DROP_E, consumer->events_mask);
+		set_bit(PPME_DROP_X, consumer->events_mask);
 
 		ret = 0;
 		goto cleanup_ioctl;
@@ -1288,7 +1313,7 @@ static int record_event_consumer(struct ppm_consumer_t *consumer,
 	int32_t cbres = PPM_SUCCESS;
 	int cpu;
 
-	if (!test_bit(event_type, g_events_mask))
+	if (!test_bit(event_type, consumer->events_mask))
 		return res;
 
 	if (event_type != PPME_DROP_E && event_type != PPME_DROP_X) {
@@ -93,6 +93,7 @@ struct ppm_consumer_t {
 	volatile int need_to_insert_drop_x;
 	struct list_head node;
 	struct ppm_proclist_info *proclist_info;
+	DECLARE_BITMAP(events_mask, PPM_EVENT_MAX);
 };
 
 #define STR_STORAGE_SIZE PAGE_SIZE
@@ -134,6 +134,10 @@ along with sysdig.  If not, see <http://www.gnu.org/licenses/>.
 #define PPM_CL_ACTIVE (1 << 19)			/* libsinsp-specific flag. Set in the first non-clone event for
 										   this thread. */
 #define PPM_CL_CLONE_NEWUSER (1 << 20)
+#define PPM_CL_PROC_PENDING (1 << 21)	/* libsinsp-specific flag. Set while the /proc information of the
+										   thread is being read in the background. */
+#define PPM_CL_FDS_PENDING (1 << 22)	/* libsinsp-specific flag. Set while the fd table of a process found
+										   in /proc at startup hasn't been read yet. */
 
 /*
  * Futex Operations
@@ -1068,6 +1072,7 @@ enum ppm_cmp_operator {
 	CO_CONTAINS = 7,
 	CO_IN = 8,
 	CO_EXISTS = 9,
+	CO_PMATCH = 10,
 };
 
 /*
@@ -1199,6 +1204,13 @@ struct ppm_evt_hdr {
 #define PPM_IOCTL_DISABLE_SIGNAL_DELIVER _IO(PPM_IOCTL_MAGIC, 14)
 #define PPM_IOCTL_ENABLE_SIGNAL_DELIVER _IO(PPM_IOCTL_MAGIC, 15)
 #define PPM_IOCTL_GET_PROCLIST _IO(PPM_IOCTL_MAGIC, 16)
+#define PPM_IOCTL_MASK_SET_EVENTS _IO(PPM_IOCTL_MAGIC, 17)
+
+/*
+ * Size of the event mask passed to PPM_IOCTL_MASK_SET_EVENTS, one bit per
+ * event type, starting from the lowest bit of the first byte
+ */
+#define PPM_EVENTMASK_SIZE ((PPM_EVENT_MAX + 7) / 8)
 
 /*!
   \brief System call description struct.
@@ -0,0 +1,221 @@
+/*
+Copyright (C) 2013-2014 Draios inc.
+
+This file is part of sysdig.
+
+sysdig is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License version 2 as
+published by the Free Software Foundation.
+
+sysdig is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sysdig.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+//
+// Measures the cost of merging the per-CPU event streams, by running the
+// libscap merge engine on synthetic ring buffers. No driver is needed.
+//
+// Usage: scap-mergebench [events per cpu] [batch window in ns]
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <scap.h>
+#include "scap-int.h"
+
+#define EVT_LEN (sizeof(scap_evt) + 2 * sizeof(uint16_t) + 16)
+#define N_ROUNDS 10
+
+static uint64_t get_time_ns()
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return (uint64_t)tv.tv_sec * 1000000000 + tv.tv_usec * 1000;
+}
+
+//
+// Fill the buffers with events whose timestamps interleave across the CPUs
+//
+static char** create_buffers(uint32_t ncpus, uint32_t nevts)
+{
+	uint32_t j, k;
+	char** bufs = (char**)malloc(ncpus * sizeof(char*));
+
+	for(j = 0; j < ncpus; j++)
+	{
+		uint64_t ts = 1000000 + (rand() % 1000);
+
+		bufs[j] = (char*)malloc(nevts * EVT_LEN);
+		memset(bufs[j], 0, nevts * EVT_LEN);
+
+		for(k = 0; k < nevts; k++)
+		{
+			scap_evt* e = (scap_evt*)(bufs[j] + k * EVT_LEN);
+			ts += 1 + rand() % (ncpus * 100);
+			e->ts = ts;
+			e->tid = j;
+			e->len = EVT_LEN;
+			e->type = PPME_GENERIC_E;
+		}
+	}
+
+	return bufs;
+}
+
+static void refill(scap_t* h, char** bufs, uint32_t nevts)
+{
+	uint32_t j;
+
+	for(j = 0; j < h->m_ndevs; j++)
+	{
+		h->m_devs[j].m_sn_next_event = bufs[j];
+		h->m_devs[j].m_sn_len = nevts * EVT_LEN;
+	}
+}
+
+//
+// The linear scan that scap_next_live used before the merge heap, kept as a
+// reference
+//
+static int32_t next_linear(scap_t* h, scap_evt** pevent, uint16_t* pcpuid)
+{
+	uint32_t j;
+	uint64_t max_ts = 0xffffffffffffffffLL;
+
+	*pcpuid = 65535;
+
+	for(j = 0; j < h->m_ndevs; j++)
+	{
+		scap_device* dev = &(h->m_devs[j]);
+		scap_evt* pe;
+
+		if(dev->m_sn_len == 0)
+		{
+			continue;
+		}
+
+		pe = (scap_evt*)dev->m_sn_next_event;
+		if(pe->ts < max_ts)
+		{
+			*pevent = pe;
+			*pcpuid = j;
+			max_ts = pe->ts;
+		}
+	}
+
+	if(*pcpuid == 65535)
+	{
+		return SCAP_TIMEOUT;
+	}
+
+	h->m_devs[*pcpuid].m_sn_len -= (*pevent)->len;
+	h->m_devs[*pcpuid].m_sn_next_event += (*pevent)->len;
+	return SCAP_SUCCESS;
+}
+
+static double run(scap_t* h, char** bufs, uint32_t nevts, bool linear, uint64_t window_ns, uint64_t* nooo)
+{
+	uint32_t j;
+	uint64_t nev = 0;
+	uint64_t start;
+	uint64_t last_ts;
+	scap_evt* ev;
+	uint16_t cpuid;
+
+	h->m_merge_window_ns = window_ns;
+	*nooo = 0;
+
+	start = get_time_ns();
+
+	for(j = 0; j < N_ROUNDS; j++)
+	{
+		refill(h, bufs, nevts);
+		scap_merge_rebuild(h);
+		last_ts = 0;
+
+		while((linear? next_linear(h, &ev, &cpuid) : scap_merge_next(h, &ev, &cpuid)) == SCAP_SUCCESS)
+		{
+			if(ev->ts < last_ts)
+			{
+				(*nooo)++;
+			}
+
+			last_ts = ev->ts;
+			nev++;
+		}
+	}
+
+	return (double)nev * 1000000000 / (get_time_ns() - start + 1);
+}
+
+int main(int argc, char** argv)
+{
+	uint32_t ncpus;
+	uint32_t nevts = 20000;
+	uint64_t window_ns = 10000;
+	uint32_t cpu_counts[] = {1, 2, 4, 8, 16, 32, 64, 96, 128};
+	uint32_t j, k;
+
+	if(argc > 1)
+	{
+		nevts = atoi(argv[1]);
+	}
+
+	if(argc > 2)
+	{
+		window_ns = strtoull(argv[2], NULL, 10);
+	}
+
+	printf("%6s %14s %14s %14s %12s\n", "cpus", "linear ev/s", "heap ev/s", "batch ev/s", "batch ooo");
+
+	for(k = 0; k < sizeof(cpu_counts) / sizeof(cpu_counts[0]); k++)
+	{
+		scap_t h;
+		char** bufs;
+		double linear, strict, batch;
+		uint64_t nooo;
+
+		ncpus = cpu_counts[k];
+
+		memset(&h, 0, sizeof(h));
+		h.m_ndevs = ncpus;
+		h.m_devs = (scap_device*)calloc(ncpus, sizeof(scap_device));
+		if(scap_merge_init(&h) != SCAP_SUCCESS)
+		{
+			fprintf(stderr, "%s\n", h.m_lasterr);
+			return -1;
+		}
+
+		bufs = create_buffers(ncpus, nevts);
+
+		linear = run(&h, bufs, nevts, true, 0, &nooo);
+		strict = run(&h, bufs, nevts, false, 0, &nooo);
+		if(nooo != 0)
+		{
+			fprintf(stderr, "strict merge returned %" PRIu64 " out of order events\n", nooo);
+			return -1;
+		}
+
+		batch = run(&h, bufs, nevts, false, window_ns, &nooo);
+
+		printf("%6u %14.0f %14.0f %14.0f %12" PRIu64 "\n", ncpus, linear, strict, batch, nooo);
+
+		for(j = 0; j < ncpus; j++)
+		{
+			free(bufs[j]);
+		}
+
+		free(bufs);
+		scap_merge_free(&h);
+		free(h.m_devs);
+	}
+
+	return 0;
+}
@@ -0,0 +1,223 @@
+/*
+Copyright (C) 2013-2014 Draios inc.
+
+This file is part of sysdig.
+
+sysdig is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License version 2 as
+published by the Free Software Foundation.
+
+sysdig is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sysdig.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+//
+// Writes the same synthetic events to a trace file with each compression
+// mode, then reads the files back with scap_open_offline and reports the
+// read throughput. No driver is needed.
+//
+// Usage: scap-readbench [number of events] [directory]
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <sys/stat.h>
+#include <scap.h>
+#include "scap-int.h"
+
+#define MAX_EVT_LEN 512
+#define EVT_TS(num) (1000000000 + (num) * 1000 + (num) % 7)
+
+static uint64_t get_time_ns()
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return (uint64_t)tv.tv_sec * 1000000000 + tv.tv_usec * 1000;
+}
+
+//
+// Build a generic event with a somewhat compressible payload
+//
+static scap_evt* create_event(char* buf, uint64_t num)
+{
+	scap_evt* e = (scap_evt*)buf;
+	uint16_t* lens = (uint16_t*)(buf + sizeof(scap_evt));
+	char* data = buf + sizeof(scap_evt) + 2 * sizeof(uint16_t);
+	int plen;
+
+	plen = snprintf(data, MAX_EVT_LEN - sizeof(scap_evt) - 2 * sizeof(uint16_t),
+		"/usr/lib/x86_64-linux-gnu/lib%u.so.%u", (uint32_t)(num % 97), (uint32_t)(num % 13)) + 1;
+
+	e->ts = EVT_TS(num);
+	e->tid = 1000 + num % 50;
+	e->type = PPME_GENERIC_E;
+	lens[0] = 2;
+	lens[1] = plen - 2;
+	e->len = sizeof(scap_evt) + 2 * sizeof(uint16_t) + plen;
+
+	return e;
+}
+
+static int write_file(scap_t* h, const char* fname, compression_mode mode, uint64_t nevts)
+{
+	char buf[MAX_EVT_LEN];
+	scap_dumper_t* d;
+	uint64_t j;
+
+	d = scap_dump_open(h, fname, mode);
+	if(d == NULL)
+	{
+		fprintf(stderr, "%s\n", scap_getlasterr(h));
+		return -1;
+	}
+
+	for(j = 0; j < nevts; j++)
+	{
+		if(scap_dump(h, d, create_event(buf, j), (uint16_t)(j % 8), 0) != SCAP_SUCCESS)
+		{
+			fprintf(stderr, "%s\n", scap_getlasterr(h));
+			return -1;
+		}
+	}
+
+	scap_dump_close(d);
+	return 0;
+}
+
+static int read_file(const char* fname, uint64_t nevts, double* evts_per_sec)
+{
+	char error[SCAP_LASTERR_SIZE];
+	char buf[MAX_EVT_LEN];
+	scap_evt* ev;
+	uint16_t cpuid;
+	uint64_t n = 0;
+	uint64_t start;
+	int32_t res;
+	scap_t* h;
+
+	start = get_time_ns();
+
+	h = scap_open_offline(fname, error);
+	if(h == NULL)
+	{
+		fprintf(stderr, "%s\n", error);
+		return -1;
+	}
+
+	while((res = scap_next(h, &ev, &cpuid)) == SCAP_SUCCESS)
+	{
+		//
+		// Fully compare only some of the events, to keep the check cheap
+		//
+		if(ev->ts != EVT_TS(n) || cpuid != n % 8 ||
+			((n & 1023) == 0 && memcmp(ev, create_event(buf, n), ev->len) != 0))
+		{
+			fprintf(stderr, "%s: event %" PRIu64 " doesn't match\n", fname, n);
+			return -1;
+		}
+
+		n++;
+	}
+
+	if(res != SCAP_EOF)
+	{
+		fprintf(stderr, "%s\n", scap_getlasterr(h));
+		return -1;
+	}
+
+	scap_close(h);
+
+	if(n != nevts)
+	{
+		fprintf(stderr, "%s: read %" PRIu64 " events, expected %" PRIu64 "\n", fname, n, nevts);
+		return -1;
+	}
+
+	*evts_per_sec = (double)n * 1000000000 / (get_time_ns() - start + 1);
+	return 0;
+}
+
+int main(int argc, char** argv)
+{
+	uint64_t nevts = 5000000;
+	const char* dir = "/tmp";
+	const char* names[] = {"none", "gzip", "chunked"};
+	compression_mode modes[] = {SCAP_COMPRESSION_NONE, SCAP_COMPRESSION_GZIP, SCAP_COMPRESSION_CHUNKED};
+	char fname[SCAP_MAX_PATH_SIZE];
+	scap_t h;
+	scap_threadinfo* tinfo;
+	int32_t uth_status = SCAP_SUCCESS;
+	uint32_t j;
+
+	if(argc > 1)
+	{
+		nevts = strtoull(argv[1], NULL, 10);
+	}
+
+	if(argc > 2)
+	{
+		dir = argv[2];
+	}
+
+	//
+	// A handle with just the tables that go in the file header
+	//
+	memset(&h, 0, sizeof(h));
+	if(scap_create_iflist(&h) != SCAP_SUCCESS ||
+		scap_create_userlist(&h) != SCAP_SUCCESS)
+	{
+		fprintf(stderr, "%s\n", h.m_lasterr);
+		return -1;
+	}
+
+	tinfo = (scap_threadinfo*)calloc(1, sizeof(scap_threadinfo));
+	tinfo->tid = 1000;
+	tinfo->pid = 1000;
+	snprintf(tinfo->comm, SCAP_MAX_PATH_SIZE, "readbench");
+	HASH_ADD_INT64(h.m_proclist, tid, tinfo);
+	if(uth_status != SCAP_SUCCESS)
+	{
+		fprintf(stderr, "error adding the process\n");
+		return -1;
+	}
+
+	//
+	// Pretend the handle is reading a file, so that scap_dump_open() saves
+	// the process table above instead of scanning /proc
+	//
+	h.m_file = (gzFile)&h;
+
+	printf("%8s %14s %14s\n", "mode", "file size", "read ev/s");
+
+	for(j = 0; j < sizeof(modes) / sizeof(modes[0]); j++)
+	{
+		struct stat st;
+		double evts_per_sec;
+
+		snprintf(fname, sizeof(fname), "%s/scap-readbench-%s.scap", dir, names[j]);
+
+		if(write_file(&h, fname, modes[j], nevts) != 0 ||
+			read_file(fname, nevts, &evts_per_sec) != 0)
+		{
+			return -1;
+		}
+
+		stat(fname, &st);
+		printf("%8s %14" PRIu64 " %14.0f\n", names[j], (uint64_t)st.st_size, evts_per_sec);
+		unlink(fname);
+	}
+
+	h.m_file = NULL;
+	scap_proc_free_table(&h);
+	scap_free_iflist(h.m_addrlist);
+	scap_free_userlist(h.m_userlist);
+
+	return 0;
+}
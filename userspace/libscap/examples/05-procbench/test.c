@@ -0,0 +1,183 @@
+/*
+Copyright (C) 2013-2014 Draios inc.
+
+This file is part of sysdig.
+
+sysdig is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License version 2 as
+published by the Free Software Foundation.
+
+sysdig is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sysdig.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+//
+// Compares the cost of looking up a single thread in /proc by scanning the
+// directory, like scap_proc_get() used to do, and by opening the thread
+// entry directly. The lookups run on a synthetic procfs tree created in
+// /tmp, so no driver is needed and the number of threads can be chosen.
+//
+// Usage: scap-procbench [processes] [threads per process] [lookups]
+//
+
+#define _XOPEN_SOURCE 700
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <scap.h>
+#include "scap-int.h"
+#include "proctree.h"
+
+//
+// procfs has a /proc/<tid> entry for every thread, that readdir() doesn't
+// return. A regular directory can't hide entries, so they are added as
+// links after the scan benchmark ran.
+//
+static void create_thread_links(const char* procdir, uint32_t nprocs, uint32_t nthreads)
+{
+	char path[SCAP_MAX_PATH_SIZE];
+	char target[SCAP_MAX_PATH_SIZE];
+	uint64_t pid = FIRST_PID;
+	uint32_t j, k;
+
+	for(j = 0; j < nprocs; j++)
+	{
+		for(k = 1; k < nthreads; k++)
+		{
+			make_path(path, "%s/%" PRIu64, procdir, pid + k);
+			make_path(target, "%" PRIu64 "/task/%" PRIu64, pid, pid + k);
+			symlink(target, path);
+		}
+
+		pid += nthreads;
+	}
+}
+
+static double run(scap_t* h, char* procdir, uint64_t* tids, uint64_t* pids, uint32_t nlookups, bool scan)
+{
+	uint64_t start = get_time_ns();
+	scap_threadinfo* tinfo;
+	uint32_t j;
+	int32_t res;
+
+	for(j = 0; j < nlookups; j++)
+	{
+		if(scan)
+		{
+			res = scap_proc_scan_proc_dir(h, procdir, -1, (int)tids[j], &tinfo, h->m_lasterr, false);
+		}
+		else
+		{
+			res = scap_proc_read_thread(h, procdir, tids[j], &tinfo, h->m_lasterr, false);
+		}
+
+		if(res != SCAP_SUCCESS || tinfo == NULL || tinfo->tid != tids[j])
+		{
+			fprintf(stderr, "lookup of %" PRIu64 " failed: %s\n", tids[j], h->m_lasterr);
+			exit(-1);
+		}
+
+		if(scan)
+		{
+			pids[j] = tinfo->pid;
+		}
+		else if(tinfo->pid != pids[j])
+		{
+			fprintf(stderr, "pid mismatch for %" PRIu64 "\n", tids[j]);
+			exit(-1);
+		}
+
+		scap_fd_free_proc_fd_table(h, tinfo);
+		free(tinfo);
+	}
+
+	return (double)(get_time_ns() - start) / nlookups / 1000;
+}
+
+int main(int argc, char** argv)
+{
+	uint32_t nprocs = 2000;
+	uint32_t nthreads = 10;
+	uint32_t nlookups = 100;
+	char root[] = "/tmp/scap-procbench-XXXXXX";
+	char procdir[SCAP_MAX_PATH_SIZE];
+	scap_device dev;
+	uint64_t* tids;
+	uint64_t* pids;
+	scap_t h;
+	uint32_t j;
+	double us_scan;
+	double us_direct;
+
+	if(argc > 1)
+	{
+		nprocs = atoi(argv[1]);
+	}
+
+	if(argc > 2)
+	{
+		nthreads = atoi(argv[2]);
+	}
+
+	if(argc > 3)
+	{
+		nlookups = atoi(argv[3]);
+	}
+
+	if(nprocs == 0 || nthreads == 0 || nlookups == 0)
+	{
+		fprintf(stderr, "invalid arguments\n");
+		return -1;
+	}
+
+	if(mkdtemp(root) == NULL)
+	{
+		fprintf(stderr, "can't create the temporary directory\n");
+		return -1;
+	}
+
+	make_path(procdir, "%s/proc", root);
+	mkdir(procdir, 0755);
+	create_tree(root, procdir, nprocs, nthreads, 0, 0);
+
+	//
+	// A live handle without a driver: the vtid/vpid ioctls fail and the
+	// real tids are used instead
+	//
+	memset(&h, 0, sizeof(h));
+	memset(&dev, 0, sizeof(dev));
+	dev.m_fd = -1;
+	h.m_devs = &dev;
+	h.m_ndevs = 1;
+
+	//
+	// Random threads, picked across the whole tree
+	//
+	srand(1);
+	tids = (uint64_t*)malloc(nlookups * sizeof(uint64_t));
+	pids = (uint64_t*)malloc(nlookups * sizeof(uint64_t));
+	for(j = 0; j < nlookups; j++)
+	{
+		tids[j] = FIRST_PID + rand() % (nprocs * nthreads);
+	}
+
+	us_scan = run(&h, procdir, tids, pids, nlookups, true);
+	create_thread_links(procdir, nprocs, nthreads);
+	us_direct = run(&h, procdir, tids, pids, nlookups, false);
+
+	printf("%u processes, %u threads each\n", nprocs, nthreads);
+	printf("%-12s %12.2f us/lookup\n", "scan", us_scan);
+	printf("%-12s %12.2f us/lookup\n", "direct", us_direct);
+
+	free(tids);
+	free(pids);
+	remove_tree(root);
+	return 0;
+}
@@ -0,0 +1,221 @@
+/*
+Copyright (C) 2013-2014 Draios inc.
+
+This file is part of sysdig.
+
+sysdig is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License version 2 as
+published by the Free Software Foundation.
+
+sysdig is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sysdig.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+//
+// Measures the initial scan of /proc done when a live capture is opened,
+// serial and with a growing number of threads, and the lazy import of the
+// fds of every process with scap_proc_get_fds(). The scan runs on a
+// synthetic procfs tree created in /tmp, that looks like a container host:
+// processes with threads and open files, spread across network namespaces
+// that each have their own socket tables.
+//
+// Usage: scap-procscanbench [processes] [threads per process] [fds per process] [processes per namespace]
+//
+
+#define _XOPEN_SOURCE 700
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <scap.h>
+#include "scap-int.h"
+#include "proctree.h"
+
+//
+// Returns the number of threads and fds found, to check that all the scans
+// see the same tree
+//
+static double run(scap_t* h, char* procdir, uint32_t nthreads, uint64_t* nentries)
+{
+	uint64_t start = get_time_ns();
+	scap_threadinfo* tinfo;
+	scap_threadinfo* ttinfo;
+	int32_t res;
+
+	if(nthreads == 0)
+	{
+		res = scap_proc_scan_proc_dir(h, procdir, -1, -1, NULL, h->m_lasterr, true);
+	}
+	else
+	{
+		res = scap_proc_scan_proc_dir_parallel(h, procdir, nthreads, h->m_lasterr, true);
+	}
+
+	if(res != SCAP_SUCCESS)
+	{
+		fprintf(stderr, "scan failed: %s\n", h->m_lasterr);
+		exit(-1);
+	}
+
+	start = get_time_ns() - start;
+
+	*nentries = 0;
+	HASH_ITER(hh, h->m_proclist, tinfo, ttinfo)
+	{
+		*nentries += 1 + HASH_COUNT(tinfo->fdlist);
+	}
+
+	scap_proc_free_table(h);
+	return (double)start / 1000000;
+}
+
+//
+// Reads the fds of every process like the lazy fd import does. Without the
+// cache, the socket tables are parsed again for every process.
+//
+static double run_get_fds(scap_t* h, uint32_t nprocs, uint32_t nthreads, bool cache, uint64_t* nentries)
+{
+	uint64_t start = get_time_ns();
+	uint64_t pid = FIRST_PID;
+	scap_threadinfo* tinfo;
+	uint32_t j;
+
+	*nentries = 0;
+
+	for(j = 0; j < nprocs; j++)
+	{
+		if(!cache)
+		{
+			scap_fd_free_ns_sockets_list(h, &h->m_sockets_cache);
+		}
+
+		tinfo = scap_proc_get_fds(h, pid, true, h->m_lasterr);
+		if(tinfo == NULL)
+		{
+			fprintf(stderr, "can't read the fds of %" PRIu64 ": %s\n", pid, h->m_lasterr);
+			exit(-1);
+		}
+
+		*nentries += HASH_COUNT(tinfo->fdlist);
+		scap_proc_free(h, tinfo);
+		pid += nthreads;
+	}
+
+	start = get_time_ns() - start;
+
+	scap_fd_free_ns_sockets_list(h, &h->m_sockets_cache);
+	return (double)start / 1000000;
+}
+
+int main(int argc, char** argv)
+{
+	uint32_t nprocs = 2000;
+	uint32_t nthreads = 5;
+	uint32_t nfds = 20;
+	uint32_t nprocs_per_ns = 10;
+	char root[] = "/tmp/scap-procscanbench-XXXXXX";
+	char procdir[SCAP_MAX_PATH_SIZE];
+	scap_device dev;
+	scap_t h;
+	uint64_t nentries;
+	uint64_t nentries_serial;
+	uint64_t nfds_cached;
+	double ms;
+	uint32_t j;
+
+	if(argc > 1)
+	{
+		nprocs = atoi(argv[1]);
+	}
+
+	if(argc > 2)
+	{
+		nthreads = atoi(argv[2]);
+	}
+
+	if(argc > 3)
+	{
+		nfds = atoi(argv[3]);
+	}
+
+	if(argc > 4)
+	{
+		nprocs_per_ns = atoi(argv[4]);
+	}
+
+	if(nprocs == 0 || nthreads == 0 || nprocs_per_ns == 0)
+	{
+		fprintf(stderr, "invalid arguments\n");
+		return -1;
+	}
+
+	if(mkdtemp(root) == NULL)
+	{
+		fprintf(stderr, "can't create the temporary directory\n");
+		return -1;
+	}
+
+	make_path(procdir, "%s/proc", root);
+	mkdir(procdir, 0755);
+	create_tree(root, procdir, nprocs, nthreads, nfds, nprocs_per_ns);
+
+	//
+	// A live handle without a driver: the vtid/vpid ioctls fail and the
+	// real tids are used instead
+	//
+	memset(&h, 0, sizeof(h));
+	memset(&dev, 0, sizeof(dev));
+	dev.m_fd = -1;
+	h.m_devs = &dev;
+	h.m_ndevs = 1;
+
+	printf("%u processes, %u threads and %u fds each, %u processes per network namespace\n",
+		nprocs, nthreads, nfds, nprocs_per_ns);
+	printf("%-12s %12s %12s\n", "threads", "ms", "entries");
+
+	ms = run(&h, procdir, 0, &nentries_serial);
+	printf("%-12s %12.1f %12" PRIu64 "\n", "serial", ms, nentries_serial);
+
+	for(j = 1; j <= PROC_SCAN_MAX_THREADS; j *= 2)
+	{
+		char name[16];
+
+		ms = run(&h, procdir, j, &nentries);
+		if(nentries != nentries_serial)
+		{
+			fprintf(stderr, "the parallel scan found %" PRIu64 " entries instead of %" PRIu64 "\n", nentries, nentries_serial);
+			exit(-1);
+		}
+
+		snprintf(name, sizeof(name), "%u", j);
+		printf("%-12s %12.1f %12" PRIu64 "\n", name, ms, nentries);
+	}
+
+	//
+	// scap_proc_get_fds() reads the tree under the host root
+	//
+	setenv("SYSDIG_HOST_ROOT", root, 1);
+
+	printf("\n%-12s %12s %12s\n", "get_fds", "ms", "fds");
+
+	ms = run_get_fds(&h, nprocs, nthreads, false, &nentries);
+	printf("%-12s %12.1f %12" PRIu64 "\n", "no cache", ms, nentries);
+
+	ms = run_get_fds(&h, nprocs, nthreads, true, &nfds_cached);
+	if(nfds_cached != nentries)
+	{
+		fprintf(stderr, "the cached import found %" PRIu64 " fds instead of %" PRIu64 "\n", nfds_cached, nentries);
+		exit(-1);
+	}
+
+	printf("%-12s %12.1f %12" PRIu64 "\n", "cache", ms, nfds_cached);
+
+	remove_tree(root);
+	return 0;
+}
@@ -0,0 +1,249 @@
+/*
+Copyright (C) 2013-2014 Draios inc.
+
+This file is part of sysdig.
+
+sysdig is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License version 2 as
+published by the Free Software Foundation.
+
+sysdig is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sysdig.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#define _XOPEN_SOURCE 700
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <ftw.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <scap.h>
+#include "proctree.h"
+
+#define FIRST_NET_NS 4026531000ULL
+#define NSOCKETS_PER_NS 200
+
+uint64_t get_time_ns()
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return (uint64_t)tv.tv_sec * 1000000000 + tv.tv_usec * 1000;
+}
+
+void make_path(char* path, const char* fmt, ...)
+{
+	va_list args;
+	int len;
+
+	va_start(args, fmt);
+	len = vsnprintf(path, SCAP_MAX_PATH_SIZE, fmt, args);
+	va_end(args);
+
+	if(len < 0 || len >= SCAP_MAX_PATH_SIZE)
+	{
+		fprintf(stderr, "path too long\n");
+		exit(-1);
+	}
+}
+
+void write_file(const char* dir, const char* name, const char* content, size_t len)
+{
+	char path[SCAP_MAX_PATH_SIZE];
+	FILE* f;
+
+	make_path(path, "%s/%s", dir, name);
+	f = fopen(path, "w");
+	if(f == NULL || fwrite(content, 1, len, f) != len)
+	{
+		fprintf(stderr, "can't write %s\n", path);
+		exit(-1);
+	}
+
+	fclose(f);
+}
+
+void create_thread_dir(const char* dir, uint64_t tid, uint64_t tgid, uint64_t net_ns, uint32_t nfds, const char* target, const char* sock)
+{
+	char path[SCAP_MAX_PATH_SIZE];
+	char link[64];
+	char status[256];
+	char stat[128];
+	static const char cmdline[] = "/usr/bin/server\0--port\0" "8080\0";
+	static const char environ[] = "HOME=/root\0PATH=/usr/bin:/bin\0";
+	static const char cgroup[] = "4:cpu,cpuacct:/docker/0123456789ab\n";
+	int len;
+	int stat_len;
+	uint32_t j;
+
+	len = snprintf(status, sizeof(status),
+		"Name:\tserver\nState:\tS (sleeping)\nTgid:\t%" PRIu64 "\nPid:\t%" PRIu64 "\nPPid:\t1\n"
+		"Uid:\t0\t0\t0\t0\nGid:\t0\t0\t0\t0\nVmSize:\t  10000 kB\nVmRSS:\t   2000 kB\nVmSwap:\t      0 kB\n",
+		tgid, tid);
+	stat_len = snprintf(stat, sizeof(stat), "%" PRIu64 " (server) S 1 %" PRIu64 " %" PRIu64 " 0 -1 4194560 100 0 2 0\n",
+		tid, tgid, tgid);
+
+	mkdir(dir, 0755);
+	write_file(dir, "status", status, len);
+	write_file(dir, "stat", stat, stat_len);
+	write_file(dir, "cmdline", cmdline, sizeof(cmdline) - 1);
+	write_file(dir, "environ", environ, sizeof(environ) - 1);
+	write_file(dir, "cgroup", cgroup, sizeof(cgroup) - 1);
+
+	make_path(path, "%s/exe", dir);
+	symlink("/usr/bin/server", path);
+	make_path(path, "%s/cwd", dir);
+	symlink("/", path);
+
+	if(net_ns != 0)
+	{
+		make_path(path, "%s/ns", dir);
+		mkdir(path, 0755);
+		make_path(path, "%s/ns/net", dir);
+		snprintf(link, sizeof(link), "net:[%" PRIu64 "]", net_ns);
+		symlink(link, path);
+	}
+
+	make_path(path, "%s/fd", dir);
+	mkdir(path, 0755);
+
+	for(j = 0; j < nfds; j++)
+	{
+		make_path(path, "%s/fd/%u", dir, j);
+		symlink((j == 0 && sock != NULL)? sock : target, path);
+	}
+}
+
+//
+// The socket tables of a namespace, in the format of /proc/net
+//
+static void create_net_dir(const char* dir)
+{
+	char path[SCAP_MAX_PATH_SIZE];
+	char* buf = (char*)malloc(256 * (NSOCKETS_PER_NS + 1));
+	int len;
+	uint32_t j;
+
+	make_path(path, "%s/net", dir);
+	mkdir(path, 0755);
+
+	len = sprintf(buf, "  sl  local_address rem_address   st tx_queue rx_queue tr tm->when retrnsmt   uid  timeout inode\n");
+	for(j = 0; j < NSOCKETS_PER_NS; j++)
+	{
+		len += sprintf(buf + len, "%4u: 0100007F:%04X 0100007F:%04X 01 00000000:00000000 00:00000000 00000000     0        0 %u 1 0000000000000000 20 4 30 10 -1\n",
+			j, 1024 + j, 8080, 100000 + j);
+	}
+
+	write_file(path, "tcp", buf, len);
+	write_file(path, "udp", buf, len);
+	write_file(path, "raw", buf, 0);
+
+	len = sprintf(buf, "Num       RefCount Protocol Flags    Type St Inode Path\n");
+	for(j = 0; j < NSOCKETS_PER_NS; j++)
+	{
+		len += sprintf(buf + len, "0000000000000000: 00000002 00000000 00010000 0001 01 %u /run/server.sock\n", 200000 + j);
+	}
+
+	write_file(path, "unix", buf, len);
+	free(buf);
+}
+
+//
+// A bound unix socket, which stat() reports as a socket like the fds of
+// procfs. The links to it are not of the socket:[ino] form, but the socket
+// tables are read anyway.
+//
+static void create_socket(const char* path)
+{
+	struct sockaddr_un addr;
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+
+	if(fd == -1 || strlen(path) >= sizeof(addr.sun_path))
+	{
+		fprintf(stderr, "can't create the socket %s\n", path);
+		exit(-1);
+	}
+
+	strcpy(addr.sun_path, path);
+
+	if(bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0)
+	{
+		fprintf(stderr, "can't bind the socket %s\n", path);
+		exit(-1);
+	}
+
+	close(fd);
+}
+
+void create_tree(const char* root, const char* procdir, uint32_t nprocs, uint32_t nthreads, uint32_t nfds, uint32_t nprocs_per_ns)
+{
+	char dir[SCAP_MAX_PATH_SIZE];
+	char target[SCAP_MAX_PATH_SIZE];
+	char sock[SCAP_MAX_PATH_SIZE];
+	uint64_t pid = FIRST_PID;
+	uint64_t net_ns = 0;
+	uint32_t j, k;
+
+	if(nprocs_per_ns == 0)
+	{
+		nfds = 0;
+	}
+
+	make_path(target, "%s/file", root);
+	write_file(root, "file", "", 0);
+
+	make_path(sock, "%s/socket", root);
+	if(nfds != 0)
+	{
+		create_socket(sock);
+	}
+
+	for(j = 0; j < nprocs; j++)
+	{
+		if(nprocs_per_ns != 0)
+		{
+			net_ns = FIRST_NET_NS + j / nprocs_per_ns;
+		}
+
+		make_path(dir, "%s/%" PRIu64, procdir, pid);
+		create_thread_dir(dir, pid, pid, net_ns, nfds, target, sock);
+
+		if(nprocs_per_ns != 0)
+		{
+			create_net_dir(dir);
+		}
+
+		make_path(dir, "%s/%" PRIu64 "/task", procdir, pid);
+		mkdir(dir, 0755);
+
+		for(k = 0; k < nthreads; k++)
+		{
+			make_path(dir, "%s/%" PRIu64 "/task/%" PRIu64, procdir, pid, pid + k);
+			create_thread_dir(dir, pid + k, pid, net_ns, 0, target, NULL);
+		}
+
+		pid += nthreads;
+	}
+}
+
+static int remove_entry(const char* path, const struct stat* sb, int type, struct FTW* ftwbuf)
+{
+	return remove(path);
+}
+
+void remove_tree(const char* root)
+{
+	nftw(root, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+}
@@ -0,0 +1,62 @@
+/*
+Copyright (C) 2013-2014 Draios inc.
+
+This file is part of sysdig.
+
+sysdig is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License version 2 as
+published by the Free Software Foundation.
+
+sysdig is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sysdig.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+//
+// Synthetic procfs trees for the benchmarks of the /proc scan, so that they
+// need no driver and the number of processes can be chosen
+//
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define FIRST_PID 1000
+
+uint64_t get_time_ns();
+
+//
+// snprintf() into a SCAP_MAX_PATH_SIZE buffer, which exits if the path
+// doesn't fit
+//
+void make_path(char* path, const char* fmt, ...);
+
+void write_file(const char* dir, const char* name, const char* content, size_t len);
+
+//
+// Create the entry of a thread, with the files that libscap reads. With a
+// net_ns other than 0, the entry has a network namespace link. Its fd
+// directory has nfds links to target, the first of which goes to sock
+// instead if it's not NULL.
+//
+void create_thread_dir(const char* dir, uint64_t tid, uint64_t tgid, uint64_t net_ns, uint32_t nfds, const char* target, const char* sock);
+
+//
+// Create the procfs tree of nprocs processes with nthreads threads each in
+// procdir, starting from FIRST_PID. With nprocs_per_ns other than 0, the
+// processes have nfds open files each, the first of which is a socket, and
+// every nprocs_per_ns processes share a network namespace with its own
+// socket tables. root must exist and receives the file and the socket the
+// fds point to.
+//
+void create_tree(const char* root, const char* procdir, uint32_t nprocs, uint32_t nthreads, uint32_t nfds, uint32_t nprocs_per_ns);
+
+//
+// Remove the tree created in root
+//
+void remove_tree(const char* root);
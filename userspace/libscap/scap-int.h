@@ -49,7 +49,15 @@ extern "C" {
 //
 // Read buffer timeout constants
 //
-#define BUFFER_EMPTY_WAIT_TIME_MS 30
+//
+// The backoff is capped below one millisecond, so that an event is delivered
+// within BUFFER_EMPTY_WAIT_TIME_US_MAX of being written even when the system
+// has been idle. The driver doesn't support poll(), so this is what bounds
+// the delivery latency.
+//
+#define BUFFER_EMPTY_WAIT_TIME_US_START 50
+#define BUFFER_EMPTY_WAIT_TIME_US_MAX 500
+#define BUFFER_EMPTY_THRESHOLD_B 20000
 #define MAX_N_CONSECUTIVE_WAITS 4
 
 //
@@ -71,6 +79,39 @@ typedef struct scap_device
 	uint32_t m_read_size; // Number of bytes currently ready to be read in this CPU's ring buffer
 }scap_device;
 
+//
+// An entry of the heap used to merge the per-CPU event streams
+//
+typedef struct scap_merge_entry
+{
+	uint64_t m_ts; // Timestamp of the next event of this device
+	uint32_t m_devid;
+}scap_merge_entry;
+
+//
+// Adaptive wait state used when the ring buffers don't have enough data.
+// The wait time starts at m_min_us and doubles every time the buffers are found
+// empty, up to m_max_us. It goes back to m_min_us as soon as data shows up.
+//
+typedef struct scap_wait_policy
+{
+	uint32_t m_min_us;
+	uint32_t m_max_us;
+	uint32_t m_cur_us;
+	uint32_t m_data_threshold; // Bytes a ring must contain to be consumed without waiting
+	uint32_t m_n_consecutive_waits;
+}scap_wait_policy;
+
+//
+// Reader of the trace files written with SCAP_COMPRESSION_CHUNKED
+//
+typedef struct scap_chunk_reader scap_chunk_reader;
+
+//
+// Reader of the uncompressed trace files, based on mmap
+//
+typedef struct scap_mmap_reader scap_mmap_reader;
+
 //
 // The open instance handle
 //
@@ -84,6 +125,8 @@ struct scap
 	FILE* m_file;
 #endif
 	char* m_file_evt_buf;
+	scap_chunk_reader* m_chunk_reader; // Non NULL if the file is made of compressed chunks
+	scap_mmap_reader* m_mmap_reader; // Non NULL if the events of an uncompressed file are read through mmap
 	uint32_t m_last_evt_dump_flags;
 	char m_lasterr[SCAP_LASTERR_SIZE];
 	scap_threadinfo* m_proclist;
@@ -92,10 +135,21 @@ struct scap
 	scap_addrlist* m_addrlist;
 	scap_machine_info m_machine_info;
 	scap_userlist* m_userlist;
-	uint32_t m_n_consecutive_waits;
+	scap_wait_policy m_wait;
 	proc_entry_callback m_proc_callback;
 	void* m_proc_callback_context;
 	struct ppm_proclist_info* m_driver_procinfo;
+	scap_merge_entry* m_merge_heap; // Devices with data to consume, ordered by next event timestamp
+	uint32_t m_merge_heap_size;
+	uint64_t m_merge_window_ns; // Reorder window for the per-CPU batch mode. 0 means strict ordering.
+	bool m_skip_proc_fds; // Set while scanning /proc for a process table without fds
+
+	//
+	// The sockets of the network namespaces read by scap_proc_get_fds(), so
+	// that the /proc/net tables are not parsed again for every process
+	//
+	struct scap_ns_socket_list* m_sockets_cache;
+	uint64_t m_sockets_cache_ts;
 };
 
 struct scap_ns_socket_list
@@ -110,6 +164,20 @@ struct scap_ns_socket_list
 //
 #define MEMBER_SIZE(type, member) sizeof(((type *)0)->member)
 #define FILE_READ_BUF_SIZE 65536
+// Amount of event data that goes in a chunk of a SCAP_COMPRESSION_CHUNKED file
+#define DUMP_CHUNK_SIZE (1024 * 1024)
+// Minimum interval between the state snapshots of a SCAP_COMPRESSION_CHUNKED file
+#define DUMP_SNAPSHOT_INTERVAL_NS 60000000000LL
+// Maximum number of threads decompressing the chunks of a file
+#define CHUNK_READER_MAX_THREADS 8
+// Maximum number of threads scanning /proc when the capture is opened
+#define PROC_SCAN_MAX_THREADS 8
+// Size of the portion of an uncompressed file that is memory mapped at any time
+#define MMAP_READER_WINDOW_SIZE (64 * 1024 * 1024)
+// How much of an uncompressed file is read through the mapping between two checks of its size
+#define MMAP_READER_CHECK_SIZE (1024 * 1024)
+// How long the socket tables read by scap_proc_get_fds() are reused
+#define SOCKETS_CACHE_TIMEOUT_NS 1000000000LL
 
 //
 // Internal library functions
@@ -119,6 +187,11 @@ struct scap_ns_socket_list
 int32_t scap_readbuf(scap_t* handle, uint32_t proc, bool blocking, OUT char** buf, OUT uint32_t* len);
 // Scan a directory containing process information
 int32_t scap_proc_scan_proc_dir(scap_t* handle, char* procdirname, int parenttid, int tid_to_scan, struct scap_threadinfo** pi, char *error, bool scan_sockets);
+// Scan a directory containing process information with a pool of threads, and add the processes
+// to the process table. nthreads is the number of threads, 0 to pick it from the number of CPUs.
+int32_t scap_proc_scan_proc_dir_parallel(scap_t* handle, char* procdirname, uint32_t nthreads, char *error, bool scan_sockets);
+// Read a single thread from a /proc directory, without scanning it
+int32_t scap_proc_read_thread(scap_t* handle, char* procdirname, int64_t tid, struct scap_threadinfo** pi, char *error, bool scan_sockets);
 // Remove an entry from the process list by parsin a PPME_PROC_EXIT event
 // void scap_proc_schedule_removal(scap_t* handle, scap_evt* e);
 // Remove the process that was scheduled for deletion for this handle
@@ -155,6 +228,8 @@ int32_t scap_fd_write_to_disk(scap_t* handle, scap_fdinfo* fdi, gzFile f);
 uint32_t scap_fd_read_from_disk(scap_t* handle, OUT scap_fdinfo* fdi, OUT size_t* nbytes, gzFile f);
 // Parse the headers of a trace file and load the tables
 int32_t scap_read_init(scap_t* handle, gzFile f);
+// Load the process and fd tables of a state snapshot
+int32_t scap_read_state(scap_t* handle, gzFile f);
 // Add the file descriptor info pointed by fdi to the fd table for process pi.
 // Note: silently skips if fdi->type is SCAP_FD_UNKNOWN.
 int32_t scap_add_fd_to_proc_table(scap_t* handle, scap_threadinfo* pi, scap_fdinfo* fdi);
@@ -181,6 +256,37 @@ void scap_free_userlist(scap_userlist* uhandle);
 
 int32_t scap_fd_post_process_unix_sockets(scap_t* handle, scap_fdinfo* sockets);
 
+// Allocate the merge heap for the handle's devices
+int32_t scap_merge_init(scap_t* handle);
+// Free the merge heap
+void scap_merge_free(scap_t* handle);
+// Rebuild the merge heap after the device buffers have been refilled
+void scap_merge_rebuild(scap_t* handle);
+// Return the next event across all the devices, or SCAP_TIMEOUT if they're all drained
+int32_t scap_merge_next(scap_t* handle, OUT scap_evt** pevent, OUT uint16_t* pcpuid);
+
+// Start reading the event chunks of a file, f must be positioned at the first chunk
+int32_t scap_chunk_reader_open(scap_t* handle, gzFile f);
+// Stop the chunk reader threads and free the reader
+void scap_chunk_reader_close(scap_t* handle);
+// Return the next event from the decompressed chunks
+int32_t scap_chunk_reader_next(scap_t* handle, OUT scap_evt** pevent, OUT uint16_t* pcpuid);
+// Return the file offset of the chunk being consumed
+int64_t scap_chunk_reader_get_offset(scap_t* handle);
+// Load the chunk index from the end of the file
+void scap_chunk_reader_load_index(scap_t* handle, const char* fname);
+// Restart reading from the state snapshot that precedes ts
+int32_t scap_chunk_reader_seek(scap_t* handle, uint64_t ts);
+
+// Start reading the events of an uncompressed file through mmap, from the given offset
+int32_t scap_mmap_reader_open(scap_t* handle, const char* fname, uint64_t offset);
+// Unmap the file and free the reader
+void scap_mmap_reader_close(scap_t* handle);
+// Return the next event, pointing into the mapped file
+int32_t scap_mmap_reader_next(scap_t* handle, OUT scap_evt** pevent, OUT uint16_t* pcpuid);
+// Return the file offset of the next event block
+int64_t scap_mmap_reader_get_offset(scap_t* handle);
+
 int32_t scap_proc_fill_cgroups(struct scap_threadinfo* tinfo, const char* procdirname);
 
 //
@@ -57,6 +57,21 @@ static uint32_t get_max_consumers()
 	return 0;
 }
 
+static void scap_wait_policy_init(scap_wait_policy* wait, uint32_t min_us, uint32_t max_us, uint32_t data_threshold)
+{
+	wait->m_min_us = (min_us != 0)? min_us : BUFFER_EMPTY_WAIT_TIME_US_START;
+	wait->m_max_us = (max_us != 0)? max_us : BUFFER_EMPTY_WAIT_TIME_US_MAX;
+	wait->m_data_threshold = (data_threshold != 0)? data_threshold : BUFFER_EMPTY_THRESHOLD_B;
+
+	if(wait->m_max_us < wait->m_min_us)
+	{
+		wait->m_max_us = wait->m_min_us;
+	}
+
+	wait->m_cur_us = wait->m_min_us;
+	wait->m_n_consecutive_waits = 0;
+}
+
 char* scap_getlasterr(scap_t* handle)
 {
 	return handle->m_lasterr;
@@ -65,7 +80,8 @@ char* scap_getlasterr(scap_t* handle)
 scap_t* scap_open_live_int(char *error, 
 						   proc_entry_callback proc_callback,
 						   void* proc_callback_context,
-						   bool import_users)
+						   bool import_users,
+						   bool skip_proc_fds)
 {
 #if !defined(HAS_CAPTURE)
 	snprintf(error, SCAP_LASTERR_SIZE, "live capture not supported on %s", PLATFORM_NAME);
@@ -122,6 +138,15 @@ scap_t* scap_open_live_int(char *error,
 
 	handle->m_ndevs = ndevs;
 
+	scap_wait_policy_init(&handle->m_wait, 0, 0, 0);
+
+	if(scap_merge_init(handle) != SCAP_SUCCESS)
+	{
+		snprintf(error, SCAP_LASTERR_SIZE, "%s", handle->m_lasterr);
+		scap_close(handle);
+		return NULL;
+	}
+
 	//
 	// Extract machine information
 	//
@@ -251,7 +276,6 @@ scap_t* scap_open_live_int(char *error,
 		//
 		handle->m_devs[j].m_lastreadsize = 0;
 		handle->m_devs[j].m_sn_len = 0;
-		handle->m_n_consecutive_waits = 0;
 		scap_stop_dropping_mode(handle);
 		j++;
 	}
@@ -261,7 +285,11 @@ scap_t* scap_open_live_int(char *error,
 	//
 	error[0] = '\0';
 	snprintf(filename, sizeof(filename), "%s/proc", scap_get_host_root());
-	if((res = scap_proc_scan_proc_dir(handle, filename, -1, -1, NULL, error, true)) != SCAP_SUCCESS)
+	handle->m_skip_proc_fds = skip_proc_fds;
+	res = scap_proc_scan_proc_dir_parallel(handle, filename, 0, error, !skip_proc_fds);
+	handle->m_skip_proc_fds = false;
+
+	if(res != SCAP_SUCCESS)
 	{
 		scap_close(handle);
 		snprintf(error, SCAP_LASTERR_SIZE, "error creating the process list. Make sure you have root credentials.");
@@ -305,11 +333,18 @@ scap_t* scap_open_offline_int(const char* fname,
 	handle->m_proclist = NULL;
 	handle->m_evtcnt = 0;
 	handle->m_file = NULL;
+	handle->m_chunk_reader = NULL;
+	handle->m_mmap_reader = NULL;
 	handle->m_addrlist = NULL;
 	handle->m_userlist = NULL;
 	handle->m_machine_info.num_cpus = (uint32_t)-1;
 	handle->m_last_evt_dump_flags = 0;
 	handle->m_driver_procinfo = NULL;
+	handle->m_merge_heap = NULL;
+	handle->m_merge_heap_size = 0;
+	handle->m_merge_window_ns = 0;
+	handle->m_skip_proc_fds = false;
+	handle->m_sockets_cache = NULL;
 
 	handle->m_file_evt_buf = (char*)malloc(FILE_READ_BUF_SIZE);
 	if(!handle->m_file_evt_buf)
@@ -340,6 +375,44 @@ scap_t* scap_open_offline_int(const char* fname,
 		return NULL;
 	}
 
+#ifdef USE_ZLIB
+	//
+	// Files made of chunks have an index that can be used for seeking
+	//
+	if(handle->m_chunk_reader != NULL)
+	{
+		scap_chunk_reader_load_index(handle, fname);
+	}
+#endif
+
+#ifndef _WIN32
+	//
+	// The events of uncompressed files are read in place from a memory
+	// mapping. If the file can't be mapped we just keep using m_file.
+	//
+	if(handle->m_chunk_reader == NULL)
+	{
+		int32_t mres = SCAP_FAILURE;
+
+#ifdef USE_ZLIB
+		if(gzdirect(handle->m_file))
+		{
+			mres = scap_mmap_reader_open(handle, fname, gztell(handle->m_file));
+		}
+#else
+		mres = scap_mmap_reader_open(handle, fname, ftell(handle->m_file));
+#endif
+
+		//
+		// The regular reads don't need the error
+		//
+		if(mres != SCAP_SUCCESS)
+		{
+			handle->m_lasterr[0] = '\0';
+		}
+	}
+#endif
+
 	if(!import_users)
 	{
 		if(handle->m_userlist != NULL)
@@ -369,7 +442,7 @@ scap_t* scap_open_offline(const char* fname, char *error)
 
 scap_t* scap_open_live(char *error)
 {
-	return scap_open_live_int(error, NULL, NULL, true);
+	return scap_open_live_int(error, NULL, NULL, true, false);
 }
 
 scap_t* scap_open(scap_open_args args, char *error)
@@ -382,9 +455,20 @@ scap_t* scap_open(scap_open_args args, char *error)
 	}
 	else
 	{
-		return scap_open_live_int(error, args.proc_callback, 
+		scap_t* handle = scap_open_live_int(error, args.proc_callback, 
 			args.proc_callback_context,
-			args.import_users);
+			args.import_users,
+			args.skip_proc_fds);
+
+		if(handle != NULL)
+		{
+			scap_wait_policy_init(&handle->m_wait,
+				args.buffer_wait_min_us,
+				args.buffer_wait_max_us,
+				args.buffer_data_threshold);
+		}
+
+		return handle;
 	}
 }
 
@@ -392,6 +476,12 @@ void scap_close(scap_t* handle)
 {
 	if(handle->m_file)
 	{
+#ifdef USE_ZLIB
+		scap_chunk_reader_close(handle);
+#endif
+#ifndef _WIN32
+		scap_mmap_reader_close(handle);
+#endif
 		gzclose(handle->m_file);
 	}
 	else
@@ -424,6 +514,8 @@ void scap_close(scap_t* handle)
 #endif // HAS_CAPTURE
 	}
 
+	scap_merge_free(handle);
+
 	if(handle->m_file_evt_buf)
 	{
 		free(handle->m_file_evt_buf);
@@ -435,6 +527,8 @@ void scap_close(scap_t* handle)
 		scap_proc_free_table(handle);
 	}
 
+	scap_fd_free_ns_sockets_list(handle, &handle->m_sockets_cache);
+
 	// Free the interface list
 	if(handle->m_addrlist)
 	{
@@ -552,10 +646,16 @@ int32_t scap_readbuf(scap_t* handle, uint32_t cpuid, bool blocking, OUT char** b
 	return SCAP_SUCCESS;
 }
 
-bool check_scap_next_wait(scap_t* handle)
+//
+// Decide how long to wait before reading the buffers, based on how much data
+// they contain. Returns 0 if the buffers should be read right away.
+//
+uint32_t check_scap_next_wait(scap_t* handle)
 {
 	uint32_t j;
-	bool res = true;
+	bool has_data = false;
+	scap_wait_policy* wait = &handle->m_wait;
+	uint32_t res;
 
 	for(j = 0; j < handle->m_ndevs; j++)
 	{
@@ -565,27 +665,48 @@ bool check_scap_next_wait(scap_t* handle)
 
 		get_buf_pointers(dev->m_bufinfo, &thead, &ttail, &dev->m_read_size);
 
-		if(dev->m_read_size > 20000)
+		if(dev->m_read_size > wait->m_data_threshold)
 		{
-			handle->m_n_consecutive_waits = 0;
-			res = false;
+			wait->m_n_consecutive_waits = 0;
+			wait->m_cur_us = wait->m_min_us;
+			return 0;
 		}
-	}
 
-	if(res == false)
-	{
-		return false;
+		if(dev->m_read_size != 0)
+		{
+			has_data = true;
+		}
 	}
 
-	if(handle->m_n_consecutive_waits >= MAX_N_CONSECUTIVE_WAITS)
+	if(has_data)
 	{
-		handle->m_n_consecutive_waits = 0;
-		return false;
+		//
+		// There are some events, but not enough to make reading them efficient.
+		// Give the buffers a chance to fill up, with a bounded delay.
+		//
+		wait->m_cur_us = wait->m_min_us;
+
+		if(wait->m_n_consecutive_waits >= MAX_N_CONSECUTIVE_WAITS)
+		{
+			wait->m_n_consecutive_waits = 0;
+			return 0;
+		}
+
+		wait->m_n_consecutive_waits++;
+		return wait->m_min_us;
 	}
-	else
+
+	//
+	// The system is idle, back off
+	//
+	res = wait->m_cur_us;
+
+	if(wait->m_cur_us < wait->m_max_us)
 	{
-		return true;
+		wait->m_cur_us = MIN(wait->m_cur_us * 2, wait->m_max_us);
 	}
+
+	return res;
 }
 
 int32_t refill_read_buffers(scap_t* handle, bool wait)
@@ -595,10 +716,11 @@ int32_t refill_read_buffers(scap_t* handle, bool wait)
 
 	if(wait)
 	{
-		if(check_scap_next_wait(handle))
+		uint32_t wait_us = check_scap_next_wait(handle);
+
+		if(wait_us != 0)
 		{
-			usleep(BUFFER_EMPTY_WAIT_TIME_MS * 1000);
-			handle->m_n_consecutive_waits++;
+			usleep(wait_us);
 		}
 	}
 
@@ -621,6 +743,8 @@ int32_t refill_read_buffers(scap_t* handle, bool wait)
 		}
 	}
 
+	scap_merge_rebuild(handle);
+
 	//
 	// Note: we might return a spurious timeout here in case the previous loop extracted valid data to parse.
 	//       It's ok, since this is rare and the caller will just call us again after receiving a 
@@ -644,70 +768,15 @@ static int32_t scap_next_live(scap_t* handle, OUT scap_evt** pevent, OUT uint16_
 	ASSERT(false);
 	return SCAP_FAILURE;
 #else
-	uint32_t j;
-	uint64_t max_ts = 0xffffffffffffffffLL;
-	uint64_t max_buf_size = 0;
-	scap_evt* pe = NULL;
-	uint32_t ndevs = handle->m_ndevs;
+	int32_t res;
 
 	*pcpuid = 65535;
 
-	for(j = 0; j < ndevs; j++)
-	{
-		scap_device* dev = &(handle->m_devs[j]);
-
-		if(dev->m_sn_len == 0)
-		{
-			continue;
-		}
+	res = scap_merge_next(handle, pevent, pcpuid);
 
-		//
-		// Make sure that we have data from this ring
-		//
-		if(dev->m_sn_len != 0)
-		{
-			if(dev->m_sn_len > max_buf_size)
-			{
-				max_buf_size = dev->m_sn_len;
-			}
-
-			//
-			// We want to consume the event with the lowest timestamp
-			//
-			pe = (scap_evt*)dev->m_sn_next_event;
-
-			if(pe->ts < max_ts)
-			{
-				if(pe->len > dev->m_sn_len)
-				{
-					snprintf(handle->m_lasterr,	SCAP_LASTERR_SIZE, "scap_next buffer corruption");
-
-					//
-					// if you get the following assertion, first recompile the driver and libscap
-					//
-					ASSERT(false);
-					return SCAP_FAILURE;
-				}
-
-				*pevent = pe;
-				*pcpuid = j;
-				max_ts = pe->ts;
-			}
-		}
-	}
-
-	//
-	// Check which buffer has been picked
-	//
-	if(*pcpuid != 65535)
+	if(res != SCAP_TIMEOUT)
 	{
-		//
-		// Update the pointers.
-		//
-		ASSERT(handle->m_devs[*pcpuid].m_sn_len >= (*pevent)->len);
-		handle->m_devs[*pcpuid].m_sn_len -= (*pevent)->len;
-		handle->m_devs[*pcpuid].m_sn_next_event += (*pevent)->len;
-		return SCAP_SUCCESS;
+		return res;
 	}
 	else
 	{
@@ -969,6 +1038,8 @@ int32_t scap_set_snaplen(scap_t* handle, uint32_t snaplen)
 
 			handle->m_devs[j].m_sn_len = 0;
 		}
+
+		scap_merge_rebuild(handle);
 	}
 
 	return SCAP_SUCCESS;
@@ -983,10 +1054,37 @@ int64_t scap_get_readfile_offset(scap_t* handle)
 		return -1;
 	}
 
+#ifdef USE_ZLIB
+	if(handle->m_chunk_reader != NULL)
+	{
+		return scap_chunk_reader_get_offset(handle);
+	}
+#endif
+
+#ifndef _WIN32
+	if(handle->m_mmap_reader != NULL)
+	{
+		return scap_mmap_reader_get_offset(handle);
+	}
+#endif
+
 	return gzoffset(handle->m_file);
 }
 
-static int32_t scap_handle_eventmask(scap_t* handle, uint32_t op, uint32_t event_id)
+int32_t scap_seek_to_ts(scap_t* handle, uint64_t ts)
+{
+#ifdef USE_ZLIB
+	if(handle->m_chunk_reader != NULL)
+	{
+		return scap_chunk_reader_seek(handle, ts);
+	}
+#endif
+
+	snprintf(handle->m_lasterr,	SCAP_LASTERR_SIZE, "seeking requires a trace file written with chunked compression");
+	return SCAP_NOT_SUPPORTED;
+}
+
+static int32_t scap_handle_eventmask(scap_t* handle, uint32_t op, unsigned long arg)
 {
 	//
 	// Not supported on files
@@ -1009,6 +1107,7 @@ static int32_t scap_handle_eventmask(scap_t* handle, uint32_t op, uint32_t event
 	case PPM_IOCTL_MASK_ZERO_EVENTS:
 	case PPM_IOCTL_MASK_SET_EVENT:
 	case PPM_IOCTL_MASK_UNSET_EVENT:
+	case PPM_IOCTL_MASK_SET_EVENTS:
 		break;
 
 	default:
@@ -1018,7 +1117,7 @@ static int32_t scap_handle_eventmask(scap_t* handle, uint32_t op, uint32_t event
 		break;
 	}
 
-	if(ioctl(handle->m_devs[0].m_fd, op, event_id))
+	if(ioctl(handle->m_devs[0].m_fd, op, arg))
 	{
 		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "%s(%d) failed", __FUNCTION__, op);
 		ASSERT(false);
@@ -1041,6 +1140,8 @@ static int32_t scap_handle_eventmask(scap_t* handle, uint32_t op, uint32_t event
 
 			handle->m_devs[j].m_sn_len = 0;
 		}
+
+		scap_merge_rebuild(handle);
 	}
 
 	return SCAP_SUCCESS;
@@ -1074,6 +1175,15 @@ int32_t scap_unset_eventmask(scap_t* handle, uint32_t event_id) {
 #endif
 }
 
+int32_t scap_set_eventmask_all(scap_t* handle, const uint8_t* mask) {
+#if !defined(HAS_CAPTURE)
+	snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "eventmask not supported on %s", PLATFORM_NAME);
+	return SCAP_FAILURE;
+#else
+	return(scap_handle_eventmask(handle, PPM_IOCTL_MASK_SET_EVENTS, (unsigned long)mask));
+#endif
+}
+
 uint32_t scap_event_get_dump_flags(scap_t* handle)
 {
 	return handle->m_last_evt_dump_flags;
@@ -69,6 +69,7 @@ typedef struct ppm_evt_hdr scap_evt;
 #define SCAP_NOTFOUND 4
 #define SCAP_INPUT_TOO_SMALL 5
 #define SCAP_EOF 6
+#define SCAP_NOT_SUPPORTED 7
 
 //
 // Last error string size for scap_open_live()
@@ -233,6 +234,10 @@ typedef struct scap_open_args
 	proc_entry_callback proc_callback; ///< Callback to be invoked for each thread/fd that is extracted from /proc, or NULL if no callback is needed.
 	void* proc_callback_context; ///< Opaque pointer that will be included in the calls to proc_callback. Ignored if proc_callback is NULL.
 	bool import_users; ///< true if the user list should be created when opening the capture.
+	uint32_t buffer_wait_min_us; ///< Initial wait time, in microseconds, when the ring buffers don't have enough data. 0 to use the default (50us). Ignored for offline captures.
+	uint32_t buffer_wait_max_us; ///< Maximum wait time, in microseconds, reached by backing off while the ring buffers stay empty, and upper bound of the delivery latency. 0 to use the default (500us). Ignored for offline captures.
+	uint32_t buffer_data_threshold; ///< Number of bytes a ring buffer must contain for its events to be consumed without waiting. 0 to use the default (20000). Ignored for offline captures.
+	bool skip_proc_fds; ///< true to create the process table without reading the fds of the processes, which can be read later with scap_proc_get_fds(). Ignored for offline captures.
 }scap_open_args;
 
 
@@ -418,7 +423,10 @@ typedef enum event_direction
 typedef enum compression_mode
 {
 	SCAP_COMPRESSION_NONE = 0,
-	SCAP_COMPRESSION_GZIP = 1
+	SCAP_COMPRESSION_GZIP = 1,
+	SCAP_COMPRESSION_CHUNKED = 2	///< The events are compressed in independent chunks, followed
+									///< by a chunk index. This allows reading the file with
+									///< multiple threads.
 }compression_mode;
 
 /*!
@@ -575,6 +583,26 @@ uint32_t scap_event_get_dump_flags(scap_t* handle);
 */
 int64_t scap_get_readfile_offset(scap_t* handle);
 
+/*!
+  \brief Move the read position of a trace file close to the given time.
+  This only works with the files written with SCAP_COMPRESSION_CHUNKED,
+  and uses their chunk index.
+
+  \param handle Handle to the capture instance.
+  \param ts The target time, in nanoseconds since epoch.
+
+  \return SCAP_SUCCESS if the call is succesful.
+   SCAP_NOT_SUPPORTED if the file doesn't have a chunk index, in which case
+   the reading position doesn't change.
+   On Failure, SCAP_FAILURE is returned and scap_getlasterr() can be used to obtain
+   the cause of the error. The reading position is then undefined.
+
+  \note Reading restarts from the last state snapshot before ts, and the process
+   table is reloaded from that snapshot. The events between the snapshot and ts
+   are returned too, so that the caller can use them to rebuild its state.
+*/
+int32_t scap_seek_to_ts(scap_t* handle, uint64_t ts);
+
 /*!
   \brief Open a tracefile for writing 
 
@@ -607,6 +635,17 @@ int64_t scap_dump_get_offset(scap_dumper_t *d);
 */
 void scap_dump_flush(scap_dumper_t *d);
 
+/*!
+  \brief Set how often a SCAP_COMPRESSION_CHUNKED tracefile gets a snapshot
+   of the process and fd tables, which is where \ref scap_seek_to_ts() can
+   restart reading from. Snapshots require a scan of /proc, which runs on a
+   background thread, so they are only written during live captures.
+
+  \param d The dump handle, returned by \ref scap_dump_open
+  \param interval_ns The minimum time between two snapshots. 0 disables them.
+*/
+void scap_dump_set_snapshot_interval(scap_dumper_t *d, uint64_t interval_ns);
+
 /*!
   \brief Tell how many bytes would be written (a dry run of scap_dump)
 
@@ -802,6 +841,32 @@ int32_t scap_set_eventmask(scap_t* handle, uint32_t event_id);
 */
 int32_t scap_unset_eventmask(scap_t* handle, uint32_t event_id);
 
+/*!
+  \brief Replace the whole eventmask, flushing the read buffers only once
+  instead of once per event like scap_set_eventmask/scap_unset_eventmask.
+  The drop events are always passed.
+
+  \param handle Handle to the capture instance.
+  \param mask PPM_EVENTMASK_SIZE bytes with one bit per event id, starting
+   from the lowest bit of the first byte.
+  \note This function can only be called for live captures. The mask
+   applies to this capture only, not to the other consumers of the driver.
+*/
+int32_t scap_set_eventmask_all(scap_t* handle, const uint8_t* mask);
+
+
+/*!
+  \brief Relax the global timestamp ordering of live events to reduce the
+  per-event merging cost.
+
+  \param handle Handle to the capture instance.
+  \param window_ns Maximum amount of time, in nanoseconds, an event can be
+   returned ahead of an earlier event coming from a different CPU. Events
+   coming from the same CPU are always returned in order. 0 restores strict
+   ordering, which is the default.
+  \note This function can only be called for live captures.
+*/
+int32_t scap_set_batch_window(scap_t* handle, uint64_t window_ns);
 
 /*!
   \brief Get the root directory of the system. This usually changes
@@ -840,6 +905,21 @@ uint32_t scap_event_get_sentinel_begin(scap_evt* e);
 // The returned pointer must be freed via scap_proc_free by the caller.
 struct scap_threadinfo* scap_proc_get(scap_t* handle, int64_t tid, bool scan_sockets);
 
+// Like scap_proc_get(), but it doesn't touch the state of the handle, so it can
+// be called from a thread other than the capture one. The fds of the process are
+// returned in the fdlist of the thread instead of being passed to the proc
+// callback, and the error string is written to error.
+// The returned pointer must be freed via scap_proc_free by the caller.
+struct scap_threadinfo* scap_proc_get_detached(scap_t* handle, int64_t tid, bool scan_sockets, char* error);
+
+// Read the fds of a process from /proc, for a process table created with the
+// skip_proc_fds open option. The fds are returned in the fdlist of a thread
+// whose other fields are not filled. The socket tables of the network
+// namespaces are kept in the handle and reused by the calls made within a
+// second, so it must be called from the capture thread.
+// The returned pointer must be freed via scap_proc_free by the caller.
+struct scap_threadinfo* scap_proc_get_fds(scap_t* handle, int64_t pid, bool scan_sockets, char* error);
+
 // Check if the given thread exists in ;proc
 bool scap_is_thread_alive(scap_t* handle, int64_t pid, int64_t tid, const char* comm);
 
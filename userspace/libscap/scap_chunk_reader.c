@@ -0,0 +1,694 @@
+/*
+Copyright (C) 2013-2014 Draios inc.
+
+This file is part of sysdig.
+
+sysdig is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License version 2 as
+published by the Free Software Foundation.
+
+sysdig is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sysdig.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+////////////////////////////////////////////////////////////////////////////
+// Reader of the trace files written with SCAP_COMPRESSION_CHUNKED.
+//
+// A pool of threads reads the ECB blocks from the file in order and
+// decompresses them ahead of the consumer. Each chunk goes into a slot of a
+// circular array, and the consumer walks the slots in the same order, so the
+// events are returned in the order they were written.
+// On Windows there are no reader threads and the chunks are decompressed by
+// the consumer.
+////////////////////////////////////////////////////////////////////////////
+
+#ifndef _WIN32
+#include <unistd.h>
+#include <pthread.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "scap.h"
+#include "scap-int.h"
+#include "scap_savefile.h"
+
+#ifdef USE_ZLIB
+
+typedef enum chunk_slot_state
+{
+	CS_FREE = 0,	// Can be loaded with the next chunk
+	CS_LOADING = 1,	// A thread is decompressing the chunk
+	CS_READY = 2,	// The chunk can be consumed
+	CS_EOF = 3,		// No more chunks in the file
+	CS_ERROR = 4	// Error reading the chunk, see m_lasterr
+}chunk_slot_state;
+
+typedef struct scap_chunk_slot
+{
+	uint32_t m_state;
+	int64_t m_offset; // File offset of the chunk
+	char* m_zbuf;
+	uint32_t m_zbuf_size;
+	char* m_buf;
+	uint32_t m_buf_size;
+	uint32_t m_len;
+	char m_lasterr[SCAP_LASTERR_SIZE];
+}scap_chunk_slot;
+
+struct scap_chunk_reader
+{
+	gzFile m_f;
+	chunk_index_entry* m_index; // NULL if the file doesn't have the index
+	uint32_t m_index_len;
+	scap_chunk_slot* m_slots;
+	uint32_t m_nslots;
+	uint64_t m_next_load; // Sequence number of the next chunk to read from the file
+	uint64_t m_next_consume; // Sequence number of the next chunk to consume
+	bool m_eof;
+	bool m_stop;
+
+	//
+	// Consumer state
+	//
+	scap_chunk_slot* m_cur;
+	char* m_cur_evt;
+	uint32_t m_cur_len;
+	int64_t m_offset;
+
+#ifndef _WIN32
+	uint32_t m_max_threads; // Started after the open and after each seek
+	uint32_t m_nthreads; // Running
+	pthread_t* m_threads;
+	pthread_mutex_t m_mutex;
+	pthread_cond_t m_work_cond; // Signaled when a slot is freed
+	pthread_cond_t m_ready_cond; // Signaled when a slot is done loading
+#endif
+};
+
+//
+// Read the next chunk from the file. This is sequential and, with the reader
+// threads, it's done holding the mutex.
+//
+static int32_t chunk_load(scap_chunk_reader* r, scap_chunk_slot* slot)
+{
+	block_header bh;
+	event_chunk_header* ch;
+	uint32_t bt;
+	uint32_t toread;
+	int readsize;
+
+	while(true)
+	{
+		slot->m_offset = gztell(r->m_f);
+
+		readsize = gzread(r->m_f, &bh, sizeof(bh));
+		if(readsize == 0)
+		{
+			//
+			// The file was not closed properly and it doesn't have the index
+			//
+			return SCAP_EOF;
+		}
+		else if(readsize != sizeof(bh))
+		{
+			snprintf(slot->m_lasterr, SCAP_LASTERR_SIZE, "error reading block header at offset %" PRId64 ". Is the file truncated?", slot->m_offset);
+			return SCAP_FAILURE;
+		}
+
+		switch(bh.block_type)
+		{
+		case ECB_BLOCK_TYPE:
+			break;
+		case CIB_BLOCK_TYPE:
+			//
+			// The index follows the last chunk
+			//
+			return SCAP_EOF;
+		case PL_BLOCK_TYPE_V4:
+		case FDL_BLOCK_TYPE:
+			//
+			// State snapshot. It's only needed when seeking, skip it.
+			//
+			if(bh.block_total_length < sizeof(bh) + 4 ||
+				gzseek(r->m_f, (long)(bh.block_total_length - sizeof(bh)), SEEK_CUR) == -1)
+			{
+				snprintf(slot->m_lasterr, SCAP_LASTERR_SIZE, "corrupted snapshot at offset %" PRId64, slot->m_offset);
+				return SCAP_FAILURE;
+			}
+			continue;
+		default:
+			snprintf(slot->m_lasterr, SCAP_LASTERR_SIZE, "unexpected block type %u", (uint32_t)bh.block_type);
+			return SCAP_FAILURE;
+		}
+
+		break;
+	}
+
+	if(bh.block_total_length < sizeof(bh) + sizeof(event_chunk_header) + 4)
+	{
+		snprintf(slot->m_lasterr, SCAP_LASTERR_SIZE, "block length too short %u", (uint32_t)bh.block_total_length);
+		return SCAP_FAILURE;
+	}
+
+	toread = bh.block_total_length - sizeof(bh);
+	if(toread > slot->m_zbuf_size)
+	{
+		char* zbuf = (char*)realloc(slot->m_zbuf, toread);
+		if(zbuf == NULL)
+		{
+			snprintf(slot->m_lasterr, SCAP_LASTERR_SIZE, "error allocating the chunk buffer");
+			return SCAP_FAILURE;
+		}
+
+		slot->m_zbuf = zbuf;
+		slot->m_zbuf_size = toread;
+	}
+
+	readsize = gzread(r->m_f, slot->m_zbuf, toread);
+	if(readsize != (int)toread)
+	{
+		snprintf(slot->m_lasterr, SCAP_LASTERR_SIZE, "error reading chunk at offset %" PRId64 ". Is the file truncated?", slot->m_offset);
+		return SCAP_FAILURE;
+	}
+
+	ch = (event_chunk_header*)slot->m_zbuf;
+	bt = *(uint32_t*)(slot->m_zbuf + toread - sizeof(uint32_t));
+
+	if(bt != bh.block_total_length ||
+		ch->compressed_len > toread - sizeof(event_chunk_header) - sizeof(uint32_t))
+	{
+		snprintf(slot->m_lasterr, SCAP_LASTERR_SIZE, "corrupted chunk at offset %" PRId64, slot->m_offset);
+		return SCAP_FAILURE;
+	}
+
+	return SCAP_SUCCESS;
+}
+
+//
+// Decompress a loaded chunk. This doesn't touch any shared state.
+//
+static int32_t chunk_inflate(scap_chunk_slot* slot)
+{
+	event_chunk_header* ch = (event_chunk_header*)slot->m_zbuf;
+	uLongf len = ch->uncompressed_len;
+
+	if(ch->uncompressed_len > slot->m_buf_size)
+	{
+		char* buf = (char*)realloc(slot->m_buf, ch->uncompressed_len);
+		if(buf == NULL)
+		{
+			snprintf(slot->m_lasterr, SCAP_LASTERR_SIZE, "error allocating the chunk buffer");
+			return SCAP_FAILURE;
+		}
+
+		slot->m_buf = buf;
+		slot->m_buf_size = ch->uncompressed_len;
+	}
+
+	if(uncompress((Bytef*)slot->m_buf, &len,
+		(Bytef*)(slot->m_zbuf + sizeof(event_chunk_header)), ch->compressed_len) != Z_OK ||
+		len != ch->uncompressed_len)
+	{
+		snprintf(slot->m_lasterr, SCAP_LASTERR_SIZE, "error decompressing chunk at offset %" PRId64, slot->m_offset);
+		return SCAP_FAILURE;
+	}
+
+	slot->m_len = (uint32_t)len;
+	return SCAP_SUCCESS;
+}
+
+static uint32_t chunk_state_from_res(int32_t res)
+{
+	switch(res)
+	{
+	case SCAP_SUCCESS:
+		return CS_READY;
+	case SCAP_EOF:
+		return CS_EOF;
+	default:
+		return CS_ERROR;
+	}
+}
+
+#ifndef _WIN32
+static void* chunk_reader_thread(void* arg)
+{
+	scap_chunk_reader* r = (scap_chunk_reader*)arg;
+	scap_chunk_slot* slot;
+	int32_t res;
+
+	pthread_mutex_lock(&r->m_mutex);
+
+	while(!r->m_stop)
+	{
+		slot = &r->m_slots[r->m_next_load % r->m_nslots];
+
+		//
+		// Wait until the consumer releases the slot of the next chunk
+		//
+		if(r->m_eof || slot->m_state != CS_FREE)
+		{
+			pthread_cond_wait(&r->m_work_cond, &r->m_mutex);
+			continue;
+		}
+
+		r->m_next_load++;
+
+		res = chunk_load(r, slot);
+		if(res == SCAP_SUCCESS)
+		{
+			slot->m_state = CS_LOADING;
+
+			pthread_mutex_unlock(&r->m_mutex);
+			res = chunk_inflate(slot);
+			pthread_mutex_lock(&r->m_mutex);
+		}
+		else
+		{
+			//
+			// Nothing after this slot can be read
+			//
+			r->m_eof = true;
+		}
+
+		slot->m_state = chunk_state_from_res(res);
+		pthread_cond_broadcast(&r->m_ready_cond);
+	}
+
+	pthread_mutex_unlock(&r->m_mutex);
+	return NULL;
+}
+#endif // _WIN32
+
+#ifndef _WIN32
+static int32_t chunk_reader_start_threads(scap_t* handle, scap_chunk_reader* r)
+{
+	r->m_stop = false;
+
+	for(r->m_nthreads = 0; r->m_nthreads < r->m_max_threads; r->m_nthreads++)
+	{
+		if(pthread_create(&r->m_threads[r->m_nthreads], NULL, chunk_reader_thread, r) != 0)
+		{
+			snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "error starting the chunk reader threads");
+			return SCAP_FAILURE;
+		}
+	}
+
+	return SCAP_SUCCESS;
+}
+
+static void chunk_reader_stop_threads(scap_chunk_reader* r)
+{
+	uint32_t j;
+
+	pthread_mutex_lock(&r->m_mutex);
+	r->m_stop = true;
+	pthread_cond_broadcast(&r->m_work_cond);
+	pthread_mutex_unlock(&r->m_mutex);
+
+	for(j = 0; j < r->m_nthreads; j++)
+	{
+		pthread_join(r->m_threads[j], NULL);
+	}
+
+	r->m_nthreads = 0;
+}
+#endif // _WIN32
+
+int32_t scap_chunk_reader_open(scap_t* handle, gzFile f)
+{
+	scap_chunk_reader* r;
+	uint32_t nthreads = 0;
+
+	r = (scap_chunk_reader*)calloc(1, sizeof(scap_chunk_reader));
+	if(r == NULL)
+	{
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "error allocating the chunk reader");
+		return SCAP_FAILURE;
+	}
+
+	r->m_f = f;
+	r->m_offset = gztell(f);
+
+#ifndef _WIN32
+	//
+	// Leave a CPU to the consumer
+	//
+	long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+	nthreads = (ncpus > 2)? (uint32_t)ncpus - 1 : 1;
+	if(nthreads > CHUNK_READER_MAX_THREADS)
+	{
+		nthreads = CHUNK_READER_MAX_THREADS;
+	}
+#endif
+
+	//
+	// Two chunks in flight per thread, plus the one being consumed
+	//
+	r->m_nslots = nthreads * 2 + 1;
+	r->m_slots = (scap_chunk_slot*)calloc(r->m_nslots, sizeof(scap_chunk_slot));
+	if(r->m_slots == NULL)
+	{
+		free(r);
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "error allocating the chunk reader");
+		return SCAP_FAILURE;
+	}
+
+	handle->m_chunk_reader = r;
+
+#ifndef _WIN32
+	pthread_mutex_init(&r->m_mutex, NULL);
+	pthread_cond_init(&r->m_work_cond, NULL);
+	pthread_cond_init(&r->m_ready_cond, NULL);
+
+	r->m_threads = (pthread_t*)malloc(nthreads * sizeof(pthread_t));
+	if(r->m_threads == NULL)
+	{
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "error allocating the chunk reader");
+		return SCAP_FAILURE;
+	}
+
+	r->m_max_threads = nthreads;
+
+	return chunk_reader_start_threads(handle, r);
+#else
+	return SCAP_SUCCESS;
+#endif
+}
+
+void scap_chunk_reader_close(scap_t* handle)
+{
+	scap_chunk_reader* r = handle->m_chunk_reader;
+	uint32_t j;
+
+	if(r == NULL)
+	{
+		return;
+	}
+
+#ifndef _WIN32
+	chunk_reader_stop_threads(r);
+
+	pthread_cond_destroy(&r->m_ready_cond);
+	pthread_cond_destroy(&r->m_work_cond);
+	pthread_mutex_destroy(&r->m_mutex);
+	free(r->m_threads);
+#endif
+
+	for(j = 0; j < r->m_nslots; j++)
+	{
+		free(r->m_slots[j].m_zbuf);
+		free(r->m_slots[j].m_buf);
+	}
+
+	free(r->m_slots);
+	free(r->m_index);
+	free(r);
+	handle->m_chunk_reader = NULL;
+}
+
+void scap_chunk_reader_load_index(scap_t* handle, const char* fname)
+{
+	scap_chunk_reader* r = handle->m_chunk_reader;
+	block_header bh;
+	uint32_t bt;
+	uint32_t len;
+	FILE* fp;
+
+	fp = fopen(fname, "rb");
+	if(fp == NULL)
+	{
+		return;
+	}
+
+	//
+	// The index is the last block of the file, and the block trailer tells
+	// where it starts
+	//
+	if(fseek(fp, -(long)sizeof(bt), SEEK_END) != 0 ||
+		fread(&bt, sizeof(bt), 1, fp) != 1 ||
+		bt < sizeof(bh) + sizeof(bt) ||
+		fseek(fp, -(long)bt, SEEK_END) != 0 ||
+		fread(&bh, sizeof(bh), 1, fp) != 1 ||
+		bh.block_type != CIB_BLOCK_TYPE ||
+		bh.block_total_length != bt)
+	{
+		fclose(fp);
+		return;
+	}
+
+	len = (bt - sizeof(bh) - sizeof(bt)) / sizeof(chunk_index_entry);
+
+	if(len != 0)
+	{
+		r->m_index = (chunk_index_entry*)malloc(len * sizeof(chunk_index_entry));
+		if(r->m_index != NULL && fread(r->m_index, sizeof(chunk_index_entry), len, fp) == len)
+		{
+			r->m_index_len = len;
+		}
+		else
+		{
+			free(r->m_index);
+			r->m_index = NULL;
+		}
+	}
+
+	fclose(fp);
+}
+
+//
+// The read position is lost after a failed seek. Make the reader return the
+// error until the next seek, which starts the reader threads again.
+//
+static int32_t chunk_reader_seek_failed(scap_t* handle, scap_chunk_reader* r)
+{
+	r->m_eof = true;
+	r->m_slots[0].m_state = CS_ERROR;
+	snprintf(r->m_slots[0].m_lasterr, SCAP_LASTERR_SIZE, "%s", handle->m_lasterr);
+	return SCAP_FAILURE;
+}
+
+int32_t scap_chunk_reader_seek(scap_t* handle, uint64_t ts)
+{
+	scap_chunk_reader* r = handle->m_chunk_reader;
+	uint32_t lo = 0;
+	uint32_t hi;
+	uint32_t j;
+	int64_t state_offset;
+
+	if(r->m_index == NULL)
+	{
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "the file doesn't have a chunk index");
+		return SCAP_NOT_SUPPORTED;
+	}
+
+	//
+	// Find the last chunk starting at or before ts, and then the closest
+	// snapshot before it. If there's none, the header tables are the state.
+	//
+	hi = r->m_index_len;
+	while(lo < hi)
+	{
+		uint32_t mid = (lo + hi) / 2;
+
+		if(r->m_index[mid].first_ts <= ts)
+		{
+			lo = mid + 1;
+		}
+		else
+		{
+			hi = mid;
+		}
+	}
+
+	j = (lo == 0)? 0 : lo - 1;
+	while(j > 0 && r->m_index[j].snapshot_offset == 0)
+	{
+		j--;
+	}
+
+	state_offset = r->m_index[j].snapshot_offset;
+	if(state_offset == 0)
+	{
+		state_offset = sizeof(block_header) + sizeof(section_header_block) + sizeof(uint32_t);
+	}
+
+#ifndef _WIN32
+	chunk_reader_stop_threads(r);
+#endif
+
+	for(hi = 0; hi < r->m_nslots; hi++)
+	{
+		r->m_slots[hi].m_state = CS_FREE;
+	}
+
+	r->m_next_load = 0;
+	r->m_next_consume = 0;
+	r->m_eof = false;
+	r->m_cur = NULL;
+	r->m_cur_len = 0;
+
+	//
+	// Reload the process table
+	//
+	scap_proc_free_table(handle);
+
+	if(gzseek(r->m_f, (long)state_offset, SEEK_SET) == -1)
+	{
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "error seeking in file");
+		return chunk_reader_seek_failed(handle, r);
+	}
+
+	if(scap_read_state(handle, r->m_f) != SCAP_SUCCESS)
+	{
+		return chunk_reader_seek_failed(handle, r);
+	}
+
+	if(gzseek(r->m_f, (long)r->m_index[j].offset, SEEK_SET) == -1)
+	{
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "error seeking in file");
+		return chunk_reader_seek_failed(handle, r);
+	}
+
+	r->m_offset = r->m_index[j].offset;
+
+#ifndef _WIN32
+	return chunk_reader_start_threads(handle, r);
+#else
+	return SCAP_SUCCESS;
+#endif
+}
+
+//
+// Make the next chunk current, waiting for it to be decompressed if needed
+//
+static int32_t chunk_reader_advance(scap_t* handle, scap_chunk_reader* r)
+{
+	scap_chunk_slot* slot;
+
+#ifndef _WIN32
+	pthread_mutex_lock(&r->m_mutex);
+
+	if(r->m_cur != NULL)
+	{
+		r->m_cur->m_state = CS_FREE;
+		r->m_cur = NULL;
+		r->m_next_consume++;
+		pthread_cond_signal(&r->m_work_cond);
+	}
+
+	slot = &r->m_slots[r->m_next_consume % r->m_nslots];
+
+	while(slot->m_state == CS_FREE || slot->m_state == CS_LOADING)
+	{
+		pthread_cond_wait(&r->m_ready_cond, &r->m_mutex);
+	}
+
+	pthread_mutex_unlock(&r->m_mutex);
+#else
+	if(r->m_cur != NULL)
+	{
+		r->m_cur->m_state = CS_FREE;
+		r->m_cur = NULL;
+		r->m_next_consume++;
+	}
+
+	slot = &r->m_slots[r->m_next_consume % r->m_nslots];
+
+	if(slot->m_state == CS_FREE)
+	{
+		int32_t res = chunk_load(r, slot);
+		if(res == SCAP_SUCCESS)
+		{
+			res = chunk_inflate(slot);
+		}
+
+		slot->m_state = chunk_state_from_res(res);
+	}
+#endif
+
+	r->m_offset = slot->m_offset;
+
+	switch(slot->m_state)
+	{
+	case CS_READY:
+		r->m_cur = slot;
+		r->m_cur_evt = slot->m_buf;
+		r->m_cur_len = slot->m_len;
+		return SCAP_SUCCESS;
+	case CS_EOF:
+		return SCAP_EOF;
+	default:
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "%s", slot->m_lasterr);
+		return SCAP_FAILURE;
+	}
+}
+
+int32_t scap_chunk_reader_next(scap_t* handle, OUT scap_evt** pevent, OUT uint16_t* pcpuid)
+{
+	scap_chunk_reader* r = handle->m_chunk_reader;
+	block_header* bh;
+	char* body;
+
+	while(r->m_cur_len == 0)
+	{
+		int32_t res = chunk_reader_advance(handle, r);
+		if(res != SCAP_SUCCESS)
+		{
+			return res;
+		}
+	}
+
+	bh = (block_header*)r->m_cur_evt;
+
+	if(r->m_cur_len < sizeof(block_header) ||
+		bh->block_total_length > r->m_cur_len ||
+		bh->block_total_length < sizeof(block_header) + sizeof(struct ppm_evt_hdr) + 4)
+	{
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "corrupted chunk at offset %" PRId64, r->m_offset);
+		return SCAP_FAILURE;
+	}
+
+	body = r->m_cur_evt + sizeof(block_header);
+
+	//
+	// EVF_BLOCK_TYPE has 32 bits of flags
+	//
+	*pcpuid = *(uint16_t *)body;
+
+	if(bh->block_type == EVF_BLOCK_TYPE)
+	{
+		handle->m_last_evt_dump_flags = *(uint32_t*)(body + sizeof(uint16_t));
+		*pevent = (struct ppm_evt_hdr *)(body + sizeof(uint16_t) + sizeof(uint32_t));
+	}
+	else if(bh->block_type == EV_BLOCK_TYPE || bh->block_type == EV_BLOCK_TYPE_INT)
+	{
+		handle->m_last_evt_dump_flags = 0;
+		*pevent = (struct ppm_evt_hdr *)(body + sizeof(uint16_t));
+	}
+	else
+	{
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "unexpected block type %u", (uint32_t)bh->block_type);
+		return SCAP_FAILURE;
+	}
+
+	r->m_cur_evt += bh->block_total_length;
+	r->m_cur_len -= bh->block_total_length;
+
+	return SCAP_SUCCESS;
+}
+
+int64_t scap_chunk_reader_get_offset(scap_t* handle)
+{
+	return handle->m_chunk_reader->m_offset;
+}
+
+#endif // USE_ZLIB
@@ -0,0 +1,226 @@
+/*
+Copyright (C) 2013-2014 Draios inc.
+
+This file is part of sysdig.
+
+sysdig is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License version 2 as
+published by the Free Software Foundation.
+
+sysdig is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sysdig.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+////////////////////////////////////////////////////////////////////////////
+// K-way merge of the per-CPU event buffers.
+//
+// The devices that have data available are kept in a binary min-heap keyed
+// on the timestamp of their next event, so picking the next event costs
+// O(log(ncpus)) instead of a full scan of the devices.
+////////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "scap.h"
+#include "scap-int.h"
+
+static inline void merge_sift_down(scap_merge_entry* heap, uint32_t size, uint32_t pos)
+{
+	scap_merge_entry e = heap[pos];
+
+	while(true)
+	{
+		uint32_t child = pos * 2 + 1;
+
+		if(child >= size)
+		{
+			break;
+		}
+
+		if(child + 1 < size && heap[child + 1].m_ts < heap[child].m_ts)
+		{
+			child++;
+		}
+
+		if(heap[child].m_ts >= e.m_ts)
+		{
+			break;
+		}
+
+		heap[pos] = heap[child];
+		pos = child;
+	}
+
+	heap[pos] = e;
+}
+
+int32_t scap_merge_init(scap_t* handle)
+{
+	handle->m_merge_heap_size = 0;
+
+	if(handle->m_ndevs == 0)
+	{
+		handle->m_merge_heap = NULL;
+		return SCAP_SUCCESS;
+	}
+
+	handle->m_merge_heap = (scap_merge_entry*)malloc(handle->m_ndevs * sizeof(scap_merge_entry));
+	if(handle->m_merge_heap == NULL)
+	{
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "error allocating the merge heap");
+		return SCAP_FAILURE;
+	}
+
+	return SCAP_SUCCESS;
+}
+
+void scap_merge_free(scap_t* handle)
+{
+	if(handle->m_merge_heap != NULL)
+	{
+		free(handle->m_merge_heap);
+		handle->m_merge_heap = NULL;
+	}
+
+	handle->m_merge_heap_size = 0;
+}
+
+void scap_merge_rebuild(scap_t* handle)
+{
+	uint32_t j;
+	uint32_t size = 0;
+	scap_merge_entry* heap = handle->m_merge_heap;
+
+	for(j = 0; j < handle->m_ndevs; j++)
+	{
+		scap_device* dev = &(handle->m_devs[j]);
+
+		if(dev->m_sn_len == 0)
+		{
+			continue;
+		}
+
+		heap[size].m_ts = ((scap_evt*)dev->m_sn_next_event)->ts;
+		heap[size].m_devid = j;
+		size++;
+	}
+
+	handle->m_merge_heap_size = size;
+
+	//
+	// Floyd's bottom-up heap construction
+	//
+	for(j = size / 2; j > 0; j--)
+	{
+		merge_sift_down(heap, size, j - 1);
+	}
+}
+
+int32_t scap_merge_next(scap_t* handle, OUT scap_evt** pevent, OUT uint16_t* pcpuid)
+{
+	scap_merge_entry* heap = handle->m_merge_heap;
+	scap_device* dev;
+	scap_evt* pe;
+
+	if(handle->m_merge_heap_size == 0)
+	{
+		return SCAP_TIMEOUT;
+	}
+
+	dev = &(handle->m_devs[heap[0].m_devid]);
+	pe = (scap_evt*)dev->m_sn_next_event;
+
+	if(pe->len > dev->m_sn_len)
+	{
+		snprintf(handle->m_lasterr,	SCAP_LASTERR_SIZE, "scap_next buffer corruption");
+
+		//
+		// if you get the following assertion, first recompile the driver and libscap
+		//
+		ASSERT(false);
+		return SCAP_FAILURE;
+	}
+
+	*pevent = pe;
+	*pcpuid = (uint16_t)heap[0].m_devid;
+
+	//
+	// Update the pointers.
+	//
+	dev->m_sn_len -= pe->len;
+	dev->m_sn_next_event += pe->len;
+
+	if(dev->m_sn_len == 0)
+	{
+		//
+		// This device is drained, replace it with the last one in the heap
+		//
+		handle->m_merge_heap_size--;
+		if(handle->m_merge_heap_size != 0)
+		{
+			heap[0] = heap[handle->m_merge_heap_size];
+			merge_sift_down(heap, handle->m_merge_heap_size, 0);
+		}
+	}
+	else
+	{
+		heap[0].m_ts = ((scap_evt*)dev->m_sn_next_event)->ts;
+
+		//
+		// In batch mode, keep serving events from the same CPU as long as they
+		// are not later than the next best CPU by more than the reorder window.
+		//
+		if(handle->m_merge_window_ns != 0)
+		{
+			uint32_t size = handle->m_merge_heap_size;
+			uint64_t next_ts;
+
+			if(size == 1)
+			{
+				return SCAP_SUCCESS;
+			}
+
+			next_ts = heap[1].m_ts;
+			if(size > 2 && heap[2].m_ts < next_ts)
+			{
+				next_ts = heap[2].m_ts;
+			}
+
+			if(heap[0].m_ts <= next_ts + handle->m_merge_window_ns)
+			{
+				return SCAP_SUCCESS;
+			}
+		}
+
+		merge_sift_down(heap, handle->m_merge_heap_size, 0);
+	}
+
+	return SCAP_SUCCESS;
+}
+
+int32_t scap_set_batch_window(scap_t* handle, uint64_t window_ns)
+{
+	if(handle->m_file)
+	{
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "batch mode not supported on offline captures");
+		return SCAP_FAILURE;
+	}
+
+	handle->m_merge_window_ns = window_ns;
+
+	//
+	// The root of the heap might be out of order if we were batching, fix it
+	//
+	if(handle->m_merge_heap_size != 0)
+	{
+		merge_sift_down(handle->m_merge_heap, handle->m_merge_heap_size, 0);
+	}
+
+	return SCAP_SUCCESS;
+}
@@ -0,0 +1,305 @@
+/*
+Copyright (C) 2013-2014 Draios inc.
+
+This file is part of sysdig.
+
+sysdig is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License version 2 as
+published by the Free Software Foundation.
+
+sysdig is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sysdig.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+////////////////////////////////////////////////////////////////////////////
+// Reader of the uncompressed trace files.
+//
+// The event blocks are accessed through a read-only memory mapping of the
+// file, and the events are returned as pointers into the mapping instead of
+// being copied into m_file_evt_buf.
+// Only a window of the file is mapped at any time, so that files bigger than
+// the address space or the physical memory can be read. The window slides
+// forward as the events are consumed.
+// Touching the pages past the end of a file that has been truncated raises
+// SIGBUS, so the size of the file is checked again with fstat() every
+// MMAP_READER_CHECK_SIZE bytes and when its end is reached. A file that is
+// still being written is then read to the end. If the file has become
+// shorter, or can't be mapped anymore, the reader goes away and
+// scap_next_offline() continues with regular reads from the same offset.
+// A truncation that happens between a check and the reads that follow it
+// can still raise SIGBUS, but only within MMAP_READER_CHECK_SIZE bytes.
+////////////////////////////////////////////////////////////////////////////
+
+#ifndef _WIN32
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "scap.h"
+#include "scap-int.h"
+#include "scap_savefile.h"
+
+struct scap_mmap_reader
+{
+	int m_fd;
+	uint64_t m_file_size;
+	uint64_t m_page_size;
+	char* m_map; // NULL if nothing is mapped
+	uint64_t m_map_offset; // File offset of the first byte of the mapping
+	uint64_t m_map_len;
+	uint64_t m_offset; // File offset of the next block
+	uint64_t m_checked_end; // The file was at least this long the last time its size was checked
+};
+
+static void mmap_reader_unmap(scap_mmap_reader* r)
+{
+	if(r->m_map != NULL)
+	{
+		munmap(r->m_map, r->m_map_len);
+		r->m_map = NULL;
+		r->m_map_len = 0;
+	}
+}
+
+//
+// Check the size of the file again if the len bytes at the current offset go
+// past the part that has been checked. Returns SCAP_FAILURE if the file has
+// become shorter.
+//
+static int32_t mmap_reader_check_size(scap_mmap_reader* r, uint64_t len)
+{
+	struct stat st;
+
+	if(r->m_offset + len <= r->m_checked_end)
+	{
+		return SCAP_SUCCESS;
+	}
+
+	if(fstat(r->m_fd, &st) != 0 || (uint64_t)st.st_size < r->m_file_size)
+	{
+		return SCAP_FAILURE;
+	}
+
+	r->m_file_size = st.st_size;
+	r->m_checked_end = MIN(r->m_file_size, r->m_offset + MAX(len, MMAP_READER_CHECK_SIZE));
+	return SCAP_SUCCESS;
+}
+
+//
+// Make sure the len bytes at offset are mapped, moving the window if they
+// aren't. The caller must have checked that they are inside the file.
+// Returns SCAP_FAILURE if the reader must fall back to regular reads.
+//
+static int32_t mmap_reader_map(scap_mmap_reader* r, uint64_t offset, uint64_t len)
+{
+	uint64_t start;
+	uint64_t maplen;
+	void* map;
+
+	if(r->m_map != NULL && offset >= r->m_map_offset &&
+		offset + len <= r->m_map_offset + r->m_map_len)
+	{
+		return SCAP_SUCCESS;
+	}
+
+	mmap_reader_unmap(r);
+
+	start = offset & ~(r->m_page_size - 1);
+	maplen = MAX(MMAP_READER_WINDOW_SIZE, offset + len - start);
+	maplen = MIN(maplen, r->m_file_size - start);
+
+	map = mmap(NULL, (size_t)maplen, PROT_READ, MAP_SHARED, r->m_fd, (off_t)start);
+	if(map == MAP_FAILED)
+	{
+		return SCAP_FAILURE;
+	}
+
+	//
+	// The events are consumed in order, let the kernel read ahead aggressively
+	// and drop the pages behind us
+	//
+	madvise(map, (size_t)maplen, MADV_SEQUENTIAL);
+
+	r->m_map = (char*)map;
+	r->m_map_offset = start;
+	r->m_map_len = maplen;
+	return SCAP_SUCCESS;
+}
+
+int32_t scap_mmap_reader_open(scap_t* handle, const char* fname, uint64_t offset)
+{
+	scap_mmap_reader* r;
+	struct stat st;
+	long page_size;
+
+	r = (scap_mmap_reader*)calloc(1, sizeof(scap_mmap_reader));
+	if(r == NULL)
+	{
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "error allocating the mmap reader");
+		return SCAP_FAILURE;
+	}
+
+	r->m_fd = open(fname, O_RDONLY);
+	if(r->m_fd < 0)
+	{
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "can't open file %s", fname);
+		free(r);
+		return SCAP_FAILURE;
+	}
+
+	//
+	// Pipes and the like can't be mapped
+	//
+	if(fstat(r->m_fd, &st) != 0 || !S_ISREG(st.st_mode) || (uint64_t)st.st_size < offset)
+	{
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "%s can't be memory mapped", fname);
+		close(r->m_fd);
+		free(r);
+		return SCAP_FAILURE;
+	}
+
+	page_size = sysconf(_SC_PAGESIZE);
+
+	r->m_file_size = st.st_size;
+	r->m_page_size = (page_size > 0)? page_size : 4096;
+	r->m_offset = offset;
+	r->m_checked_end = offset;
+
+	handle->m_mmap_reader = r;
+	return SCAP_SUCCESS;
+}
+
+void scap_mmap_reader_close(scap_t* handle)
+{
+	scap_mmap_reader* r = handle->m_mmap_reader;
+
+	if(r == NULL)
+	{
+		return;
+	}
+
+	mmap_reader_unmap(r);
+	close(r->m_fd);
+	free(r);
+	handle->m_mmap_reader = NULL;
+}
+
+//
+// Close the reader and continue with the regular reads of scap_next_offline()
+// from the offset of the next block
+//
+static int32_t mmap_reader_fallback(scap_t* handle, OUT scap_evt** pevent, OUT uint16_t* pcpuid)
+{
+	uint64_t offset = handle->m_mmap_reader->m_offset;
+
+	scap_mmap_reader_close(handle);
+
+	if(gzseek(handle->m_file, (long)offset, SEEK_SET) == -1)
+	{
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "error seeking the trace file to offset %" PRIu64, offset);
+		return SCAP_FAILURE;
+	}
+
+	return scap_next_offline(handle, pevent, pcpuid);
+}
+
+int32_t scap_mmap_reader_next(scap_t* handle, OUT scap_evt** pevent, OUT uint16_t* pcpuid)
+{
+	scap_mmap_reader* r = handle->m_mmap_reader;
+	uint64_t remaining;
+	block_header* bh;
+	char* block;
+
+	if(mmap_reader_check_size(r, sizeof(block_header)) != SCAP_SUCCESS)
+	{
+		return mmap_reader_fallback(handle, pevent, pcpuid);
+	}
+
+	remaining = r->m_file_size - r->m_offset;
+
+	if(remaining == 0)
+	{
+		return SCAP_EOF;
+	}
+
+	CHECK_READ_SIZE(MIN(remaining, sizeof(block_header)), sizeof(block_header));
+
+	if(mmap_reader_map(r, r->m_offset, sizeof(block_header)) != SCAP_SUCCESS)
+	{
+		return mmap_reader_fallback(handle, pevent, pcpuid);
+	}
+
+	block = r->m_map + (r->m_offset - r->m_map_offset);
+	bh = (block_header*)block;
+
+	if(bh->block_type != EV_BLOCK_TYPE &&
+		bh->block_type != EV_BLOCK_TYPE_INT &&
+		bh->block_type != EVF_BLOCK_TYPE)
+	{
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "unexpected block type %u", (uint32_t)bh->block_type);
+		return SCAP_FAILURE;
+	}
+
+	if(bh->block_total_length < sizeof(block_header) + sizeof(struct ppm_evt_hdr) + 4)
+	{
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "block length too short %u", (uint32_t)bh->block_total_length);
+		return SCAP_FAILURE;
+	}
+
+	if(mmap_reader_check_size(r, bh->block_total_length) != SCAP_SUCCESS)
+	{
+		return mmap_reader_fallback(handle, pevent, pcpuid);
+	}
+
+	remaining = r->m_file_size - r->m_offset;
+
+	CHECK_READ_SIZE(MIN(remaining, bh->block_total_length), bh->block_total_length);
+
+	//
+	// Bring the whole block in the window. This can move the mapping.
+	//
+	if(mmap_reader_map(r, r->m_offset, bh->block_total_length) != SCAP_SUCCESS)
+	{
+		return mmap_reader_fallback(handle, pevent, pcpuid);
+	}
+
+	block = r->m_map + (r->m_offset - r->m_map_offset);
+	bh = (block_header*)block;
+	block += sizeof(block_header);
+
+	//
+	// EVF_BLOCK_TYPE has 32 bits of flags
+	//
+	*pcpuid = *(uint16_t *)block;
+
+	if(bh->block_type == EVF_BLOCK_TYPE)
+	{
+		handle->m_last_evt_dump_flags = *(uint32_t*)(block + sizeof(uint16_t));
+		*pevent = (struct ppm_evt_hdr *)(block + sizeof(uint16_t) + sizeof(uint32_t));
+	}
+	else
+	{
+		handle->m_last_evt_dump_flags = 0;
+		*pevent = (struct ppm_evt_hdr *)(block + sizeof(uint16_t));
+	}
+
+	r->m_offset += bh->block_total_length;
+	return SCAP_SUCCESS;
+}
+
+int64_t scap_mmap_reader_get_offset(scap_t* handle)
+{
+	return (int64_t)handle->m_mmap_reader->m_offset;
+}
+
+#endif // _WIN32
@@ -25,6 +25,7 @@ along with sysdig.  If not, see <http://www.gnu.org/licenses/>.
 #include <sys/resource.h>
 #include <sys/syscall.h>
 #include <sys/ioctl.h>
+#include <pthread.h>
 #endif
 
 #include "scap.h"
@@ -685,7 +686,7 @@ static int32_t scap_proc_add_from_proc(scap_t* handle, uint32_t tid, int parentt
 	//
 	// Only add fds for processes, not threads
 	//
-	if(parenttid == -1)
+	if(parenttid == -1 && !handle->m_skip_proc_fds)
 	{
 		res = scap_fd_scan_fd_dir(handle, dir_name, tinfo, sockets_by_ns, error);
 	}
@@ -821,6 +822,624 @@ int32_t scap_proc_scan_proc_dir(scap_t* handle, char* procdirname, int parenttid
 	return res;
 }
 
+//
+// Parallel version of the initial scan of /proc. The processes are split
+// across a pool of threads, in three rounds:
+//  - the network namespace of every process is read
+//  - the socket tables of every namespace are read, once per namespace
+//  - the processes are read, with their threads and fds
+// The results are then handed to the process table, or to the callback, in
+// the order in which /proc lists the processes, from the calling thread.
+//
+// Each worker scans through a private copy of the handle without the
+// callback, so that the existing scan functions fill a private process list
+// and the callback is never invoked concurrently.
+//
+struct scap_proc_scan;
+
+struct scap_proc_scan_worker
+{
+	struct scap_proc_scan* m_scan;
+	pthread_t m_thread;
+	scap_t m_handle;
+	struct scap_ns_socket_list* m_sockets_by_ns;
+	int32_t m_res;
+	char m_error[SCAP_LASTERR_SIZE];
+};
+
+struct scap_proc_scan
+{
+	char* m_procdirname;
+	bool m_scan_sockets;
+	uint64_t* m_tids;
+	uint32_t m_ntids;
+	int64_t* m_net_ns; // Network namespace of each process
+	scap_threadinfo** m_results; // Threads of each process
+	struct scap_ns_socket_list* m_sockets_by_ns; // Read only during the process round
+	struct scap_ns_socket_list** m_ns; // The namespaces to read...
+	uint64_t* m_ns_tids; // ...and a process in each of them
+	uint32_t m_nns;
+	uint32_t m_round;
+	uint32_t m_next;
+	pthread_mutex_t m_mutex;
+};
+
+#define PROC_SCAN_ROUND_NS 0
+#define PROC_SCAN_ROUND_SOCKETS 1
+#define PROC_SCAN_ROUND_PROCS 2
+
+static int32_t scap_proc_scan_read_net_ns(struct scap_proc_scan* scan, uint32_t j)
+{
+	char filename[SCAP_MAX_PATH_SIZE];
+	char link_name[SCAP_MAX_PATH_SIZE];
+	ssize_t r;
+
+	//
+	// Same as scap_fd_scan_fd_dir(): no namespace means the global one
+	//
+	scan->m_net_ns[j] = 0;
+
+	snprintf(filename, sizeof(filename), "%s/%" PRIu64 "/ns/net", scan->m_procdirname, scan->m_tids[j]);
+	r = readlink(filename, link_name, sizeof(link_name) - 1);
+	if(r > 0)
+	{
+		link_name[r] = '\0';
+		sscanf(link_name, "net:[%" PRIi64 "]", &scan->m_net_ns[j]);
+	}
+
+	return SCAP_SUCCESS;
+}
+
+static int32_t scap_proc_scan_read_sockets(struct scap_proc_scan_worker* w, uint32_t j)
+{
+	struct scap_proc_scan* scan = w->m_scan;
+	char procdir[SCAP_MAX_PATH_SIZE];
+
+	snprintf(procdir, sizeof(procdir), "%s/%" PRIu64 "/", scan->m_procdirname, scan->m_ns_tids[j]);
+
+	if(scap_fd_read_sockets(&w->m_handle, procdir, scan->m_ns[j]) == SCAP_FAILURE)
+	{
+		snprintf(w->m_error, SCAP_LASTERR_SIZE, "%s", w->m_handle.m_lasterr);
+		return SCAP_FAILURE;
+	}
+
+	return SCAP_SUCCESS;
+}
+
+static int32_t scap_proc_scan_read_proc(struct scap_proc_scan_worker* w, uint32_t j)
+{
+	struct scap_proc_scan* scan = w->m_scan;
+	char childdir[SCAP_MAX_PATH_SIZE];
+	uint64_t tid = scan->m_tids[j];
+	int32_t res;
+
+	res = scap_proc_add_from_proc(&w->m_handle, (uint32_t)tid, -1, -1, scan->m_procdirname, &w->m_sockets_by_ns, NULL, w->m_error);
+	if(res != SCAP_SUCCESS)
+	{
+		snprintf(w->m_error, SCAP_LASTERR_SIZE, "cannot add procs tid = %" PRIu64 ", parenttid = -1, dirname = %s", tid, scan->m_procdirname);
+		return res;
+	}
+
+	snprintf(childdir, sizeof(childdir), "%s/%u/task", scan->m_procdirname, (int)tid);
+	if(scap_proc_scan_proc_dir(&w->m_handle, childdir, (int)tid, -1, NULL, w->m_error, scan->m_scan_sockets) == SCAP_FAILURE)
+	{
+		return SCAP_FAILURE;
+	}
+
+	scan->m_results[j] = w->m_handle.m_proclist;
+	w->m_handle.m_proclist = NULL;
+	return SCAP_SUCCESS;
+}
+
+static void* scap_proc_scan_thread(void* arg)
+{
+	struct scap_proc_scan_worker* w = (struct scap_proc_scan_worker*)arg;
+	struct scap_proc_scan* scan = w->m_scan;
+	uint32_t nitems = (scan->m_round == PROC_SCAN_ROUND_SOCKETS)? scan->m_nns : scan->m_ntids;
+	uint32_t j;
+
+	while(w->m_res == SCAP_SUCCESS)
+	{
+		pthread_mutex_lock(&scan->m_mutex);
+		j = scan->m_next++;
+		pthread_mutex_unlock(&scan->m_mutex);
+
+		if(j >= nitems)
+		{
+			break;
+		}
+
+		switch(scan->m_round)
+		{
+		case PROC_SCAN_ROUND_NS:
+			w->m_res = scap_proc_scan_read_net_ns(scan, j);
+			break;
+		case PROC_SCAN_ROUND_SOCKETS:
+			w->m_res = scap_proc_scan_read_sockets(w, j);
+			break;
+		case PROC_SCAN_ROUND_PROCS:
+			w->m_res = scap_proc_scan_read_proc(w, j);
+			break;
+		default:
+			ASSERT(false);
+			w->m_res = SCAP_FAILURE;
+		}
+	}
+
+	return NULL;
+}
+
+//
+// Run a round on all the workers, and return the result of the first one
+// that failed
+//
+static int32_t scap_proc_scan_run_round(struct scap_proc_scan* scan, struct scap_proc_scan_worker* workers, uint32_t nworkers, uint32_t round, char* error)
+{
+	uint32_t nstarted;
+	uint32_t j;
+	int32_t res = SCAP_SUCCESS;
+
+	scan->m_round = round;
+	scan->m_next = 0;
+
+	for(nstarted = 0; nstarted < nworkers; nstarted++)
+	{
+		if(pthread_create(&workers[nstarted].m_thread, NULL, scap_proc_scan_thread, &workers[nstarted]) != 0)
+		{
+			break;
+		}
+	}
+
+	if(nstarted == 0)
+	{
+		snprintf(error, SCAP_LASTERR_SIZE, "can't start the /proc scan threads");
+		return SCAP_FAILURE;
+	}
+
+	for(j = 0; j < nstarted; j++)
+	{
+		pthread_join(workers[j].m_thread, NULL);
+	}
+
+	for(j = 0; j < nworkers; j++)
+	{
+		if(workers[j].m_res != SCAP_SUCCESS)
+		{
+			snprintf(error, SCAP_LASTERR_SIZE, "%s", workers[j].m_error);
+			res = workers[j].m_res;
+			break;
+		}
+	}
+
+	return res;
+}
+
+//
+// Give a worker its own list of the namespaces, pointing to the shared socket
+// tables. A process whose namespace changed after the first round adds its
+// namespace to this list only.
+//
+static int32_t scap_proc_scan_init_worker_sockets(struct scap_proc_scan* scan, struct scap_proc_scan_worker* w)
+{
+	struct scap_ns_socket_list* ns;
+	struct scap_ns_socket_list* tns;
+	struct scap_ns_socket_list* wns;
+	int32_t uth_status = SCAP_SUCCESS;
+
+	if(!scan->m_scan_sockets)
+	{
+		w->m_sockets_by_ns = (void*)-1;
+		return SCAP_SUCCESS;
+	}
+
+	HASH_ITER(hh, scan->m_sockets_by_ns, ns, tns)
+	{
+		wns = (struct scap_ns_socket_list*)malloc(sizeof(struct scap_ns_socket_list));
+		if(wns == NULL)
+		{
+			snprintf(w->m_error, SCAP_LASTERR_SIZE, "socket list allocation error");
+			return SCAP_FAILURE;
+		}
+
+		wns->net_ns = ns->net_ns;
+		wns->sockets = ns->sockets;
+		HASH_ADD_INT64(w->m_sockets_by_ns, net_ns, wns);
+		if(uth_status != SCAP_SUCCESS)
+		{
+			snprintf(w->m_error, SCAP_LASTERR_SIZE, "socket list allocation error");
+			return SCAP_FAILURE;
+		}
+	}
+
+	return SCAP_SUCCESS;
+}
+
+static void scap_proc_scan_free_worker_sockets(scap_t* handle, struct scap_proc_scan* scan, struct scap_proc_scan_worker* w)
+{
+	struct scap_ns_socket_list* wns;
+	struct scap_ns_socket_list* tns;
+	struct scap_ns_socket_list* ns;
+
+	if(w->m_sockets_by_ns == NULL || w->m_sockets_by_ns == (void*)-1)
+	{
+		return;
+	}
+
+	HASH_ITER(hh, w->m_sockets_by_ns, wns, tns)
+	{
+		HASH_DEL(w->m_sockets_by_ns, wns);
+
+		HASH_FIND_INT64(scan->m_sockets_by_ns, &wns->net_ns, ns);
+		if(ns == NULL)
+		{
+			scap_fd_free_table(handle, &wns->sockets);
+		}
+
+		free(wns);
+	}
+}
+
+static void scap_proc_scan_free_list(scap_t* handle, scap_threadinfo** list)
+{
+	scap_threadinfo* tinfo;
+	scap_threadinfo* ttinfo;
+
+	HASH_ITER(hh, *list, tinfo, ttinfo)
+	{
+		HASH_DEL(*list, tinfo);
+		scap_fd_free_proc_fd_table(handle, tinfo);
+		free(tinfo);
+	}
+}
+
+//
+// Move the threads of a process to the process table, or hand them to the
+// callback together with their fds
+//
+static int32_t scap_proc_scan_merge(scap_t* handle, scap_threadinfo** list, char* error)
+{
+	scap_threadinfo* tinfo;
+	scap_threadinfo* ttinfo;
+	scap_threadinfo* ptinfo;
+	scap_fdinfo* fdi;
+	scap_fdinfo* tfdi;
+	int32_t uth_status = SCAP_SUCCESS;
+
+	HASH_ITER(hh, *list, tinfo, ttinfo)
+	{
+		HASH_DEL(*list, tinfo);
+
+		if(handle->m_proc_callback == NULL)
+		{
+			HASH_FIND_INT64(handle->m_proclist, &tinfo->tid, ptinfo);
+			if(ptinfo != NULL)
+			{
+				ASSERT(false);
+				snprintf(error, SCAP_LASTERR_SIZE, "duplicate process %"PRIu64, tinfo->tid);
+				scap_fd_free_proc_fd_table(handle, tinfo);
+				free(tinfo);
+				return SCAP_FAILURE;
+			}
+
+			HASH_ADD_INT64(handle->m_proclist, tid, tinfo);
+			if(uth_status != SCAP_SUCCESS)
+			{
+				snprintf(error, SCAP_LASTERR_SIZE, "process table allocation error (2)");
+				return SCAP_FAILURE;
+			}
+		}
+		else
+		{
+			handle->m_proc_callback(handle->m_proc_callback_context, tinfo->tid, tinfo, NULL, handle);
+
+			HASH_ITER(hh, tinfo->fdlist, fdi, tfdi)
+			{
+				HASH_DEL(tinfo->fdlist, fdi);
+				handle->m_proc_callback(handle->m_proc_callback_context, tinfo->tid, tinfo, fdi, handle);
+				free(fdi);
+			}
+
+			free(tinfo);
+		}
+	}
+
+	return SCAP_SUCCESS;
+}
+
+int32_t scap_proc_scan_proc_dir_parallel(scap_t* handle, char* procdirname, uint32_t nthreads, char *error, bool scan_sockets)
+{
+	struct scap_proc_scan scan;
+	struct scap_proc_scan_worker* workers = NULL;
+	struct scap_ns_socket_list* ns;
+	DIR *dir_p;
+	struct dirent *dir_entry_p;
+	uint32_t tids_size = 1024;
+	uint32_t j;
+	int32_t res = SCAP_SUCCESS;
+	int32_t uth_status = SCAP_SUCCESS;
+
+	if(nthreads == 0)
+	{
+		long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+		nthreads = (ncpus > 0)? (uint32_t)ncpus : 1;
+	}
+
+	if(nthreads > PROC_SCAN_MAX_THREADS)
+	{
+		nthreads = PROC_SCAN_MAX_THREADS;
+	}
+
+	memset(&scan, 0, sizeof(scan));
+	scan.m_procdirname = procdirname;
+	scan.m_scan_sockets = scan_sockets;
+
+	//
+	// List the processes
+	//
+	dir_p = opendir(procdirname);
+	if(dir_p == NULL)
+	{
+		snprintf(error, SCAP_LASTERR_SIZE, "error opening the %s directory", procdirname);
+		return SCAP_NOTFOUND;
+	}
+
+	scan.m_tids = (uint64_t*)malloc(tids_size * sizeof(uint64_t));
+	if(scan.m_tids == NULL)
+	{
+		closedir(dir_p);
+		snprintf(error, SCAP_LASTERR_SIZE, "process table allocation error (3)");
+		return SCAP_FAILURE;
+	}
+
+	while((dir_entry_p = readdir(dir_p)) != NULL)
+	{
+		if(strspn(dir_entry_p->d_name, "0123456789") != strlen(dir_entry_p->d_name))
+		{
+			continue;
+		}
+
+		if(scan.m_ntids == tids_size)
+		{
+			uint64_t* tids = (uint64_t*)realloc(scan.m_tids, 2 * tids_size * sizeof(uint64_t));
+			if(tids == NULL)
+			{
+				closedir(dir_p);
+				free(scan.m_tids);
+				snprintf(error, SCAP_LASTERR_SIZE, "process table allocation error (3)");
+				return SCAP_FAILURE;
+			}
+
+			scan.m_tids = tids;
+			tids_size *= 2;
+		}
+
+		scan.m_tids[scan.m_ntids++] = atoi(dir_entry_p->d_name);
+	}
+
+	closedir(dir_p);
+
+	scan.m_net_ns = (int64_t*)malloc((scan.m_ntids + 1) * sizeof(int64_t));
+	scan.m_ns = (struct scap_ns_socket_list**)malloc((scan.m_ntids + 1) * sizeof(struct scap_ns_socket_list*));
+	scan.m_ns_tids = (uint64_t*)malloc((scan.m_ntids + 1) * sizeof(uint64_t));
+	scan.m_results = (scap_threadinfo**)calloc(scan.m_ntids + 1, sizeof(scap_threadinfo*));
+	workers = (struct scap_proc_scan_worker*)calloc(nthreads, sizeof(struct scap_proc_scan_worker));
+	if(scan.m_net_ns == NULL || scan.m_ns == NULL || scan.m_ns_tids == NULL || scan.m_results == NULL || workers == NULL)
+	{
+		snprintf(error, SCAP_LASTERR_SIZE, "process table allocation error (3)");
+		res = SCAP_FAILURE;
+		goto done;
+	}
+
+	pthread_mutex_init(&scan.m_mutex, NULL);
+
+	for(j = 0; j < nthreads; j++)
+	{
+		workers[j].m_scan = &scan;
+		workers[j].m_handle = *handle;
+		workers[j].m_handle.m_proclist = NULL;
+		workers[j].m_handle.m_proc_callback = NULL;
+		workers[j].m_res = SCAP_SUCCESS;
+	}
+
+	if(scan_sockets)
+	{
+		res = scap_proc_scan_run_round(&scan, workers, nthreads, PROC_SCAN_ROUND_NS, error);
+		if(res != SCAP_SUCCESS)
+		{
+			goto done_mutex;
+		}
+
+		//
+		// One socket table per namespace
+		//
+		for(j = 0; j < scan.m_ntids; j++)
+		{
+			HASH_FIND_INT64(scan.m_sockets_by_ns, &scan.m_net_ns[j], ns);
+			if(ns != NULL)
+			{
+				continue;
+			}
+
+			ns = (struct scap_ns_socket_list*)malloc(sizeof(struct scap_ns_socket_list));
+			if(ns == NULL)
+			{
+				snprintf(error, SCAP_LASTERR_SIZE, "socket list allocation error");
+				res = SCAP_FAILURE;
+				goto done_mutex;
+			}
+
+			ns->net_ns = scan.m_net_ns[j];
+			ns->sockets = NULL;
+			HASH_ADD_INT64(scan.m_sockets_by_ns, net_ns, ns);
+			if(uth_status != SCAP_SUCCESS)
+			{
+				snprintf(error, SCAP_LASTERR_SIZE, "socket list allocation error");
+				res = SCAP_FAILURE;
+				goto done_mutex;
+			}
+
+			scan.m_ns[scan.m_nns] = ns;
+			scan.m_ns_tids[scan.m_nns] = scan.m_tids[j];
+			scan.m_nns++;
+		}
+
+		res = scap_proc_scan_run_round(&scan, workers, nthreads, PROC_SCAN_ROUND_SOCKETS, error);
+		if(res != SCAP_SUCCESS)
+		{
+			goto done_mutex;
+		}
+	}
+
+	for(j = 0; j < nthreads; j++)
+	{
+		res = scap_proc_scan_init_worker_sockets(&scan, &workers[j]);
+		if(res != SCAP_SUCCESS)
+		{
+			snprintf(error, SCAP_LASTERR_SIZE, "%s", workers[j].m_error);
+			goto done_mutex;
+		}
+	}
+
+	res = scap_proc_scan_run_round(&scan, workers, nthreads, PROC_SCAN_ROUND_PROCS, error);
+	if(res != SCAP_SUCCESS)
+	{
+		goto done_mutex;
+	}
+
+	for(j = 0; j < scan.m_ntids; j++)
+	{
+		res = scap_proc_scan_merge(handle, &scan.m_results[j], error);
+		if(res != SCAP_SUCCESS)
+		{
+			break;
+		}
+	}
+
+done_mutex:
+	pthread_mutex_destroy(&scan.m_mutex);
+
+	for(j = 0; j < nthreads; j++)
+	{
+		scap_proc_scan_free_worker_sockets(handle, &scan, &workers[j]);
+
+		//
+		// The threads of a process that failed halfway
+		//
+		scap_proc_scan_free_list(handle, &workers[j].m_handle.m_proclist);
+	}
+
+done:
+	if(scan.m_results != NULL)
+	{
+		for(j = 0; j < scan.m_ntids; j++)
+		{
+			scap_proc_scan_free_list(handle, &scan.m_results[j]);
+		}
+	}
+
+	if(scan.m_sockets_by_ns != NULL)
+	{
+		scap_fd_free_ns_sockets_list(handle, &scan.m_sockets_by_ns);
+	}
+
+	free(workers);
+	free(scan.m_results);
+	free(scan.m_ns_tids);
+	free(scan.m_ns);
+	free(scan.m_net_ns);
+	free(scan.m_tids);
+	return res;
+}
+
+//
+// Read the thread group id of a thread from its status file. Note that
+// /proc/<tid> can be opened for any thread, even if readdir() on /proc only
+// returns the thread group leaders.
+//
+static int32_t scap_proc_read_tgid(char* procdirname, int64_t tid, int64_t* tgid)
+{
+	char filename[SCAP_MAX_PATH_SIZE];
+	char line[512];
+	int32_t res = SCAP_NOTFOUND;
+	FILE* f;
+
+	snprintf(filename, sizeof(filename), "%s/%" PRId64 "/status", procdirname, tid);
+
+	f = fopen(filename, "r");
+	if(f == NULL)
+	{
+		return SCAP_NOTFOUND;
+	}
+
+	while(fgets(line, sizeof(line), f) != NULL)
+	{
+		if(strstr(line, "Tgid:") == line)
+		{
+			if(sscanf(line, "Tgid: %" PRId64, tgid) == 1)
+			{
+				res = SCAP_SUCCESS;
+			}
+
+			break;
+		}
+	}
+
+	fclose(f);
+	return res;
+}
+
+//
+// Read a single thread from /proc, going straight to /proc/<tid> for a
+// process and to /proc/<tgid>/task/<tid> for a thread, instead of scanning
+// the whole directory like scap_proc_scan_proc_dir() does
+//
+int32_t scap_proc_read_thread(scap_t* handle, char* procdirname, int64_t tid, struct scap_threadinfo** procinfo, char *error, bool scan_sockets)
+{
+	char childdir[SCAP_MAX_PATH_SIZE];
+	struct scap_ns_socket_list* sockets_by_ns = NULL;
+	int64_t tgid;
+	int32_t res;
+
+	*procinfo = NULL;
+
+	if(scap_proc_read_tgid(procdirname, tid, &tgid) != SCAP_SUCCESS)
+	{
+		snprintf(error, SCAP_LASTERR_SIZE, "thread %" PRId64 " not found in %s", tid, procdirname);
+		return SCAP_NOTFOUND;
+	}
+
+	if(tgid == tid)
+	{
+		//
+		// Main thread: this is a process, so its fds are read too
+		//
+		if(!scan_sockets)
+		{
+			sockets_by_ns = (void*)-1;
+		}
+
+		res = scap_proc_add_from_proc(handle, (uint32_t)tid, -1, (int)tid, procdirname, &sockets_by_ns, procinfo, error);
+
+		if(sockets_by_ns != NULL && sockets_by_ns != (void*)-1)
+		{
+			scap_fd_free_ns_sockets_list(handle, &sockets_by_ns);
+		}
+	}
+	else
+	{
+		snprintf(childdir, sizeof(childdir), "%s/%" PRId64 "/task", procdirname, tgid);
+		res = scap_proc_add_from_proc(handle, (uint32_t)tid, (int)tgid, (int)tid, childdir, &sockets_by_ns, procinfo, error);
+	}
+
+	if(res != SCAP_SUCCESS)
+	{
+		snprintf(error, SCAP_LASTERR_SIZE, "cannot add procs tid = %" PRId64 ", tgid = %" PRId64 ", dirname = %s", tid, tgid, procdirname);
+	}
+
+	return res;
+}
+
 #endif // HAS_CAPTURE
 
 //
@@ -875,7 +1494,7 @@ struct scap_threadinfo* scap_proc_get(scap_t* handle, int64_t tid, bool scan_soc
 	struct scap_threadinfo* tinfo = NULL;
 	char filename[SCAP_MAX_PATH_SIZE];
 	snprintf(filename, sizeof(filename), "%s/proc", scap_get_host_root());
-	if(scap_proc_scan_proc_dir(handle, filename, -1, tid, &tinfo, handle->m_lasterr, scan_sockets) != SCAP_SUCCESS)
+	if(scap_proc_read_thread(handle, filename, tid, &tinfo, handle->m_lasterr, scan_sockets) != SCAP_SUCCESS)
 	{
 		return NULL;
 	}
@@ -884,6 +1503,143 @@ struct scap_threadinfo* scap_proc_get(scap_t* handle, int64_t tid, bool scan_soc
 #endif // HAS_CAPTURE
 }
 
+struct scap_threadinfo* scap_proc_get_detached(scap_t* handle, int64_t tid, bool scan_sockets, char* error)
+{
+#if !defined(HAS_CAPTURE)
+	snprintf(error, SCAP_LASTERR_SIZE, "live capture not supported on this platform");
+	return NULL;
+#else
+	struct scap_threadinfo* tinfo = NULL;
+	char filename[SCAP_MAX_PATH_SIZE];
+	scap_t* h;
+
+	if(handle->m_file)
+	{
+		snprintf(error, SCAP_LASTERR_SIZE, "no /proc parsing for offline captures");
+		return NULL;
+	}
+
+	//
+	// Do the lookup on a private handle that only shares the devices, which
+	// the vtid/vpid ioctls need, with the capture one
+	//
+	h = (scap_t*)calloc(1, sizeof(scap_t));
+	if(h == NULL)
+	{
+		snprintf(error, SCAP_LASTERR_SIZE, "error allocating the handle");
+		return NULL;
+	}
+
+	h->m_devs = handle->m_devs;
+	h->m_ndevs = handle->m_ndevs;
+
+	snprintf(filename, sizeof(filename), "%s/proc", scap_get_host_root());
+	if(scap_proc_read_thread(h, filename, tid, &tinfo, h->m_lasterr, scan_sockets) != SCAP_SUCCESS)
+	{
+		if(tinfo != NULL)
+		{
+			scap_proc_free(h, tinfo);
+			tinfo = NULL;
+		}
+	}
+
+	if(tinfo == NULL)
+	{
+		snprintf(error, SCAP_LASTERR_SIZE, "%s", h->m_lasterr);
+	}
+
+	free(h);
+	return tinfo;
+#endif // HAS_CAPTURE
+}
+
+struct scap_threadinfo* scap_proc_get_fds(scap_t* handle, int64_t pid, bool scan_sockets, char* error)
+{
+#if !defined(HAS_CAPTURE)
+	snprintf(error, SCAP_LASTERR_SIZE, "live capture not supported on this platform");
+	return NULL;
+#else
+	struct scap_threadinfo* tinfo;
+	struct scap_ns_socket_list* sockets_by_ns = NULL;
+	char procdir[SCAP_MAX_PATH_SIZE];
+	scap_t* h;
+	int32_t res;
+
+	if(handle->m_file)
+	{
+		snprintf(error, SCAP_LASTERR_SIZE, "no /proc parsing for offline captures");
+		return NULL;
+	}
+
+	//
+	// A private handle, so that the fds are not passed to the proc callback
+	//
+	h = (scap_t*)calloc(1, sizeof(scap_t));
+	tinfo = (scap_threadinfo*)calloc(1, sizeof(scap_threadinfo));
+	if(h == NULL || tinfo == NULL)
+	{
+		snprintf(error, SCAP_LASTERR_SIZE, "error allocating the handle");
+		free(h);
+		free(tinfo);
+		return NULL;
+	}
+
+	h->m_devs = handle->m_devs;
+	h->m_ndevs = handle->m_ndevs;
+
+	tinfo->tid = pid;
+	tinfo->pid = pid;
+
+	if(scan_sockets)
+	{
+		struct timespec ts;
+		uint64_t now;
+
+		//
+		// The processes read in a row mostly share a few namespaces, so their
+		// socket tables are kept for a while. The sockets created later are
+		// seen in the events, or are missing like the ones of a /proc scan.
+		//
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		now = (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+
+		if(handle->m_sockets_cache != NULL &&
+			now - handle->m_sockets_cache_ts > SOCKETS_CACHE_TIMEOUT_NS)
+		{
+			scap_fd_free_ns_sockets_list(handle, &handle->m_sockets_cache);
+		}
+
+		if(handle->m_sockets_cache == NULL)
+		{
+			handle->m_sockets_cache_ts = now;
+		}
+
+		sockets_by_ns = handle->m_sockets_cache;
+	}
+	else
+	{
+		sockets_by_ns = (void*)-1;
+	}
+
+	snprintf(procdir, sizeof(procdir), "%s/proc/%" PRId64 "/", scap_get_host_root(), pid);
+	res = scap_fd_scan_fd_dir(h, procdir, tinfo, &sockets_by_ns, error);
+
+	if(scan_sockets)
+	{
+		handle->m_sockets_cache = sockets_by_ns;
+	}
+
+	if(res != SCAP_SUCCESS)
+	{
+		scap_proc_free(h, tinfo);
+		tinfo = NULL;
+	}
+
+	free(h);
+	return tinfo;
+#endif // HAS_CAPTURE
+}
+
 bool scap_is_thread_alive(scap_t* handle, int64_t pid, int64_t tid, const char* comm)
 {
 #if !defined(HAS_CAPTURE)
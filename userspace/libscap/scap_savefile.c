@@ -18,6 +18,7 @@ along with sysdig.  If not, see <http://www.gnu.org/licenses/>.
 
 #ifndef _WIN32
 #include <unistd.h>
+#include <pthread.h>
 #endif
 
 #include <stdio.h>
@@ -27,6 +28,46 @@ along with sysdig.  If not, see <http://www.gnu.org/licenses/>.
 #include "scap-int.h"
 #include "scap_savefile.h"
 
+//
+// A trace file opened for writing
+//
+struct scap_dumper
+{
+	gzFile m_f;
+
+	//
+	// State of SCAP_COMPRESSION_CHUNKED files. m_chunk_buf is NULL for the
+	// other compression modes.
+	//
+	char* m_chunk_buf;
+	uint32_t m_chunk_len;
+	uint32_t m_chunk_size;
+	uint32_t m_chunk_nevts;
+	uint64_t m_chunk_first_ts;
+	uint64_t m_chunk_last_ts;
+	char* m_zbuf;
+	uint32_t m_zbuf_size;
+	chunk_index_entry* m_index;
+	uint32_t m_index_len;
+	uint32_t m_index_size;
+	uint64_t m_snapshot_interval_ns;
+	uint64_t m_last_snapshot_ts;
+	int64_t m_snapshot_offset; // Offset of the snapshot preceding the current chunk, 0 if none
+#if defined(HAS_CAPTURE)
+	//
+	// The /proc scan of the next snapshot, which runs on a background thread
+	// on a private handle that shares the devices with the capture one. It's
+	// running while m_snapshot_handle isn't NULL. m_snapshot_done and
+	// m_snapshot_res are protected by m_snapshot_mutex.
+	//
+	scap_t* m_snapshot_handle;
+	pthread_t m_snapshot_thread;
+	pthread_mutex_t m_snapshot_mutex;
+	bool m_snapshot_done;
+	int32_t m_snapshot_res;
+#endif
+};
+
 ///////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////
 // WRITE FUNCTIONS
@@ -513,14 +554,42 @@ static int32_t scap_write_userlist(scap_t *handle, gzFile f)
 	return SCAP_SUCCESS;
 }
 
+//
+// In live mode, rescan /proc to get the current process and fd tables
+//
+static int32_t scap_dump_refresh_proc_table(scap_t *handle)
+{
+#if defined(HAS_CAPTURE)
+	if(handle->m_file == NULL)
+	{
+		proc_entry_callback tcb = handle->m_proc_callback;
+		handle->m_proc_callback = NULL;
+
+		scap_proc_free_table(handle);
+		char filename[SCAP_MAX_PATH_SIZE];
+		snprintf(filename, sizeof(filename), "%s/proc", scap_get_host_root());
+		if(scap_proc_scan_proc_dir(handle, filename, -1, -1, NULL, handle->m_lasterr, true) != SCAP_SUCCESS)
+		{
+			handle->m_proc_callback = tcb;
+			return SCAP_FAILURE;
+		}
+
+		handle->m_proc_callback = tcb;
+	}
+#endif
+
+	return SCAP_SUCCESS;
+}
+
 //
 // Create the dump file headers and add the tables
 //
-static scap_dumper_t *scap_setup_dump(scap_t *handle, gzFile f, const char *fname)
+static scap_dumper_t *scap_setup_dump(scap_t *handle, scap_dumper_t *d, const char *fname)
 {
 	block_header bh;
 	section_header_block sh;
 	uint32_t bt;
+	gzFile f = d->m_f;
 
 	//
 	// Write the section header
@@ -548,24 +617,10 @@ static scap_dumper_t *scap_setup_dump(scap_t *handle, gzFile f, const char *fnam
 	// so we don't lose information about processes created in the interval
 	// between opening the handle and starting the dump
 	//
-#if defined(HAS_CAPTURE)
-	if(handle->m_file == NULL)
+	if(scap_dump_refresh_proc_table(handle) != SCAP_SUCCESS)
 	{
-		proc_entry_callback tcb = handle->m_proc_callback;
-		handle->m_proc_callback = NULL;
-
-		scap_proc_free_table(handle);
-		char filename[SCAP_MAX_PATH_SIZE];
-		snprintf(filename, sizeof(filename), "%s/proc", scap_get_host_root());
-		if(scap_proc_scan_proc_dir(handle, filename, -1, -1, NULL, handle->m_lasterr, true) != SCAP_SUCCESS)
-		{
-			handle->m_proc_callback = tcb;
-			return NULL;
-		}
-
-		handle->m_proc_callback = tcb;
+		return NULL;
 	}
-#endif
 
 	//
 	// Write the machine info
@@ -619,7 +674,279 @@ static scap_dumper_t *scap_setup_dump(scap_t *handle, gzFile f, const char *fnam
 	//
 	// Done, return the file
 	//
-	return (scap_dumper_t *)f;
+	return d;
+}
+
+#ifdef USE_ZLIB
+//
+// Compress the buffered events and write them as an ECB block
+//
+static int32_t scap_dump_flush_chunk(scap_dumper_t *d)
+{
+	block_header bh;
+	event_chunk_header ch;
+	chunk_index_entry* entry;
+	uLongf zlen;
+	uint32_t bt;
+	int64_t offset;
+
+	if(d->m_chunk_nevts == 0)
+	{
+		return SCAP_SUCCESS;
+	}
+
+	zlen = compressBound(d->m_chunk_len);
+	if(zlen > d->m_zbuf_size)
+	{
+		char* zbuf = (char*)realloc(d->m_zbuf, zlen);
+		if(zbuf == NULL)
+		{
+			return SCAP_FAILURE;
+		}
+
+		d->m_zbuf = zbuf;
+		d->m_zbuf_size = (uint32_t)zlen;
+	}
+
+	if(compress2((Bytef*)d->m_zbuf, &zlen, (Bytef*)d->m_chunk_buf, d->m_chunk_len, Z_DEFAULT_COMPRESSION) != Z_OK)
+	{
+		return SCAP_FAILURE;
+	}
+
+	if(d->m_index_len == d->m_index_size)
+	{
+		uint32_t size = (d->m_index_size == 0)? 256 : d->m_index_size * 2;
+		chunk_index_entry* index = (chunk_index_entry*)realloc(d->m_index, size * sizeof(chunk_index_entry));
+		if(index == NULL)
+		{
+			return SCAP_FAILURE;
+		}
+
+		d->m_index = index;
+		d->m_index_size = size;
+	}
+
+	ch.uncompressed_len = d->m_chunk_len;
+	ch.compressed_len = (uint32_t)zlen;
+	ch.nevts = d->m_chunk_nevts;
+	ch.reserved = 0;
+	ch.first_ts = d->m_chunk_first_ts;
+	ch.last_ts = d->m_chunk_last_ts;
+
+	bh.block_type = ECB_BLOCK_TYPE;
+	bh.block_total_length = scap_normalize_block_len(sizeof(block_header) + sizeof(ch) + ch.compressed_len + 4);
+	bt = bh.block_total_length;
+
+	//
+	// The file is not compressed, so the uncompressed position is the file offset
+	//
+	offset = gztell(d->m_f);
+
+	if(gzwrite(d->m_f, &bh, sizeof(bh)) != sizeof(bh) ||
+		gzwrite(d->m_f, &ch, sizeof(ch)) != sizeof(ch) ||
+		gzwrite(d->m_f, d->m_zbuf, ch.compressed_len) != (int)ch.compressed_len ||
+		scap_write_padding(d->m_f, sizeof(ch) + ch.compressed_len) != SCAP_SUCCESS ||
+		gzwrite(d->m_f, &bt, sizeof(bt)) != sizeof(bt))
+	{
+		return SCAP_FAILURE;
+	}
+
+	entry = &d->m_index[d->m_index_len++];
+	entry->offset = offset;
+	entry->block_total_length = bh.block_total_length;
+	entry->nevts = ch.nevts;
+	entry->first_ts = ch.first_ts;
+	entry->last_ts = ch.last_ts;
+	entry->snapshot_offset = d->m_snapshot_offset;
+
+	d->m_chunk_len = 0;
+	d->m_chunk_nevts = 0;
+	d->m_snapshot_offset = 0;
+
+	return SCAP_SUCCESS;
+}
+
+#if defined(HAS_CAPTURE)
+static void* scap_dump_snapshot_thread(void* arg)
+{
+	scap_dumper_t* d = (scap_dumper_t*)arg;
+	scap_t* h = d->m_snapshot_handle;
+	char filename[SCAP_MAX_PATH_SIZE];
+	int32_t res;
+
+	snprintf(filename, sizeof(filename), "%s/proc", scap_get_host_root());
+	res = scap_proc_scan_proc_dir(h, filename, -1, -1, NULL, h->m_lasterr, true);
+
+	pthread_mutex_lock(&d->m_snapshot_mutex);
+	d->m_snapshot_res = res;
+	d->m_snapshot_done = true;
+	pthread_mutex_unlock(&d->m_snapshot_mutex);
+
+	return NULL;
+}
+
+//
+// Start the /proc scan of a state snapshot. The tables come from a fresh
+// scan of /proc, so this is only done for live captures.
+//
+static int32_t scap_dump_start_snapshot(scap_t *handle, scap_dumper_t *d)
+{
+	scap_t* h;
+
+	d->m_last_snapshot_ts = d->m_chunk_last_ts;
+
+	if(handle->m_file != NULL)
+	{
+		return SCAP_SUCCESS;
+	}
+
+	h = (scap_t*)calloc(1, sizeof(scap_t));
+	if(h == NULL)
+	{
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "error allocating the snapshot handle");
+		return SCAP_FAILURE;
+	}
+
+	h->m_devs = handle->m_devs;
+	h->m_ndevs = handle->m_ndevs;
+	h->m_skip_proc_fds = handle->m_skip_proc_fds;
+
+	d->m_snapshot_handle = h;
+	d->m_snapshot_done = false;
+
+	if(pthread_create(&d->m_snapshot_thread, NULL, scap_dump_snapshot_thread, d) != 0)
+	{
+		d->m_snapshot_handle = NULL;
+		free(h);
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "error starting the snapshot thread");
+		return SCAP_FAILURE;
+	}
+
+	return SCAP_SUCCESS;
+}
+
+//
+// Wait for the /proc scan and free its tables
+//
+static void scap_dump_end_snapshot(scap_dumper_t *d)
+{
+	pthread_join(d->m_snapshot_thread, NULL);
+
+	scap_proc_free_table(d->m_snapshot_handle);
+	free(d->m_snapshot_handle);
+	d->m_snapshot_handle = NULL;
+}
+
+//
+// If the /proc scan has completed, write the snapshot between two chunks.
+// The events captured during the scan are in the chunks before the snapshot,
+// but a /proc scan is never consistent with the events to begin with. A scan
+// that fails is skipped, and the next one starts after the interval.
+//
+static int32_t scap_dump_write_snapshot(scap_t *handle, scap_dumper_t *d)
+{
+	scap_t* h = d->m_snapshot_handle;
+	int64_t offset;
+	bool done;
+	int32_t res = SCAP_SUCCESS;
+
+	pthread_mutex_lock(&d->m_snapshot_mutex);
+	done = d->m_snapshot_done;
+	pthread_mutex_unlock(&d->m_snapshot_mutex);
+
+	if(!done)
+	{
+		return SCAP_SUCCESS;
+	}
+
+	if(d->m_snapshot_res == SCAP_SUCCESS)
+	{
+		offset = gztell(d->m_f);
+
+		if(scap_write_proclist(h, d->m_f) != SCAP_SUCCESS ||
+			scap_write_fdlist(h, d->m_f) != SCAP_SUCCESS)
+		{
+			snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "%s", h->m_lasterr);
+			res = SCAP_FAILURE;
+		}
+		else
+		{
+			d->m_snapshot_offset = offset;
+		}
+	}
+
+	scap_dump_end_snapshot(d);
+	return res;
+}
+#endif // HAS_CAPTURE
+
+//
+// Write the chunk index block at the end of a chunked file
+//
+static int32_t scap_dump_write_chunk_index(scap_dumper_t *d)
+{
+	block_header bh;
+	uint32_t bt;
+	uint32_t len = d->m_index_len * sizeof(chunk_index_entry);
+
+	bh.block_type = CIB_BLOCK_TYPE;
+	bh.block_total_length = scap_normalize_block_len(sizeof(block_header) + len + 4);
+	bt = bh.block_total_length;
+
+	if(gzwrite(d->m_f, &bh, sizeof(bh)) != sizeof(bh) ||
+		(len != 0 && gzwrite(d->m_f, d->m_index, len) != (int)len) ||
+		scap_write_padding(d->m_f, len) != SCAP_SUCCESS ||
+		gzwrite(d->m_f, &bt, sizeof(bt)) != sizeof(bt))
+	{
+		return SCAP_FAILURE;
+	}
+
+	return SCAP_SUCCESS;
+}
+#endif // USE_ZLIB
+
+//
+// Write to a dump file. In chunked mode, the data is accumulated in the
+// current chunk.
+//
+static int scap_dump_write(scap_dumper_t *d, void* buf, uint32_t len)
+{
+	if(d->m_chunk_buf != NULL)
+	{
+		if(d->m_chunk_len + len > d->m_chunk_size)
+		{
+			uint32_t size = d->m_chunk_size * 2 + len;
+			char* chunk_buf = (char*)realloc(d->m_chunk_buf, size);
+			if(chunk_buf == NULL)
+			{
+				return -1;
+			}
+
+			d->m_chunk_buf = chunk_buf;
+			d->m_chunk_size = size;
+		}
+
+		memcpy(d->m_chunk_buf + d->m_chunk_len, buf, len);
+		d->m_chunk_len += len;
+		return (int)len;
+	}
+
+	return gzwrite(d->m_f, buf, len);
+}
+
+static int32_t scap_dump_write_padding(scap_dumper_t *d, uint32_t blocklen)
+{
+	int32_t val = 0;
+	uint32_t bytestowrite = scap_normalize_block_len(blocklen) - blocklen;
+
+	if(scap_dump_write(d, &val, bytestowrite) == (int)bytestowrite)
+	{
+		return SCAP_SUCCESS;
+	}
+	else
+	{
+		return SCAP_FAILURE;
+	}
 }
 
 //
@@ -630,6 +957,8 @@ scap_dumper_t *scap_dump_open(scap_t *handle, const char *fname, compression_mod
 	gzFile f = NULL;
 	int fd = -1;
 	const char* mode;
+	scap_dumper_t* d;
+	scap_dumper_t* res;
 
 	switch(compress)
 	{
@@ -639,6 +968,14 @@ scap_dumper_t *scap_dump_open(scap_t *handle, const char *fname, compression_mod
 	case SCAP_COMPRESSION_NONE:
 		mode = "wbT";
 		break;
+#ifdef USE_ZLIB
+	case SCAP_COMPRESSION_CHUNKED:
+		//
+		// The chunks are compressed individually, the file itself is not
+		//
+		mode = "wbT";
+		break;
+#endif
 	default:
 		ASSERT(false);
 		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "invalid compression mode");
@@ -676,7 +1013,43 @@ scap_dumper_t *scap_dump_open(scap_t *handle, const char *fname, compression_mod
 		return NULL;
 	}
 
-	return scap_setup_dump(handle, f, fname);
+	d = (scap_dumper_t*)calloc(1, sizeof(scap_dumper_t));
+	if(d == NULL)
+	{
+		gzclose(f);
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "error allocating the dumper");
+		return NULL;
+	}
+
+	d->m_f = f;
+#if defined(HAS_CAPTURE)
+	pthread_mutex_init(&d->m_snapshot_mutex, NULL);
+#endif
+
+	res = scap_setup_dump(handle, d, fname);
+	if(res == NULL)
+	{
+		scap_dump_close(d);
+		return NULL;
+	}
+
+	//
+	// From now on, the events are accumulated in chunks
+	//
+	if(compress == SCAP_COMPRESSION_CHUNKED)
+	{
+		d->m_snapshot_interval_ns = DUMP_SNAPSHOT_INTERVAL_NS;
+		d->m_chunk_size = DUMP_CHUNK_SIZE + FILE_READ_BUF_SIZE;
+		d->m_chunk_buf = (char*)malloc(d->m_chunk_size);
+		if(d->m_chunk_buf == NULL)
+		{
+			snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "error allocating the chunk buffer");
+			scap_dump_close(d);
+			return NULL;
+		}
+	}
+
+	return res;
 }
 
 //
@@ -684,7 +1057,33 @@ scap_dumper_t *scap_dump_open(scap_t *handle, const char *fname, compression_mod
 //
 void scap_dump_close(scap_dumper_t *d)
 {
-	gzclose((gzFile)d);
+#ifdef USE_ZLIB
+	if(d->m_chunk_buf != NULL)
+	{
+		scap_dump_flush_chunk(d);
+		scap_dump_write_chunk_index(d);
+		free(d->m_chunk_buf);
+		free(d->m_zbuf);
+		free(d->m_index);
+	}
+
+#if defined(HAS_CAPTURE)
+	//
+	// A snapshot that isn't complete yet is dropped
+	//
+	if(d->m_snapshot_handle != NULL)
+	{
+		scap_dump_end_snapshot(d);
+	}
+#endif
+#endif
+
+#if defined(HAS_CAPTURE)
+	pthread_mutex_destroy(&d->m_snapshot_mutex);
+#endif
+
+	gzclose(d->m_f);
+	free(d);
 }
 
 //
@@ -692,12 +1091,24 @@ void scap_dump_close(scap_dumper_t *d)
 //
 int64_t scap_dump_get_offset(scap_dumper_t *d)
 {
-	return gzoffset((gzFile)d);
+	return gzoffset(d->m_f);
 }
 
 void scap_dump_flush(scap_dumper_t *d)
 {
-	gzflush((gzFile)d, Z_FULL_FLUSH);
+#ifdef USE_ZLIB
+	if(d->m_chunk_buf != NULL)
+	{
+		scap_dump_flush_chunk(d);
+	}
+#endif
+
+	gzflush(d->m_f, Z_FULL_FLUSH);
+}
+
+void scap_dump_set_snapshot_interval(scap_dumper_t *d, uint64_t interval_ns)
+{
+	d->m_snapshot_interval_ns = interval_ns;
 }
 
 //
@@ -717,7 +1128,6 @@ int32_t scap_dump(scap_t *handle, scap_dumper_t *d, scap_evt *e, uint16_t cpuid,
 {
 	block_header bh;
 	uint32_t bt;
-	gzFile f = (gzFile)d;
 
 	if(flags == 0)
 	{
@@ -728,11 +1138,11 @@ int32_t scap_dump(scap_t *handle, scap_dumper_t *d, scap_evt *e, uint16_t cpuid,
 		bh.block_total_length = scap_normalize_block_len(sizeof(block_header) + sizeof(cpuid) + e->len + 4);
 		bt = bh.block_total_length;
 
-		if(gzwrite(f, &bh, sizeof(bh)) != sizeof(bh) ||
-				gzwrite(f, &cpuid, sizeof(cpuid)) != sizeof(cpuid) ||
-				gzwrite(f, e, e->len) != e->len ||
-				scap_write_padding(f, sizeof(cpuid) + e->len) != SCAP_SUCCESS ||
-				gzwrite(f, &bt, sizeof(bt)) != sizeof(bt))
+		if(scap_dump_write(d, &bh, sizeof(bh)) != sizeof(bh) ||
+				scap_dump_write(d, &cpuid, sizeof(cpuid)) != sizeof(cpuid) ||
+				scap_dump_write(d, e, e->len) != (int)e->len ||
+				scap_dump_write_padding(d, sizeof(cpuid) + e->len) != SCAP_SUCCESS ||
+				scap_dump_write(d, &bt, sizeof(bt)) != sizeof(bt))
 		{
 			snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "error writing to file (6)");
 			return SCAP_FAILURE;
@@ -747,23 +1157,73 @@ int32_t scap_dump(scap_t *handle, scap_dumper_t *d, scap_evt *e, uint16_t cpuid,
 		bh.block_total_length = scap_normalize_block_len(sizeof(block_header) + sizeof(cpuid) + sizeof(flags) + e->len + 4);
 		bt = bh.block_total_length;
 
-		if(gzwrite(f, &bh, sizeof(bh)) != sizeof(bh) ||
-				gzwrite(f, &cpuid, sizeof(cpuid)) != sizeof(cpuid) ||
-				gzwrite(f, &flags, sizeof(flags)) != sizeof(flags) ||
-				gzwrite(f, e, e->len) != e->len ||
-				scap_write_padding(f, sizeof(cpuid) + e->len) != SCAP_SUCCESS ||
-				gzwrite(f, &bt, sizeof(bt)) != sizeof(bt))
+		if(scap_dump_write(d, &bh, sizeof(bh)) != sizeof(bh) ||
+				scap_dump_write(d, &cpuid, sizeof(cpuid)) != sizeof(cpuid) ||
+				scap_dump_write(d, &flags, sizeof(flags)) != sizeof(flags) ||
+				scap_dump_write(d, e, e->len) != (int)e->len ||
+				scap_dump_write_padding(d, sizeof(cpuid) + e->len) != SCAP_SUCCESS ||
+				scap_dump_write(d, &bt, sizeof(bt)) != sizeof(bt))
 		{
 			snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "error writing to file (6)");
 			return SCAP_FAILURE;
 		}
 	}
 
+#ifdef USE_ZLIB
+	if(d->m_chunk_buf != NULL)
+	{
+		if(d->m_chunk_nevts == 0)
+		{
+			d->m_chunk_first_ts = e->ts;
+
+			//
+			// The header tables are the snapshot for the beginning of the file
+			//
+			if(d->m_last_snapshot_ts == 0)
+			{
+				d->m_last_snapshot_ts = e->ts;
+			}
+		}
+
+		d->m_chunk_last_ts = e->ts;
+		d->m_chunk_nevts++;
+
+		if(d->m_chunk_len >= DUMP_CHUNK_SIZE)
+		{
+			if(scap_dump_flush_chunk(d) != SCAP_SUCCESS)
+			{
+				snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "error writing to file (7)");
+				return SCAP_FAILURE;
+			}
+
+#if defined(HAS_CAPTURE)
+			//
+			// The /proc scan runs in the background, and the snapshot is
+			// written after the first chunk that completes after it
+			//
+			if(d->m_snapshot_handle != NULL)
+			{
+				if(scap_dump_write_snapshot(handle, d) != SCAP_SUCCESS)
+				{
+					return SCAP_FAILURE;
+				}
+			}
+			else if(d->m_snapshot_interval_ns != 0 &&
+				d->m_chunk_last_ts - d->m_last_snapshot_ts >= d->m_snapshot_interval_ns &&
+				scap_dump_start_snapshot(handle, d) != SCAP_SUCCESS)
+			{
+				return SCAP_FAILURE;
+			}
+#endif
+		}
+	}
+#endif
+
 	//
 	// Enable this to make sure that everything is saved to disk during the tests
 	//
 #if 0
-	fflush(f);
+	fflush(d->m_f);
 #endif
 
 	return SCAP_SUCCESS;
@@ -1790,6 +2250,7 @@ int32_t scap_read_init(scap_t *handle, gzFile f)
 	int8_t found_il = 0;
 	int8_t found_ul = 0;
 	int8_t found_ev = 0;
+	int8_t found_chunks = 0;
 
 	//
 	// Read the section header block
@@ -1868,6 +2329,11 @@ int32_t scap_read_init(scap_t *handle, gzFile f)
 				return SCAP_FAILURE;
 			}
 			break;
+#ifdef USE_ZLIB
+		case ECB_BLOCK_TYPE:
+			found_chunks = 1;
+			// fall through
+#endif
 		case EV_BLOCK_TYPE:
 		case EV_BLOCK_TYPE_INT:
 		case EVF_BLOCK_TYPE:
@@ -1970,9 +2436,92 @@ int32_t scap_read_init(scap_t *handle, gzFile f)
 		return SCAP_FAILURE;
 	}
 
+#ifdef USE_ZLIB
+	//
+	// The events are in compressed chunks, start decompressing them
+	//
+	if(found_chunks)
+	{
+		return scap_chunk_reader_open(handle, f);
+	}
+#endif
+
 	return SCAP_SUCCESS;
 }
 
+//
+// Load the process and fd list blocks that start at the current position of
+// the file, stopping at the first event chunk.
+//
+int32_t scap_read_state(scap_t *handle, gzFile f)
+{
+	block_header bh;
+	uint32_t bt;
+	size_t readsize;
+	int fseekres;
+
+	while(true)
+	{
+		readsize = gzread(f, &bh, sizeof(bh));
+		CHECK_READ_SIZE(readsize, sizeof(bh));
+
+		switch(bh.block_type)
+		{
+		case PL_BLOCK_TYPE_V1:
+		case PL_BLOCK_TYPE_V2:
+		case PL_BLOCK_TYPE_V3:
+		case PL_BLOCK_TYPE_V4:
+		case PL_BLOCK_TYPE_V1_INT:
+		case PL_BLOCK_TYPE_V2_INT:
+		case PL_BLOCK_TYPE_V3_INT:
+			if(scap_read_proclist(handle, f, bh.block_total_length - sizeof(block_header) - 4, bh.block_type) != SCAP_SUCCESS)
+			{
+				return SCAP_FAILURE;
+			}
+			break;
+		case FDL_BLOCK_TYPE:
+		case FDL_BLOCK_TYPE_INT:
+			if(scap_read_fdlist(handle, f, bh.block_total_length - sizeof(block_header) - 4) != SCAP_SUCCESS)
+			{
+				return SCAP_FAILURE;
+			}
+			break;
+		case ECB_BLOCK_TYPE:
+		case CIB_BLOCK_TYPE:
+			fseekres = gzseek(f, (long)0 - sizeof(bh), SEEK_CUR);
+			if(fseekres == -1)
+			{
+				snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "error seeking in file");
+				return SCAP_FAILURE;
+			}
+
+			return SCAP_SUCCESS;
+		default:
+			//
+			// The other header blocks are not part of the state
+			//
+			fseekres = (int)gzseek(f, (long)(bh.block_total_length - sizeof(block_header) - 4), SEEK_CUR);
+			if(fseekres == -1)
+			{
+				snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "error seeking in file");
+				return SCAP_FAILURE;
+			}
+			break;
+		}
+
+		readsize = gzread(f, &bt, sizeof(bt));
+		CHECK_READ_SIZE(readsize, sizeof(bt));
+
+		if(bt != bh.block_total_length)
+		{
+			snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "wrong block total length, header=%u, trailer=%u",
+			         bh.block_total_length,
+			         bt);
+			return SCAP_FAILURE;
+		}
+	}
+}
+
 //
 // Read an event from disk
 //
@@ -1985,6 +2534,20 @@ int32_t scap_next_offline(scap_t *handle, OUT scap_evt **pevent, OUT uint16_t *p
 
 	ASSERT(f != NULL);
 
+#ifdef USE_ZLIB
+	if(handle->m_chunk_reader != NULL)
+	{
+		return scap_chunk_reader_next(handle, pevent, pcpuid);
+	}
+#endif
+
+#ifndef _WIN32
+	if(handle->m_mmap_reader != NULL)
+	{
+		return scap_mmap_reader_next(handle, pevent, pcpuid);
+	}
+#endif
+
 	//
 	// Read the block header
 	//
@@ -121,6 +121,45 @@ typedef struct _section_header_block
 ///////////////////////////////////////////////////////////////////////////////
 #define EVF_BLOCK_TYPE	0x208
 
+///////////////////////////////////////////////////////////////////////////////
+// EVENT CHUNK BLOCK
+///////////////////////////////////////////////////////////////////////////////
+// A run of EV/EVF blocks compressed as a standalone zlib stream, so that each
+// chunk can be decompressed independently from the others.
+// The block contains an event_chunk_header followed by the compressed data.
+// The files that contain chunks are not gzip compressed as a whole.
+#define ECB_BLOCK_TYPE	0x211
+
+typedef struct _event_chunk_header
+{
+	uint32_t uncompressed_len;
+	uint32_t compressed_len;
+	uint32_t nevts;
+	uint32_t reserved;
+	uint64_t first_ts;
+	uint64_t last_ts;
+}event_chunk_header;
+
+///////////////////////////////////////////////////////////////////////////////
+// CHUNK INDEX BLOCK
+///////////////////////////////////////////////////////////////////////////////
+// Written after the last event chunk when the file is closed. It contains one
+// chunk_index_entry for every ECB block in the file.
+// Between two chunks there can be a state snapshot, made of the process list
+// and fd list blocks of the system at that point of the capture. Snapshots
+// make it possible to start reading from the middle of the file.
+#define CIB_BLOCK_TYPE	0x212
+
+typedef struct _chunk_index_entry
+{
+	uint64_t offset; // File offset of the ECB block
+	uint32_t block_total_length;
+	uint32_t nevts;
+	uint64_t first_ts;
+	uint64_t last_ts;
+	uint64_t snapshot_offset; // File offset of the state snapshot right before this chunk, 0 if there's none
+}chunk_index_entry;
+
 #if defined __sun
 #pragma pack()
 #else
@@ -0,0 +1,263 @@
+/*
+Copyright (C) 2013-2014 Draios inc.
+
+This file is part of sysdig.
+
+sysdig is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License version 2 as
+published by the Free Software Foundation.
+
+sysdig is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sysdig.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _WIN32
+#include <unistd.h>
+#else
+#include <io.h>
+#define isatty _isatty
+#define fileno _fileno
+#endif
+
+#include "sinsp.h"
+#include "sinsp_int.h"
+
+sinsp_buffered_writer::sinsp_buffered_writer(FILE* f, uint32_t bufsize)
+{
+	m_file = f;
+	m_nwrites = 0;
+	m_last_flush_ns = 0;
+	m_use_thread = false;
+	m_len = 0;
+	m_wlen = 0;
+	m_stop = false;
+	m_buf.resize(bufsize);
+	m_wbuf.resize(bufsize);
+
+	//
+	// Somebody is watching the output of a terminal, so it's written as soon
+	// as it's produced and the line buffering of stdio is left alone.
+	// Everything else gets a big buffer. The stream uses it until the
+	// process exits, so it's never freed.
+	//
+	if(isatty(fileno(f)))
+	{
+		set_flush_policy(FP_IMMEDIATE, 0);
+	}
+	else
+	{
+		setvbuf(f, new char[bufsize], _IOFBF, bufsize);
+		set_flush_policy(FP_TIME, DEFAULT_OUTPUT_FLUSH_INTERVAL_MS);
+	}
+}
+
+sinsp_buffered_writer::~sinsp_buffered_writer()
+{
+	stop_thread();
+	fflush(m_file);
+}
+
+void sinsp_buffered_writer::set_flush_policy(flush_policy policy, uint64_t value)
+{
+	m_policy = policy;
+	m_flush_lines = (policy == FP_LINES)? value : 0;
+	m_flush_interval_ns = (policy == FP_TIME)? value * 1000000 : 0;
+}
+
+void sinsp_buffered_writer::start_thread()
+{
+	if(m_use_thread)
+	{
+		return;
+	}
+
+	fflush(m_file);
+	m_stop = false;
+	m_use_thread = true;
+	m_thread = std::thread(&sinsp_buffered_writer::run, this);
+}
+
+void sinsp_buffered_writer::stop_thread()
+{
+	if(!m_use_thread)
+	{
+		return;
+	}
+
+	handoff(true);
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stop = true;
+	}
+
+	m_cond.notify_all();
+	m_thread.join();
+	m_use_thread = false;
+}
+
+inline bool sinsp_buffered_writer::should_flush(uint64_t* now)
+{
+	switch(m_policy)
+	{
+	case FP_IMMEDIATE:
+		return true;
+	case FP_LINES:
+		return m_nwrites >= m_flush_lines;
+	case FP_TIME:
+		*now = sinsp_utils::get_current_time_ns();
+		return *now - m_last_flush_ns >= m_flush_interval_ns;
+	default:
+		ASSERT(false);
+		return true;
+	}
+}
+
+void sinsp_buffered_writer::write(const char* buf, uint32_t len)
+{
+	uint64_t now = 0;
+
+	//
+	// Write errors are ignored, like they were when the output went
+	// through cout
+	//
+	if(m_use_thread)
+	{
+		if(m_len + len > m_buf.size())
+		{
+			handoff(false);
+
+			if(len > m_buf.size())
+			{
+				m_buf.resize(len);
+			}
+		}
+
+		memcpy(&m_buf[m_len], buf, len);
+		m_len += len;
+	}
+	else
+	{
+		fwrite(buf, 1, len, m_file);
+	}
+
+	m_nwrites++;
+
+	if(should_flush(&now))
+	{
+		if(m_use_thread)
+		{
+			handoff(false);
+		}
+		else
+		{
+			fflush(m_file);
+		}
+
+		m_nwrites = 0;
+		m_last_flush_ns = now;
+	}
+}
+
+void sinsp_buffered_writer::check_flush()
+{
+	uint64_t now;
+
+	//
+	// Don't look at m_nwrites, since the chisels write to the stream without
+	// going through write()
+	//
+	if(m_policy == FP_TIME && should_flush(&now))
+	{
+		flush();
+		m_last_flush_ns = now;
+	}
+}
+
+void sinsp_buffered_writer::flush()
+{
+	if(m_use_thread)
+	{
+		handoff(true);
+	}
+	else
+	{
+		fflush(m_file);
+	}
+
+	m_nwrites = 0;
+}
+
+//
+// Hands the data collected in m_buf to the writer thread, once it's done
+// with the previous batch. With wait, it also waits until the data has been
+// written and flushed.
+//
+void sinsp_buffered_writer::handoff(bool wait)
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	while(m_wlen != 0)
+	{
+		m_cond.wait(lock);
+	}
+
+	if(m_len == 0)
+	{
+		return;
+	}
+
+	m_buf.swap(m_wbuf);
+	m_wlen = m_len;
+	m_len = 0;
+	m_cond.notify_all();
+
+	if(m_buf.size() < m_wbuf.size())
+	{
+		m_buf.resize(m_wbuf.size());
+	}
+
+	if(wait)
+	{
+		while(m_wlen != 0)
+		{
+			m_cond.wait(lock);
+		}
+	}
+}
+
+void sinsp_buffered_writer::run()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	while(true)
+	{
+		while(m_wlen == 0 && !m_stop)
+		{
+			m_cond.wait(lock);
+		}
+
+		if(m_wlen == 0)
+		{
+			break;
+		}
+
+		//
+		// The producer doesn't touch m_wbuf until m_wlen goes back to 0, so
+		// the write can happen without holding the lock
+		//
+		uint32_t len = m_wlen;
+		lock.unlock();
+		fwrite(&m_wbuf[0], 1, len, m_file);
+		fflush(m_file);
+		lock.lock();
+
+		m_wlen = 0;
+		m_cond.notify_all();
+	}
+}
@@ -0,0 +1,135 @@
+/*
+Copyright (C) 2013-2014 Draios inc.
+
+This file is part of sysdig.
+
+sysdig is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License version 2 as
+published by the Free Software Foundation.
+
+sysdig is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sysdig.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+/** @defgroup event Event manipulation
+ *  @{
+ */
+
+/*!
+  \brief Buffered writer for the event output.
+  sysdig and the chisels write their output through this class, which gives
+  the stream a large buffer and flushes it based on a policy, instead of
+  flushing it after every event. The buffer is also flushed when it's full.
+  Anything else written to the stream, e.g. by the Lua chisels, goes through
+  the same buffer, so the order of the output is preserved.
+
+  Optionally, the output can be written by a dedicated thread, so that the
+  formatting of the events and the I/O overlap. In that case the writes are
+  collected in a buffer of the writer and handed to the thread, and nothing
+  else must use the stream until flush() or stop_thread() are called.
+*/
+class SINSP_PUBLIC sinsp_buffered_writer : public sinsp_writer
+{
+public:
+	enum flush_policy
+	{
+		FP_IMMEDIATE = 0, ///< Flush after every write. The default for terminals.
+		FP_LINES = 1, ///< Flush every N writes.
+		FP_TIME = 2, ///< Flush at most every N milliseconds. The default, with DEFAULT_OUTPUT_FLUSH_INTERVAL_MS, for files and pipes.
+	};
+
+	/*!
+	  \brief Constructs a writer for the given stream.
+
+	  \param f The stream. Unless it's a terminal, it gets a buffer of
+	   bufsize bytes, which it keeps using after the writer is destroyed,
+	   so there should be a single writer for a stream.
+	  \param bufsize The size of the buffer of the stream, and of the buffers
+	   handed to the writer thread.
+	*/
+	sinsp_buffered_writer(FILE* f, uint32_t bufsize = OUTPUT_BUFFER_SIZE);
+	~sinsp_buffered_writer();
+
+	/*!
+	  \brief Sets when the output is flushed.
+
+	  \param policy The flush policy.
+	  \param value The number of writes for FP_LINES, the interval in
+	   milliseconds for FP_TIME.
+	*/
+	void set_flush_policy(flush_policy policy, uint64_t value);
+
+	/*!
+	  \brief Starts writing the output on a dedicated thread.
+	*/
+	void start_thread();
+
+	/*!
+	  \brief Writes the pending output and stops the writer thread.
+	*/
+	void stop_thread();
+
+	/*!
+	  \brief Writes len bytes of output.
+	*/
+	void write(const char* buf, uint32_t len);
+
+	/*!
+	  \brief Flushes the output if the FP_TIME interval has expired. Call it
+	   when there are no writes for a while, e.g. on capture timeouts or for
+	   events that are filtered out, so that the output doesn't sit in the
+	   buffer. It also flushes what was written to the stream directly, e.g.
+	   by the prints of the Lua chisels.
+	*/
+	void check_flush();
+
+	/*!
+	  \brief Flushes the output. With the writer thread, waits until it has
+	   been written.
+	*/
+	void flush();
+
+private:
+	inline bool should_flush(uint64_t* now);
+	void handoff(bool wait);
+	void run();
+
+	FILE* m_file;
+	flush_policy m_policy;
+	uint64_t m_flush_lines;
+	uint64_t m_flush_interval_ns;
+	// Writes since the last flush
+	uint64_t m_nwrites;
+	uint64_t m_last_flush_ns;
+
+	//
+	// The writer thread writes m_wbuf while the producer fills m_buf, and the
+	// two are swapped when the producer flushes.
+	//
+	bool m_use_thread;
+	std::thread m_thread;
+	std::mutex m_mutex;
+	std::condition_variable m_cond;
+	vector<char> m_buf;
+	uint32_t m_len;
+
+	//
+	// Protected by m_mutex. m_wlen is 0 when the thread is idle.
+	//
+	vector<char> m_wbuf;
+	uint32_t m_wlen;
+	bool m_stop;
+};
+
+/*@}*/
@@ -232,6 +232,7 @@ sinsp_chisel::sinsp_chisel(sinsp* inspector, string filename)
 	m_lua_has_handle_evt = false;
 	m_lua_is_first_evt = true;
 	m_lua_cinfo = NULL;
+	m_writer = NULL;
 	m_lua_last_interval_sample_time = 0;
 	m_lua_last_interval_ts = 0;
 
@@ -1431,7 +1432,11 @@ bool sinsp_chisel::run(sinsp_evt* evt)
 	//
 	if(m_lua_cinfo->m_formatter != NULL)
 	{
-		if(m_lua_cinfo->m_formatter->tostring(evt, &line))
+		if(m_writer != NULL)
+		{
+			m_lua_cinfo->m_formatter->write(evt, m_writer, true);
+		}
+		else if(m_lua_cinfo->m_formatter->tostring(evt, &line))
 		{
 			cout << line << endl;
 		}
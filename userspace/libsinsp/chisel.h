@@ -122,6 +122,14 @@ public:
 	void on_capture_start();
 	void on_capture_end();
 	bool get_nextrun_args(OUT string* args);
+	//
+	// Makes the formatter output of the chisel go through the given writer
+	// instead of cout
+	//
+	void set_output_writer(sinsp_writer* writer)
+	{
+		m_writer = writer;
+	}
 	chisel_desc* get_lua_script_info()
 	{
 		return &m_lua_script_info;
@@ -151,6 +159,7 @@ private:
 	char m_lua_fld_storage[1024];
 	chiselinfo* m_lua_cinfo;
 	string m_new_chisel_to_exec;
+	sinsp_writer* m_writer;
 
 	friend class lua_cbacks;
 };
@@ -624,7 +624,7 @@ int lua_cbacks::get_machine_info(lua_State *ls)
 int lua_cbacks::get_thread_table(lua_State *ls) 
 {
 	threadinfo_map_iterator_t it;
-	unordered_map<int64_t, sinsp_fdinfo_t>::iterator fdit;
+	sinsp_fdtable::iterator fdit;
 	uint32_t j;
 	sinsp_filter* filter = NULL;
 	sinsp_evt tevt;
@@ -692,7 +692,7 @@ int lua_cbacks::get_thread_table(lua_State *ls)
 		{
 			bool match = false;
 
-			for(fdit = fdtable->m_table.begin(); fdit != fdtable->m_table.end(); ++fdit)
+			for(fdit = fdtable->begin(); fdit != fdtable->end(); ++fdit)
 			{
 				tevt.m_tinfo = &(it->second);
 				tevt.m_fdinfo = &(fdit->second);
@@ -834,7 +834,7 @@ int lua_cbacks::get_thread_table(lua_State *ls)
 		//
 		lua_pushstring(ls, "fdtable");
 		lua_newtable(ls);
-		for(fdit = fdtable->m_table.begin(); fdit != fdtable->m_table.end(); ++fdit)
+		for(fdit = fdtable->begin(); fdit != fdtable->end(); ++fdit)
 		{
 			tevt.m_tinfo = &(it->second);
 			tevt.m_fdinfo = &(fdit->second);
@@ -989,7 +989,7 @@ int lua_cbacks::get_thread_table(lua_State *ls)
 
 int lua_cbacks::get_container_table(lua_State *ls) 
 {
-	unordered_map<int64_t, sinsp_fdinfo_t>::iterator fdit;
+	sinsp_fdtable::iterator fdit;
 	uint32_t j;
 	sinsp_evt tevt;
 
@@ -25,57 +25,215 @@ along with sysdig.  If not, see <http://www.gnu.org/licenses/>.
 #include "sinsp.h"
 #include "sinsp_int.h"
 #include "container.h"
+#include "containerresolver.h"
 
 sinsp_container_manager::sinsp_container_manager(sinsp* inspector) :
 	m_inspector(inspector),
-	m_last_flush_time_ns(0)
+	m_last_flush_time_ns(0),
+	m_scan_in_progress(false),
+	m_scan_pos(0),
+	m_resolver(NULL)
 {
 }
 
-bool sinsp_container_manager::remove_inactive_containers()
+sinsp_container_manager::~sinsp_container_manager()
+{
+	stop_metadata_resolver();
+}
+
+void sinsp_container_manager::start_metadata_resolver()
+{
+	if(m_resolver == NULL)
+	{
+		m_resolver = new sinsp_container_resolver(m_inspector, get_docker_socket_path());
+	}
+}
+
+void sinsp_container_manager::stop_metadata_resolver()
+{
+	if(m_resolver != NULL)
+	{
+		delete m_resolver;
+		m_resolver = NULL;
+	}
+}
+
+void sinsp_container_manager::set_docker_socket_path(const string& path)
+{
+	m_docker_socket_path = path;
+}
+
+string sinsp_container_manager::get_docker_socket_path()
+{
+	if(m_docker_socket_path.empty())
+	{
+		return string(scap_get_host_root()) + "/var/run/docker.sock";
+	}
+
+	return m_docker_socket_path;
+}
+
+void sinsp_container_manager::process_metadata_results()
+{
+	if(m_resolver != NULL && m_resolver->has_results())
+	{
+		m_resolver->process_results();
+	}
+}
+
+void sinsp_container_manager::complete_metadata_fetch(const sinsp_container_info& container_info, bool success)
+{
+	unordered_map<string, sinsp_container_info>::iterator it = m_containers.find(container_info.m_id);
+
+	if(it == m_containers.end())
+	{
+		return;
+	}
+
+	if(success)
+	{
+		it->second = container_info;
+	}
+
+	it->second.m_metadata_pending = false;
+
+	add_container_event(it->second);
+}
+
+void sinsp_container_manager::add_container_event(const sinsp_container_info& container_info)
+{
+	//
+	// There's room for a single container event. When dumping, write the one
+	// that is still pending before reusing the buffer, which happens when the
+	// metadata of a container is fetched and the next event starts another.
+	//
+	if(m_inspector->m_meta_evt_pending && m_inspector->m_dumper != NULL)
+	{
+		int32_t res = scap_dump(m_inspector->m_h, m_inspector->m_dumper, m_inspector->m_meta_evt.m_pevt, m_inspector->m_meta_evt.m_cpuid, 0);
+		if(res != SCAP_SUCCESS)
+		{
+			throw sinsp_exception(scap_getlasterr(m_inspector->m_h));
+		}
+	}
+
+	m_inspector->m_meta_evt_pending = false;
+
+	if(container_to_sinsp_event(container_info, &m_inspector->m_meta_evt, SP_EVT_BUF_SIZE))
+	{
+		m_inspector->m_meta_evt_pending = true;
+	}
+}
+
+void sinsp_container_manager::reset_scan()
 {
-	bool res = false;
+	m_last_flush_time_ns = 0;
+	m_scan_in_progress = false;
+	m_scan_pos = 0;
+	m_containers_in_use.clear();
+}
 
+bool sinsp_container_manager::remove_inactive_containers()
+{
 	if(m_last_flush_time_ns == 0)
 	{
 		m_last_flush_time_ns = m_inspector->m_lastevent_ts - m_inspector->m_inactive_container_scan_time_ns + 30 * ONE_SECOND_IN_NS;
+
+#ifdef GATHER_INTERNAL_STATS
+		//
+		// The stats are constructed after the container manager, so the
+		// counters are registered here
+		//
+		m_scan_passes = &m_inspector->m_stats.get_metrics_registry().register_counter(internal_metrics::metric_name("container_scan_passes","Inactive container table scans"));
+		m_scan_slices = &m_inspector->m_stats.get_metrics_registry().register_counter(internal_metrics::metric_name("container_scan_slices","Inactive container table scan slices"));
+		m_removed_containers = &m_inspector->m_stats.get_metrics_registry().register_counter(internal_metrics::metric_name("container_removed","Removed containers"));
+#endif
 	}
 
-	if(m_inspector->m_lastevent_ts > 
-		m_last_flush_time_ns + m_inspector->m_inactive_thread_scan_time_ns)
+	if(!m_scan_in_progress)
 	{
-		res = true;
+		if(m_inspector->m_lastevent_ts <= 
+			m_last_flush_time_ns + m_inspector->m_inactive_container_scan_time_ns)
+		{
+			return false;
+		}
 
 		m_last_flush_time_ns = m_inspector->m_lastevent_ts;
 
 		g_logger.format(sinsp_logger::SEV_INFO, "Flushing container table");
 
-		set<string> containers_in_use;
+		m_scan_in_progress = true;
+		m_scan_pos = 0;
+		m_containers_in_use.clear();
 
-		threadinfo_map_t* threadtable = m_inspector->m_thread_manager->get_threads();
+#ifdef GATHER_INTERNAL_STATS
+		m_scan_passes->increment();
+#endif
+	}
 
-		for(threadinfo_map_iterator_t it = threadtable->begin(); it != threadtable->end(); ++it)
+	return scan_inactive_containers();
+}
+
+bool sinsp_container_manager::scan_inactive_containers()
+{
+	threadinfo_map_t* threadtable = m_inspector->m_thread_manager->get_threads();
+	threadinfo_map_iterator_t it = threadtable->seek(m_scan_pos);
+	uint32_t nvisited = 0;
+
+#ifdef GATHER_INTERNAL_STATS
+	m_scan_slices->increment();
+#endif
+
+	for(; it != threadtable->end() && nvisited < m_inspector->m_inactive_scan_slice_entries; ++it)
+	{
+		if(!it->second.m_container_id.empty())
 		{
-			if(!it->second.m_container_id.empty())
-			{
-				containers_in_use.insert(it->second.m_container_id);
-			}
+			m_containers_in_use.insert(it->second.m_container_id);
 		}
 
-		for(unordered_map<string, sinsp_container_info>::iterator it = m_containers.begin(); it != m_containers.end();)
+		nvisited++;
+	}
+
+	if(it != threadtable->end())
+	{
+		m_scan_pos = it.get_pos();
+		return false;
+	}
+
+	for(unordered_map<string, sinsp_container_info>::iterator cit = m_containers.begin(); cit != m_containers.end();)
+	{
+		if(m_containers_in_use.find(cit->first) == m_containers_in_use.end())
 		{
-			if(containers_in_use.find(it->first) == containers_in_use.end())
-			{
-				m_containers.erase(it++);
-			}
-			else
+#ifdef GATHER_INTERNAL_STATS
+			m_removed_containers->increment();
+#endif
+			if(m_resolver != NULL)
 			{
-				++it;
+				m_resolver->remove(cit->first);
 			}
+
+			m_containers.erase(cit++);
+		}
+		else
+		{
+			++cit;
 		}
 	}
 
-	return res;
+	for(unordered_map<string, sinsp_cgroup_set_ptr>::iterator sit = m_cgroup_sets.begin(); sit != m_cgroup_sets.end();)
+	{
+		if(sit->second.use_count() == 1)
+		{
+			m_cgroup_sets.erase(sit++);
+		}
+		else
+		{
+			++sit;
+		}
+	}
+
+	m_containers_in_use.clear();
+	m_scan_in_progress = false;
+	return true;
 }
 
 bool sinsp_container_manager::get_container(const string& id, sinsp_container_info* container_info)
@@ -90,11 +248,77 @@ bool sinsp_container_manager::get_container(const string& id, sinsp_container_in
 	return false;
 }
 
-bool sinsp_container_manager::resolve_container_from_cgroups(const vector<pair<string, string>>& cgroups, bool query_os_for_missing_info, string* container_id)
+void sinsp_cgroup_set::parse(const char* cgroups, size_t len)
 {
-	bool valid_id = false;
+	size_t offset = 0;
+	while(offset < len)
+	{
+		const char* str = cgroups + offset;
+		const char* sep = strchr(str, '=');
+		if(sep == NULL)
+		{
+			ASSERT(false);
+			return;
+		}
+
+		string subsys(str, sep - str);
+		string cgroup(sep + 1);
+
+		size_t subsys_length = subsys.length();
+		size_t pos = subsys.find("_cgroup");
+		if(pos != string::npos)
+		{
+			subsys.erase(pos, sizeof("_cgroup") - 1);
+		}
+
+		if(subsys == "perf")
+		{
+			subsys = "perf_event";
+		}
+		else if(subsys == "mem")
+		{
+			subsys = "memory";
+		}
+
+		m_cgroups.push_back(std::make_pair(subsys, cgroup));
+		offset += subsys_length + 1 + cgroup.length() + 1;
+	}
+}
+
+sinsp_cgroup_set_ptr sinsp_container_manager::intern_cgroups(const char* cgroups, size_t len)
+{
+	if(len == 0)
+	{
+		return sinsp_cgroup_set_ptr();
+	}
+
+	string key(cgroups, len);
+
+	unordered_map<string, sinsp_cgroup_set_ptr>::const_iterator it = m_cgroup_sets.find(key);
+	if(it != m_cgroup_sets.end())
+	{
+		return it->second;
+	}
+
+	std::shared_ptr<sinsp_cgroup_set> set = std::make_shared<sinsp_cgroup_set>();
 	sinsp_container_info container_info;
 
+	set->parse(cgroups, len);
+
+	if(detect_container(set->m_cgroups, &container_info))
+	{
+		set->m_container_type = container_info.m_type;
+		set->m_container_id = container_info.m_id;
+	}
+
+	m_cgroup_sets.insert(std::make_pair(key, set));
+	return set;
+}
+
+bool sinsp_container_manager::detect_container(const vector<pair<string, string>>& cgroups, sinsp_container_info* container_info)
+{
+	bool valid_id = false;
+
 	for(vector<pair<string, string>>::const_iterator it = cgroups.begin(); it != cgroups.end(); ++it)
 	{
 		string cgroup = it->second;
@@ -108,8 +332,8 @@ bool sinsp_container_manager::resolve_container_from_cgroups(const vector<pair<s
 		{
 			if(cgroup.length() - pos - sizeof("/docker/") + 1 == 64)
 			{
-				container_info.m_type = CT_DOCKER;
-				container_info.m_id = cgroup.substr(pos + sizeof("/docker/") - 1, 12);
+				container_info->m_type = CT_DOCKER;
+				container_info->m_id = cgroup.substr(pos + sizeof("/docker/") - 1, 12);
 				valid_id = true;
 				break;
 			}
@@ -125,8 +349,8 @@ bool sinsp_container_manager::resolve_container_from_cgroups(const vector<pair<s
 			if(pos2 != string::npos &&
 				pos2 - pos - sizeof("docker-") + 1 == 64)
 			{
-				container_info.m_type = CT_DOCKER;
-				container_info.m_id = cgroup.substr(pos + sizeof("docker-") - 1, 12);
+				container_info->m_type = CT_DOCKER;
+				container_info->m_id = cgroup.substr(pos + sizeof("docker-") - 1, 12);
 				valid_id = true;
 				continue;
 			}
@@ -142,8 +366,8 @@ bool sinsp_container_manager::resolve_container_from_cgroups(const vector<pair<s
 			size_t pos2 = cgroup.find_last_of("/");
 			if(pos2 != string::npos)
 			{
-				container_info.m_type = CT_LIBVIRT_LXC;
-				container_info.m_id = cgroup.substr(pos2 + 1, pos - pos2 - 1);
+				container_info->m_type = CT_LIBVIRT_LXC;
+				container_info->m_id = cgroup.substr(pos2 + 1, pos - pos2 - 1);
 				valid_id = true;
 				continue;
 			}
@@ -159,8 +383,8 @@ bool sinsp_container_manager::resolve_container_from_cgroups(const vector<pair<s
 			if(pos2 != string::npos &&
 				pos2 == cgroup.length() - sizeof(".scope") + 1)
 			{
-				container_info.m_type = CT_LIBVIRT_LXC;
-				container_info.m_id = cgroup.substr(pos + sizeof("-lxc\\x2"), pos2 - pos - sizeof("-lxc\\x2"));
+				container_info->m_type = CT_LIBVIRT_LXC;
+				container_info->m_id = cgroup.substr(pos + sizeof("-lxc\\x2"), pos2 - pos - sizeof("-lxc\\x2"));
 				valid_id = true;
 				continue;
 			}
@@ -172,8 +396,8 @@ bool sinsp_container_manager::resolve_container_from_cgroups(const vector<pair<s
 		pos = cgroup.find("/libvirt/lxc/");
 		if(pos != string::npos)
 		{
-			container_info.m_type = CT_LIBVIRT_LXC;
-			container_info.m_id = cgroup.substr(pos + sizeof("/libvirt/lxc/") - 1);
+			container_info->m_type = CT_LIBVIRT_LXC;
+			container_info->m_id = cgroup.substr(pos + sizeof("/libvirt/lxc/") - 1);
 			valid_id = true;
 			continue;
 		}
@@ -184,8 +408,8 @@ bool sinsp_container_manager::resolve_container_from_cgroups(const vector<pair<s
 		pos = cgroup.find("/lxc/");
 		if(pos != string::npos)
 		{
-			container_info.m_type = CT_LXC;
-			container_info.m_id = cgroup.substr(pos + sizeof("/lxc/") - 1);
+			container_info->m_type = CT_LXC;
+			container_info->m_id = cgroup.substr(pos + sizeof("/lxc/") - 1);
 			valid_id = true;
 			continue;
 		}
@@ -195,17 +419,41 @@ bool sinsp_container_manager::resolve_container_from_cgroups(const vector<pair<s
 		pos = cgroup.find("/mesos/");
 		if(pos != string::npos)
 		{
-			container_info.m_type = CT_MESOS;
-			container_info.m_id = cgroup.substr(pos + sizeof("/mesos/") - 1);
+			container_info->m_type = CT_MESOS;
+			container_info->m_id = cgroup.substr(pos + sizeof("/mesos/") - 1);
 			valid_id = true;
 			continue;
 		}
 	}
 
+	return valid_id;
+}
+
+bool sinsp_container_manager::resolve_container_from_cgroups(const sinsp_cgroup_set_ptr& cgroups, bool query_os_for_missing_info, string* container_id)
+{
+	sinsp_container_info container_info;
+	bool valid_id = false;
+
+	if(cgroups != NULL && !cgroups->m_container_id.empty())
+	{
+		container_info.m_type = cgroups->m_container_type;
+		container_info.m_id = cgroups->m_container_id;
+		valid_id = true;
+	}
+
 	if(valid_id)
 	{
 		*container_id = container_info.m_id;
 
+		//
+		// The thread getting this container might be in the part of the
+		// thread table that the scan has already visited
+		//
+		if(m_scan_in_progress)
+		{
+			m_containers_in_use.insert(container_info.m_id);
+		}
+
 		unordered_map<string, sinsp_container_info>::const_iterator it = m_containers.find(container_info.m_id);
 		if(it == m_containers.end())
 		{
@@ -215,7 +463,23 @@ bool sinsp_container_manager::resolve_container_from_cgroups(const vector<pair<s
 #ifndef _WIN32
 					if(query_os_for_missing_info)
 					{
-						parse_docker(&container_info);
+						if(m_resolver != NULL)
+						{
+							//
+							// The container event is sent when the metadata
+							// is available
+							//
+							container_info.m_metadata_pending = m_resolver->request(container_info);
+							if(container_info.m_metadata_pending)
+							{
+								m_containers.insert(std::make_pair(container_info.m_id, container_info));
+								return true;
+							}
+						}
+						else
+						{
+							parse_docker(get_docker_socket_path(), &container_info);
+						}
 					}
 #endif
 					break;
@@ -233,9 +497,20 @@ bool sinsp_container_manager::resolve_container_from_cgroups(const vector<pair<s
 			}
 
 			m_containers.insert(std::make_pair(container_info.m_id, container_info));
-			if(container_to_sinsp_event(container_info, &m_inspector->m_meta_evt, SP_EVT_BUF_SIZE))
+			add_container_event(container_info);
+		}
+		else if(m_resolver != NULL &&
+			it->second.m_type == CT_DOCKER &&
+			!it->second.m_metadata_pending &&
+			it->second.m_name.empty() &&
+			query_os_for_missing_info)
+		{
+			//
+			// The last fetch failed. Try again, unless it was too recent.
+			//
+			if(m_resolver->request(it->second))
 			{
-				m_inspector->m_meta_evt_pending = true;
+				m_containers[container_info.m_id].m_metadata_pending = true;
 			}
 		}
 	}
@@ -292,65 +567,90 @@ bool sinsp_container_manager::container_to_sinsp_event(const sinsp_container_inf
 }
 
 #ifndef _WIN32
-bool sinsp_container_manager::parse_docker(sinsp_container_info* container)
+int sinsp_container_manager::send_docker_request(const string& docker_socket, const string& container_id)
 {
-	string file = string(scap_get_host_root()) + "/var/run/docker.sock";
-
 	int sock = socket(PF_UNIX, SOCK_STREAM, 0);
 	if(sock < 0)
 	{
 		ASSERT(false);
-		return false;
+		return -1;
 	}
 
 	struct sockaddr_un address;
 	memset(&address, 0, sizeof(struct sockaddr_un));
 
 	address.sun_family = AF_UNIX;
-	strncpy(address.sun_path, file.c_str(), sizeof(address.sun_path) - 1);
+	strncpy(address.sun_path, docker_socket.c_str(), sizeof(address.sun_path) - 1);
 	address.sun_path[sizeof(address.sun_path) - 1]= '\0';
 
+	//
+	// Don't wait forever on a daemon that doesn't answer
+	//
+	struct timeval tv;
+	tv.tv_sec = DOCKER_SOCKET_TIMEOUT_S;
+	tv.tv_usec = 0;
+	setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+	setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
 	if(connect(sock, (struct sockaddr *) &address, sizeof(struct sockaddr_un)) != 0)
 	{
-		return false;
+		close(sock);
+		return -1;
 	}
 
-	string message = "GET /containers/" + container->m_id + "/json HTTP/1.0\r\n\n";
+	string message = "GET /containers/" + container_id + "/json HTTP/1.0\r\n\n";
 	if(write(sock, message.c_str(), message.length()) != (ssize_t) message.length())
 	{
 		ASSERT(false);
 		close(sock);
+		return -1;
+	}
+
+	return sock;
+}
+
+bool sinsp_container_manager::parse_docker(const string& docker_socket, sinsp_container_info* container)
+{
+	int sock = send_docker_request(docker_socket, container->m_id);
+	if(sock < 0)
+	{
 		return false;
 	}
 
-	char buf[256];
-	string json;
+	char buf[16384];
+	string answer;
 	ssize_t res;
 	while((res = read(sock, buf, sizeof(buf))) != 0)
 	{
 		if(res == -1)
 		{
-			ASSERT(false);
 			close(sock);
 			return false;
 		}
 
-		buf[res] = 0;
-		json += buf;
+		answer.append(buf, res);
 	}
 
 	close(sock);
 
-	size_t pos = json.find("{");
+	return parse_docker_answer(answer, container);
+}
+
+bool sinsp_container_manager::parse_docker_answer(const string& answer, sinsp_container_info* container)
+{
+	//
+	// The daemon answers 404 with a plain text body for the containers that
+	// are already gone
+	//
+	size_t pos = answer.find("{");
 	if(pos == string::npos)
 	{
-		ASSERT(false);
 		return false;
 	}
 
 	Json::Value root;
 	Json::Reader reader;
-	bool parsingSuccessful = reader.parse(json.substr(pos), root);
+	bool parsingSuccessful = reader.parse(answer.c_str() + pos, answer.c_str() + answer.length(), root);
 	if(!parsingSuccessful)
 	{
 		ASSERT(false);
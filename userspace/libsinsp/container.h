@@ -45,7 +45,8 @@ public:
 	};
 
 	sinsp_container_info():
-		m_container_ip(0)
+		m_container_ip(0),
+		m_metadata_pending(false)
 	{
 	}
 
@@ -56,26 +57,114 @@ public:
 	uint32_t m_container_ip;
 	vector<container_port_mapping> m_port_mappings;
 	map<string, string> m_labels;
+	bool m_metadata_pending; // The metadata is being fetched in the background
 };
 
+//
+// The cgroups of a thread, as subsystem-cgroup pairs.
+// The threads of a container, and most of the processes of the host, have
+// the same cgroups, so the sets are interned by sinsp_container_manager and
+// the threads only keep a reference to them. The container id is derived
+// from the cgroups once, when the set is interned.
+//
+class sinsp_cgroup_set
+{
+public:
+	void parse(const char* cgroups, size_t len);
+
+	vector<pair<string, string>> m_cgroups;
+	sinsp_container_type m_container_type;
+	string m_container_id; // Empty if the cgroups are not the ones of a container
+};
+
+typedef std::shared_ptr<const sinsp_cgroup_set> sinsp_cgroup_set_ptr;
+
+class sinsp_container_resolver;
+
 class sinsp_container_manager
 {
 public:
 	sinsp_container_manager(sinsp* inspector);
+	~sinsp_container_manager();
 
 	const unordered_map<string, sinsp_container_info>* get_containers();
+	// Returns true when a scan of the thread table completes
 	bool remove_inactive_containers();
+	// Restarts the inactive container scans, e.g. after a seek. The containers
+	// are kept, since a trace file only has their events where they were first
+	// seen.
+	void reset_scan();
 	void add_container(const sinsp_container_info& container_info);
 	bool get_container(const string& id, sinsp_container_info* container_info);
-	bool resolve_container_from_cgroups(const vector<pair<string, string>>& cgroups, bool query_os_for_missing_info, string* container_id);
+	// Returns the interned set for the given cgroups blob, NULL if it's empty
+	sinsp_cgroup_set_ptr intern_cgroups(const char* cgroups, size_t len);
+	bool resolve_container_from_cgroups(const sinsp_cgroup_set_ptr& cgroups, bool query_os_for_missing_info, string* container_id);
 	void dump_containers(scap_dumper_t* dumper);
 	string get_container_name(sinsp_threadinfo* tinfo);
 
+	//
+	// Fetch the Docker metadata on a background thread, see
+	// sinsp_container_resolver
+	//
+	void start_metadata_resolver();
+	void stop_metadata_resolver();
+	void process_metadata_results();
+	inline bool is_metadata_resolver_running()
+	{
+		return m_resolver != NULL;
+	}
+
+	// The Docker daemon socket, <host root>/var/run/docker.sock by default
+	void set_docker_socket_path(const string& path);
+	string get_docker_socket_path();
+
+	//
+	// Fetch the metadata of a container from the Docker daemon listening on
+	// docker_socket. parse_docker() waits for the answer, while
+	// send_docker_request() returns the connected socket, whose answer is
+	// then given to parse_docker_answer(), so that several fetches can be in
+	// flight at once.
+	//
+	static bool parse_docker(const string& docker_socket, sinsp_container_info* container);
+	static int send_docker_request(const string& docker_socket, const string& container_id);
+	static bool parse_docker_answer(const string& answer, sinsp_container_info* container);
+
 private:
 	bool container_to_sinsp_event(const sinsp_container_info& container_info, sinsp_evt* evt, size_t evt_len);
-	bool parse_docker(sinsp_container_info* container);
+	// Sets the container event to dump before the next event
+	void add_container_event(const sinsp_container_info& container_info);
+	static bool detect_container(const vector<pair<string, string>>& cgroups, sinsp_container_info* container_info);
+	void complete_metadata_fetch(const sinsp_container_info& container_info, bool success);
+
+	bool scan_inactive_containers();
 
 	sinsp* m_inspector;
 	unordered_map<string, sinsp_container_info> m_containers;
 	uint64_t m_last_flush_time_ns;
+
+	//
+	// The interned cgroup sets, by their blob as found in the events and in
+	// /proc. The sets that no thread references anymore are dropped at the
+	// end of the inactive container scans.
+	//
+	unordered_map<string, sinsp_cgroup_set_ptr> m_cgroup_sets;
+
+	//
+	// The scan for the containers without threads is done a slice of the
+	// thread table at a time, see sinsp::set_inactive_scan_slice().
+	// m_containers_in_use collects the containers of the threads visited so
+	// far, and of the threads that got a container during the scan.
+	//
+	bool m_scan_in_progress;
+	uint32_t m_scan_pos;
+	set<string> m_containers_in_use;
+
+	INTERNAL_COUNTER(m_scan_passes);
+	INTERNAL_COUNTER(m_scan_slices);
+	INTERNAL_COUNTER(m_removed_containers);
+
+	sinsp_container_resolver* m_resolver;
+	string m_docker_socket_path;
+
+	friend class sinsp_container_resolver;
 };
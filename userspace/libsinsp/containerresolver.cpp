@@ -0,0 +1,242 @@
+/*
+Copyright (C) 2013-2014 Draios inc.
+
+This file is part of sysdig.
+
+sysdig is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License version 2 as
+published by the Free Software Foundation.
+
+sysdig is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sysdig.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "sinsp.h"
+#include "sinsp_int.h"
+#include "containerresolver.h"
+
+#include <poll.h>
+
+sinsp_container_resolver::sinsp_container_resolver(sinsp* inspector, const string& docker_socket)
+{
+	m_inspector = inspector;
+	m_docker_socket = docker_socket;
+	m_stop = false;
+	m_has_results = false;
+	m_thread = std::thread(&sinsp_container_resolver::run, this);
+}
+
+sinsp_container_resolver::~sinsp_container_resolver()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stop = true;
+	}
+
+	m_cond.notify_one();
+	m_thread.join();
+}
+
+bool sinsp_container_resolver::request(const sinsp_container_info& container_info)
+{
+	unordered_map<string, uint64_t>::iterator it = m_failed.find(container_info.m_id);
+
+	if(it != m_failed.end())
+	{
+		if(sinsp_utils::get_current_time_ns() - it->second <
+			DEFAULT_CONTAINER_METADATA_RETRY_TIME_S * ONE_SECOND_IN_NS)
+		{
+			return false;
+		}
+
+		m_failed.erase(it);
+	}
+
+	if(!m_pending.insert(container_info.m_id).second)
+	{
+		return false;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_requests.push_back(container_info);
+	}
+
+	m_cond.notify_one();
+	return true;
+}
+
+void sinsp_container_resolver::remove(const string& container_id)
+{
+	m_failed.erase(container_id);
+}
+
+void sinsp_container_resolver::fetch(const string& docker_socket, vector<sinsp_container_info>* containers, vector<bool>* success)
+{
+	success->assign(containers->size(), false);
+
+	for(uint32_t first = 0; first < containers->size(); first += MAX_DOCKER_CONCURRENT_REQUESTS)
+	{
+		uint32_t last = first + MAX_DOCKER_CONCURRENT_REQUESTS;
+		if(last > containers->size())
+		{
+			last = (uint32_t)containers->size();
+		}
+
+		//
+		// Send all the requests of the slice, then read the answers as they
+		// come. The daemon closes the connection after each answer.
+		//
+		vector<struct pollfd> fds;
+		vector<uint32_t> fd_containers;
+		vector<string> answers(last - first);
+
+		for(uint32_t j = first; j < last; j++)
+		{
+			struct pollfd pfd;
+
+			pfd.fd = sinsp_container_manager::send_docker_request(docker_socket, (*containers)[j].m_id);
+			if(pfd.fd < 0)
+			{
+				continue;
+			}
+
+			pfd.events = POLLIN;
+			pfd.revents = 0;
+			fds.push_back(pfd);
+			fd_containers.push_back(j);
+		}
+
+		uint32_t nopen = (uint32_t)fds.size();
+
+		while(nopen != 0)
+		{
+			int res = poll(fds.data(), fds.size(), DOCKER_SOCKET_TIMEOUT_S * 1000);
+			if(res < 0 && errno == EINTR)
+			{
+				continue;
+			}
+
+			if(res <= 0)
+			{
+				break;
+			}
+
+			for(uint32_t k = 0; k < fds.size(); k++)
+			{
+				if(fds[k].fd < 0 || fds[k].revents == 0)
+				{
+					continue;
+				}
+
+				uint32_t j = fd_containers[k];
+				char buf[16384];
+				ssize_t len = read(fds[k].fd, buf, sizeof(buf));
+
+				if(len > 0)
+				{
+					answers[j - first].append(buf, len);
+					continue;
+				}
+
+				if(len == 0)
+				{
+					(*success)[j] = sinsp_container_manager::parse_docker_answer(answers[j - first], &(*containers)[j]);
+				}
+
+				close(fds[k].fd);
+				fds[k].fd = -1;
+				nopen--;
+			}
+		}
+
+		//
+		// Whatever is left timed out
+		//
+		for(uint32_t k = 0; k < fds.size(); k++)
+		{
+			if(fds[k].fd >= 0)
+			{
+				close(fds[k].fd);
+			}
+		}
+	}
+}
+
+void sinsp_container_resolver::run()
+{
+	while(true)
+	{
+		vector<sinsp_container_info> requests;
+		vector<bool> success;
+		deque<fetch_result> results;
+
+		//
+		// Take all the queued requests at once, so that a burst of new
+		// containers is fetched concurrently
+		//
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+
+			while(m_requests.empty() && !m_stop)
+			{
+				m_cond.wait(lock);
+			}
+
+			if(m_stop)
+			{
+				return;
+			}
+
+			requests.swap(m_requests);
+		}
+
+		fetch(m_docker_socket, &requests, &success);
+
+		for(uint32_t j = 0; j < requests.size(); j++)
+		{
+			fetch_result res;
+
+			res.m_info = requests[j];
+			res.m_success = success[j];
+			results.push_back(res);
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_results.insert(m_results.end(), results.begin(), results.end());
+			m_has_results.store(true, memory_order_release);
+		}
+	}
+}
+
+void sinsp_container_resolver::process_results()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	while(!m_results.empty())
+	{
+		fetch_result& res = m_results.front();
+
+		m_pending.erase(res.m_info.m_id);
+
+		if(!res.m_success)
+		{
+			m_failed[res.m_info.m_id] = sinsp_utils::get_current_time_ns();
+		}
+
+		//
+		// The container may have been removed from the table in the meantime,
+		// in which case the result is not needed anymore
+		//
+		m_inspector->m_container_manager.complete_metadata_fetch(res.m_info, res.m_success);
+		m_results.pop_front();
+	}
+
+	m_has_results.store(false, memory_order_relaxed);
+}
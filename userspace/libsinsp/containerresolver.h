@@ -0,0 +1,113 @@
+/*
+Copyright (C) 2013-2014 Draios inc.
+
+This file is part of sysdig.
+
+sysdig is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License version 2 as
+published by the Free Software Foundation.
+
+sysdig is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sysdig.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <unordered_set>
+
+//
+// Background fetcher of the container metadata that is not in the cgroups,
+// i.e. the Docker name, image, network and labels, so that the event loop
+// doesn't wait on the Docker daemon when containers are started.
+// sinsp_container_manager adds the containers right away with
+// m_metadata_pending set and queues a request. The fetcher thread takes the
+// queued requests in batches and sends up to MAX_DOCKER_CONCURRENT_REQUESTS
+// of them to the daemon at once, and sinsp::next() applies the results to the
+// container table between two events.
+// Failed fetches are not retried for a while, so that a container whose
+// metadata can't be read doesn't cause a request for each of its threads.
+// They are forgotten when the container is removed from the table.
+//
+class sinsp_container_resolver
+{
+public:
+	sinsp_container_resolver(sinsp* inspector, const string& docker_socket);
+	~sinsp_container_resolver();
+
+	//
+	// Queue the fetch of a container's metadata. Returns false if a fetch for
+	// the same container is already in progress, or if the last one failed
+	// recently.
+	//
+	bool request(const sinsp_container_info& container_info);
+
+	//
+	// Drop the state kept for a container that has been removed from the
+	// table. Must be called from the inspector thread.
+	//
+	void remove(const string& container_id);
+
+	//
+	// Apply the fetched metadata to the container table. Must be called from
+	// the inspector thread.
+	//
+	void process_results();
+
+	inline bool has_results()
+	{
+		return m_has_results.load(memory_order_acquire);
+	}
+
+	uint32_t get_num_pending()
+	{
+		return (uint32_t)m_pending.size();
+	}
+
+	//
+	// Fetch the metadata of the given containers from the Docker daemon
+	// listening on docker_socket, with up to MAX_DOCKER_CONCURRENT_REQUESTS
+	// requests in flight. success gets the outcome of each fetch.
+	//
+	static void fetch(const string& docker_socket, vector<sinsp_container_info>* containers, vector<bool>* success);
+
+private:
+	struct fetch_result
+	{
+		sinsp_container_info m_info;
+		bool m_success;
+	};
+
+	void run();
+
+	sinsp* m_inspector;
+	string m_docker_socket;
+	std::thread m_thread;
+	std::mutex m_mutex;
+	std::condition_variable m_cond;
+
+	//
+	// Protected by m_mutex
+	//
+	vector<sinsp_container_info> m_requests;
+	deque<fetch_result> m_results;
+	bool m_stop;
+
+	atomic<bool> m_has_results;
+
+	//
+	// Only used by the inspector thread: the containers with a fetch in
+	// progress, and the time of the last failed fetch of the other ones
+	//
+	unordered_set<string> m_pending;
+	unordered_map<string, uint64_t> m_failed;
+};
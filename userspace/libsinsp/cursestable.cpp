@@ -142,6 +142,12 @@ void curses_table::configure(sinsp_table* table,
 
 	m_table = table;
 
+	//
+	// Sort only the rows that fit in the window, the others are sorted when
+	// the user scrolls to them
+	//
+	m_table->set_visible_rows(m_h);
+
 	vector<filtercheck_field_info>* legend = m_table->get_legend();
 
 	if(colsizes)
@@ -308,15 +314,6 @@ void curses_table::render(bool data_changed)
 		goto render_end;
 	}
 
-	if(m_data->size() != 0)
-	{
-		if(m_legend.size() != m_data->at(0).m_values.size())
-		{
-			ASSERT(false);
-			throw sinsp_exception("corrupted curses table data");
-		}
-	}
-
 	if(data_changed)
 	{
 		m_column_startx.clear();
@@ -416,7 +413,9 @@ void curses_table::render(bool data_changed)
 		//
 		// Render the rows
 		//
-		vector<sinsp_table_field>* row;
+		sinsp_table_field* row;
+
+		m_table->sort_rows(m_firstrow + m_h - 1);
 
 		for(l = 0; l < (int32_t)MIN(m_data->size(), m_h - 1); l++)
 		{
@@ -425,7 +424,7 @@ void curses_table::render(bool data_changed)
 				break;
 			}
 
-			row = &(m_data->at(l + m_firstrow).m_values);
+			row = m_data->at(l + m_firstrow).m_values;
 
 			//
 			// Pick the proper color based on the selection
@@ -460,9 +459,9 @@ void curses_table::render(bool data_changed)
 				}
 
 				m_converter->set_val(m_legend[j].m_info.m_type, 
-					row->at(j).m_val, 
-					row->at(j).m_len,
-					row->at(j).m_cnt,
+					row[j].m_val, 
+					row[j].m_len,
+					row[j].m_cnt,
 					m_legend[j].m_info.m_print_format);
 
 				uint32_t size = m_legend[j].m_size - 1;
@@ -621,7 +620,7 @@ sysdig_table_action curses_table::handle_input(int ch)
 							return STA_PARENT_HANDLE;
 						}
 
-						ASSERT((m_data->size() == 0) || (m_column_startx.size() == m_data->at(0).m_values.size()));
+						ASSERT((m_data->size() == 0) || (m_column_startx.size() == m_legend.size()));
 
 						if((uint32_t)m_last_mevent.y == m_table_y_start)
 						{
@@ -729,6 +728,11 @@ void curses_table::recreate_win(int h)
 {
 	delwin(m_tblwin);
 	m_h = h;
+
+	if(m_table != NULL)
+	{
+		m_table->set_visible_rows(m_h);
+	}
 	m_tblwin = newwin(m_h, 500, m_table_y_start, m_table_x_start);
 	render(true);
 }
@@ -29,6 +29,7 @@ along with sysdig.  If not, see <http://www.gnu.org/licenses/>.
 
 #include "sinsp.h"
 #include "sinsp_int.h"
+#include "pipeline.h"
 
 #include "../libscap/scap.h"
 
@@ -90,6 +91,11 @@ uint64_t sinsp_evt::get_ts()
 
 uint32_t sinsp_evt::get_dump_flags()
 {
+	if(m_inspector->m_pipeline != NULL)
+	{
+		return m_inspector->m_pipeline->get_dump_flags();
+	}
+
 	return scap_event_get_dump_flags(m_inspector->m_h);
 }
 
@@ -524,7 +530,7 @@ uint32_t strcpy_sanitized(char *dest, char *src, uint32_t dstsize)
 	return dstsize;
 }
 
-int sinsp_evt::render_fd_json(Json::Value *ret, int64_t fd, const char** resolved_str, sinsp_evt::param_fmt fmt)
+int sinsp_evt::render_fd_json(sinsp_json_writer* writer, int64_t fd, const char** resolved_str, sinsp_evt::param_fmt fmt)
 {
 	sinsp_threadinfo* tinfo = get_thread_info();
 	if(tinfo == NULL)
@@ -580,8 +586,10 @@ int sinsp_evt::render_fd_json(Json::Value *ret, int64_t fd, const char** resolve
 
 			sanitized_str.erase(remove_if(sanitized_str.begin(), sanitized_str.end(), g_invalidchar()), sanitized_str.end());
 
-			(*ret)["typechar"] = typestr;
-			(*ret)["name"] = sanitized_str;
+			writer->key("typechar");
+			writer->string_value(typestr);
+			writer->key("name");
+			writer->string_value(sanitized_str.c_str(), (uint32_t)sanitized_str.size());
 		}
 	}
 	else
@@ -592,7 +600,8 @@ int sinsp_evt::render_fd_json(Json::Value *ret, int64_t fd, const char** resolve
 		string errstr(sinsp_utils::errno_to_str((int32_t)fd));
 		if(errstr != "")
 		{
-			(*ret)["error"] = errstr;
+			writer->key("error");
+			writer->string_value(errstr.c_str(), (uint32_t)errstr.size());
 			return 0;
 		}
 	}
@@ -711,13 +720,12 @@ char* sinsp_evt::render_fd(int64_t fd, const char** resolved_str, sinsp_evt::par
 	return &m_paramstr_storage[0];
 }
 
-Json::Value sinsp_evt::get_param_as_json(uint32_t id, OUT const char** resolved_str, sinsp_evt::param_fmt fmt)
+void sinsp_evt::get_param_as_json(uint32_t id, sinsp_json_writer* writer, OUT const char** resolved_str, sinsp_evt::param_fmt fmt)
 {
 	ASSERT(id < m_info->nparams);
 	const ppm_param_info* param_info;
 	char* payload;
 	uint16_t payload_len;
-	Json::Value ret;
 
 	//
 	// Make sure the params are actually loaded
@@ -763,48 +771,48 @@ Json::Value sinsp_evt::get_param_as_json(uint32_t id, OUT const char** resolved_
 	{
 	case PT_INT8:
 		ASSERT(payload_len == sizeof(int8_t));
-		ret = *(int8_t *)payload;
+		writer->int_value(*(int8_t *)payload);
 		break;
 
 	case PT_INT16:
 		ASSERT(payload_len == sizeof(int16_t));
-		ret = *(int16_t *)payload;
+		writer->int_value(*(int16_t *)payload);
 		break;
 
 	case PT_INT32:
 		ASSERT(payload_len == sizeof(int32_t));
-		ret = *(int32_t *)payload;
+		writer->int_value(*(int32_t *)payload);
 		break;
 
 	case PT_INT64:
 		ASSERT(payload_len == sizeof(int64_t));
-		ret = (Json::Value::Int64)*(int64_t *)payload;
+		writer->int_value(*(int64_t *)payload);
 		break;
 
 	case PT_UINT8:
 		ASSERT(payload_len == sizeof(uint8_t));
-		ret = *(uint8_t *)payload;
+		writer->uint_value(*(uint8_t *)payload);
 		break;
 
 	case PT_UINT16:
 		ASSERT(payload_len == sizeof(uint16_t));
-		ret = *(uint16_t *)payload;
+		writer->uint_value(*(uint16_t *)payload);
 		break;
 
 	case PT_UINT32:
 		ASSERT(payload_len == sizeof(uint32_t));
-		ret = *(uint32_t *)payload;
+		writer->uint_value(*(uint32_t *)payload);
 		break;
 
 	case PT_UINT64:
 		ASSERT(payload_len == sizeof(uint64_t));
-		ret = (Json::Value::UInt64)*(int64_t *)payload;
+		writer->uint_value(*(uint64_t *)payload);
 		break;
 
 	case PT_PID:
 		{
 			ASSERT(payload_len == sizeof(int64_t));
-			ret = (Json::Value::UInt64)*(int64_t *)payload;
+			writer->uint_value(*(uint64_t *)payload);
 
 			sinsp_threadinfo* atinfo = m_inspector->get_thread(*(int64_t *)payload, false, true);
 			if(atinfo != NULL)
@@ -848,8 +856,8 @@ Json::Value sinsp_evt::get_param_as_json(uint32_t id, OUT const char** resolved_
 				         m_resolved_paramstr_storage.size(),
 				         "%s", errstr.c_str());
 			}
-		} 
-		ret = (Json::Value::Int64)val;
+		}
+		writer->int_value(val);
 	}
 	break;
 
@@ -860,21 +868,24 @@ Json::Value sinsp_evt::get_param_as_json(uint32_t id, OUT const char** resolved_
 			// to get the actual value to return
 			ASSERT(payload_len == sizeof(int64_t));
 			int64_t fd = *(int64_t*)payload;
-			render_fd_json(&ret, fd, resolved_str, fmt);
-			ret["num"] = (Json::Value::UInt64)*(int64_t *)payload;
+			writer->begin_object();
+			render_fd_json(writer, fd, resolved_str, fmt);
+			writer->key("num");
+			writer->uint_value((uint64_t)fd);
+			writer->end_object();
 			break;
 		}
 
 	case PT_CHARBUF:
 	case PT_FSPATH:
 	case PT_BYTEBUF:
-		ret = get_param_as_str(id, resolved_str, fmt);
+		writer->string_value(get_param_as_str(id, resolved_str, fmt));
 		break;
 
 	case PT_SOCKADDR:
 		if(payload_len == 0)
 		{
-			ret = Json::Value::nullRef;
+			writer->null_value();
 			break;
 		}
 		else if(payload[0] == AF_UNIX)
@@ -887,7 +898,7 @@ Json::Value sinsp_evt::get_param_as_json(uint32_t id, OUT const char** resolved_
             string sanitized_str = payload + 1;
             sanitized_str.erase(remove_if(sanitized_str.begin(), sanitized_str.end(), g_invalidchar()), sanitized_str.end());
 
-			ret = sanitized_str;
+			writer->string_value(sanitized_str.c_str(), (uint32_t)sanitized_str.size());
 		}
 		else if(payload[0] == PPM_AF_INET)
 		{
@@ -905,25 +916,32 @@ Json::Value sinsp_evt::get_param_as_json(uint32_t id, OUT const char** resolved_
 						(unsigned int)(uint8_t)payload[3],
 						(unsigned int)(uint8_t)payload[4]
 				);
-				ret["addr"] = string(ipv4_addr);
-				ret["port"] = *(uint16_t*)(payload + 5);
+				writer->begin_object();
+				writer->key("addr");
+				writer->string_value(ipv4_addr);
+				writer->key("port");
+				writer->uint_value(*(uint16_t*)(payload + 5));
+				writer->end_object();
 			}
 			else
 			{
 				ASSERT(false);
-				ret = "INVALID IPv4";
+				writer->string_value("INVALID IPv4");
 			}
 		}
 		else
 		{
-			ret["family"] = (int)payload[0];
+			writer->begin_object();
+			writer->key("family");
+			writer->int_value(payload[0]);
+			writer->end_object();
 		}
 		break;
 
 	case PT_SOCKTUPLE:
 		if(payload_len == 0)
 		{
-			ret = Json::Value::nullRef;
+			writer->null_value();
 			break;
 		}
 
@@ -931,9 +949,6 @@ Json::Value sinsp_evt::get_param_as_json(uint32_t id, OUT const char** resolved_
 		{
 			if(payload_len == 1 + 4 + 2 + 4 + 2)
 			{
-				Json::Value source;
-				Json::Value dest;
-
 				const int ipv4_len = (3 + 1) * 4 + 1;
 				char ipv4_addr[ ipv4_len ];
 
@@ -947,8 +962,14 @@ Json::Value sinsp_evt::get_param_as_json(uint32_t id, OUT const char** resolved_
 						(unsigned int)(uint8_t)payload[4]
 				);
 
-				source["addr"] = string(ipv4_addr);
-				source["port"] = *(uint16_t*)(payload + 5);
+				writer->begin_object();
+				writer->key("src");
+				writer->begin_object();
+				writer->key("addr");
+				writer->string_value(ipv4_addr);
+				writer->key("port");
+				writer->uint_value(*(uint16_t*)(payload + 5));
+				writer->end_object();
 
 				snprintf(
 					ipv4_addr,
@@ -960,17 +981,19 @@ Json::Value sinsp_evt::get_param_as_json(uint32_t id, OUT const char** resolved_
 				         (unsigned int)(uint8_t)payload[10]
 				);
 
-
-				dest["addr"] = string(ipv4_addr);
-				dest["port"] = *(uint16_t*)(payload + 11);
-
-				ret["src"] = source;
-				ret["dst"] = dest;
+				writer->key("dst");
+				writer->begin_object();
+				writer->key("addr");
+				writer->string_value(ipv4_addr);
+				writer->key("port");
+				writer->uint_value(*(uint16_t*)(payload + 11));
+				writer->end_object();
+				writer->end_object();
 			}
 			else
 			{
 				ASSERT(false);
-				ret = "INVALID IPv4";
+				writer->string_value("INVALID IPv4");
 			}
 		}
 		else if(payload[0] == PPM_AF_INET6)
@@ -984,9 +1007,6 @@ Json::Value sinsp_evt::get_param_as_json(uint32_t id, OUT const char** resolved_
 
 				if(sinsp_utils::is_ipv4_mapped_ipv6(sip6) && sinsp_utils::is_ipv4_mapped_ipv6(dip6))
 				{
-					Json::Value source;
-					Json::Value dest;
-
 					const int ipv4_len = (3 + 1) * 4 + 1;
 					char ipv4_addr[ ipv4_len ];
 
@@ -1000,8 +1020,14 @@ Json::Value sinsp_evt::get_param_as_json(uint32_t id, OUT const char** resolved_
 							(unsigned int)sip[3]
 					);
 
-					source["addr"] = string(ipv4_addr);
-					source["port"] = (unsigned int)*(uint16_t*)(payload + 17);
+					writer->begin_object();
+					writer->key("src");
+					writer->begin_object();
+					writer->key("addr");
+					writer->string_value(ipv4_addr);
+					writer->key("port");
+					writer->uint_value(*(uint16_t*)(payload + 17));
+					writer->end_object();
 
 					snprintf(
 						ipv4_addr,
@@ -1013,11 +1039,14 @@ Json::Value sinsp_evt::get_param_as_json(uint32_t id, OUT const char** resolved_
 							(unsigned int)dip[3]
 				 	);
 
-					dest["addr"] = string(ipv4_addr);
-					dest["port"] = (unsigned int)*(uint16_t*)(payload + 35);
-
-					ret["src"] = source;
-					ret["dst"] = dest;
+					writer->key("dst");
+					writer->begin_object();
+					writer->key("addr");
+					writer->string_value(ipv4_addr);
+					writer->key("port");
+					writer->uint_value(*(uint16_t*)(payload + 35));
+					writer->end_object();
+					writer->end_object();
 
 					break;
 				}
@@ -1027,26 +1056,31 @@ Json::Value sinsp_evt::get_param_as_json(uint32_t id, OUT const char** resolved_
 					char dststr[INET6_ADDRSTRLEN];
 
 					if(inet_ntop(AF_INET6, sip6, srcstr, sizeof(srcstr)) &&
-						inet_ntop(AF_INET6, sip6, dststr, sizeof(dststr)))
+						inet_ntop(AF_INET6, dip6, dststr, sizeof(dststr)))
 					{
-						Json::Value source;
-						Json::Value dest;
-
-						source["addr"] = srcstr;
-						source["port"] = (unsigned int)*(uint16_t*)(payload + 17);
-
-						dest["addr"] = dststr;
-						dest["port"] = (unsigned int)*(uint16_t*)(payload + 35);
-
-						ret["src"] = source;
-						ret["dst"] = dest;
+						writer->begin_object();
+						writer->key("src");
+						writer->begin_object();
+						writer->key("addr");
+						writer->string_value(srcstr);
+						writer->key("port");
+						writer->uint_value(*(uint16_t*)(payload + 17));
+						writer->end_object();
+						writer->key("dst");
+						writer->begin_object();
+						writer->key("addr");
+						writer->string_value(dststr);
+						writer->key("port");
+						writer->uint_value(*(uint16_t*)(payload + 35));
+						writer->end_object();
+						writer->end_object();
 
 						break;
 					}
 				}
 			}
 			ASSERT(false);
-			ret = "INVALID IPv6";
+			writer->string_value("INVALID IPv6");
 
 		}
 		else if(payload[0] == AF_UNIX)
@@ -1065,14 +1099,19 @@ Json::Value sinsp_evt::get_param_as_json(uint32_t id, OUT const char** resolved_
 				*(uint64_t*)(payload + 1),
 				*(uint64_t*)(payload + 9),
 				sanitized_str.c_str());
+
+			writer->null_value();
 		}
 		else
 		{
-			ret["family"] = (int)payload[0];
+			writer->begin_object();
+			writer->key("family");
+			writer->int_value(payload[0]);
+			writer->end_object();
 		}
 		break;
 	case PT_FDLIST:
-		ret = get_param_as_str(id, resolved_str, fmt);
+		writer->string_value(get_param_as_str(id, resolved_str, fmt));
 		break;
 
 	case PT_SYSCALLID:
@@ -1084,12 +1123,13 @@ Json::Value sinsp_evt::get_param_as_json(uint32_t id, OUT const char** resolved_
 				snprintf(&m_resolved_paramstr_storage[0],
 						 m_resolved_paramstr_storage.size(),
 						 "<unknown syscall>");
+				writer->null_value();
 				break;
 			}
 
 			const struct ppm_syscall_desc* desc = &(g_infotables.m_syscall_info_table[scid]);
 
-			ret = scid;
+			writer->uint_value(scid);
 
 			snprintf(&m_resolved_paramstr_storage[0],
 				m_resolved_paramstr_storage.size(),
@@ -1105,7 +1145,7 @@ Json::Value sinsp_evt::get_param_as_json(uint32_t id, OUT const char** resolved_
 			uint8_t val = *(uint8_t *)payload;
 
 			sigstr = sinsp_utils::signal_to_str(val);
-			ret = val;
+			writer->uint_value(val);
 
 			if(sigstr)
 			{
@@ -1119,7 +1159,7 @@ Json::Value sinsp_evt::get_param_as_json(uint32_t id, OUT const char** resolved_
 		{
 			ASSERT(payload_len == sizeof(uint64_t));
 			uint64_t val = *(uint64_t *)payload;
-			ret = (Json::Value::Int64)val;
+			writer->int_value((int64_t)val);
 
 			snprintf(&m_resolved_paramstr_storage[0],
 						m_resolved_paramstr_storage.size(),
@@ -1132,8 +1172,9 @@ Json::Value sinsp_evt::get_param_as_json(uint32_t id, OUT const char** resolved_
 	case PT_FLAGS32:
 		{
 			uint32_t val = *(uint32_t *)payload & (((uint64_t)1 << payload_len * 8) - 1);
-			ret["val"] = val;
-			ret["flags"] = Json::arrayValue;
+			writer->begin_object();
+			writer->key("flags");
+			writer->begin_array();
 
 			const struct ppm_name_value *flags = (const struct ppm_name_value *)m_info->params[id].info;
 			uint32_t initial_val = val;
@@ -1142,7 +1183,7 @@ Json::Value sinsp_evt::get_param_as_json(uint32_t id, OUT const char** resolved_
 			{
 				if((val & flags->value) == flags->value && val != 0)
 				{
-					ret["flags"].append(flags->name);
+					writer->string_value(flags->name);
 
 					// We remove current flags value to avoid duplicate flags e.g. PPM_O_RDWR, PPM_O_RDONLY, PPM_O_WRONLY
 					val &= ~flags->value;
@@ -1153,9 +1194,14 @@ Json::Value sinsp_evt::get_param_as_json(uint32_t id, OUT const char** resolved_
 
 			if(flags != NULL && flags->name != NULL)
 			{
-				ret["flags"].append(flags->name);
+				writer->string_value(flags->name);
 			}
 
+			writer->end_array();
+			writer->key("val");
+			writer->uint_value(initial_val);
+			writer->end_object();
+
 			break;
 		}
 	case PT_UID:
@@ -1165,11 +1211,11 @@ Json::Value sinsp_evt::get_param_as_json(uint32_t id, OUT const char** resolved_
 		uint32_t val = *(uint32_t *)payload;
 		if(val < std::numeric_limits<uint32_t>::max() )
 		{
-			ret = val;
+			writer->uint_value(val);
 		}
 		else
 		{
-			ret = -1;
+			writer->int_value(-1);
 		}
 		break;
 	}
@@ -1183,10 +1229,11 @@ Json::Value sinsp_evt::get_param_as_json(uint32_t id, OUT const char** resolved_
 		snprintf(&m_paramstr_storage[0],
 		         m_paramstr_storage.size(),
 		         "INVALID DYNAMIC PARAMETER");
+		writer->null_value();
 		break;
 
 	case PT_SIGSET:
-		ret = get_param_as_str(id, resolved_str, fmt);
+		writer->string_value(get_param_as_str(id, resolved_str, fmt));
 		break;
 
 	default:
@@ -1194,12 +1241,11 @@ Json::Value sinsp_evt::get_param_as_json(uint32_t id, OUT const char** resolved_
 		snprintf(&m_paramstr_storage[0],
 		         m_paramstr_storage.size(),
 		         "(n.a.)");
+		writer->null_value();
 		break;
 	}
 
 	*resolved_str = &m_resolved_paramstr_storage[0];
-
-	return ret;
 }
 
 const char* sinsp_evt::get_param_as_str(uint32_t id, OUT const char** resolved_str, sinsp_evt::param_fmt fmt)
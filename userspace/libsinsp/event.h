@@ -298,7 +298,7 @@ private:
 	void set_iosize(uint32_t size);
 	uint32_t get_iosize();
 	const char* get_param_as_str(uint32_t id, OUT const char** resolved_str, param_fmt fmt = PF_NORMAL);
-	Json::Value get_param_as_json(uint32_t id, OUT const char** resolved_str, param_fmt fmt = PF_NORMAL);
+	void get_param_as_json(uint32_t id, sinsp_json_writer* writer, OUT const char** resolved_str, param_fmt fmt = PF_NORMAL);
 
 	const char* get_param_value_str(const char* name, OUT const char** resolved_str, param_fmt fmt = PF_NORMAL);
 
@@ -342,7 +342,7 @@ private:
 	string get_param_value_str(uint32_t id, bool resolved);
 	string get_param_value_str(const char* name, bool resolved = true);
 	char* render_fd(int64_t fd, const char** resolved_str, sinsp_evt::param_fmt fmt);
-	int render_fd_json(Json::Value *ret, int64_t fd, const char** resolved_str, sinsp_evt::param_fmt fmt);
+	int render_fd_json(sinsp_json_writer* writer, int64_t fd, const char** resolved_str, sinsp_evt::param_fmt fmt);
 	uint32_t get_dump_flags();
 
 VISIBILITY_PRIVATE
@@ -16,6 +16,8 @@ You should have received a copy of the GNU General Public License
 along with sysdig.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <algorithm>
+
 #include "sinsp.h"
 #include "sinsp_int.h"
 #include "filter.h"
@@ -32,9 +34,20 @@ sinsp_evt_formatter::sinsp_evt_formatter(sinsp* inspector, const string& fmt)
 {
 	m_inspector = inspector;
 	m_first = true;
+	m_outbuf.resize(256);
+	m_outlen = 0;
 	set_format(fmt);
 }
 
+sinsp_evt_formatter::sinsp_evt_formatter(sinsp* inspector)
+{
+	m_inspector = inspector;
+	m_first = true;
+	m_require_all_values = true;
+	m_outbuf.resize(256);
+	m_outlen = 0;
+}
+
 sinsp_evt_formatter::~sinsp_evt_formatter()
 {
 	uint32_t j;
@@ -45,11 +58,27 @@ sinsp_evt_formatter::~sinsp_evt_formatter()
 	}
 }
 
+static inline bool is_json_format(sinsp_evt::param_fmt fmt)
+{
+	switch(fmt)
+	{
+	case sinsp_evt::PF_JSON:
+	case sinsp_evt::PF_JSONEOLS:
+	case sinsp_evt::PF_JSONHEX:
+	case sinsp_evt::PF_JSONHEXASCII:
+	case sinsp_evt::PF_JSONBASE64:
+		return true;
+	default:
+		return false;
+	}
+}
+
 void sinsp_evt_formatter::set_format(const string& fmt)
 {
 	uint32_t j;
 	uint32_t last_nontoken_str_start = 0;
 	string lfmt(fmt);
+	format_op op;
 
 	if(lfmt == "")
 	{
@@ -71,27 +100,34 @@ void sinsp_evt_formatter::set_format(const string& fmt)
 	}
 
 	//
-	// Parse the string and extract the tokens
+	// Parse the string and compile it. The text between the fields is only
+	// part of the text output.
 	//
 	const char* cfmt = lfmt.c_str();
 
-	m_tokens.clear();
+	m_text_program.clear();
+	m_json_program.clear();
 	uint32_t lfmtlen = (uint32_t)lfmt.length();
 
-	for(j = 0; j < lfmtlen; j++)
+	for(j = 0; j <= lfmtlen; j++)
 	{
-		if(cfmt[j] == '%')
+		if(j == lfmtlen || cfmt[j] == '%')
 		{
-			int toklen = 0;
-
 			if(last_nontoken_str_start != j)
 			{
-				rawstring_check* newtkn = new rawstring_check(lfmt.substr(last_nontoken_str_start, j - last_nontoken_str_start));
-				m_tokens.push_back(newtkn);
-				m_tokenlens.push_back(0);
-				m_chks_to_free.push_back(newtkn);
+				op.m_chk = NULL;
+				op.m_text = lfmt.substr(last_nontoken_str_start, j - last_nontoken_str_start);
+				op.m_width = 0;
+				m_text_program.push_back(op);
+			}
+
+			if(j == lfmtlen)
+			{
+				break;
 			}
 
+			int toklen = 0;
+
 			if(j == lfmtlen - 1)
 			{
 				throw sinsp_exception("invalid formatting syntax: formatting cannot end with a %");
@@ -142,29 +178,50 @@ void sinsp_evt_formatter::set_format(const string& fmt)
 			j += chk->parse_field_name(cfmt + j + 1, true);
 			ASSERT(j <= lfmt.length());
 
-			m_tokens.push_back(chk);
-			m_tokenlens.push_back(toklen);
+			const filtercheck_field_info* fi = chk->get_field_info();
+
+			op.m_chk = chk;
+			op.m_text = "";
+			op.m_width = toklen;
+			m_text_program.push_back(op);
+
+			if(fi != NULL)
+			{
+				op.m_text = fi->m_name;
+				op.m_width = 0;
+				m_json_program.push_back(op);
+			}
 
 			last_nontoken_str_start = j + 1;
 		}
 	}
 
-	if(last_nontoken_str_start != j)
+	//
+	// The JSON objects have always been written with their keys sorted, and
+	// with a single key, the last one, for a field that appears more than
+	// once in the format.
+	//
+	stable_sort(m_json_program.begin(), m_json_program.end());
+
+	vector<format_op> json_program;
+
+	for(j = 0; j < m_json_program.size(); j++)
 	{
-		m_tokens.push_back(new rawstring_check(lfmt.substr(last_nontoken_str_start, j - last_nontoken_str_start)));
-		m_tokenlens.push_back(0);
+		if(j + 1 < m_json_program.size() && m_json_program[j + 1].m_text == m_json_program[j].m_text)
+		{
+			continue;
+		}
+
+		json_program.push_back(m_json_program[j]);
 	}
+
+	m_json_program.swap(json_program);
 }
 
 bool sinsp_evt_formatter::on_capture_end(OUT string* res)
 {
 	res->clear();
-	if(!m_first &&
-		(m_inspector->get_buffer_format() == sinsp_evt::PF_JSON
-		|| m_inspector->get_buffer_format() == sinsp_evt::PF_JSONEOLS
-		|| m_inspector->get_buffer_format() == sinsp_evt::PF_JSONHEX
-		|| m_inspector->get_buffer_format() == sinsp_evt::PF_JSONHEXASCII
-		|| m_inspector->get_buffer_format() == sinsp_evt::PF_JSONBASE64))
+	if(!m_first && is_json_format(m_inspector->get_buffer_format()))
 	{
 		(*res) = ']';
 	}
@@ -172,108 +229,378 @@ bool sinsp_evt_formatter::on_capture_end(OUT string* res)
 	return res->size() > 0;
 }
 
-bool sinsp_evt_formatter::tostring(sinsp_evt* evt, OUT string* res)
+void sinsp_evt_formatter::grow(uint32_t len)
 {
-	bool retval = true;
-	const filtercheck_field_info* fi;
+	uint32_t size = (uint32_t)m_outbuf.size() * 2;
 
-	uint32_t j = 0;
-	vector<sinsp_filter_check*>::iterator it;
-	res->clear();
+	if(size < len)
+	{
+		size = len;
+	}
 
-	ASSERT(m_tokenlens.size() == m_tokens.size());
+	m_outbuf.resize(size);
+}
 
-	for(j = 0; j < m_tokens.size(); j++)
+void sinsp_evt_formatter::append(const char* str, uint32_t len)
+{
+	if(m_outlen + len > m_outbuf.size())
 	{
-		if(m_inspector->get_buffer_format() == sinsp_evt::PF_JSON
-		   || m_inspector->get_buffer_format() == sinsp_evt::PF_JSONEOLS
-		   || m_inspector->get_buffer_format() == sinsp_evt::PF_JSONHEX
-		   || m_inspector->get_buffer_format() == sinsp_evt::PF_JSONHEXASCII
-		   || m_inspector->get_buffer_format() == sinsp_evt::PF_JSONBASE64)
-		{
-			Json::Value json_value = m_tokens[j]->tojson(evt);
+		grow(m_outlen + len);
+	}
 
-			if(retval == false)
+	memcpy(&m_outbuf[m_outlen], str, len);
+	m_outlen += len;
+}
+
+//
+// Appends exactly width characters: str is truncated or padded with spaces
+//
+void sinsp_evt_formatter::append_padded(const char* str, uint32_t width)
+{
+	uint32_t len = (uint32_t)strnlen(str, width);
+
+	if(m_outlen + width > m_outbuf.size())
+	{
+		grow(m_outlen + width);
+	}
+
+	memcpy(&m_outbuf[m_outlen], str, len);
+	memset(&m_outbuf[m_outlen + len], ' ', width - len);
+	m_outlen += width;
+}
+
+bool sinsp_evt_formatter::render_text(sinsp_evt* evt)
+{
+	bool retval = true;
+
+	m_outlen = 0;
+
+	for(auto it = m_text_program.begin(); it != m_text_program.end(); ++it)
+	{
+		if(it->m_chk == NULL)
+		{
+			if(retval)
 			{
-				continue;
+				append(it->m_text.c_str(), (uint32_t)it->m_text.size());
 			}
 
-			if(json_value == Json::Value::nullRef && m_require_all_values)
+			continue;
+		}
+
+		//
+		// The fields that follow a missing one are still extracted, since some
+		// of them keep state across events
+		//
+		char* str = it->m_chk->tostring(evt);
+
+		if(retval == false)
+		{
+			continue;
+		}
+
+		retval = append_field(&*it, str);
+	}
+
+	return retval;
+}
+
+//
+// Appends the value of a field, str is NULL if the event doesn't have it.
+// Returns false if the event must not be shown.
+//
+bool sinsp_evt_formatter::append_field(const format_op* op, char* str)
+{
+	if(str == NULL)
+	{
+		if(m_require_all_values)
+		{
+			return false;
+		}
+
+		str = (char*)"<NA>";
+	}
+
+	if(op->m_width != 0)
+	{
+		append_padded(str, op->m_width);
+	}
+	else
+	{
+		append(str, (uint32_t)strlen(str));
+	}
+
+	return true;
+}
+
+//
+// Tells if rawval_to_string() can convert the values of a type, so that the
+// conversion can happen in render_snapshot()
+//
+static inline bool is_renderable_type(ppm_param_type type)
+{
+	switch(type)
+	{
+	case PT_INT8:
+	case PT_INT16:
+	case PT_INT32:
+	case PT_INT64:
+	case PT_PID:
+	case PT_ERRNO:
+	case PT_L4PROTO:
+	case PT_UINT8:
+	case PT_PORT:
+	case PT_UINT16:
+	case PT_UINT32:
+	case PT_UINT64:
+	case PT_RELTIME:
+	case PT_ABSTIME:
+	case PT_CHARBUF:
+	case PT_BYTEBUF:
+	case PT_BOOL:
+	case PT_IPV4ADDR:
+	case PT_DOUBLE:
+		return true;
+	default:
+		return false;
+	}
+}
+
+bool sinsp_evt_formatter::snapshot(sinsp_evt* evt, OUT sinsp_value_snapshot* snap)
+{
+	bool retval = true;
+
+	for(auto it = m_text_program.begin(); it != m_text_program.end(); ++it)
+	{
+		sinsp_filter_check* chk = it->m_chk;
+		uint32_t len;
+
+		if(chk == NULL)
+		{
+			continue;
+		}
+
+		uint8_t* val = chk->extract(evt, &len);
+
+		//
+		// The values that rawval_to_string() can't convert later, e.g.
+		// because they point to data that goes away with the event, are
+		// converted now, like tostring() does
+		//
+		if(val != NULL &&
+			is_renderable_type(chk->m_field->m_type) &&
+			snap->add_raw(val, len, chk->m_field->m_type))
+		{
+			continue;
+		}
+
+		char* str = (val != NULL)? chk->rawval_to_string(val, chk->m_field, len) : NULL;
+
+		if(str == NULL)
+		{
+			snap->add(sinsp_value_snapshot::VT_NULL, NULL, 0, 0);
+
+			if(m_require_all_values)
 			{
 				retval = false;
-				continue;
 			}
+		}
+		else
+		{
+			uint32_t slen = (uint32_t)strlen(str);
+			snap->add(sinsp_value_snapshot::VT_STRING, (uint8_t*)str, slen, slen);
+		}
+	}
 
-			fi = m_tokens[j]->get_field_info();
+	return retval;
+}
 
-			if(fi && fi->m_name) 
-			{
-				m_root[fi->m_name] = m_tokens[j]->tojson(evt);
-			} 
-		} 
-		else 
-		{
-			char* str = m_tokens[j]->tostring(evt);
+bool sinsp_evt_formatter::render_snapshot(sinsp_value_snapshot* snap, uint32_t* pos, OUT char** res, OUT uint32_t* len)
+{
+	bool retval = true;
 
-			if(retval == false)
+	m_outlen = 0;
+
+	for(auto it = m_text_program.begin(); it != m_text_program.end(); ++it)
+	{
+		if(it->m_chk == NULL)
+		{
+			if(retval)
 			{
-				continue;
+				append(it->m_text.c_str(), (uint32_t)it->m_text.size());
 			}
 
-			if(str == NULL) 
+			continue;
+		}
+
+		//
+		// Always consume the value, so that *pos ends up after the event
+		//
+		sinsp_value_snapshot::value* v = snap->next(pos);
+		char* str;
+
+		if(retval == false)
+		{
+			continue;
+		}
+
+		switch(v->m_type)
+		{
+		case sinsp_value_snapshot::VT_RAW:
+			str = it->m_chk->rawval_to_string(v->get_data(), it->m_chk->m_field, v->m_len);
+			break;
+		case sinsp_value_snapshot::VT_STRING:
+			str = (char*)v->get_data();
+			break;
+		default:
+			str = NULL;
+			break;
+		}
+
+		retval = append_field(&*it, str);
+	}
+
+	append("", 1);
+	m_outlen--;
+
+	*res = &m_outbuf[0];
+	*len = m_outlen;
+	return retval;
+}
+
+sinsp_evt_formatter* sinsp_evt_formatter::new_renderer()
+{
+	sinsp_evt_formatter* res = new sinsp_evt_formatter(m_inspector);
+
+	res->m_require_all_values = m_require_all_values;
+
+	//
+	// The checks are only used for their conversion buffers. Their field
+	// info is the one of the original check, which may have been customized
+	// by parse_field_name(), e.g. for evt.rawarg.
+	//
+	for(auto it = m_text_program.begin(); it != m_text_program.end(); ++it)
+	{
+		format_op op = *it;
+
+		if(op.m_chk != NULL)
+		{
+			op.m_chk = g_filterlist.new_filter_check_from_another(it->m_chk);
+			op.m_chk->m_field = it->m_chk->m_field;
+			res->m_chks_to_free.push_back(op.m_chk);
+		}
+
+		res->m_text_program.push_back(op);
+	}
+
+	return res;
+}
+
+bool sinsp_evt_formatter::render_json(sinsp_evt* evt)
+{
+	bool retval = true;
+
+	m_json.clear();
+
+	if(m_first) 
+	{
+		// Give it the opening stanza of a JSON array
+		m_json.raw("[", 1);
+	} 
+	else 
+	{
+		// Otherwise say this is another object in an
+		// existing JSON array
+		m_json.raw(",\n", 2);
+	}
+
+	if(m_json_program.size() == 0)
+	{
+		m_json.null_value();
+	}
+	else
+	{
+		m_json.begin_object();
+
+		for(auto it = m_json_program.begin(); it != m_json_program.end(); ++it)
+		{
+			m_json.key(it->m_text.c_str(), (uint32_t)it->m_text.size());
+
+			if(!it->m_chk->tojson(evt, &m_json))
 			{
 				if(m_require_all_values)
 				{
 					retval = false;
-					continue;
-				}
-				else 
-				{
-					str = (char*)"<NA>";
 				}
-			}
-
-			uint32_t tks = m_tokenlens[j];
 
-			if(tks != 0)
-			{
-				string sstr(str);
-				sstr.resize(tks, ' ');
-				(*res) += sstr;
-			}
-			else
-			{
-				(*res) += str;
+				m_json.null_value();
 			}
 		}
+
+		m_json.end_object();
 	}
 
-	if(m_inspector->get_buffer_format() == sinsp_evt::PF_JSON
-	   || m_inspector->get_buffer_format() == sinsp_evt::PF_JSONEOLS
-	   || m_inspector->get_buffer_format() == sinsp_evt::PF_JSONHEX
-	   || m_inspector->get_buffer_format() == sinsp_evt::PF_JSONHEXASCII
-	   || m_inspector->get_buffer_format() == sinsp_evt::PF_JSONBASE64)
+	m_first = false;
+	return retval;
+}
+
+bool sinsp_evt_formatter::tobuffer(sinsp_evt* evt, OUT char** res, OUT uint32_t* len)
+{
+	bool retval;
+
+	if(is_json_format(m_inspector->get_buffer_format()))
 	{
-		if(m_first) 
-		{
-			// Give it the opening stanza of a JSON array
-			(*res) = '[';
-			m_first = false;
-		} 
-		else 
-		{
-			// Otherwise say this is another object in an
-			// existing JSON array
-			(*res) = ",\n";
-		}
+		retval = render_json(evt);
 
-		(*res) += m_writer.write( m_root );
-		(*res) = res->substr(0, res->size() - 1);
+		*res = m_json.get_buffer();
+		*len = m_json.get_size();
 	}
+	else
+	{
+		retval = render_text(evt);
+
+		append("", 1);
+		m_outlen--;
+
+		*res = &m_outbuf[0];
+		*len = m_outlen;
+	}
+
+	return retval;
+}
 
+bool sinsp_evt_formatter::tostring(sinsp_evt* evt, OUT string* res)
+{
+	char* str;
+	uint32_t len;
+	bool retval = tobuffer(evt, &str, &len);
+
+	res->assign(str, len);
 	return retval;
 }
 
+bool sinsp_evt_formatter::write(sinsp_evt* evt, sinsp_writer* writer, bool eol)
+{
+	char* str;
+	uint32_t len;
+
+	if(!tobuffer(evt, &str, &len))
+	{
+		return false;
+	}
+
+	//
+	// The rendering is NUL terminated, so there's room for the newline
+	//
+	if(eol)
+	{
+		str[len] = '\n';
+		len++;
+	}
+
+	writer->write(str, len);
+	return true;
+}
+
 #else  // HAS_FILTERING
 
 sinsp_evt_formatter::sinsp_evt_formatter(sinsp* inspector, const string& fmt)
@@ -290,4 +617,34 @@ bool sinsp_evt_formatter::tostring(sinsp_evt* evt, OUT string* res)
 	throw sinsp_exception("sinsp_evt_formatter unvavailable because it was not compiled in the library");
 	return false;
 }
+
+bool sinsp_evt_formatter::tobuffer(sinsp_evt* evt, OUT char** res, OUT uint32_t* len)
+{
+	throw sinsp_exception("sinsp_evt_formatter unvavailable because it was not compiled in the library");
+	return false;
+}
+
+bool sinsp_evt_formatter::write(sinsp_evt* evt, sinsp_writer* writer, bool eol)
+{
+	throw sinsp_exception("sinsp_evt_formatter unvavailable because it was not compiled in the library");
+	return false;
+}
+
+bool sinsp_evt_formatter::snapshot(sinsp_evt* evt, OUT sinsp_value_snapshot* snap)
+{
+	throw sinsp_exception("sinsp_evt_formatter unvavailable because it was not compiled in the library");
+	return false;
+}
+
+bool sinsp_evt_formatter::render_snapshot(sinsp_value_snapshot* snap, uint32_t* pos, OUT char** res, OUT uint32_t* len)
+{
+	throw sinsp_exception("sinsp_evt_formatter unvavailable because it was not compiled in the library");
+	return false;
+}
+
+sinsp_evt_formatter* sinsp_evt_formatter::new_renderer()
+{
+	throw sinsp_exception("sinsp_evt_formatter unvavailable because it was not compiled in the library");
+	return NULL;
+}
 #endif // HAS_FILTERING
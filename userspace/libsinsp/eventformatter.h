@@ -17,18 +17,37 @@ along with sysdig.  If not, see <http://www.gnu.org/licenses/>.
 */
 
 #pragma once
-#include <json/json.h>
 
 class sinsp_filter_check;
+class sinsp_value_snapshot;
 
 /** @defgroup event Event manipulation
  *  @{
  */
 
+/*!
+  \brief Destination of the output of sinsp_evt_formatter::write().
+*/
+class SINSP_PUBLIC sinsp_writer
+{
+public:
+	virtual ~sinsp_writer()
+	{
+	}
+
+	/*!
+	  \brief Writes len bytes of output.
+	*/
+	virtual void write(const char* buf, uint32_t len) = 0;
+};
+
 /*!
   \brief Event to string converter class.
   This class can be used to format an event into a string, based on an arbitrary
   format.
+  The format is compiled once, into a sequence of operations for the text
+  output and one for the JSON output, and the events are rendered in a
+  buffer that is reused from one event to the next.
 */
 class SINSP_PUBLIC sinsp_evt_formatter
 {
@@ -57,6 +76,33 @@ public:
 	*/
 	bool tostring(sinsp_evt* evt, OUT string* res);
 
+	/*!
+	  \brief Renders the event in the internal buffer of the formatter,
+	   without allocating memory once the buffer has grown to the size of the
+	   longest rendering.
+
+	  \param evt Pointer to the event to be converted into string.
+	  \param res Set to the NUL terminated rendering, which stays valid until
+	   the next call.
+	  \param len Set to the length of the rendering.
+
+	  \return true if the string should be shown (based on the initial *), 
+	   false otherwise.
+	*/
+	bool tobuffer(sinsp_evt* evt, OUT char** res, OUT uint32_t* len);
+
+	/*!
+	  \brief Renders the event and passes it to a writer.
+
+	  \param evt Pointer to the event to be converted into string.
+	  \param writer The writer that receives the rendering.
+	  \param eol If true, a newline is appended to the rendering.
+
+	  \return true if the event has been written (based on the initial *), 
+	   false otherwise.
+	*/
+	bool write(sinsp_evt* evt, sinsp_writer* writer, bool eol);
+
 	/*!
 	  \brief Fills res with end of capture string rendering of the event.
 	  \param res Pointer to the string that will be filled with the result. 
@@ -66,18 +112,87 @@ public:
 	*/
 	bool on_capture_end(OUT string* res);
 
+	/*!
+	  \brief Extracts the fields of the text output of the event and appends
+	   their values to a snapshot, so that the event can be rendered later by
+	   render_snapshot().
+
+	  \param evt Pointer to the event.
+	  \param snap The snapshot that receives the values.
+
+	  \return false if the event must not be shown (based on the initial *).
+	   The values are added anyway.
+	*/
+	bool snapshot(sinsp_evt* evt, OUT sinsp_value_snapshot* snap);
+
+	/*!
+	  \brief Renders the text output of an event from the values added to a
+	   snapshot by snapshot().
+	  Unlike the other functions, this one doesn't extract anything, so it can
+	  run on another thread, with a formatter returned by new_renderer().
+
+	  \param snap The snapshot.
+	  \param pos The offset of the values of the event in the snapshot. It's
+	   moved past them.
+	  \param res Set to the NUL terminated rendering, which stays valid until
+	   the next call.
+	  \param len Set to the length of the rendering.
+
+	  \return true if the string should be shown (based on the initial *),
+	   false otherwise.
+	*/
+	bool render_snapshot(sinsp_value_snapshot* snap, uint32_t* pos, OUT char** res, OUT uint32_t* len);
+
+	/*!
+	  \brief Returns a formatter with the same text format, which can only be
+	   used with render_snapshot(). Each thread that renders snapshots needs its
+	   own. It must be deleted before this formatter.
+	*/
+	sinsp_evt_formatter* new_renderer();
+
 private:
+	//
+	// An operation of a compiled format. In the text programs, m_chk is NULL
+	// for the text between the fields.
+	//
+	class format_op
+	{
+	public:
+		sinsp_filter_check* m_chk;
+		string m_text;
+		uint32_t m_width; // 0 if the field is not padded
+
+		// Orders the operations of the JSON program by key
+		bool operator<(const format_op& other) const
+		{
+			return m_text < other.m_text;
+		}
+	};
+
+	sinsp_evt_formatter(sinsp* inspector);
 	void set_format(const string& fmt);
-	vector<sinsp_filter_check*> m_tokens;
-	vector<uint32_t> m_tokenlens;
+	inline bool append_field(const format_op* op, char* str);
+	bool render_text(sinsp_evt* evt);
+	bool render_json(sinsp_evt* evt);
+	inline void append(const char* str, uint32_t len);
+	inline void append_padded(const char* str, uint32_t width);
+	void grow(uint32_t len);
+
+	vector<format_op> m_text_program;
+	vector<format_op> m_json_program;
 	sinsp* m_inspector;
 	bool m_require_all_values;
 	vector<sinsp_filter_check*> m_chks_to_free;
 
+	//
+	// The rendering of the last event, when it's text
+	//
+	vector<char> m_outbuf;
+	uint32_t m_outlen;
+
 	// Is this the first to_string call?
 	bool m_first;
-	Json::Value m_root;
-	Json::FastWriter m_writer;
+	sinsp_json_writer m_json;
 };
 
 /*@}*/
@@ -0,0 +1,158 @@
+/*
+Copyright (C) 2013-2014 Draios inc.
+
+This file is part of sysdig.
+
+sysdig is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License version 2 as
+published by the Free Software Foundation.
+
+sysdig is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sysdig.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "sinsp.h"
+#include "sinsp_int.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// sinsp_evt_buffer_pool implementation
+///////////////////////////////////////////////////////////////////////////////
+sinsp_evt_buffer_pool::sinsp_evt_buffer_pool()
+{
+	m_allocated_bytes = 0;
+	m_leased_bytes = 0;
+}
+
+sinsp_evt_buffer_pool::~sinsp_evt_buffer_pool()
+{
+	//
+	// All the buffers must have been released by now
+	//
+	ASSERT(m_leased_bytes == 0);
+
+	for(uint32_t j = 0; j < m_slabs.size(); j++)
+	{
+		free(m_slabs[j]);
+	}
+}
+
+void sinsp_evt_buffer_pool::refill(uint32_t sclass)
+{
+	uint32_t size = get_class_size(sclass);
+	uint8_t* slab = (uint8_t*)malloc(EVT_POOL_SLAB_SIZE);
+
+	if(slab == NULL)
+	{
+		throw sinsp_exception("cannot allocate the event buffer pool");
+	}
+
+	m_slabs.push_back(slab);
+	m_allocated_bytes += EVT_POOL_SLAB_SIZE;
+
+	for(uint32_t off = 0; off + size <= EVT_POOL_SLAB_SIZE; off += size)
+	{
+		m_free[sclass].push_back(slab + off);
+	}
+}
+
+uint8_t* sinsp_evt_buffer_pool::lease(uint32_t len, uint32_t* sclass)
+{
+	uint32_t c = 0;
+	uint8_t* res;
+
+	ASSERT(len <= SP_EVT_BUF_SIZE);
+
+	while(get_class_size(c) < len)
+	{
+		c++;
+	}
+
+	ASSERT(c < EVT_POOL_NCLASSES);
+
+	if(m_free[c].empty())
+	{
+		refill(c);
+	}
+
+	res = m_free[c].back();
+	m_free[c].pop_back();
+	m_leased_bytes += get_class_size(c);
+
+	*sclass = c;
+	return res;
+}
+
+void sinsp_evt_buffer_pool::release(uint8_t* buf, uint32_t sclass)
+{
+	ASSERT(sclass < EVT_POOL_NCLASSES);
+
+	m_free[sclass].push_back(buf);
+	m_leased_bytes -= get_class_size(sclass);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// sinsp_evt_buffer implementation
+///////////////////////////////////////////////////////////////////////////////
+sinsp_evt_buffer::sinsp_evt_buffer(const sinsp_evt_buffer& other)
+{
+	m_pool = NULL;
+	m_data = NULL;
+	m_sclass = 0;
+	*this = other;
+}
+
+sinsp_evt_buffer& sinsp_evt_buffer::operator=(const sinsp_evt_buffer& other)
+{
+	if(this == &other)
+	{
+		return *this;
+	}
+
+	if(other.m_data == NULL)
+	{
+		release();
+		return *this;
+	}
+
+	uint32_t len = sinsp_evt_buffer_pool::get_class_size(other.m_sclass);
+	memcpy(reserve(other.m_pool, len), other.m_data, len);
+	return *this;
+}
+
+uint8_t* sinsp_evt_buffer::reserve(sinsp_evt_buffer_pool* pool, uint32_t len)
+{
+	if(m_data != NULL)
+	{
+		//
+		// Keep the buffer if it's of the right class. A smaller event in a
+		// bigger buffer would waste memory for as long as the thread lives.
+		//
+		if(pool == m_pool &&
+			len <= sinsp_evt_buffer_pool::get_class_size(m_sclass) &&
+			(m_sclass == 0 || len > sinsp_evt_buffer_pool::get_class_size(m_sclass - 1)))
+		{
+			return m_data;
+		}
+
+		release();
+	}
+
+	m_pool = pool;
+	m_data = pool->lease(len, &m_sclass);
+	return m_data;
+}
+
+void sinsp_evt_buffer::release()
+{
+	if(m_data != NULL)
+	{
+		m_pool->release(m_data, m_sclass);
+		m_data = NULL;
+		m_pool = NULL;
+	}
+}
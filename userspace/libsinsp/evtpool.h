@@ -0,0 +1,116 @@
+/*
+Copyright (C) 2013-2014 Draios inc.
+
+This file is part of sysdig.
+
+sysdig is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License version 2 as
+published by the Free Software Foundation.
+
+sysdig is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sysdig.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+//
+// Pool of the buffers that the threads use to keep their last enter event.
+// Most threads never store an event, or store small ones, so rather than
+// embedding an SP_EVT_BUF_SIZE array in every sinsp_threadinfo the buffers
+// are leased from here, in power of two size classes carved out of larger
+// slabs. Released buffers go back to the free list of their class, and the
+// slabs are only freed with the pool.
+//
+class SINSP_PUBLIC sinsp_evt_buffer_pool
+{
+public:
+	sinsp_evt_buffer_pool();
+	~sinsp_evt_buffer_pool();
+
+	//
+	// Lease a buffer of at least len bytes, len <= SP_EVT_BUF_SIZE.
+	// *sclass receives the size class that must be passed to release().
+	//
+	uint8_t* lease(uint32_t len, uint32_t* sclass);
+	void release(uint8_t* buf, uint32_t sclass);
+
+	static inline uint32_t get_class_size(uint32_t sclass)
+	{
+		return EVT_POOL_MIN_SIZE << sclass;
+	}
+
+	//
+	// Memory taken by the slabs, and the part of it that is currently leased
+	//
+	inline uint64_t get_allocated_bytes()
+	{
+		return m_allocated_bytes;
+	}
+
+	inline uint64_t get_leased_bytes()
+	{
+		return m_leased_bytes;
+	}
+
+private:
+	static const uint32_t EVT_POOL_MIN_SIZE = 64;
+	static const uint32_t EVT_POOL_NCLASSES = 7; // 64 to 4096 bytes
+	static const uint32_t EVT_POOL_SLAB_SIZE = 64 * 1024;
+
+	void refill(uint32_t sclass);
+
+	vector<uint8_t*> m_free[EVT_POOL_NCLASSES];
+	vector<uint8_t*> m_slabs;
+	uint64_t m_allocated_bytes;
+	uint64_t m_leased_bytes;
+};
+
+//
+// A buffer leased from a sinsp_evt_buffer_pool, returned to the pool when
+// released or destroyed. Copies get a buffer of their own.
+//
+class SINSP_PUBLIC sinsp_evt_buffer
+{
+public:
+	sinsp_evt_buffer()
+	{
+		m_pool = NULL;
+		m_data = NULL;
+		m_sclass = 0;
+	}
+
+	sinsp_evt_buffer(const sinsp_evt_buffer& other);
+	sinsp_evt_buffer& operator=(const sinsp_evt_buffer& other);
+
+	~sinsp_evt_buffer()
+	{
+		release();
+	}
+
+	//
+	// Make sure the buffer can hold len bytes and return it. The content is
+	// preserved only if the size class doesn't change.
+	//
+	uint8_t* reserve(sinsp_evt_buffer_pool* pool, uint32_t len);
+	void release();
+
+	inline uint8_t* data()
+	{
+		return m_data;
+	}
+
+	inline uint32_t size()
+	{
+		return (m_data != NULL)? sinsp_evt_buffer_pool::get_class_size(m_sclass) : 0;
+	}
+
+private:
+	sinsp_evt_buffer_pool* m_pool;
+	uint8_t* m_data;
+	uint32_t m_sclass;
+};
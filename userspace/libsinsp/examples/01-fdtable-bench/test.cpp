@@ -0,0 +1,213 @@
+/*
+Copyright (C) 2013-2014 Draios inc.
+
+This file is part of sysdig.
+
+sysdig is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License version 2 as
+published by the Free Software Foundation.
+
+sysdig is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sysdig.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+//
+// Compares the lookup speed of sinsp_fdtable with the unordered_map based
+// table it replaced, on fd sequences that look like the ones of a process:
+// mostly small fds with some locality, and a few large ones.
+//
+// Usage: sinsp-fdtable-bench [number of lookups]
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+
+#include "sinsp.h"
+#include "sinsp_int.h"
+
+static uint64_t get_time_ns()
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return (uint64_t)tv.tv_sec * 1000000000 + tv.tv_usec * 1000;
+}
+
+//
+// The previous implementation of the table, lookup logic included
+//
+class map_fdtable
+{
+public:
+	map_fdtable()
+	{
+		m_last_accessed_fd = -1;
+		m_last_accessed_fdinfo = NULL;
+	}
+
+	sinsp_fdinfo_t* find(int64_t fd)
+	{
+		unordered_map<int64_t, sinsp_fdinfo_t>::iterator fdit = m_table.find(fd);
+
+		if(m_last_accessed_fd != -1 && fd == m_last_accessed_fd)
+		{
+			return m_last_accessed_fdinfo;
+		}
+
+		fdit = m_table.find(fd);
+
+		if(fdit == m_table.end())
+		{
+			return NULL;
+		}
+
+		m_last_accessed_fd = fd;
+		m_last_accessed_fdinfo = &(fdit->second);
+		return &(fdit->second);
+	}
+
+	void add(int64_t fd, sinsp_fdinfo_t* fdinfo)
+	{
+		m_table.insert(std::make_pair(fd, *fdinfo));
+		m_last_accessed_fd = -1;
+	}
+
+	unordered_map<int64_t, sinsp_fdinfo_t> m_table;
+	int64_t m_last_accessed_fd;
+	sinsp_fdinfo_t* m_last_accessed_fdinfo;
+};
+
+//
+// A sequence of lookups: each fd is looked up a few times in a row, like
+// the enter and exit events of a syscall and the filter fields do. The
+// sequence is short enough to stay in the CPU cache and is replayed, so
+// that the benchmark measures the table and not the sequence.
+//
+#define SEQUENCE_LEN 65536
+
+static void make_sequence(vector<int64_t>* seq, const vector<int64_t>& fds)
+{
+	seq->clear();
+
+	while(seq->size() < SEQUENCE_LEN)
+	{
+		int64_t fd = fds[rand() % fds.size()];
+		uint32_t nrep = 1 + rand() % 4;
+
+		for(uint32_t j = 0; j < nrep; j++)
+		{
+			seq->push_back(fd);
+		}
+	}
+}
+
+template<typename T> static double run(T* table, const vector<int64_t>& seq, uint64_t nlookups, uint64_t* checksum)
+{
+	uint64_t start = get_time_ns();
+	uint64_t sum = 0;
+	uint64_t n = 0;
+
+	while(n < nlookups)
+	{
+		for(uint32_t j = 0; j < seq.size(); j++)
+		{
+			sinsp_fdinfo_t* fdinfo = table->find(seq[j]);
+
+			if(fdinfo != NULL)
+			{
+				sum += fdinfo->m_openflags;
+			}
+		}
+
+		n += seq.size();
+	}
+
+	*checksum = sum;
+	return (double)(get_time_ns() - start) / n;
+}
+
+static void bench(sinsp* inspector, const char* name, const vector<int64_t>& fds, uint64_t nlookups)
+{
+	sinsp_fdtable table(inspector);
+	map_fdtable oldtable;
+	sinsp_fdinfo_t fdinfo;
+	vector<int64_t> seq;
+	uint64_t sum_old;
+	uint64_t sum_new;
+	double ns_old;
+	double ns_new;
+
+	for(uint32_t j = 0; j < fds.size(); j++)
+	{
+		fdinfo.m_openflags = (uint32_t)j;
+		table.add(fds[j], &fdinfo);
+		oldtable.add(fds[j], &fdinfo);
+	}
+
+	make_sequence(&seq, fds);
+
+	ns_old = run(&oldtable, seq, nlookups, &sum_old);
+	ns_new = run(&table, seq, nlookups, &sum_new);
+
+	if(sum_old != sum_new)
+	{
+		fprintf(stderr, "%s: lookup results don't match\n", name);
+		exit(-1);
+	}
+
+	printf("%-24s %8u %12.2f %12.2f\n", name, (uint32_t)fds.size(), ns_old, ns_new);
+}
+
+int main(int argc, char** argv)
+{
+	uint64_t nlookups = 50000000;
+	sinsp inspector;
+	vector<int64_t> fds;
+	uint32_t j;
+
+	if(argc > 1)
+	{
+		nlookups = strtoull(argv[1], NULL, 10);
+	}
+
+	srand(1);
+
+	printf("%-24s %8s %12s %12s\n", "workload", "fds", "map ns/op", "table ns/op");
+
+	for(j = 0; j < 16; j++)
+	{
+		fds.push_back(j);
+	}
+
+	bench(&inspector, "small process", fds, nlookups);
+
+	for(; j < 400; j++)
+	{
+		fds.push_back(j);
+	}
+
+	bench(&inspector, "server", fds, nlookups);
+
+	for(j = 0; j < 64; j++)
+	{
+		fds.push_back(FDTABLE_DENSE_SIZE + j * 15013);
+	}
+
+	bench(&inspector, "server, some large fds", fds, nlookups);
+
+	fds.clear();
+
+	for(j = 0; j < 5000; j++)
+	{
+		fds.push_back(FDTABLE_DENSE_SIZE + j * 7);
+	}
+
+	bench(&inspector, "large fds only", fds, nlookups);
+
+	return 0;
+}
@@ -0,0 +1,210 @@
+/*
+Copyright (C) 2013-2014 Draios inc.
+
+This file is part of sysdig.
+
+sysdig is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License version 2 as
+published by the Free Software Foundation.
+
+sysdig is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sysdig.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+//
+// Compares the memory taken by the thread table when every thread embeds an
+// SP_EVT_BUF_SIZE buffer for its last enter event, like it used to, with
+// the buffers leased from the pool of the thread manager.
+// Every thread stores one enter event of a typical size, which is the worst
+// case for the pool: the threads imported from /proc that never run a
+// syscall don't lease anything.
+// Each measurement runs in a child process, so that it starts from a clean
+// heap.
+//
+// Usage: sinsp-threadmem-bench [number of threads] ...
+//
+
+#define VISIBILITY_PRIVATE public:
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "sinsp.h"
+#include "sinsp_int.h"
+
+//
+// The previous layout of the thread info
+//
+class legacy_threadinfo : public sinsp_threadinfo
+{
+public:
+	uint8_t m_lastevent_buf[SP_EVT_BUF_SIZE];
+};
+
+static uint64_t get_rss_bytes()
+{
+	FILE* f = fopen("/proc/self/statm", "r");
+	unsigned long size;
+	unsigned long resident = 0;
+
+	if(f == NULL)
+	{
+		return 0;
+	}
+
+	if(fscanf(f, "%lu %lu", &size, &resident) != 2)
+	{
+		resident = 0;
+	}
+
+	fclose(f);
+	return (uint64_t)resident * sysconf(_SC_PAGESIZE);
+}
+
+//
+// An enter event with the given length. Most enter events carry a few
+// numeric parameters, the ones with a path are bigger.
+//
+static void make_event(uint8_t* buf, int64_t tid, uint32_t len)
+{
+	scap_evt* hdr = (scap_evt*)buf;
+
+	memset(buf, 0, len);
+	hdr->ts = 1;
+	hdr->tid = tid;
+	hdr->len = len;
+	hdr->type = PPME_SYSCALL_OPEN_E;
+}
+
+static uint32_t get_event_len(int64_t tid)
+{
+	static const uint32_t lens[] = {40, 48, 64, 96, 180};
+	return lens[tid % (sizeof(lens) / sizeof(lens[0]))];
+}
+
+static void fill_legacy(uint32_t nthreads)
+{
+	unordered_map<int64_t, legacy_threadinfo>* table = new unordered_map<int64_t, legacy_threadinfo>();
+	uint8_t evt[SP_EVT_BUF_SIZE];
+
+	for(uint32_t j = 0; j < nthreads; j++)
+	{
+		legacy_threadinfo tinfo;
+		int64_t tid = j + 1;
+
+		tinfo.m_tid = tid;
+		tinfo.m_pid = tid;
+		tinfo.m_ptid = 1;
+		tinfo.m_comm = "worker";
+		tinfo.m_exe = "/usr/bin/worker";
+
+		legacy_threadinfo& entry = ((*table)[tid] = tinfo);
+
+		make_event(evt, tid, get_event_len(tid));
+		memcpy(entry.m_lastevent_buf, evt, get_event_len(tid));
+	}
+}
+
+static void fill_pooled(uint32_t nthreads)
+{
+	sinsp* inspector = new sinsp();
+	uint8_t evtbuf[SP_EVT_BUF_SIZE];
+	sinsp_evt evt;
+
+	evt.m_pevt = (scap_evt*)evtbuf;
+	evt.m_cpuid = 0;
+
+	for(uint32_t j = 0; j < nthreads; j++)
+	{
+		sinsp_threadinfo tinfo(inspector);
+		int64_t tid = j + 1;
+
+		tinfo.m_tid = tid;
+		tinfo.m_pid = tid;
+		tinfo.m_ptid = 1;
+		tinfo.m_comm = "worker";
+		tinfo.m_exe = "/usr/bin/worker";
+
+		inspector->m_thread_manager->add_thread(tinfo, true);
+
+		make_event(evtbuf, tid, get_event_len(tid));
+		inspector->get_thread(tid, false, true)->store_event(&evt);
+	}
+}
+
+static double measure(void (*fill)(uint32_t), uint32_t nthreads)
+{
+	int fds[2];
+	uint64_t rss = 0;
+	pid_t pid;
+
+	if(pipe(fds) != 0)
+	{
+		fprintf(stderr, "cannot create the pipe\n");
+		exit(-1);
+	}
+
+	pid = fork();
+
+	if(pid == 0)
+	{
+		uint64_t start = get_rss_bytes();
+
+		fill(nthreads);
+		rss = get_rss_bytes() - start;
+
+		if(write(fds[1], &rss, sizeof(rss)) != sizeof(rss))
+		{
+			_exit(-1);
+		}
+
+		_exit(0);
+	}
+
+	if(pid < 0 || read(fds[0], &rss, sizeof(rss)) != sizeof(rss))
+	{
+		fprintf(stderr, "measurement failed\n");
+		exit(-1);
+	}
+
+	waitpid(pid, NULL, 0);
+	close(fds[0]);
+	close(fds[1]);
+
+	return (double)rss / (1024 * 1024);
+}
+
+int main(int argc, char** argv)
+{
+	vector<uint32_t> nthreads;
+
+	for(int j = 1; j < argc; j++)
+	{
+		nthreads.push_back((uint32_t)strtoul(argv[j], NULL, 10));
+	}
+
+	if(nthreads.empty())
+	{
+		nthreads.push_back(10000);
+		nthreads.push_back(50000);
+	}
+
+	printf("%8s %14s %14s\n", "threads", "inline MB", "pooled MB");
+
+	for(uint32_t j = 0; j < nthreads.size(); j++)
+	{
+		double mb_legacy = measure(fill_legacy, nthreads[j]);
+		double mb_pooled = measure(fill_pooled, nthreads[j]);
+
+		printf("%8u %14.1f %14.1f\n", nthreads[j], mb_legacy, mb_pooled);
+	}
+
+	return 0;
+}
@@ -0,0 +1,197 @@
+/*
+Copyright (C) 2013-2014 Draios inc.
+
+This file is part of sysdig.
+
+sysdig is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License version 2 as
+published by the Free Software Foundation.
+
+sysdig is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sysdig.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+//
+// Compares sinsp_threadtable with the unordered_map based thread table it
+// replaced, on a table with a steady number of threads where processes are
+// started and reaped at different rates: from a long running server, where
+// almost all the operations are lookups, to a fork-heavy CI host.
+//
+// Usage: sinsp-threadtable-bench [number of operations]
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+
+#include "sinsp.h"
+#include "sinsp_int.h"
+
+static uint64_t get_time_ns()
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return (uint64_t)tv.tv_sec * 1000000000 + tv.tv_usec * 1000;
+}
+
+//
+// The previous implementation of the table
+//
+class map_threadtable
+{
+public:
+	sinsp_threadinfo* find(int64_t tid)
+	{
+		unordered_map<int64_t, sinsp_threadinfo>::iterator it = m_table.find(tid);
+		return (it != m_table.end())? &it->second : NULL;
+	}
+
+	void insert(const sinsp_threadinfo& tinfo)
+	{
+		m_table[tinfo.m_tid] = tinfo;
+	}
+
+	void erase(int64_t tid)
+	{
+		m_table.erase(tid);
+	}
+
+	unordered_map<int64_t, sinsp_threadinfo> m_table;
+};
+
+class slot_threadtable
+{
+public:
+	sinsp_threadinfo* find(int64_t tid)
+	{
+		sinsp_threadtable::iterator it = m_table.find(tid);
+		return (it != m_table.end())? &it->second : NULL;
+	}
+
+	void insert(const sinsp_threadinfo& tinfo)
+	{
+		m_table.insert(tinfo);
+	}
+
+	void erase(int64_t tid)
+	{
+		m_table.erase(m_table.find(tid));
+	}
+
+	sinsp_threadtable m_table;
+};
+
+//
+// Every nlookups lookups, the oldest process exits and a new one is started
+// with the next pid, like the kernel does. The lookups go to random live
+// threads, a few times in a row like the events of a syscall do.
+//
+#define SEQUENCE_LEN 65536
+
+template<typename T> static double run(sinsp* inspector, uint32_t nthreads, uint32_t nlookups, uint64_t nops, uint64_t* checksum)
+{
+	T table;
+	sinsp_threadinfo tinfo(inspector);
+	vector<int64_t> live;
+	vector<uint32_t> seq;
+	uint32_t seqpos = 0;
+	uint64_t sum = 0;
+	uint64_t n = 0;
+	uint32_t oldest = 0;
+	int64_t next_tid = 1;
+	uint64_t start;
+
+	//
+	// The random positions are generated in advance, so that the benchmark
+	// measures the table and not rand()
+	//
+	srand(1);
+
+	for(uint32_t j = 0; j < SEQUENCE_LEN; j++)
+	{
+		seq.push_back(rand() % nthreads);
+	}
+
+	for(uint32_t j = 0; j < nthreads; j++)
+	{
+		tinfo.m_tid = tinfo.m_pid = next_tid++;
+		table.insert(tinfo);
+		live.push_back(tinfo.m_tid);
+	}
+
+	start = get_time_ns();
+
+	while(n < nops)
+	{
+		for(uint32_t j = 0; j < nlookups; j += 4)
+		{
+			int64_t tid = live[seq[seqpos]];
+
+			seqpos = (seqpos + 1) % SEQUENCE_LEN;
+
+			for(uint32_t k = 0; k < 4; k++)
+			{
+				sinsp_threadinfo* ptinfo = table.find(tid);
+
+				if(ptinfo != NULL)
+				{
+					sum += ptinfo->m_pid;
+				}
+			}
+		}
+
+		table.erase(live[oldest]);
+		tinfo.m_tid = tinfo.m_pid = next_tid++;
+		table.insert(tinfo);
+		live[oldest] = tinfo.m_tid;
+		oldest = (oldest + 1) % live.size();
+
+		n += nlookups + 2;
+	}
+
+	*checksum = sum;
+	return (double)(get_time_ns() - start) / n;
+}
+
+static void bench(sinsp* inspector, const char* name, uint32_t nthreads, uint32_t nlookups, uint64_t nops)
+{
+	uint64_t sum_old;
+	uint64_t sum_new;
+	double ns_old = run<map_threadtable>(inspector, nthreads, nlookups, nops, &sum_old);
+	double ns_new = run<slot_threadtable>(inspector, nthreads, nlookups, nops, &sum_new);
+
+	if(sum_old != sum_new)
+	{
+		fprintf(stderr, "%s: lookup results don't match\n", name);
+		exit(-1);
+	}
+
+	printf("%-20s %8u %10u %12.2f %12.2f\n", name, nthreads, nlookups, ns_old, ns_new);
+}
+
+int main(int argc, char** argv)
+{
+	uint64_t nops = 20000000;
+	sinsp inspector;
+
+	if(argc > 1)
+	{
+		nops = strtoull(argv[1], NULL, 10);
+	}
+
+	printf("%-20s %8s %10s %12s %12s\n", "workload", "threads", "lookups", "map ns/op", "table ns/op");
+
+	bench(&inspector, "server", 2000, 10000, nops);
+	bench(&inspector, "busy host", 2000, 200, nops);
+	bench(&inspector, "fork-heavy CI host", 2000, 16, nops);
+	bench(&inspector, "server", 30000, 10000, nops);
+	bench(&inspector, "busy host", 30000, 200, nops);
+	bench(&inspector, "fork-heavy CI host", 30000, 16, nops);
+
+	return 0;
+}
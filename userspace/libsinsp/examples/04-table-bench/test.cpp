@@ -0,0 +1,222 @@
+/*
+Copyright (C) 2013-2014 Draios inc.
+
+This file is part of sysdig.
+
+sysdig is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License version 2 as
+published by the Free Software Foundation.
+
+sysdig is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sysdig.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+//
+// Feeds synthetic event streams through sinsp_table the way csysdig does,
+// with timestamps 1us apart, i.e. 1M events per second, and a sample
+// emitted at the end of every second.
+// For every table layout it reports the cost of an event, the share of a
+// CPU that a 1M events/sec stream takes, and the bytes of the value buffer
+// that a sample uses, which should depend on the number of rows and not on
+// the number of events. The time it takes to create a sample is reported
+// separately, since csysdig stops processing events while it does that. Like
+// csysdig, only the rows that fit on a VISIBLE_ROWS lines terminal are sorted
+// when the sample is created.
+//
+// Usage: sinsp-table-bench [number of events]
+//
+
+#define VISIBILITY_PRIVATE public:
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+
+#include "sinsp.h"
+#include "sinsp_int.h"
+#include "filter.h"
+#include "filterchecks.h"
+#include "table.h"
+
+extern sinsp_evttables g_infotables;
+
+#define EVENTS_PER_SECOND 1000000
+#define SEQUENCE_LEN (1 << 20)
+#define VISIBLE_ROWS 50
+
+static uint64_t get_time_ns()
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return (uint64_t)tv.tv_sec * 1000000000 + tv.tv_usec * 1000;
+}
+
+static sinsp_view_column_info make_column(string field, uint32_t flags, sinsp_field_aggregation aggregation)
+{
+	return sinsp_view_column_info(field,
+		field,
+		"",
+		10,
+		flags,
+		aggregation,
+		aggregation,
+		vector<string>());
+}
+
+//
+// Returns the sum of the evt.count column of the sample, which must match
+// the number of events that went into it
+//
+static uint64_t count_events(vector<sinsp_sample_row>* sample)
+{
+	uint64_t res = 0;
+
+	for(auto it = sample->begin(); it != sample->end(); ++it)
+	{
+		res += *(uint32_t*)it->m_values[0].m_val;
+	}
+
+	return res;
+}
+
+static void bench(sinsp* inspector, const char* name, const string& key, const string& groupby, uint32_t nkeys, uint64_t nevents)
+{
+	static const uint16_t evtypes[] = {PPME_SYSCALL_READ_X, PPME_SYSCALL_WRITE_X, PPME_SYSCALL_OPEN_X, PPME_SOCKET_SENDTO_X};
+	vector<sinsp_view_column_info> columns;
+	vector<sinsp_threadinfo*> threads;
+	vector<uint32_t> seq;
+	scap_evt scapevt;
+	sinsp_evt evt;
+	uint64_t ts = 1000000000ULL * 1000000000ULL;
+	uint64_t max_buffer_usage = 0;
+	uint64_t sample_time = 0;
+	uint32_t nsamples = 0;
+	uint64_t nsample_events = 0;
+	uint32_t nrows = 0;
+	uint64_t j;
+
+	columns.push_back(make_column(key, TEF_IS_KEY, A_NONE));
+	columns.push_back(make_column("evt.count", TEF_NONE, A_SUM));
+	columns.push_back(make_column("evt.rawtime", TEF_NONE, A_MAX));
+	columns.push_back(make_column("evt.num", TEF_NONE, A_SUM));
+	columns.push_back(make_column("evt.type", TEF_NONE, A_NONE));
+
+	if(groupby != "")
+	{
+		columns.push_back(make_column(groupby, TEF_IS_GROUPBY_KEY, A_NONE));
+	}
+
+	sinsp_table table(inspector, sinsp_table::TT_TABLE, ONE_SECOND_IN_NS, false);
+	table.configure(&columns, "", false);
+	table.set_sorting_col(1);
+	table.set_visible_rows(VISIBLE_ROWS);
+
+	for(j = 0; j < nkeys; j++)
+	{
+		sinsp_threadinfo* tinfo = new sinsp_threadinfo(inspector);
+		tinfo->m_tid = j + 1;
+		tinfo->m_pid = j + 1;
+		tinfo->m_comm = "worker-" + to_string(j);
+		threads.push_back(tinfo);
+	}
+
+	for(j = 0; j < SEQUENCE_LEN; j++)
+	{
+		seq.push_back(rand() % nkeys);
+	}
+
+	memset(&scapevt, 0, sizeof(scapevt));
+	evt.m_inspector = inspector;
+	evt.m_pevt = &scapevt;
+	evt.m_fdinfo = NULL;
+
+	uint64_t start = get_time_ns();
+
+	for(j = 0; j < nevents; j++)
+	{
+		uint32_t id = seq[j & (SEQUENCE_LEN - 1)];
+		uint16_t type = evtypes[j & 3];
+
+		ts += ONE_SECOND_IN_NS / EVENTS_PER_SECOND;
+		scapevt.ts = ts;
+		scapevt.tid = id + 1;
+		scapevt.type = type;
+		evt.m_info = &(g_infotables.m_event_info[type]);
+		evt.m_evtnum = j;
+		evt.m_cpuid = (uint16_t)id;
+		evt.m_tinfo = threads[id];
+
+		if(ts > table.m_next_flush_time_ns)
+		{
+			uint64_t buffer_usage = table.get_buffer_usage();
+
+			if(buffer_usage > max_buffer_usage)
+			{
+				max_buffer_usage = buffer_usage;
+			}
+
+			uint64_t sample_start = get_time_ns();
+			table.flush(&evt);
+			vector<sinsp_sample_row>* sample = table.get_sample(ONE_SECOND_IN_NS);
+			sample_time += get_time_ns() - sample_start;
+			nsamples++;
+
+			if(count_events(sample) != nsample_events)
+			{
+				fprintf(stderr, "%s: the sample has the wrong event count\n", name);
+				exit(-1);
+			}
+
+			nsample_events = 0;
+			nrows = (uint32_t)sample->size();
+		}
+
+		table.process_event(&evt);
+		nsample_events++;
+	}
+
+	double ns = (double)(get_time_ns() - start) / nevents;
+
+	printf("%-28s %8u %8u %12.1f %8.1f%% %12.1f %10.2f\n",
+		name,
+		nkeys,
+		nrows,
+		ns,
+		ns * EVENTS_PER_SECOND / ONE_SECOND_IN_NS * 100,
+		(double)max_buffer_usage / 1024,
+		nsamples? (double)sample_time / nsamples / 1000000 : 0);
+
+	for(j = 0; j < threads.size(); j++)
+	{
+		delete threads[j];
+	}
+}
+
+int main(int argc, char** argv)
+{
+	uint64_t nevents = 10 * EVENTS_PER_SECOND;
+	sinsp inspector;
+
+	if(argc > 1)
+	{
+		nevents = strtoull(argv[1], NULL, 10);
+	}
+
+	srand(1);
+
+	printf("%-28s %8s %8s %12s %9s %12s %10s\n", "table", "keys", "rows", "ns/event", "cpu", "buffer KB", "sample ms");
+
+	bench(&inspector, "by cpu", "evt.cpu", "", 8, nevents);
+	bench(&inspector, "by cpu", "evt.cpu", "", 10000, nevents);
+	bench(&inspector, "by process name", "proc.name", "", 100, nevents);
+	bench(&inspector, "by process name", "proc.name", "", 10000, nevents);
+	bench(&inspector, "by process name", "proc.name", "", 200000, nevents);
+	bench(&inspector, "by cpu, merged by type", "evt.cpu", "evt.type", 10000, nevents);
+
+	return 0;
+}
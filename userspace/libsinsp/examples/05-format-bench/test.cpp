@@ -0,0 +1,493 @@
+/*
+Copyright (C) 2013-2014 Draios inc.
+
+This file is part of sysdig.
+
+sysdig is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License version 2 as
+published by the Free Software Foundation.
+
+sysdig is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sysdig.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+//
+// Measures the cost of formatting the events of a capture file with
+// sinsp_evt_formatter, as text and as JSON, compared with the formatter it
+// replaced, which interpreted the format and built a new string for every
+// event, and built the JSON objects as Json::Value trees.
+// Every run reads the whole file, and the time of a run that only reads it
+// is subtracted, so that what's left is the cost of the formatting. Every
+// run is repeated NREPS times, and the fastest one is kept.
+//
+// Usage: sinsp-format-bench <capture file> [format]
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+
+#include "sinsp.h"
+#include "sinsp_int.h"
+#include "filter.h"
+#include "filterchecks.h"
+
+extern sinsp_filter_check_list g_filterlist;
+
+#define NREPS 3
+
+static uint64_t get_time_ns()
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return (uint64_t)tv.tv_sec * 1000000000 + tv.tv_usec * 1000;
+}
+
+//
+// Gives the legacy formatter access to the protected members of the checks
+//
+class legacy_check : public sinsp_filter_check
+{
+public:
+	static char* rawval_to_string(sinsp_filter_check* chk, uint8_t* rawval, const filtercheck_field_info* finfo, uint32_t len)
+	{
+		return ((legacy_check*)chk)->sinsp_filter_check::rawval_to_string(rawval, finfo, len);
+	}
+
+	static uint32_t get_field_id(sinsp_filter_check* chk)
+	{
+		return ((legacy_check*)chk)->m_field_id;
+	}
+};
+
+//
+// The previous conversion of the fields into Json::Value
+//
+static Json::Value legacy_tojson(sinsp_filter_check* chk, sinsp_evt* evt)
+{
+	const filtercheck_field_info* finfo = chk->get_field_info();
+	uint32_t len;
+
+	if(dynamic_cast<sinsp_filter_check_event*>(chk) != NULL)
+	{
+		switch(legacy_check::get_field_id(chk))
+		{
+		case sinsp_filter_check_event::TYPE_TIME:
+		case sinsp_filter_check_event::TYPE_TIME_S:
+		case sinsp_filter_check_event::TYPE_DATETIME:
+		case sinsp_filter_check_event::TYPE_RUNTIME_TIME_OUTPUT_FORMAT:
+			return (Json::Value::Int64)evt->get_ts();
+		case sinsp_filter_check_event::TYPE_RAWTS:
+		case sinsp_filter_check_event::TYPE_RAWTS_S:
+		case sinsp_filter_check_event::TYPE_RAWTS_NS:
+		case sinsp_filter_check_event::TYPE_RELTS:
+		case sinsp_filter_check_event::TYPE_RELTS_S:
+		case sinsp_filter_check_event::TYPE_RELTS_NS:
+		case sinsp_filter_check_event::TYPE_LATENCY:
+		case sinsp_filter_check_event::TYPE_LATENCY_S:
+		case sinsp_filter_check_event::TYPE_LATENCY_NS:
+		case sinsp_filter_check_event::TYPE_DELTA:
+		case sinsp_filter_check_event::TYPE_DELTA_S:
+		case sinsp_filter_check_event::TYPE_DELTA_NS:
+			return (Json::Value::Int64)*(uint64_t*)chk->extract(evt, &len);
+		case sinsp_filter_check_event::TYPE_COUNT:
+			return 1;
+		default:
+			break;
+		}
+	}
+
+	uint8_t* rawval = chk->extract(evt, &len);
+
+	if(rawval == NULL)
+	{
+		return Json::Value::nullRef;
+	}
+
+	bool numeric = (finfo->m_print_format == PF_DEC || finfo->m_print_format == PF_ID);
+
+	switch(finfo->m_type)
+	{
+	case PT_INT8:
+		if(numeric) return *(int8_t*)rawval;
+		break;
+	case PT_INT16:
+		if(numeric) return *(int16_t*)rawval;
+		break;
+	case PT_INT32:
+		if(numeric) return *(int32_t*)rawval;
+		break;
+	case PT_INT64:
+	case PT_PID:
+		if(numeric) return (Json::Value::Int64)*(int64_t*)rawval;
+		break;
+	case PT_L4PROTO:
+	case PT_UINT8:
+		if(numeric) return *(uint8_t*)rawval;
+		break;
+	case PT_PORT:
+	case PT_UINT16:
+		if(numeric) return *(uint16_t*)rawval;
+		break;
+	case PT_UINT32:
+		if(numeric) return *(uint32_t*)rawval;
+		break;
+	case PT_UINT64:
+	case PT_RELTIME:
+	case PT_ABSTIME:
+		if(numeric) return (Json::Value::UInt64)*(uint64_t*)rawval;
+		break;
+	case PT_BOOL:
+		return Json::Value((bool)(*(uint32_t*)rawval != 0));
+	case PT_CHARBUF:
+	case PT_BYTEBUF:
+	case PT_IPV4ADDR:
+		break;
+	default:
+		throw sinsp_exception("wrong event type");
+	}
+
+	return legacy_check::rawval_to_string(chk, rawval, finfo, len);
+}
+
+//
+// The previous implementation of the formatter
+//
+class legacy_formatter
+{
+public:
+	legacy_formatter(sinsp* inspector, const string& fmt)
+	{
+		uint32_t j;
+		uint32_t last_nontoken_str_start = 0;
+		string lfmt(fmt);
+
+		m_inspector = inspector;
+		m_first = true;
+
+		if(lfmt[0] == '*')
+		{
+			m_require_all_values = false;
+			lfmt.erase(0, 1);
+		}
+		else
+		{
+			m_require_all_values = true;
+		}
+
+		const char* cfmt = lfmt.c_str();
+		uint32_t lfmtlen = (uint32_t)lfmt.length();
+
+		for(j = 0; j < lfmtlen; j++)
+		{
+			if(cfmt[j] == '%')
+			{
+				int toklen = 0;
+
+				if(last_nontoken_str_start != j)
+				{
+					add_token(new rawstring_check(lfmt.substr(last_nontoken_str_start, j - last_nontoken_str_start)), 0);
+				}
+
+				if(isdigit(cfmt[j + 1]))
+				{
+					sscanf(cfmt + j + 1, "%d", &toklen);
+
+					while(isdigit(cfmt[j + 1]))
+					{
+						j++;
+					}
+				}
+
+				sinsp_filter_check* chk = g_filterlist.new_filter_check_from_fldname(string(cfmt + j + 1),
+					inspector,
+					false);
+
+				if(chk == NULL)
+				{
+					fprintf(stderr, "invalid formatting token %s\n", cfmt + j + 1);
+					exit(-1);
+				}
+
+				j += chk->parse_field_name(cfmt + j + 1, true);
+				add_token(chk, toklen);
+				last_nontoken_str_start = j + 1;
+			}
+		}
+
+		if(last_nontoken_str_start != j)
+		{
+			add_token(new rawstring_check(lfmt.substr(last_nontoken_str_start, j - last_nontoken_str_start)), 0);
+		}
+	}
+
+	~legacy_formatter()
+	{
+		for(uint32_t j = 0; j < m_tokens.size(); j++)
+		{
+			delete m_tokens[j];
+		}
+	}
+
+	bool tostring(sinsp_evt* evt, OUT string* res)
+	{
+		if(m_inspector->get_buffer_format() == sinsp_evt::PF_JSON)
+		{
+			return tojson(evt, res);
+		}
+
+		bool retval = true;
+		res->clear();
+
+		for(uint32_t j = 0; j < m_tokens.size(); j++)
+		{
+			char* str = m_tokens[j]->tostring(evt);
+
+			if(retval == false)
+			{
+				continue;
+			}
+
+			if(str == NULL)
+			{
+				if(m_require_all_values)
+				{
+					retval = false;
+					continue;
+				}
+				else
+				{
+					str = (char*)"<NA>";
+				}
+			}
+
+			uint32_t tks = m_tokenlens[j];
+
+			if(tks != 0)
+			{
+				string sstr(str);
+				sstr.resize(tks, ' ');
+				(*res) += sstr;
+			}
+			else
+			{
+				(*res) += str;
+			}
+		}
+
+		return retval;
+	}
+
+	bool tojson(sinsp_evt* evt, OUT string* res)
+	{
+		bool retval = true;
+
+		for(uint32_t j = 0; j < m_tokens.size(); j++)
+		{
+			const filtercheck_field_info* fi = m_tokens[j]->get_field_info();
+
+			if(fi == NULL)
+			{
+				continue;
+			}
+
+			Json::Value json_value = legacy_tojson(m_tokens[j], evt);
+
+			if(retval == false)
+			{
+				continue;
+			}
+
+			if(json_value == Json::Value::nullRef && m_require_all_values)
+			{
+				retval = false;
+				continue;
+			}
+
+			m_root[fi->m_name] = legacy_tojson(m_tokens[j], evt);
+		}
+
+		if(m_first)
+		{
+			(*res) = '[';
+			m_first = false;
+		}
+		else
+		{
+			(*res) = ",\n";
+		}
+
+		(*res) += m_writer.write(m_root);
+		(*res) = res->substr(0, res->size() - 1);
+
+		return retval;
+	}
+
+private:
+	void add_token(sinsp_filter_check* chk, uint32_t len)
+	{
+		m_tokens.push_back(chk);
+		m_tokenlens.push_back(len);
+	}
+
+	sinsp* m_inspector;
+	vector<sinsp_filter_check*> m_tokens;
+	vector<uint32_t> m_tokenlens;
+	bool m_require_all_values;
+	bool m_first;
+	Json::Value m_root;
+	Json::FastWriter m_writer;
+};
+
+enum run_type
+{
+	RT_READ_ONLY,
+	RT_LEGACY,
+	RT_TOSTRING,
+	RT_TOBUFFER,
+};
+
+//
+// Reads the file, formatting the events as requested. Returns the run time
+// and the number of events, and the total length of the output in checksum.
+//
+static uint64_t run(const char* fname, const string& fmt, sinsp_evt::param_fmt pf, run_type type, uint64_t* nevents, uint64_t* checksum)
+{
+	sinsp inspector;
+	sinsp_evt* ev;
+	string line;
+	char* buf;
+	uint32_t len;
+	int32_t res;
+
+	inspector.set_buffer_format(pf);
+	inspector.open(fname);
+
+	legacy_formatter legacy(&inspector, fmt);
+	sinsp_evt_formatter formatter(&inspector, fmt);
+
+	*nevents = 0;
+	*checksum = 0;
+
+	uint64_t start = get_time_ns();
+
+	while(true)
+	{
+		res = inspector.next(&ev);
+
+		if(res == SCAP_TIMEOUT)
+		{
+			continue;
+		}
+		else if(res != SCAP_SUCCESS)
+		{
+			break;
+		}
+
+		(*nevents)++;
+
+		switch(type)
+		{
+		case RT_READ_ONLY:
+			break;
+		case RT_LEGACY:
+			if(legacy.tostring(ev, &line))
+			{
+				*checksum += line.size();
+			}
+			break;
+		case RT_TOSTRING:
+			if(formatter.tostring(ev, &line))
+			{
+				*checksum += line.size();
+			}
+			break;
+		case RT_TOBUFFER:
+			if(formatter.tobuffer(ev, &buf, &len))
+			{
+				*checksum += len;
+			}
+			break;
+		}
+	}
+
+	uint64_t duration = get_time_ns() - start;
+
+	inspector.close();
+	return duration;
+}
+
+static uint64_t run_best(const char* fname, const string& fmt, sinsp_evt::param_fmt pf, run_type type, uint64_t* nevents, uint64_t* checksum)
+{
+	uint64_t best = 0;
+
+	for(uint32_t j = 0; j < NREPS; j++)
+	{
+		uint64_t duration = run(fname, fmt, pf, type, nevents, checksum);
+
+		if(j == 0 || duration < best)
+		{
+			best = duration;
+		}
+	}
+
+	return best;
+}
+
+int main(int argc, char** argv)
+{
+	vector<string> formats;
+	uint64_t nevents;
+	uint64_t checksum;
+	uint64_t legacy_checksum;
+
+	if(argc < 2)
+	{
+		fprintf(stderr, "usage: %s <capture file> [format]\n", argv[0]);
+		return -1;
+	}
+
+	if(argc > 2)
+	{
+		formats.push_back(argv[2]);
+	}
+	else
+	{
+		formats.push_back("*%evt.num %evt.outputtime %evt.cpu %proc.name (%thread.tid) %evt.dir %evt.type %evt.info");
+		formats.push_back("*%10proc.name %6thread.tid %8evt.type %32fd.name %evt.rawres");
+	}
+
+	for(uint32_t j = 0; j < formats.size(); j++)
+	{
+		for(uint32_t k = 0; k < 2; k++)
+		{
+			sinsp_evt::param_fmt pf = (k == 0)? sinsp_evt::PF_NORMAL : sinsp_evt::PF_JSON;
+
+			printf("%s (%s)\n", formats[j].c_str(), (k == 0)? "text" : "json");
+
+			uint64_t t_read = run_best(argv[1], formats[j], pf, RT_READ_ONLY, &nevents, &checksum);
+			uint64_t t_legacy = run_best(argv[1], formats[j], pf, RT_LEGACY, &nevents, &legacy_checksum);
+			uint64_t t_tostring = run_best(argv[1], formats[j], pf, RT_TOSTRING, &nevents, &checksum);
+
+			if(checksum != legacy_checksum)
+			{
+				fprintf(stderr, "the output of the formatters doesn't match\n");
+				return -1;
+			}
+
+			uint64_t t_tobuffer = run_best(argv[1], formats[j], pf, RT_TOBUFFER, &nevents, &checksum);
+
+			printf("  %" PRIu64 " events, reading: %.1f ns/event\n", nevents, (double)t_read / nevents);
+			printf("  %-24s %8.1f ns/event\n", "legacy tostring()", (double)(t_legacy - t_read) / nevents);
+			printf("  %-24s %8.1f ns/event\n", "tostring()", (double)(t_tostring - t_read) / nevents);
+			printf("  %-24s %8.1f ns/event\n", "tobuffer()", (double)(t_tobuffer - t_read) / nevents);
+		}
+	}
+
+	return 0;
+}
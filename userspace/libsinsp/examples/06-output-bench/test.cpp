@@ -0,0 +1,224 @@
+/*
+Copyright (C) 2013-2014 Draios inc.
+
+This file is part of sysdig.
+
+sysdig is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License version 2 as
+published by the Free Software Foundation.
+
+sysdig is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sysdig.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+//
+// Measures the cost of writing the formatted events of a capture file to
+// stdout, the way sysdig does it, when stdout is /dev/null and when it's a
+// pipe to another process. The output is written with cout and a flush for
+// every line, like sysdig used to do, and with sinsp_buffered_writer and
+// each of its flush policies.
+// Every run reads and formats the whole file, and the time of a run that
+// doesn't write the output is subtracted, so that what's left is the cost
+// of the output. Every run is repeated NREPS times, and the fastest one is
+// kept. The results are printed on stderr.
+//
+// Usage: sinsp-output-bench <capture file>
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+#include "sinsp.h"
+#include "sinsp_int.h"
+
+#define NREPS 3
+#define FLUSH_LINES 1000
+
+static uint64_t get_time_ns()
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return (uint64_t)tv.tv_sec * 1000000000 + tv.tv_usec * 1000;
+}
+
+enum run_type
+{
+	RT_FORMAT_ONLY,
+	RT_COUT_ENDL,
+	RT_IMMEDIATE,
+	RT_LINES,
+	RT_TIME,
+	RT_THREAD,
+};
+
+static const char* run_names[] =
+{
+	"format only",
+	"cout << endl",
+	"writer, immediate",
+	"writer, 1000 lines",
+	"writer, 100 ms",
+	"writer, 100 ms, thread",
+};
+
+static uint64_t run(const char* fname, run_type type, sinsp_buffered_writer* writer, uint64_t* nevents)
+{
+	sinsp inspector;
+	sinsp_evt* ev;
+	string line;
+	char* buf;
+	uint32_t len;
+	int32_t res;
+
+	inspector.open(fname);
+
+	sinsp_evt_formatter formatter(&inspector, "*%evt.num %evt.outputtime %evt.cpu %proc.name (%thread.tid) %evt.dir %evt.type %evt.info");
+
+	switch(type)
+	{
+	case RT_IMMEDIATE:
+		writer->set_flush_policy(sinsp_buffered_writer::FP_IMMEDIATE, 0);
+		break;
+	case RT_LINES:
+		writer->set_flush_policy(sinsp_buffered_writer::FP_LINES, FLUSH_LINES);
+		break;
+	case RT_TIME:
+		writer->set_flush_policy(sinsp_buffered_writer::FP_TIME, DEFAULT_OUTPUT_FLUSH_INTERVAL_MS);
+		break;
+	case RT_THREAD:
+		writer->set_flush_policy(sinsp_buffered_writer::FP_TIME, DEFAULT_OUTPUT_FLUSH_INTERVAL_MS);
+		writer->start_thread();
+		break;
+	default:
+		break;
+	}
+
+	*nevents = 0;
+
+	uint64_t start = get_time_ns();
+
+	while(true)
+	{
+		res = inspector.next(&ev);
+
+		if(res == SCAP_TIMEOUT)
+		{
+			continue;
+		}
+		else if(res != SCAP_SUCCESS)
+		{
+			break;
+		}
+
+		(*nevents)++;
+
+		switch(type)
+		{
+		case RT_FORMAT_ONLY:
+			formatter.tobuffer(ev, &buf, &len);
+			break;
+		case RT_COUT_ENDL:
+			if(formatter.tostring(ev, &line))
+			{
+				cout << line << endl;
+			}
+			break;
+		default:
+			formatter.write(ev, writer, true);
+			break;
+		}
+	}
+
+	writer->stop_thread();
+	writer->flush();
+
+	uint64_t duration = get_time_ns() - start;
+
+	inspector.close();
+	return duration;
+}
+
+static void bench(const char* fname, const char* target, sinsp_buffered_writer* writer)
+{
+	uint64_t nevents;
+	uint64_t t_format = 0;
+
+	fprintf(stderr, "%s\n", target);
+
+	for(uint32_t type = RT_FORMAT_ONLY; type <= RT_THREAD; type++)
+	{
+		uint64_t best = 0;
+
+		for(uint32_t j = 0; j < NREPS; j++)
+		{
+			uint64_t duration = run(fname, (run_type)type, writer, &nevents);
+
+			if(j == 0 || duration < best)
+			{
+				best = duration;
+			}
+		}
+
+		if(type == RT_FORMAT_ONLY)
+		{
+			t_format = best;
+		}
+
+		fprintf(stderr, "  %-24s %12.0f events/sec %8.1f ns/event of output\n",
+			run_names[type],
+			(double)nevents * ONE_SECOND_IN_NS / best,
+			(double)((int64_t)best - (int64_t)t_format) / nevents);
+	}
+}
+
+int main(int argc, char** argv)
+{
+	if(argc < 2)
+	{
+		fprintf(stderr, "usage: %s <capture file>\n", argv[0]);
+		return -1;
+	}
+
+	//
+	// Like in sysdig, there's a single writer, which gives stdout its
+	// buffer. stdout is redirected before creating it, so that it isn't a
+	// terminal.
+	//
+	int null_fd = open("/dev/null", O_WRONLY);
+	dup2(null_fd, STDOUT_FILENO);
+	close(null_fd);
+
+	sinsp_buffered_writer writer(stdout);
+
+	bench(argv[1], "/dev/null", &writer);
+
+	FILE* pipe = popen("cat > /dev/null", "w");
+
+	if(pipe == NULL)
+	{
+		fprintf(stderr, "can't start the pipe reader\n");
+		return -1;
+	}
+
+	fflush(stdout);
+	dup2(fileno(pipe), STDOUT_FILENO);
+
+	bench(argv[1], "pipe", &writer);
+
+	//
+	// cat gets EOF only when stdout doesn't point to the pipe anymore
+	//
+	fflush(stdout);
+	close(STDOUT_FILENO);
+	pclose(pipe);
+
+	return 0;
+}
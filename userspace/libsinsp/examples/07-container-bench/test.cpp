@@ -0,0 +1,206 @@
+/*
+Copyright (C) 2013-2014 Draios inc.
+
+This file is part of sysdig.
+
+sysdig is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License version 2 as
+published by the Free Software Foundation.
+
+sysdig is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sysdig.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+//
+// Measures the time it takes to fetch the Docker metadata of a burst of new
+// containers, one request at a time like the synchronous path does, and with
+// the concurrent requests of the background fetcher.
+// The daemon is a fake one listening on a socket in the current directory.
+// It serves every connection on its own thread and waits DAEMON_DELAY_MS
+// before answering, like a busy daemon would. The fetched names and images
+// are checked against the ones the fake daemon sends.
+//
+// Usage: sinsp-container-bench [number of containers]
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <thread>
+
+#include "sinsp.h"
+#include "sinsp_int.h"
+#include "containerresolver.h"
+
+#define DOCKER_SOCKET "docker-bench.sock"
+#define DAEMON_DELAY_MS 5
+#define DEFAULT_NCONTAINERS 100
+
+static uint64_t get_time_ns()
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return (uint64_t)tv.tv_sec * 1000000000 + tv.tv_usec * 1000;
+}
+
+static string container_id(uint32_t j)
+{
+	char id[16];
+	snprintf(id, sizeof(id), "%012x", j + 1);
+	return id;
+}
+
+static void serve(int sock)
+{
+	char buf[1024];
+	string request;
+	ssize_t res;
+
+	//
+	// The requests end with an empty line
+	//
+	while(request.find("\r\n\n") == string::npos &&
+		(res = read(sock, buf, sizeof(buf))) > 0)
+	{
+		request.append(buf, res);
+	}
+
+	usleep(DAEMON_DELAY_MS * 1000);
+
+	size_t start = request.find("/containers/");
+	size_t end = request.find("/json");
+
+	if(start == string::npos || end == string::npos)
+	{
+		close(sock);
+		return;
+	}
+
+	string id = request.substr(start + sizeof("/containers/") - 1, end - start - sizeof("/containers/") + 1);
+	string body = "{\"Name\":\"/bench_" + id + "\","
+		"\"Config\":{\"Image\":\"image_" + id + "\",\"Labels\":{\"bench\":\"1\"}},"
+		"\"NetworkSettings\":{\"IPAddress\":\"172.17.0.2\",\"Ports\":{}}}";
+	string answer = "HTTP/1.0 200 OK\r\nContent-Type: application/json\r\n\r\n" + body;
+
+	if(write(sock, answer.c_str(), answer.length()) != (ssize_t)answer.length())
+	{
+		fprintf(stderr, "fake daemon: short write\n");
+	}
+
+	close(sock);
+}
+
+static void run_daemon(int listen_sock)
+{
+	while(true)
+	{
+		int sock = accept(listen_sock, NULL, NULL);
+		if(sock < 0)
+		{
+			return;
+		}
+
+		std::thread(serve, sock).detach();
+	}
+}
+
+static bool check(const vector<sinsp_container_info>& containers, const vector<bool>& success)
+{
+	for(uint32_t j = 0; j < containers.size(); j++)
+	{
+		if(!success[j] ||
+			containers[j].m_name != "bench_" + containers[j].m_id ||
+			containers[j].m_image != "image_" + containers[j].m_id)
+		{
+			fprintf(stderr, "wrong metadata for container %s\n", containers[j].m_id.c_str());
+			return false;
+		}
+	}
+
+	return true;
+}
+
+int main(int argc, char** argv)
+{
+	uint32_t ncontainers = DEFAULT_NCONTAINERS;
+
+	if(argc > 1)
+	{
+		ncontainers = atoi(argv[1]);
+	}
+
+	int listen_sock = socket(PF_UNIX, SOCK_STREAM, 0);
+	struct sockaddr_un address;
+
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	strncpy(address.sun_path, DOCKER_SOCKET, sizeof(address.sun_path) - 1);
+	unlink(DOCKER_SOCKET);
+
+	if(listen_sock < 0 ||
+		bind(listen_sock, (struct sockaddr*)&address, sizeof(address)) != 0 ||
+		listen(listen_sock, 128) != 0)
+	{
+		fprintf(stderr, "can't create the fake daemon socket\n");
+		return -1;
+	}
+
+	std::thread daemon(run_daemon, listen_sock);
+
+	vector<sinsp_container_info> containers(ncontainers);
+	vector<bool> success(ncontainers);
+
+	for(uint32_t j = 0; j < ncontainers; j++)
+	{
+		containers[j].m_type = CT_DOCKER;
+		containers[j].m_id = container_id(j);
+	}
+
+	//
+	// One request at a time
+	//
+	vector<sinsp_container_info> seq_containers = containers;
+
+	uint64_t start = get_time_ns();
+
+	for(uint32_t j = 0; j < ncontainers; j++)
+	{
+		success[j] = sinsp_container_manager::parse_docker(DOCKER_SOCKET, &seq_containers[j]);
+	}
+
+	uint64_t seq_duration = get_time_ns() - start;
+
+	bool ok = check(seq_containers, success);
+
+	//
+	// The background fetcher
+	//
+	vector<sinsp_container_info> conc_containers = containers;
+
+	start = get_time_ns();
+
+	sinsp_container_resolver::fetch(DOCKER_SOCKET, &conc_containers, &success);
+
+	uint64_t conc_duration = get_time_ns() - start;
+
+	ok = check(conc_containers, success) && ok;
+
+	fprintf(stderr, "%u containers, %u ms per answer\n", ncontainers, DAEMON_DELAY_MS);
+	fprintf(stderr, "  %-12s %10.1f ms\n", "sequential", (double)seq_duration / 1000000);
+	fprintf(stderr, "  %-12s %10.1f ms\n", "concurrent", (double)conc_duration / 1000000);
+
+	shutdown(listen_sock, SHUT_RDWR);
+	close(listen_sock);
+	daemon.join();
+	unlink(DOCKER_SOCKET);
+
+	return ok? 0 : -1;
+}
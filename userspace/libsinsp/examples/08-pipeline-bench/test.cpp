@@ -0,0 +1,145 @@
+/*
+Copyright (C) 2013-2014 Draios inc.
+
+This file is part of sysdig.
+
+sysdig is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License version 2 as
+published by the Free Software Foundation.
+
+sysdig is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sysdig.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+//
+// Measures the throughput of replaying a capture file through sinsp, with
+// the events read on the inspector thread and with the pipelined mode, where
+// a background thread reads and decompresses them. Every event is parsed,
+// and optionally run through a filter, like sysdig -q does.
+// The throughput is the number of events divided by the wall clock time of
+// the whole replay, since the pipelined mode uses more than one thread. Every
+// run is repeated NREPS times, and the fastest one is kept. The number of
+// events of the two modes is checked to be the same.
+//
+// Usage: sinsp-pipeline-bench <capture file> [filter]
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+
+#include "sinsp.h"
+#include "sinsp_int.h"
+
+#define NREPS 3
+
+static uint64_t get_time_ns()
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return (uint64_t)tv.tv_sec * 1000000000 + tv.tv_usec * 1000;
+}
+
+static uint64_t run(const char* fname, const char* filter, bool pipeline, uint64_t* nevents)
+{
+	sinsp inspector;
+	sinsp_evt* ev;
+	int32_t res;
+
+	inspector.set_pipeline_mode(pipeline);
+	inspector.open(fname);
+
+#ifdef HAS_FILTERING
+	if(filter != NULL)
+	{
+		inspector.set_filter(filter);
+	}
+#endif
+
+	*nevents = 0;
+
+	uint64_t start = get_time_ns();
+
+	while(true)
+	{
+		res = inspector.next(&ev);
+
+		if(res == SCAP_TIMEOUT)
+		{
+			continue;
+		}
+		else if(res != SCAP_SUCCESS)
+		{
+			break;
+		}
+
+		(*nevents)++;
+	}
+
+	uint64_t duration = get_time_ns() - start;
+
+	inspector.close();
+	return duration;
+}
+
+int main(int argc, char** argv)
+{
+	const char* filter = NULL;
+	uint64_t nevents[2];
+	uint64_t best[2];
+
+	if(argc < 2)
+	{
+		fprintf(stderr, "usage: %s <capture file> [filter]\n", argv[0]);
+		return -1;
+	}
+
+	if(argc > 2)
+	{
+		filter = argv[2];
+	}
+
+	try
+	{
+		for(uint32_t mode = 0; mode < 2; mode++)
+		{
+			for(uint32_t j = 0; j < NREPS; j++)
+			{
+				uint64_t duration = run(argv[1], filter, mode == 1, &nevents[mode]);
+
+				if(j == 0 || duration < best[mode])
+				{
+					best[mode] = duration;
+				}
+			}
+		}
+	}
+	catch(sinsp_exception& e)
+	{
+		fprintf(stderr, "%s\n", e.what());
+		return -1;
+	}
+
+	if(nevents[0] != nevents[1])
+	{
+		fprintf(stderr, "the pipelined mode returned %" PRIu64 " events instead of %" PRIu64 "\n",
+			nevents[1],
+			nevents[0]);
+		return -1;
+	}
+
+	fprintf(stderr, "%" PRIu64 " events%s%s\n",
+		nevents[0],
+		filter? ", filter: " : "",
+		filter? filter : "");
+
+	fprintf(stderr, "  %-12s %12.0f events/sec\n", "direct", (double)nevents[0] * ONE_SECOND_IN_NS / best[0]);
+	fprintf(stderr, "  %-12s %12.0f events/sec\n", "pipeline", (double)nevents[1] * ONE_SECOND_IN_NS / best[1]);
+
+	return 0;
+}
@@ -307,29 +307,172 @@ template<> void sinsp_fdinfo_t::unregister_event_callback(sinsp_pd_callback_type
 sinsp_fdtable::sinsp_fdtable(sinsp* inspector)
 {
 	m_inspector = inspector;
+	m_sparse_mask = 0;
+	m_nsparse = 0;
+	m_size = 0;
 	reset_cache();
 }
 
-sinsp_fdinfo_t* sinsp_fdtable::add(int64_t fd, sinsp_fdinfo_t* fdinfo)
+sinsp_fdtable::sinsp_fdtable(const sinsp_fdtable& other)
 {
-	pair<unordered_map<int64_t, sinsp_fdinfo_t>::iterator, bool> insert_res;
+	m_inspector = other.m_inspector;
+	m_sparse_mask = 0;
+	m_nsparse = 0;
+	m_size = 0;
+	reset_cache();
+	copy_entries(other);
+}
 
-	//
-	// NOTE: emplace would be more efficinent and avoid the multiple contrcutions
-	// required by make_pair, but it's not supported by some gcc versions, so
-	// we use insert for the moment.
-	//
-	insert_res = m_table.insert(std::make_pair(fd, *fdinfo));
-	//insert_res = m_table.emplace(fd, *fdinfo);
+sinsp_fdtable::~sinsp_fdtable()
+{
+	clear();
+}
+
+sinsp_fdtable& sinsp_fdtable::operator=(const sinsp_fdtable& other)
+{
+	if(this != &other)
+	{
+		clear();
+		m_inspector = other.m_inspector;
+		copy_entries(other);
+	}
+
+	return *this;
+}
+
+//
+// The cache is not copied, since it points into the other table
+//
+void sinsp_fdtable::copy_entries(const sinsp_fdtable& other)
+{
+	sinsp_fdtable* src = (sinsp_fdtable*)&other;
+
+	for(iterator it = src->begin(); it != src->end(); ++it)
+	{
+		insert(new value_type(*it));
+	}
+}
+
+uint32_t sinsp_fdtable::next_slot(uint32_t pos)
+{
+	uint32_t nslots = (uint32_t)(m_dense.size() + m_sparse.size());
+
+	while(pos < nslots && get_slot(pos) == NULL)
+	{
+		pos++;
+	}
+
+	return pos;
+}
+
+sinsp_fdtable::value_type* sinsp_fdtable::lookup_sparse(int64_t fd)
+{
+	uint32_t idx;
+
+	if(m_nsparse == 0)
+	{
+		return NULL;
+	}
+
+	idx = sparse_hash(fd) & m_sparse_mask;
+
+	while(m_sparse[idx] != NULL)
+	{
+		if(m_sparse[idx]->first == fd)
+		{
+			return m_sparse[idx];
+		}
+
+		idx = (idx + 1) & m_sparse_mask;
+	}
+
+	return NULL;
+}
+
+void sinsp_fdtable::insert_sparse(value_type* entry)
+{
+	uint32_t idx = sparse_hash(entry->first) & m_sparse_mask;
+
+	while(m_sparse[idx] != NULL)
+	{
+		idx = (idx + 1) & m_sparse_mask;
+	}
+
+	m_sparse[idx] = entry;
+}
+
+void sinsp_fdtable::rehash_sparse(uint32_t nslots)
+{
+	vector<value_type*> old;
+
+	old.swap(m_sparse);
+	m_sparse.assign(nslots, NULL);
+	m_sparse_mask = nslots - 1;
+
+	for(uint32_t j = 0; j < old.size(); j++)
+	{
+		if(old[j] != NULL)
+		{
+			insert_sparse(old[j]);
+		}
+	}
+}
+
+//
+// Add an entry for an fd that is not in the table
+//
+void sinsp_fdtable::insert(value_type* entry)
+{
+	int64_t fd = entry->first;
+
+	if((uint64_t)fd < FDTABLE_DENSE_SIZE)
+	{
+		if((uint64_t)fd >= m_dense.size())
+		{
+			size_t newsize = MAX(m_dense.size(), 16);
+
+			while(newsize <= (uint64_t)fd)
+			{
+				newsize *= 2;
+			}
+
+			m_dense.resize(MIN(newsize, FDTABLE_DENSE_SIZE), NULL);
+		}
+
+		m_dense[(size_t)fd] = entry;
+	}
+	else
+	{
+		//
+		// Keep the load factor below 1/2
+		//
+		if((m_nsparse + 1) * 2 > m_sparse.size())
+		{
+			rehash_sparse(MAX((uint32_t)m_sparse.size() * 2, 16));
+		}
+
+		insert_sparse(entry);
+		m_nsparse++;
+	}
+
+	m_size++;
+}
+
+sinsp_fdinfo_t* sinsp_fdtable::add(int64_t fd, sinsp_fdinfo_t* fdinfo)
+{
+	value_type* entry = lookup(fd);
 
 	//
 	// Look for the FD in the table
 	//
-	if(insert_res.second == true)
+	if(entry == NULL)
 	{
 		//
 		// No entry in the table, this is the normal case
 		//
+		entry = new value_type(fd, *fdinfo);
+		insert(entry);
+
 		m_last_accessed_fd = -1;
 #ifdef GATHER_INTERNAL_STATS
 		m_inspector->m_stats.m_n_added_fds++;
@@ -340,7 +483,7 @@ sinsp_fdinfo_t* sinsp_fdtable::add(int64_t fd, sinsp_fdinfo_t* fdinfo)
 		//
 		// the fd is already in the table.
 		//
-		if(insert_res.first->second.m_flags & sinsp_fdinfo_t::FLAGS_CLOSE_IN_PROGRESS)
+		if(entry->second.m_flags & sinsp_fdinfo_t::FLAGS_CLOSE_IN_PROGRESS)
 		{
 			//
 			// Sometimes an FD-creating syscall can be called on an FD that is being closed (i.e
@@ -348,10 +491,19 @@ sinsp_fdinfo_t* sinsp_fdtable::add(int64_t fd, sinsp_fdinfo_t* fdinfo)
 			// If this is the case, mark the new entry so that the successive close exit won't
 			// destroy it.
 			//
+			value_type* canceled = lookup(CANCELED_FD_NUMBER);
+
 			fdinfo->m_flags &= ~sinsp_fdinfo_t::FLAGS_CLOSE_IN_PROGRESS;
 			fdinfo->m_flags |= sinsp_fdinfo_t::FLAGS_CLOSE_CANCELED;
 			
-			m_table[CANCELED_FD_NUMBER] = insert_res.first->second;
+			if(canceled == NULL)
+			{
+				insert(new value_type(CANCELED_FD_NUMBER, entry->second));
+			}
+			else
+			{
+				canceled->second = entry->second;
+			}
 		}
 		else
 		{
@@ -371,22 +523,22 @@ sinsp_fdinfo_t* sinsp_fdtable::add(int64_t fd, sinsp_fdinfo_t* fdinfo)
 		//
 		// Replace the fd as a struct copy
 		//
-		insert_res.first->second.copy(*fdinfo, true);
+		entry->second.copy(*fdinfo, true);
 	}
 
-	return &(insert_res.first->second);
+	return &(entry->second);
 }
 
 void sinsp_fdtable::erase(int64_t fd)
 {
-	unordered_map<int64_t, sinsp_fdinfo_t>::iterator fdit = m_table.find(fd);
+	value_type* entry = lookup(fd);
 
 	if(fd == m_last_accessed_fd)
 	{
 		m_last_accessed_fd = -1;		
 	}
 
-	if(fdit == m_table.end())
+	if(entry == NULL)
 	{
 		//
 		// Looks like there's no fd to remove.
@@ -398,25 +550,86 @@ void sinsp_fdtable::erase(int64_t fd)
 #ifdef GATHER_INTERNAL_STATS
 		m_inspector->m_stats.m_n_failed_fd_lookups++;
 #endif
+		return;
+	}
+
+	if((uint64_t)fd < FDTABLE_DENSE_SIZE)
+	{
+		m_dense[(size_t)fd] = NULL;
 	}
 	else
 	{
-		m_table.erase(fdit);
+		uint32_t idx = sparse_hash(fd) & m_sparse_mask;
+		uint32_t j;
+
+		while(m_sparse[idx] != entry)
+		{
+			idx = (idx + 1) & m_sparse_mask;
+		}
+
+		//
+		// Move back the entries that follow in the probe sequence, so that
+		// the lookups don't stop at the hole
+		//
+		m_sparse[idx] = NULL;
+		j = idx;
+
+		while(true)
+		{
+			uint32_t home;
+
+			j = (j + 1) & m_sparse_mask;
+
+			if(m_sparse[j] == NULL)
+			{
+				break;
+			}
+
+			home = sparse_hash(m_sparse[j]->first) & m_sparse_mask;
+
+			if(((j - home) & m_sparse_mask) >= ((j - idx) & m_sparse_mask))
+			{
+				m_sparse[idx] = m_sparse[j];
+				m_sparse[j] = NULL;
+				idx = j;
+			}
+		}
+
+		m_nsparse--;
+	}
+
+	delete entry;
+	m_size--;
+
 #ifdef GATHER_INTERNAL_STATS
-		m_inspector->m_stats.m_n_noncached_fd_lookups++;
-		m_inspector->m_stats.m_n_removed_fds++;
+	m_inspector->m_stats.m_n_noncached_fd_lookups++;
+	m_inspector->m_stats.m_n_removed_fds++;
 #endif
-	}
 }
 
 void sinsp_fdtable::clear()
 {
-	m_table.clear();
+	for(uint32_t j = 0; j < m_dense.size(); j++)
+	{
+		delete m_dense[j];
+	}
+
+	for(uint32_t j = 0; j < m_sparse.size(); j++)
+	{
+		delete m_sparse[j];
+	}
+
+	m_dense.clear();
+	m_sparse.clear();
+	m_sparse_mask = 0;
+	m_nsparse = 0;
+	m_size = 0;
+	reset_cache();
 }
 
 size_t sinsp_fdtable::size()
 {
-	return m_table.size();
+	return m_size;
 }
 
 void sinsp_fdtable::reset_cache()
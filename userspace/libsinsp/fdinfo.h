@@ -386,15 +386,85 @@ private:
 
 ///////////////////////////////////////////////////////////////////////////////
 // fd info table
+//
+// Almost all the fds of a process are small numbers, so the entries for the
+// fds below FDTABLE_DENSE_SIZE are in an array indexed by fd. The other ones
+// go in an open addressing hash table. The entries are allocated one by one,
+// so that the pointers returned by find() and add() stay valid until the fd
+// is erased, regardless of what happens to the rest of the table.
 ///////////////////////////////////////////////////////////////////////////////
 class sinsp_fdtable
 {
 public:
+	typedef pair<const int64_t, sinsp_fdinfo_t> value_type;
+
+	//
+	// Iterates over the fds in no particular order. The table must not be
+	// modified while iterating.
+	//
+	class iterator
+	{
+	public:
+		iterator()
+		{
+			m_table = NULL;
+			m_pos = 0;
+		}
+
+		value_type& operator*()
+		{
+			return *m_table->get_slot(m_pos);
+		}
+
+		value_type* operator->()
+		{
+			return m_table->get_slot(m_pos);
+		}
+
+		iterator& operator++()
+		{
+			m_pos = m_table->next_slot(m_pos + 1);
+			return *this;
+		}
+
+		iterator operator++(int)
+		{
+			iterator res = *this;
+			m_pos = m_table->next_slot(m_pos + 1);
+			return res;
+		}
+
+		bool operator==(const iterator& other) const
+		{
+			return m_pos == other.m_pos;
+		}
+
+		bool operator!=(const iterator& other) const
+		{
+			return m_pos != other.m_pos;
+		}
+
+	private:
+		iterator(sinsp_fdtable* table, uint32_t pos)
+		{
+			m_table = table;
+			m_pos = pos;
+		}
+
+		sinsp_fdtable* m_table;
+		uint32_t m_pos;
+
+		friend class sinsp_fdtable;
+	};
+
 	sinsp_fdtable(sinsp* inspector);
+	sinsp_fdtable(const sinsp_fdtable& other);
+	~sinsp_fdtable();
+	sinsp_fdtable& operator=(const sinsp_fdtable& other);
 
 	inline sinsp_fdinfo_t* find(int64_t fd)
 	{
-		unordered_map<int64_t, sinsp_fdinfo_t>::iterator fdit = m_table.find(fd);
+		value_type* entry;
 
 		//
 		// Try looking up in our simple cache
@@ -410,9 +480,9 @@ public:
 		//
 		// Caching failed, do a real lookup
 		//
-		fdit = m_table.find(fd);
+		entry = lookup(fd);
 
-		if(fdit == m_table.end())
+		if(entry == NULL)
 		{
 	#ifdef GATHER_INTERNAL_STATS
 			m_inspector->m_stats.m_n_failed_fd_lookups++;
@@ -425,8 +495,8 @@ public:
 			m_inspector->m_stats.m_n_noncached_fd_lookups++;
 	#endif
 			m_last_accessed_fd = fd;
-			m_last_accessed_fdinfo = &(fdit->second);
-			return &(fdit->second);
+			m_last_accessed_fdinfo = &(entry->second);
+			return &(entry->second);
 		}
 	}
 	
@@ -438,12 +508,59 @@ public:
 	size_t size();
 	void reset_cache();
 
+	iterator begin()
+	{
+		return iterator(this, next_slot(0));
+	}
+
+	iterator end()
+	{
+		return iterator(this, (uint32_t)(m_dense.size() + m_sparse.size()));
+	}
+
 	sinsp* m_inspector;
-	unordered_map<int64_t, sinsp_fdinfo_t> m_table;
 
 	//
 	// Simple fd cache
 	//
 	int64_t m_last_accessed_fd;
 	sinsp_fdinfo_t *m_last_accessed_fdinfo;
+
+private:
+	inline value_type* lookup(int64_t fd)
+	{
+		if((uint64_t)fd < FDTABLE_DENSE_SIZE)
+		{
+			return ((uint64_t)fd < m_dense.size())? m_dense[(size_t)fd] : NULL;
+		}
+
+		return lookup_sparse(fd);
+	}
+
+	//
+	// The slots of the dense array come first, then the ones of the hash
+	// table
+	//
+	inline value_type* get_slot(uint32_t pos)
+	{
+		return (pos < m_dense.size())? m_dense[pos] : m_sparse[pos - m_dense.size()];
+	}
+
+	uint32_t next_slot(uint32_t pos);
+	value_type* lookup_sparse(int64_t fd);
+	void insert(value_type* entry);
+	void insert_sparse(value_type* entry);
+	void rehash_sparse(uint32_t nslots);
+	void copy_entries(const sinsp_fdtable& other);
+
+	static inline uint32_t sparse_hash(int64_t fd)
+	{
+		return (uint32_t)(((uint64_t)fd * 0x9E3779B97F4A7C15ULL) >> 32);
+	}
+
+	vector<value_type*> m_dense;
+	vector<value_type*> m_sparse;
+	uint32_t m_sparse_mask;
+	uint32_t m_nsparse;
+	uint32_t m_size;
 };
@@ -32,6 +32,8 @@ along with sysdig.  If not, see <http://www.gnu.org/licenses/>.
 #ifdef HAS_FILTERING
 #include "filter.h"
 #include "filterchecks.h"
+#include "filterprogram.h"
+#include "filtermatch.h"
 
 #ifndef _GNU_SOURCE
 //
@@ -209,8 +211,6 @@ bool flt_compare_string(ppm_cmp_operator op, char* operand1, char* operand2)
 		return (strcmp(operand1, operand2) != 0);
 	case CO_CONTAINS:
 		return (strstr(operand1, operand2) != NULL);
-	case CO_IN:
-		return (strstr(operand1, operand2) != NULL);
 	case CO_LT:
 		return (strcmp(operand1, operand2) < 0);
 	case CO_LE:
@@ -447,16 +447,31 @@ sinsp_filter_check::sinsp_filter_check() :
 	m_info.m_fields = NULL;
 	m_info.m_nfields = -1;
 	m_val_storage_len = 0;
+	m_val_set = NULL;
+	m_val_patterns = NULL;
 	m_aggregation = A_NONE;
 	m_merge_aggregation = A_NONE;
 }
 
+sinsp_filter_check::~sinsp_filter_check()
+{
+	if(m_val_set != NULL)
+	{
+		delete m_val_set;
+	}
+
+	if(m_val_patterns != NULL)
+	{
+		delete m_val_patterns;
+	}
+}
+
 void sinsp_filter_check::set_inspector(sinsp* inspector)
 {
 	m_inspector = inspector;
 }
 
-Json::Value sinsp_filter_check::rawval_to_json(uint8_t* rawval, const filtercheck_field_info* finfo, uint32_t len)
+bool sinsp_filter_check::rawval_to_json(uint8_t* rawval, const filtercheck_field_info* finfo, uint32_t len, sinsp_json_writer* writer)
 {
 	ASSERT(rawval != NULL);
 	ASSERT(finfo != NULL);
@@ -467,48 +482,54 @@ Json::Value sinsp_filter_check::rawval_to_json(uint8_t* rawval, const filterchec
 			if(finfo->m_print_format == PF_DEC ||
 			   finfo->m_print_format == PF_ID)
 			{
-				return *(int8_t *)rawval;
+				writer->int_value(*(int8_t *)rawval);
+				return true;
 			}
 			else if(finfo->m_print_format == PF_HEX)
 			{
-				return rawval_to_string(rawval, finfo, len);
+				writer->string_value(rawval_to_string(rawval, finfo, len));
+				return true;
 			}
 			else
 			{
 				ASSERT(false);
-				return Json::Value::nullRef;
+				return false;
 			}
 
 		case PT_INT16:
 			if(finfo->m_print_format == PF_DEC ||
 			   finfo->m_print_format == PF_ID)
 			{
-				return *(int16_t *)rawval;
+				writer->int_value(*(int16_t *)rawval);
+				return true;
 			}
 			else if(finfo->m_print_format == PF_HEX)
 			{
-				return rawval_to_string(rawval, finfo, len);
+				writer->string_value(rawval_to_string(rawval, finfo, len));
+				return true;
 			}
 			else
 			{
 				ASSERT(false);
-				return Json::Value::nullRef;
+				return false;
 			}
 
 		case PT_INT32:
 			if(finfo->m_print_format == PF_DEC ||
 			   finfo->m_print_format == PF_ID)
 			{
-				return *(int32_t *)rawval;
+				writer->int_value(*(int32_t *)rawval);
+				return true;
 			}
 			else if(finfo->m_print_format == PF_HEX)
 			{
-				return rawval_to_string(rawval, finfo, len);
+				writer->string_value(rawval_to_string(rawval, finfo, len));
+				return true;
 			}
 			else
 			{
 				ASSERT(false);
-				return Json::Value::nullRef;
+				return false;
 			}
 
 		case PT_INT64:
@@ -516,11 +537,13 @@ Json::Value sinsp_filter_check::rawval_to_json(uint8_t* rawval, const filterchec
 			if(finfo->m_print_format == PF_DEC ||
 			   finfo->m_print_format == PF_ID)
 			{
-		 		return (Json::Value::Int64)*(int64_t *)rawval;
+				writer->int_value(*(int64_t *)rawval);
+				return true;
 			}
 			else
 			{
-				return rawval_to_string(rawval, finfo, len);
+				writer->string_value(rawval_to_string(rawval, finfo, len));
+				return true;
 			}
 
 		case PT_L4PROTO: // This can be resolved in the future
@@ -528,16 +551,18 @@ Json::Value sinsp_filter_check::rawval_to_json(uint8_t* rawval, const filterchec
 			if(finfo->m_print_format == PF_DEC ||
 			   finfo->m_print_format == PF_ID)
 			{
-				return *(uint8_t *)rawval;
+				writer->uint_value(*(uint8_t *)rawval);
+				return true;
 			}
 			else if(finfo->m_print_format == PF_HEX)
 			{
-				return rawval_to_string(rawval, finfo, len);
+				writer->string_value(rawval_to_string(rawval, finfo, len));
+				return true;
 			}
 			else
 			{
 				ASSERT(false);
-				return Json::Value::nullRef;
+				return false;
 			}
 
 		case PT_PORT: // This can be resolved in the future
@@ -545,32 +570,36 @@ Json::Value sinsp_filter_check::rawval_to_json(uint8_t* rawval, const filterchec
 			if(finfo->m_print_format == PF_DEC ||
 			   finfo->m_print_format == PF_ID)
 			{
-				return *(uint16_t *)rawval;
+				writer->uint_value(*(uint16_t *)rawval);
+				return true;
 			}
 			else if(finfo->m_print_format == PF_HEX)
 			{
-				return rawval_to_string(rawval, finfo, len);
+				writer->string_value(rawval_to_string(rawval, finfo, len));
+				return true;
 			}
 			else
 			{
 				ASSERT(false);
-				return Json::Value::nullRef;
+				return false;
 			}
 
 		case PT_UINT32:
 			if(finfo->m_print_format == PF_DEC ||
 			   finfo->m_print_format == PF_ID)
 			{
-				return *(uint32_t *)rawval;
+				writer->uint_value(*(uint32_t *)rawval);
+				return true;
 			}
 			else if(finfo->m_print_format == PF_HEX)
 			{
-				return rawval_to_string(rawval, finfo, len);
+				writer->string_value(rawval_to_string(rawval, finfo, len));
+				return true;
 			}
 			else
 			{
 				ASSERT(false);
-				return Json::Value::nullRef;
+				return false;
 			}
 
 		case PT_UINT64:
@@ -579,32 +608,36 @@ Json::Value sinsp_filter_check::rawval_to_json(uint8_t* rawval, const filterchec
 			if(finfo->m_print_format == PF_DEC ||
 			   finfo->m_print_format == PF_ID)
 			{
-				return (Json::Value::UInt64)*(uint64_t *)rawval;
+				writer->uint_value(*(uint64_t *)rawval);
+				return true;
 			}
 			else if(
 				finfo->m_print_format == PF_10_PADDED_DEC ||
 				finfo->m_print_format == PF_HEX)
 			{
-				return rawval_to_string(rawval, finfo, len);
+				writer->string_value(rawval_to_string(rawval, finfo, len));
+				return true;
 			}
 			else
 			{
 				ASSERT(false);
-				return Json::Value::nullRef;
+				return false;
 			}
 
 		case PT_SOCKADDR:
 		case PT_SOCKFAMILY:
 			ASSERT(false);
-			return Json::Value::nullRef;
+			return false;
 
 		case PT_BOOL:
-			return Json::Value((bool)(*(uint32_t*)rawval != 0));
+			writer->bool_value(*(uint32_t*)rawval != 0);
+			return true;
 
 		case PT_CHARBUF:
 		case PT_BYTEBUF:
 		case PT_IPV4ADDR:
-			return rawval_to_string(rawval, finfo, len);
+			writer->string_value(rawval_to_string(rawval, finfo, len));
+			return true;
 
 		default:
 			ASSERT(false);
@@ -973,23 +1006,22 @@ char* sinsp_filter_check::tostring(sinsp_evt* evt)
 	return rawval_to_string(rawval, m_field, len);
 }
 
-Json::Value sinsp_filter_check::tojson(sinsp_evt* evt)
+bool sinsp_filter_check::tojson(sinsp_evt* evt, sinsp_json_writer* writer)
 {
 	uint32_t len;
-	Json::Value jsonval = extract_as_js(evt, &len);
 
-	if(jsonval == Json::Value::nullRef)
+	if(extract_as_js(evt, writer))
 	{
-		uint8_t* rawval = extract(evt, &len);
-		if(rawval == NULL)
-		{
-			return Json::Value::nullRef
-;
-		}
-		return rawval_to_json(rawval, m_field, len);
+		return true;
+	}
+
+	uint8_t* rawval = extract(evt, &len);
+	if(rawval == NULL)
+	{
+		return false;
 	}
 
-	return jsonval;
+	return rawval_to_json(rawval, m_field, len, writer);
 }
 
 int32_t sinsp_filter_check::parse_field_name(const char* str, bool alloc_state)
@@ -1028,6 +1060,96 @@ void sinsp_filter_check::parse_filter_value(const char* str, uint32_t len)
 	string_to_rawval(str, len, m_field->m_type);
 }
 
+//
+// Length of the bytes of a raw value that are compared by '=', or -1 if the
+// type has no such representation
+//
+int32_t sinsp_filter_check::get_rawval_len(uint8_t* rawval, uint32_t len)
+{
+	switch(m_info.m_fields[m_field_id].m_type)
+	{
+	case PT_INT8:
+	case PT_UINT8:
+	case PT_FLAGS8:
+	case PT_SIGTYPE:
+		return 1;
+	case PT_INT16:
+	case PT_UINT16:
+	case PT_FLAGS16:
+	case PT_PORT:
+	case PT_SYSCALLID:
+		return 2;
+	case PT_INT32:
+	case PT_UINT32:
+	case PT_FLAGS32:
+	case PT_BOOL:
+	case PT_IPV4ADDR:
+		return 4;
+	case PT_INT64:
+	case PT_FD:
+	case PT_PID:
+	case PT_ERRNO:
+	case PT_UINT64:
+	case PT_RELTIME:
+	case PT_ABSTIME:
+		return 8;
+	case PT_CHARBUF:
+		return (int32_t)strlen((char*)rawval);
+	case PT_BYTEBUF:
+		return (int32_t)len;
+	default:
+		return -1;
+	}
+}
+
+bool sinsp_filter_check::supports_value_list()
+{
+	if(!has_generic_compare())
+	{
+		return false;
+	}
+
+	return get_rawval_len(&m_val_storage[0], 0) >= 0;
+}
+
+void sinsp_filter_check::add_filter_value(const char* str, uint32_t len)
+{
+	uint8_t* val = &m_val_storage[0];
+	uint32_t vlen;
+
+	parse_filter_value(str, len);
+	vlen = (uint32_t)get_rawval_len(val, m_val_storage_len);
+
+	if(m_cmpop == CO_IN)
+	{
+		if(m_val_set == NULL)
+		{
+			m_val_set = new sinsp_filter_value_set();
+		}
+
+		m_val_set->add(val, vlen);
+	}
+	else
+	{
+		ASSERT(m_cmpop == CO_PMATCH);
+
+		if(m_val_patterns == NULL)
+		{
+			m_val_patterns = new sinsp_filter_pattern_matcher();
+		}
+
+		m_val_patterns->add(val, vlen);
+	}
+}
+
+void sinsp_filter_check::end_filter_values()
+{
+	if(m_val_patterns != NULL)
+	{
+		m_val_patterns->build();
+	}
+}
+
 const filtercheck_field_info* sinsp_filter_check::get_field_info()
 {
 	return &m_info.m_fields[m_field_id];
@@ -1043,6 +1165,15 @@ bool sinsp_filter_check::compare(sinsp_evt *evt)
 		return false;
 	}
 
+	if(m_val_set != NULL)
+	{
+		return m_val_set->contains(extracted_val, get_rawval_len(extracted_val, len));
+	}
+	else if(m_val_patterns != NULL)
+	{
+		return m_val_patterns->match(extracted_val, get_rawval_len(extracted_val, len));
+	}
+
 	return flt_compare(m_cmpop,
 		m_info.m_fields[m_field_id].m_type,
 		extracted_val,
@@ -1147,6 +1278,7 @@ sinsp_filter::sinsp_filter(sinsp* inspector, const string& fltstr, bool ttable_o
 	m_scansize = 0;
 	m_state = ST_NEED_EXPRESSION;
 	m_filter = new sinsp_filter_expression();
+	m_program = NULL;
 	m_curexpr = m_filter;
 	m_last_boolop = BO_NONE;
 	m_nest_level = 0;
@@ -1154,6 +1286,7 @@ sinsp_filter::sinsp_filter(sinsp* inspector, const string& fltstr, bool ttable_o
 	try
 	{
 		compile(fltstr);
+		m_program = new sinsp_filter_program(m_filter);
 	}
 	catch(sinsp_exception& e)
 	{
@@ -1169,6 +1302,11 @@ sinsp_filter::sinsp_filter(sinsp* inspector, const string& fltstr, bool ttable_o
 
 sinsp_filter::~sinsp_filter()
 {
+	if(m_program)
+	{
+		delete m_program;
+	}
+
 	if(m_filter)
 	{
 		delete m_filter;
@@ -1459,6 +1597,11 @@ ppm_cmp_operator sinsp_filter::next_comparison_operator()
 		m_scanpos += 2;
 		return CO_IN;
 	}
+	else if(compare_no_consume("pmatch"))
+	{
+		m_scanpos += 6;
+		return CO_PMATCH;
+	}
 	else if(compare_no_consume("exists"))
 	{
 		m_scanpos += 6;
@@ -1499,15 +1642,32 @@ void sinsp_filter::parse_check(sinsp_filter_expression* parent_expr, boolop op)
 	chk->parse_field_name((char *)&operand1[0], true);
 
 	//
-	// In this case we need to create '(field=value1 or field=value2 ...)'
+	// The values of 'in' and 'pmatch' go in a set stored in the check when
+	// possible. Otherwise we need to create '(field=value1 or field=value2 ...)'
+	// or '(field contains value1 or field contains value2 ...)'
 	//
-	if(co == CO_IN)
+	if(co == CO_IN || co == CO_PMATCH)
 	{
-		//
-		// Separate the 'or's from the
-		// rest of the conditions
-		//
-		push_expression(op);
+		bool use_set = chk->supports_value_list();
+
+		if(co == CO_PMATCH)
+		{
+			ppm_param_type type = chk->get_field_info()->m_type;
+
+			if(type != PT_CHARBUF && type != PT_BYTEBUF)
+			{
+				throw sinsp_exception("'pmatch' is supported only for string fields");
+			}
+		}
+
+		if(!use_set)
+		{
+			//
+			// Separate the 'or's from the
+			// rest of the conditions
+			//
+			push_expression(op);
+		}
 
 		//
 		// Skip spaces
@@ -1541,21 +1701,28 @@ void sinsp_filter::parse_check(sinsp_filter_expression* parent_expr, boolop op)
 			// 'in' clause aware
 			vector<char> operand2 = next_operand(false, true);
 
-			//
-			// Append every sinsp_filter_check creating the 'or' sequence
-			//
-			sinsp_filter_check* newchk = g_filterlist.new_filter_check_from_another(chk);
-			newchk->m_boolop = op;
-			newchk->m_cmpop = CO_EQ;
-			newchk->parse_filter_value((char *)&operand2[0], (uint32_t)operand2.size() - 1);
+			if(use_set)
+			{
+				chk->add_filter_value((char *)&operand2[0], (uint32_t)operand2.size() - 1);
+			}
+			else
+			{
+				//
+				// Append every sinsp_filter_check creating the 'or' sequence
+				//
+				sinsp_filter_check* newchk = g_filterlist.new_filter_check_from_another(chk);
+				newchk->m_boolop = op;
+				newchk->m_cmpop = (co == CO_IN)? CO_EQ : CO_CONTAINS;
+				newchk->parse_filter_value((char *)&operand2[0], (uint32_t)operand2.size() - 1);
 
-			//
-			// We pushed another expression before
-			// so 'parent_expr' still referers to
-			// the old one, this is the new nested
-			// level for the 'or' sequence
-			//
-			m_curexpr->add_check(newchk);
+				//
+				// We pushed another expression before
+				// so 'parent_expr' still referers to
+				// the old one, this is the new nested
+				// level for the 'or' sequence
+				//
+				m_curexpr->add_check(newchk);
+			}
 
 			next();
 
@@ -1578,10 +1745,18 @@ void sinsp_filter::parse_check(sinsp_filter_expression* parent_expr, boolop op)
 			op = BO_OR;
 		}
 
-		//
-		// Come back to the rest of the filter
-		//
-		pop_expression();
+		if(use_set)
+		{
+			chk->end_filter_values();
+			parent_expr->add_check(chk);
+		}
+		else
+		{
+			//
+			// Come back to the rest of the filter
+			//
+			pop_expression();
+		}
 	}
 	else
 	{
@@ -1744,7 +1919,12 @@ void sinsp_filter::compile(const string& fltstr)
 
 bool sinsp_filter::run(sinsp_evt *evt)
 {
-	return m_filter->compare(evt);
+	return m_program->run(evt);
+}
+
+bool sinsp_filter::accepts_evttype(uint16_t etype)
+{
+	return m_program->accepts_evttype(etype);
 }
 
 #endif // HAS_FILTERING
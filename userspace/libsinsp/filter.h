@@ -20,7 +20,12 @@ along with sysdig.  If not, see <http://www.gnu.org/licenses/>.
 
 #ifdef HAS_FILTERING
 
+#ifndef VISIBILITY_PRIVATE
+#define VISIBILITY_PRIVATE private:
+#endif
+
 class sinsp_filter_expression;
+class sinsp_filter_program;
 
 enum boolop
 {
@@ -65,7 +70,22 @@ public:
 	*/
 	bool run(sinsp_evt *evt);
 
+	/*!
+	  \brief Tells if events of the given type can be accepted by the filter.
+
+	  \param etype The event type, one of the PPME_* values.
+	  \return false if the filter rejects every event of this type, e.g.
+	   the filter is "evt.type=open" and etype is PPME_SYSCALL_READ_X.
+	*/
+	bool accepts_evttype(uint16_t etype);
+
+VISIBILITY_PRIVATE
+
+// Doxygen doesn't understand VISIBILITY_PRIVATE
+#ifdef _DOXYGEN
 private:
+#endif
+
 	enum state
 	{
 		ST_EXPRESSION_DONE,
@@ -99,6 +119,7 @@ private:
 	int32_t m_nest_level;
 
 	sinsp_filter_expression* m_filter;
+	sinsp_filter_program* m_program;
 
 	friend class sinsp_evt_formatter;
 };
@@ -0,0 +1,529 @@
+/*
+Copyright (C) 2013-2014 Draios inc.
+
+This file is part of sysdig.
+
+sysdig is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License version 2 as
+published by the Free Software Foundation.
+
+sysdig is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sysdig.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdarg.h>
+#include <gtest.h>
+#define VISIBILITY_PRIVATE
+#include "sinsp.h"
+#include "sinsp_int.h"
+#include "filter.h"
+#include "filterchecks.h"
+#include "filtermatch.h"
+
+//
+// Number of events of the synthetic capture. Enough for the filter programs
+// to be reordered twice based on their statistics.
+//
+#define NEVENTS (2 * FILTER_REORDER_INTERVAL + 1000)
+
+static const char* g_comms[] = {"nginx", "bash", "sshd", "cat", "python", "java", "redis", "postgres"};
+
+//
+// A synthetic capture, kept in memory: a thread table, and a stream of
+// open/read/write/close events of those threads. Some of the events belong
+// to threads that are not in the table, or use fds that are not in the fd
+// tables, so that the fields of those events are missing.
+//
+class filter_capture : public testing::Test
+{
+protected:
+	virtual void SetUp()
+	{
+		for(uint32_t j = 0; j < 40; j++)
+		{
+			sinsp_threadinfo tinfo(&m_inspector);
+
+			tinfo.m_tid = 100 + j;
+			tinfo.m_pid = 100 + j;
+			tinfo.m_ptid = 1;
+			tinfo.m_uid = j % 3;
+			tinfo.m_comm = g_comms[j % 8];
+			tinfo.m_exe = string("/usr/bin/") + g_comms[j % 8];
+
+			m_inspector.m_thread_manager->add_thread(tinfo, true);
+
+			sinsp_threadinfo* added = m_inspector.get_thread(100 + j, false, true);
+			ASSERT_TRUE(added != NULL);
+
+			for(int64_t fd = 3; fd < 7; fd++)
+			{
+				sinsp_fdinfo_t fdinfo;
+				char name[64];
+
+				snprintf(name, sizeof(name), "/etc/dir%u/file%u.conf", (uint32_t)(j + fd) % 13, (uint32_t)(j * fd) % 101);
+				fdinfo.m_type = SCAP_FD_FILE;
+				fdinfo.m_name = name;
+				added->add_fd(fd, &fdinfo);
+			}
+		}
+
+		char data[64];
+		memset(data, 'x', sizeof(data));
+		memcpy(data, "hello world GET /index.html", 27);
+
+		for(uint32_t j = 0; m_offsets.size() < NEVENTS; j++)
+		{
+			//
+			// The tids above 139 are not in the thread table, and fd 7 is not
+			// in any fd table
+			//
+			int64_t tid = 100 + (j * 7) % 43;
+			int64_t fd = 3 + j % 5;
+			int64_t res = (j % 11 == 0)? -2 : 64;
+			uint32_t size = 64;
+			uint32_t flags = 1;
+			uint32_t mode = 0644;
+			char name[64];
+			uint32_t nlen = snprintf(name, sizeof(name), "/etc/dir%u/file%u.conf", j % 13, j % 101) + 1;
+
+			add_event(tid, PPME_SYSCALL_OPEN_E, 0);
+			add_event(tid, PPME_SYSCALL_OPEN_X, 4, &fd, 8, name, nlen, &flags, 4, &mode, 4);
+			add_event(tid, PPME_SYSCALL_READ_E, 2, &fd, 8, &size, 4);
+			add_event(tid, PPME_SYSCALL_READ_X, 2, &res, 8, data, (uint32_t)sizeof(data));
+			add_event(tid, PPME_SYSCALL_WRITE_E, 2, &fd, 8, &size, 4);
+			add_event(tid, PPME_SYSCALL_WRITE_X, 2, &res, 8, data, (uint32_t)(j % sizeof(data)));
+			add_event(tid, PPME_SYSCALL_CLOSE_E, 1, &fd, 8);
+			add_event(tid, PPME_SYSCALL_CLOSE_X, 1, &res, 8);
+		}
+	}
+
+	void add_event(int64_t tid, uint16_t type, uint32_t nparams, ...)
+	{
+		va_list args;
+		uint32_t offset = (uint32_t)m_buf.size();
+		uint32_t len = sizeof(scap_evt) + nparams * sizeof(uint16_t);
+
+		m_buf.resize(offset + len);
+
+		va_start(args, nparams);
+		for(uint32_t j = 0; j < nparams; j++)
+		{
+			uint8_t* val = (uint8_t*)va_arg(args, void*);
+			uint32_t vlen = va_arg(args, uint32_t);
+
+			((uint16_t*)&m_buf[offset + sizeof(scap_evt)])[j] = (uint16_t)vlen;
+			m_buf.insert(m_buf.end(), val, val + vlen);
+		}
+		va_end(args);
+
+		scap_evt* pevt = (scap_evt*)&m_buf[offset];
+		pevt->ts = 1000000000 + m_offsets.size();
+		pevt->tid = tid;
+		pevt->len = (uint32_t)m_buf.size() - offset;
+		pevt->type = type;
+
+		m_offsets.push_back(offset);
+	}
+
+	//
+	// Set up the event like the parser would, without changing the state
+	//
+	void load_event(uint32_t j, sinsp_evt* evt)
+	{
+		evt->init(&m_buf[m_offsets[j]], j % 4);
+		evt->m_evtnum = j + 1;
+		evt->m_tinfo = m_inspector.get_thread(evt->m_pevt->tid, false, true);
+
+		if(evt->m_tinfo != NULL && evt->m_pevt->type != PPME_SYSCALL_OPEN_E)
+		{
+			sinsp_evt_param* param = evt->get_param(0);
+			int64_t fd = *(int64_t*)param->m_val;
+
+			if(PPME_IS_ENTER(evt->m_pevt->type) || evt->m_pevt->type == PPME_SYSCALL_OPEN_X)
+			{
+				evt->m_tinfo->m_lastevent_fd = fd;
+			}
+
+			evt->m_fdinfo = evt->m_tinfo->get_fd(evt->m_tinfo->m_lastevent_fd);
+		}
+	}
+
+	//
+	// Run the filter on every event through the compiled program, and
+	// through the expression tree that it replaces
+	//
+	void run(const string& fltstr, vector<bool>* program, vector<bool>* tree)
+	{
+		sinsp_filter filter(&m_inspector, fltstr);
+		sinsp_evt evt(&m_inspector);
+
+		program->resize(m_offsets.size());
+		tree->resize(m_offsets.size());
+
+		for(uint32_t j = 0; j < m_offsets.size(); j++)
+		{
+			load_event(j, &evt);
+
+			(*program)[j] = filter.accepts_evttype(evt.get_type()) && filter.run(&evt);
+			(*tree)[j] = filter.m_filter->compare(&evt);
+		}
+	}
+
+	//
+	// Run two filters through their expression trees
+	//
+	void run_tree(const string& fltstr1, const string& fltstr2, vector<bool>* res1, vector<bool>* res2)
+	{
+		sinsp_filter filter1(&m_inspector, fltstr1);
+		sinsp_filter filter2(&m_inspector, fltstr2);
+		sinsp_evt evt(&m_inspector);
+
+		res1->resize(m_offsets.size());
+		res2->resize(m_offsets.size());
+
+		for(uint32_t j = 0; j < m_offsets.size(); j++)
+		{
+			load_event(j, &evt);
+
+			(*res1)[j] = filter1.m_filter->compare(&evt);
+			(*res2)[j] = filter2.m_filter->compare(&evt);
+		}
+	}
+
+	static uint32_t count(const vector<bool>& res)
+	{
+		uint32_t n = 0;
+
+		for(uint32_t j = 0; j < res.size(); j++)
+		{
+			n += res[j];
+		}
+
+		return n;
+	}
+
+	static int32_t first_mismatch(const vector<bool>& res1, const vector<bool>& res2)
+	{
+		for(uint32_t j = 0; j < res1.size(); j++)
+		{
+			if(res1[j] != res2[j])
+			{
+				return j;
+			}
+		}
+
+		return -1;
+	}
+
+	void expect_same_as_tree(const string& fltstr)
+	{
+		vector<bool> program;
+		vector<bool> tree;
+
+		run(fltstr, &program, &tree);
+		EXPECT_EQ(-1, first_mismatch(program, tree)) << fltstr;
+	}
+
+	//
+	// The value lists must give the same result as the checks they replaced,
+	// which compared the field with each value
+	//
+	void expect_same_as_expanded(const string& fltstr, const string& expanded)
+	{
+		vector<bool> program;
+		vector<bool> tree;
+		vector<bool> res1;
+		vector<bool> res2;
+
+		run(fltstr, &program, &tree);
+		run_tree(fltstr, expanded, &res1, &res2);
+
+		EXPECT_EQ(-1, first_mismatch(program, tree)) << fltstr;
+		EXPECT_EQ(-1, first_mismatch(res1, res2)) << fltstr << " vs " << expanded;
+	}
+
+	sinsp m_inspector;
+	vector<uint8_t> m_buf;
+	vector<uint32_t> m_offsets;
+};
+
+TEST_F(filter_capture, capture_has_matches)
+{
+	vector<bool> program;
+	vector<bool> tree;
+
+	run("evt.type=open and proc.name=nginx and fd.name contains dir1", &program, &tree);
+	EXPECT_NE(0u, count(tree));
+	EXPECT_NE(m_offsets.size(), count(tree));
+	EXPECT_EQ(-1, first_mismatch(program, tree));
+}
+
+TEST_F(filter_capture, program_reorders_and_or)
+{
+	expect_same_as_tree("evt.type=open and proc.name=nginx");
+	expect_same_as_tree("fd.name contains dir1 and evt.type=read and proc.name=bash");
+	expect_same_as_tree("proc.name=nginx or evt.type=read and fd.name contains dir3");
+	expect_same_as_tree("evt.type=read or evt.type=write and proc.name=cat or fd.num=4");
+	expect_same_as_tree("(evt.type=open or evt.type=close) and (proc.name=sshd or fd.name contains file1)");
+	expect_same_as_tree("evt.dir=< and (proc.pid<110 or proc.pid>130) and (fd.num=3 or fd.num=5)");
+	expect_same_as_tree("evt.num>1000 and evt.num<5000 or evt.cpu=2 and evt.type=write");
+}
+
+TEST_F(filter_capture, program_reorders_not)
+{
+	expect_same_as_tree("not evt.type=read");
+	expect_same_as_tree("not evt.type=read and not (proc.name=bash or proc.name=cat)");
+	expect_same_as_tree("evt.type!=read or not fd.name contains conf and proc.pid>110");
+	expect_same_as_tree("not (evt.type=open or evt.type=close) and not (fd.name contains /etc/dir1 or evt.dir=<)");
+	expect_same_as_tree("not (not proc.name=nginx and not (evt.type=read and not fd.num=3))");
+	expect_same_as_tree("proc.name=java or not (evt.cpu=1 or not (fd.num=6 and evt.dir=>))");
+}
+
+TEST_F(filter_capture, program_missing_fields)
+{
+	//
+	// The events of the threads that are not in the table have no proc and
+	// fd fields, the open enter events have no fd, and fd 7 is in no table
+	//
+	expect_same_as_tree("proc.name=nginx");
+	expect_same_as_tree("not proc.name=nginx");
+	expect_same_as_tree("proc.name!=nginx");
+	expect_same_as_tree("fd.name contains etc");
+	expect_same_as_tree("not fd.name contains etc");
+	expect_same_as_tree("proc.name=nginx or fd.num=7");
+	expect_same_as_tree("not fd.num=7 and not proc.name=bash");
+	expect_same_as_tree("thread.tid=141 or fd.name contains dir2");
+	expect_same_as_tree("evt.rawarg.res<0 or evt.rawarg.size=64");
+	expect_same_as_tree("not evt.rawarg.res<0 and evt.type in (read, write, close)");
+}
+
+TEST_F(filter_capture, program_mixed_types)
+{
+	expect_same_as_tree("proc.pid=100 or proc.name=100");
+	expect_same_as_tree("evt.rawarg.fd>=4 and evt.rawarg.res=64");
+	expect_same_as_tree("evt.buflen>10 and evt.buflen<40 or fd.num<=3");
+	expect_same_as_tree("evt.arg.fd=3 or evt.arg.name contains dir1");
+	expect_same_as_tree("user.uid=1 and evt.res=SUCCESS or evt.res!=SUCCESS and fd.typechar=f");
+	expect_same_as_tree("evt.type in (open, close) and (proc.name pmatch (ngi, sh) or not fd.name in (/etc/dir1/file1.conf, /etc/dir2/file2.conf))");
+}
+
+TEST_F(filter_capture, program_many_clauses)
+{
+	string fltstr;
+
+	for(uint32_t j = 0; j < 40; j++)
+	{
+		char clause[64];
+
+		snprintf(clause, sizeof(clause), "%s%s%u",
+			(j == 0)? "" : (j % 4 == 0)? " and " : " or ",
+			(j % 3 == 0)? "fd.name contains file" : "proc.pid=",
+			100 + j);
+		fltstr += clause;
+	}
+
+	expect_same_as_tree(fltstr);
+	expect_same_as_tree("not (" + fltstr + ")");
+}
+
+TEST_F(filter_capture, in_same_as_equal)
+{
+	expect_same_as_expanded("proc.name in (nginx, bash)",
+		"(proc.name=nginx or proc.name=bash)");
+
+	//
+	// Duplicate values
+	//
+	expect_same_as_expanded("proc.name in (nginx, nginx, bash, nginx)",
+		"(proc.name=nginx or proc.name=nginx or proc.name=bash or proc.name=nginx)");
+
+	//
+	// Values that are prefixes of each other, and of the field values
+	//
+	expect_same_as_expanded("fd.name in (/etc, /etc/dir1, /etc/dir1/file1.conf, /etc/dir1/file1.conf.bak)",
+		"(fd.name=/etc or fd.name=/etc/dir1 or fd.name=/etc/dir1/file1.conf or fd.name=/etc/dir1/file1.conf.bak)");
+	expect_same_as_expanded("proc.name in (ng, nginx, nginxx, sshd)",
+		"(proc.name=ng or proc.name=nginx or proc.name=nginxx or proc.name=sshd)");
+
+	//
+	// Values longer than any field value
+	//
+	expect_same_as_expanded("proc.name in (nginx_with_a_name_longer_than_any_process, cat)",
+		"(proc.name=nginx_with_a_name_longer_than_any_process or proc.name=cat)");
+
+	//
+	// Numeric fields, and negation
+	//
+	expect_same_as_expanded("proc.pid in (100, 102, 102, 139, 142)",
+		"(proc.pid=100 or proc.pid=102 or proc.pid=102 or proc.pid=139 or proc.pid=142)");
+	expect_same_as_expanded("not fd.num in (3, 7)",
+		"not (fd.num=3 or fd.num=7)");
+	expect_same_as_expanded("evt.type=read and not proc.name in (nginx, bash)",
+		"evt.type=read and not (proc.name=nginx or proc.name=bash)");
+}
+
+TEST_F(filter_capture, pmatch_same_as_contains)
+{
+	expect_same_as_expanded("fd.name pmatch (dir1, file2)",
+		"(fd.name contains dir1 or fd.name contains file2)");
+
+	//
+	// Duplicate patterns, and patterns that overlap or contain each other
+	//
+	expect_same_as_expanded("fd.name pmatch (dir1, dir1, dir1/, dir10, r1/f, /etc/dir1/file1)",
+		"(fd.name contains dir1 or fd.name contains dir1 or fd.name contains dir1/ or fd.name contains dir10 or fd.name contains r1/f or fd.name contains /etc/dir1/file1)");
+	expect_same_as_expanded("proc.name pmatch (ngin, gin, inx, x, nginxnginx)",
+		"(proc.name contains ngin or proc.name contains gin or proc.name contains inx or proc.name contains x or proc.name contains nginxnginx)");
+
+	//
+	// Patterns longer than the field values
+	//
+	expect_same_as_expanded("fd.name pmatch (/etc/dir1/file1.conf.with.a.very.long.suffix, /etc/dir12/file99.conf)",
+		"(fd.name contains /etc/dir1/file1.conf.with.a.very.long.suffix or fd.name contains /etc/dir12/file99.conf)");
+
+	expect_same_as_expanded("not fd.name pmatch (dir3, dir4)",
+		"not (fd.name contains dir3 or fd.name contains dir4)");
+}
+
+//
+// The value set and the pattern matcher against a linear scan of the values,
+// on every string up to a given length over a small alphabet
+//
+static void next_string(string* str, const string& alphabet, uint32_t maxlen, bool* done)
+{
+	for(uint32_t j = 0; j < str->size(); j++)
+	{
+		size_t pos = alphabet.find((*str)[j]);
+
+		if(pos + 1 < alphabet.size())
+		{
+			(*str)[j] = alphabet[pos + 1];
+			return;
+		}
+
+		(*str)[j] = alphabet[0];
+	}
+
+	*done = (str->size() == maxlen);
+	str->push_back(alphabet[0]);
+}
+
+static bool linear_contains(const vector<string>& values, const string& str)
+{
+	for(uint32_t j = 0; j < values.size(); j++)
+	{
+		if(values[j].size() == str.size() && memcmp(values[j].data(), str.data(), str.size()) == 0)
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static bool linear_match(const vector<string>& patterns, const string& str)
+{
+	for(uint32_t j = 0; j < patterns.size(); j++)
+	{
+		if(str.find(patterns[j]) != string::npos)
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static void expect_value_set(const vector<string>& values)
+{
+	sinsp_filter_value_set set;
+	string str;
+	bool done = false;
+
+	for(uint32_t j = 0; j < values.size(); j++)
+	{
+		set.add((const uint8_t*)values[j].data(), (uint32_t)values[j].size());
+	}
+
+	while(!done)
+	{
+		EXPECT_EQ(linear_contains(values, str), set.contains((const uint8_t*)str.data(), (uint32_t)str.size())) << "'" << str << "'";
+		next_string(&str, "abc", 6, &done);
+	}
+
+	for(uint32_t j = 0; j < values.size(); j++)
+	{
+		EXPECT_TRUE(set.contains((const uint8_t*)values[j].data(), (uint32_t)values[j].size())) << "'" << values[j] << "'";
+	}
+}
+
+static void expect_pattern_matcher(const vector<string>& patterns)
+{
+	sinsp_filter_pattern_matcher matcher;
+	string str;
+	bool done = false;
+
+	for(uint32_t j = 0; j < patterns.size(); j++)
+	{
+		matcher.add((const uint8_t*)patterns[j].data(), (uint32_t)patterns[j].size());
+	}
+
+	matcher.build();
+
+	while(!done)
+	{
+		EXPECT_EQ(linear_match(patterns, str), matcher.match((const uint8_t*)str.data(), (uint32_t)str.size())) << "'" << str << "'";
+		next_string(&str, "abcd", 6, &done);
+	}
+}
+
+TEST(sinsp_filter_value_set, same_as_linear_scan)
+{
+	expect_value_set({"a", "b"});
+	expect_value_set({"ab", "ab", "ab", "ba"});
+	expect_value_set({"", "a"});
+	expect_value_set({"a", "ab", "abc", "abca", "abcab"});
+	expect_value_set({"abcabcabcabc", "cc"});
+	expect_value_set({string("a\0b", 3), "a"});
+}
+
+TEST(sinsp_filter_value_set, grows)
+{
+	vector<string> values;
+
+	for(uint32_t j = 0; j < 1000; j++)
+	{
+		values.push_back(to_string(j * 7));
+	}
+
+	sinsp_filter_value_set set;
+
+	for(uint32_t j = 0; j < values.size(); j++)
+	{
+		set.add((const uint8_t*)values[j].data(), (uint32_t)values[j].size());
+	}
+
+	for(uint32_t j = 0; j < 7000; j++)
+	{
+		string str = to_string(j);
+		EXPECT_EQ(j % 7 == 0, set.contains((const uint8_t*)str.data(), (uint32_t)str.size())) << str;
+	}
+}
+
+TEST(sinsp_filter_pattern_matcher, same_as_linear_scan)
+{
+	expect_pattern_matcher({"a"});
+	expect_pattern_matcher({"ab", "ab", "ba"});
+	expect_pattern_matcher({"abc", "bc", "c"});
+	expect_pattern_matcher({"abcd", "bcda", "cdab", "dabc"});
+	expect_pattern_matcher({"aab", "ab", "abab", "bab"});
+	expect_pattern_matcher({"abcdabcdabcd", "dd"});
+	expect_pattern_matcher({"abcdabcdabcd"});
+	expect_pattern_matcher({"", "dd"});
+	expect_pattern_matcher({"e"});
+}
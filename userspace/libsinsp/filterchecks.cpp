@@ -1098,18 +1098,7 @@ bool sinsp_filter_check_fd::compare(sinsp_evt *evt)
 	//
 	// Standard extract-based fields
 	//
-	uint32_t len;
-	uint8_t* extracted_val = extract(evt, &len);
-
-	if(extracted_val == NULL)
-	{
-		return false;
-	}
-
-	return flt_compare(m_cmpop, 
-		m_info.m_fields[m_field_id].m_type, 
-		extracted_val, 
-		&m_val_storage[0]);
+	return sinsp_filter_check::compare(evt);
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -1154,6 +1143,7 @@ const filtercheck_field_info sinsp_filter_check_thread_fields[] =
 	{PT_DOUBLE, EPF_NONE, PF_NA, "thread.cpu.system", "the system CPU consumed by the thread in the last second."},
 	{PT_UINT64, EPF_NONE, PF_DEC, "thread.vmsize", "For the process main thread, this is the total virtual memory for the process (as kb). For the other threads, this field is zero."},
 	{PT_UINT64, EPF_NONE, PF_DEC, "thread.vmrss", "For the process main thread, this is the resident non-swapped memory for the process (as kb). For the other threads, this field is zero."},
+	{PT_BOOL, EPF_NONE, PF_NA, "thread.ispending", "'true' if the /proc information of the thread generating the event is still being read in the background. Until then, the process fields of the thread are not available."},
 };
 
 sinsp_filter_check_thread::sinsp_filter_check_thread()
@@ -1509,6 +1499,9 @@ uint8_t* sinsp_filter_check_thread::extract(sinsp_evt *evt, OUT uint32_t* len)
 	case TYPE_ISMAINTHREAD:
 		m_tbool = (uint32_t)tinfo->is_main_thread();
 		return (uint8_t*)&m_tbool;
+	case TYPE_ISPENDING:
+		m_tbool = (uint32_t)tinfo->is_proc_pending();
+		return (uint8_t*)&m_tbool;
 	case TYPE_EXECTIME:
 		{
 			m_u64val = 0;
@@ -1733,8 +1726,14 @@ uint8_t* sinsp_filter_check_thread::extract(sinsp_evt *evt, OUT uint32_t* len)
 		{
 			m_tstr.clear();
 
+			if(tinfo->m_cgroups == NULL)
+			{
+				return NULL;
+			}
+
+			const vector<pair<string, string>>& cgroups = tinfo->m_cgroups->m_cgroups;
 			uint32_t j;
-			uint32_t nargs = (uint32_t)tinfo->m_cgroups.size();
+			uint32_t nargs = (uint32_t)cgroups.size();
 
 			if(nargs == 0)
 			{
@@ -1743,9 +1742,9 @@ uint8_t* sinsp_filter_check_thread::extract(sinsp_evt *evt, OUT uint32_t* len)
 			
 			for(j = 0; j < nargs; j++)
 			{
-				m_tstr += tinfo->m_cgroups[j].first;
+				m_tstr += cgroups[j].first;
 				m_tstr += "=";
-				m_tstr += tinfo->m_cgroups[j].second;				
+				m_tstr += cgroups[j].second;
 				if(j < nargs - 1)
 				{
 					m_tstr += ' ';
@@ -1756,7 +1755,13 @@ uint8_t* sinsp_filter_check_thread::extract(sinsp_evt *evt, OUT uint32_t* len)
 		}
 	case TYPE_CGROUP:
 		{
-			uint32_t nargs = (uint32_t)tinfo->m_cgroups.size();
+			if(tinfo->m_cgroups == NULL)
+			{
+				return NULL;
+			}
+
+			const vector<pair<string, string>>& cgroups = tinfo->m_cgroups->m_cgroups;
+			uint32_t nargs = (uint32_t)cgroups.size();
 
 			if(nargs == 0)
 			{
@@ -1765,9 +1770,9 @@ uint8_t* sinsp_filter_check_thread::extract(sinsp_evt *evt, OUT uint32_t* len)
 			
 			for(uint32_t j = 0; j < nargs; j++)
 			{
-				if(tinfo->m_cgroups[j].first == m_argname)
+				if(cgroups[j].first == m_argname)
 				{
-					m_tstr = tinfo->m_cgroups[j].second;
+					m_tstr = cgroups[j].second;
 					return (uint8_t*)m_tstr.c_str();					
 				}
 			}
@@ -2548,15 +2553,18 @@ inline uint8_t* sinsp_filter_check_event::extract_buflen(sinsp_evt *evt)
 	return NULL;
 }
 
-Json::Value sinsp_filter_check_event::extract_as_js(sinsp_evt *evt, OUT uint32_t* len)
+bool sinsp_filter_check_event::extract_as_js(sinsp_evt *evt, sinsp_json_writer* writer)
 {
+	uint32_t len;
+
 	switch(m_field_id)
 	{
 	case TYPE_TIME:
 	case TYPE_TIME_S:
 	case TYPE_DATETIME:
 	case TYPE_RUNTIME_TIME_OUTPUT_FORMAT:
-		return (Json::Value::Int64)evt->get_ts();
+		writer->int_value((int64_t)evt->get_ts());
+		return true;
 
 	case TYPE_RAWTS:
 	case TYPE_RAWTS_S:
@@ -2570,16 +2578,32 @@ Json::Value sinsp_filter_check_event::extract_as_js(sinsp_evt *evt, OUT uint32_t
 	case TYPE_DELTA:
 	case TYPE_DELTA_S:
 	case TYPE_DELTA_NS:
-		return (Json::Value::Int64)*(uint64_t*)extract(evt, len);
+		{
+			//
+			// For the evt.deltatime fields, extract() remembers the timestamp
+			// of the event for the delta of the next one, so it must run once
+			// per event. The JSON output used to extract the fields twice, and
+			// those fields were always 0 in it.
+			//
+			uint8_t* rawval = extract(evt, &len);
+
+			if(rawval == NULL)
+			{
+				return false;
+			}
+
+			writer->int_value(*(int64_t*)rawval);
+			return true;
+		}
 	case TYPE_COUNT:
-		m_u32val = 1;
-		return m_u32val;
+		writer->uint_value(1);
+		return true;
 
 	default:
-		return Json::Value::nullRef;
+		return false;
 	}
 
-	return Json::Value::nullRef;
+	return false;
 }
 
 uint8_t* sinsp_filter_check_event::extract_error_count(sinsp_evt *evt, OUT uint32_t* len)
@@ -3838,7 +3862,8 @@ const filtercheck_field_info sinsp_filter_check_container_fields[] =
 {
 	{PT_CHARBUF, EPF_NONE, PF_NA, "container.id", "the container id."},
 	{PT_CHARBUF, EPF_NONE, PF_NA, "container.name", "the container name."},
-	{PT_CHARBUF, EPF_NONE, PF_NA, "container.image", "the container image."}
+	{PT_CHARBUF, EPF_NONE, PF_NA, "container.image", "the container image."},
+	{PT_BOOL, EPF_NONE, PF_NA, "container.ispending", "'true' if the metadata of the container is still being fetched from the Docker daemon in the background. Until then, the container name and image are not available."}
 };
 
 sinsp_filter_check_container::sinsp_filter_check_container()
@@ -3921,6 +3946,24 @@ uint8_t* sinsp_filter_check_container::extract(sinsp_evt *evt, OUT uint32_t* len
 		}
 
 		return (uint8_t*)m_tstr.c_str();
+	case TYPE_CONTAINER_ISPENDING:
+		if(tinfo->m_container_id.empty())
+		{
+			m_tbool = false;
+		}
+		else
+		{
+			sinsp_container_info container_info;
+			bool found = m_inspector->m_container_manager.get_container(tinfo->m_container_id, &container_info);
+			if(!found)
+			{
+				return NULL;
+			}
+
+			m_tbool = container_info.m_metadata_pending;
+		}
+
+		return (uint8_t*)&m_tbool;
 	default:
 		ASSERT(false);
 		break;
@@ -17,7 +17,6 @@ along with sysdig.  If not, see <http://www.gnu.org/licenses/>.
 */
 
 #pragma once
-#include <json/json.h>
 
 #ifdef HAS_FILTERING
 
@@ -31,6 +30,9 @@ bool flt_compare_avg(ppm_cmp_operator op, ppm_param_type type, void* operand1, v
 
 char* flt_to_string(uint8_t* rawval, filtercheck_field_info* finfo);
 
+class sinsp_filter_value_set;
+class sinsp_filter_pattern_matcher;
+
 class operand_info
 {
 public:
@@ -50,9 +52,7 @@ class sinsp_filter_check
 public:
 	sinsp_filter_check();
 
-	virtual ~sinsp_filter_check()
-	{
-	}
+	virtual ~sinsp_filter_check();
 
 	//
 	// Allocate a new check of the same type.
@@ -81,6 +81,24 @@ public:
 	//
 	virtual void parse_filter_value(const char* str, uint32_t len);
 
+	//
+	// Return true if the values of an 'in' or 'pmatch' check can be stored
+	// in this check. If not, the check must be expanded into a sequence of
+	// '=' or 'contains' checks.
+	//
+	bool supports_value_list();
+
+	//
+	// Parse one of the values of an 'in' or 'pmatch' check and add it to the
+	// ones the field is compared with
+	//
+	void add_filter_value(const char* str, uint32_t len);
+
+	//
+	// Called after the last add_filter_value()
+	//
+	void end_filter_values();
+
 	//
 	// Return the info about the field that this instance contains
 	//
@@ -92,12 +110,12 @@ public:
 	virtual uint8_t* extract(sinsp_evt *evt, OUT uint32_t* len) = 0;
 
 	//
-	// Extract the field as json from the event (by default, fall
-	// back to the regular extract functionality)
+	// Extract the field from the event and write it as json (by default,
+	// return false to fall back to the regular extract functionality)
 	//
-	virtual Json::Value extract_as_js(sinsp_evt *evt, OUT uint32_t* len)
+	virtual bool extract_as_js(sinsp_evt *evt, sinsp_json_writer* writer)
 	{
-		return Json::Value::nullRef;
+		return false;
 	}
 
 	//
@@ -105,16 +123,29 @@ public:
 	//
 	virtual bool compare(sinsp_evt *evt);
 
+	//
+	// Return true if compare() is just extract() followed by flt_compare() on
+	// the field type, in which case sinsp_filter_program can replace it with
+	// a comparison specialized for the type and the operator.
+	// Checks that override compare() for some of their fields must override
+	// this as well.
+	//
+	virtual bool has_generic_compare()
+	{
+		return true;
+	}
+
 	//
 	// Extract the value from the event and convert it into a string
 	//
 	virtual char* tostring(sinsp_evt* evt);
 
 	//
-	// Extract the value from the event and convert it into a Json value
-	// or object
+	// Extract the value from the event and write it into writer as a Json
+	// value or object. Returns false, without writing anything, if the
+	// event doesn't have the value.
 	//
-	virtual Json::Value tojson(sinsp_evt* evt);
+	virtual bool tojson(sinsp_evt* evt, sinsp_json_writer* writer);
 
 	sinsp* m_inspector;
 	boolop m_boolop;
@@ -124,7 +155,7 @@ public:
 
 protected:
 	char* rawval_to_string(uint8_t* rawval, const filtercheck_field_info* finfo, uint32_t len);
-	Json::Value rawval_to_json(uint8_t* rawval, const filtercheck_field_info* finfo, uint32_t len);
+	bool rawval_to_json(uint8_t* rawval, const filtercheck_field_info* finfo, uint32_t len, sinsp_json_writer* writer);
 	void string_to_rawval(const char* str, uint32_t len, ppm_param_type ptype);
 
 	char m_getpropertystr_storage[1024];
@@ -134,11 +165,16 @@ protected:
 	uint32_t m_field_id;
 	uint32_t m_th_state_id;
 	uint32_t m_val_storage_len;
+	sinsp_filter_value_set* m_val_set; // Values of an 'in' check
+	sinsp_filter_pattern_matcher* m_val_patterns; // Values of a 'pmatch' check
 
 private:
 	void set_inspector(sinsp* inspector);
+	int32_t get_rawval_len(uint8_t* rawval, uint32_t len);
 
 friend class sinsp_filter_check_list;
+friend class sinsp_filter_program;
+friend class sinsp_evt_formatter;
 };
 
 //
@@ -175,6 +211,11 @@ public:
 	void parse(string expr);
 	bool compare(sinsp_evt *evt);
 
+	bool has_generic_compare()
+	{
+		return false;
+	}
+
 	//
 	// The following methods are part of the filter check interface but are irrelevant
 	// for this class, because they are used only for the leaves of the filtering tree.
@@ -271,6 +312,11 @@ public:
 	bool compare_port(sinsp_evt *evt);
 	bool compare(sinsp_evt *evt);
 
+	bool has_generic_compare()
+	{
+		return m_field_id != TYPE_IP && m_field_id != TYPE_PORT && m_field_id != TYPE_PROTO;
+	}
+
 	sinsp_threadinfo* m_tinfo;
 	sinsp_fdinfo_t* m_fdinfo;
 	fd_type m_fd_type;
@@ -329,6 +375,7 @@ public:
 		TYPE_THREAD_CPU_SYSTEM = 34,
 		TYPE_THREAD_VMSIZE = 35,
 		TYPE_THREAD_VMRSS = 36,
+		TYPE_ISPENDING = 37,
 	};
 
 	sinsp_filter_check_thread();
@@ -337,6 +384,11 @@ public:
 	uint8_t* extract(sinsp_evt *evt, OUT uint32_t* len);
 	bool compare(sinsp_evt *evt);
 
+	bool has_generic_compare()
+	{
+		return !((m_field_id == TYPE_APID || m_field_id == TYPE_ANAME) && m_argid == -1);
+	}
+
 private:
 	uint64_t extract_exectime(sinsp_evt *evt);
 	int32_t extract_arg(string fldname, string val, OUT const struct ppm_param_info** parinfo);
@@ -430,9 +482,14 @@ public:
 	void parse_filter_value(const char* str, uint32_t len);
 	const filtercheck_field_info* get_field_info();
 	uint8_t* extract(sinsp_evt *evt, OUT uint32_t* len);
-	Json::Value extract_as_js(sinsp_evt *evt, OUT uint32_t* len);
+	bool extract_as_js(sinsp_evt *evt, sinsp_json_writer* writer);
 	bool compare(sinsp_evt *evt);
 
+	bool has_generic_compare()
+	{
+		return m_field_id != TYPE_ARGRAW && m_field_id != TYPE_AROUND && m_field_id != TYPE_BUFFER;
+	}
+
 	uint64_t m_u64val;
 	uint64_t m_tsdelta;
 	uint32_t m_u32val;
@@ -559,6 +616,7 @@ public:
 		TYPE_CONTAINER_ID = 0,
 		TYPE_CONTAINER_NAME,
 		TYPE_CONTAINER_IMAGE,
+		TYPE_CONTAINER_ISPENDING,
 	};
 
 	sinsp_filter_check_container();
@@ -567,6 +625,7 @@ public:
 
 private:
 	string m_tstr;
+	uint32_t m_tbool;
 };
 
 //
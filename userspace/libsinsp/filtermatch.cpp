@@ -0,0 +1,275 @@
+/*
+Copyright (C) 2013-2014 Draios inc.
+
+This file is part of sysdig.
+
+sysdig is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License version 2 as
+published by the Free Software Foundation.
+
+sysdig is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sysdig.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <queue>
+
+#include "sinsp.h"
+#include "sinsp_int.h"
+
+#ifdef HAS_FILTERING
+#include "filtermatch.h"
+
+#define VALUE_SET_MIN_BUCKETS 16
+#define PATTERN_NO_STATE 0xffffffff
+
+///////////////////////////////////////////////////////////////////////////////
+// sinsp_filter_value_set implementation
+///////////////////////////////////////////////////////////////////////////////
+sinsp_filter_value_set::sinsp_filter_value_set()
+{
+	m_buckets.resize(VALUE_SET_MIN_BUCKETS, -1);
+	m_mask = VALUE_SET_MIN_BUCKETS - 1;
+}
+
+//
+// 32 bit FNV-1a
+//
+uint32_t sinsp_filter_value_set::hash(const uint8_t* val, uint32_t len)
+{
+	uint32_t h = 2166136261U;
+
+	for(uint32_t j = 0; j < len; j++)
+	{
+		h ^= val[j];
+		h *= 16777619U;
+	}
+
+	return h;
+}
+
+int32_t sinsp_filter_value_set::find(const uint8_t* val, uint32_t len, uint32_t h)
+{
+	uint32_t idx = h & m_mask;
+
+	while(true)
+	{
+		int32_t vidx = m_buckets[idx];
+
+		if(vidx < 0)
+		{
+			return -1;
+		}
+
+		if(m_values[vidx].second == len &&
+			memcmp(m_pool.data() + m_values[vidx].first, val, len) == 0)
+		{
+			return vidx;
+		}
+
+		idx = (idx + 1) & m_mask;
+	}
+}
+
+void sinsp_filter_value_set::rehash(uint32_t nbuckets)
+{
+	m_buckets.assign(nbuckets, -1);
+	m_mask = nbuckets - 1;
+
+	for(uint32_t j = 0; j < m_values.size(); j++)
+	{
+		uint32_t len;
+		const uint8_t* val = get(j, &len);
+		uint32_t idx = hash(val, len) & m_mask;
+
+		while(m_buckets[idx] >= 0)
+		{
+			idx = (idx + 1) & m_mask;
+		}
+
+		m_buckets[idx] = j;
+	}
+}
+
+void sinsp_filter_value_set::add(const uint8_t* val, uint32_t len)
+{
+	uint32_t h = hash(val, len);
+	uint32_t idx;
+
+	if(find(val, len, h) >= 0)
+	{
+		return;
+	}
+
+	m_values.push_back(pair<uint32_t, uint32_t>((uint32_t)m_pool.size(), len));
+	m_pool.insert(m_pool.end(), val, val + len);
+
+	//
+	// Keep the load factor below 1/2, so that the probe sequences stay short
+	//
+	if(m_values.size() * 2 > m_buckets.size())
+	{
+		rehash((uint32_t)m_buckets.size() * 2);
+		return;
+	}
+
+	idx = h & m_mask;
+
+	while(m_buckets[idx] >= 0)
+	{
+		idx = (idx + 1) & m_mask;
+	}
+
+	m_buckets[idx] = (int32_t)m_values.size() - 1;
+}
+
+bool sinsp_filter_value_set::contains(const uint8_t* val, uint32_t len)
+{
+	return find(val, len, hash(val, len)) >= 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// sinsp_filter_pattern_matcher implementation
+///////////////////////////////////////////////////////////////////////////////
+sinsp_filter_pattern_matcher::sinsp_filter_pattern_matcher()
+{
+	memset(m_classes, 0, sizeof(m_classes));
+	m_nclasses = 1;
+	m_match_all = false;
+}
+
+void sinsp_filter_pattern_matcher::add(const uint8_t* pattern, uint32_t len)
+{
+	m_patterns.push_back(string((const char*)pattern, len));
+}
+
+void sinsp_filter_pattern_matcher::build()
+{
+	uint32_t nstates = 1;
+	vector<uint32_t> fail;
+	queue<uint32_t> q;
+
+	//
+	// Class 0 is for the bytes that don't appear in any pattern
+	//
+	memset(m_classes, 0, sizeof(m_classes));
+	m_nclasses = 1;
+
+	for(uint32_t j = 0; j < m_patterns.size(); j++)
+	{
+		for(uint32_t k = 0; k < m_patterns[j].size(); k++)
+		{
+			uint8_t b = (uint8_t)m_patterns[j][k];
+
+			if(m_classes[b] == 0)
+			{
+				m_classes[b] = (uint16_t)m_nclasses++;
+			}
+		}
+	}
+
+	//
+	// Build the trie of the patterns
+	//
+	m_delta.assign(m_nclasses, PATTERN_NO_STATE);
+	m_final.assign(1, 0);
+
+	for(uint32_t j = 0; j < m_patterns.size(); j++)
+	{
+		uint32_t s = 0;
+
+		if(m_patterns[j].empty())
+		{
+			m_match_all = true;
+			continue;
+		}
+
+		for(uint32_t k = 0; k < m_patterns[j].size(); k++)
+		{
+			uint32_t c = m_classes[(uint8_t)m_patterns[j][k]];
+
+			if(m_delta[s * m_nclasses + c] == PATTERN_NO_STATE)
+			{
+				m_delta[s * m_nclasses + c] = nstates++;
+				m_delta.resize(nstates * m_nclasses, PATTERN_NO_STATE);
+				m_final.push_back(0);
+			}
+
+			s = m_delta[s * m_nclasses + c];
+		}
+
+		m_final[s] = 1;
+	}
+
+	//
+	// Compute the failure links breadth first, and replace the missing
+	// transitions with the ones of the failure state, so that match() never
+	// has to follow the links
+	//
+	fail.assign(nstates, 0);
+
+	for(uint32_t c = 0; c < m_nclasses; c++)
+	{
+		uint32_t t = m_delta[c];
+
+		if(t == PATTERN_NO_STATE)
+		{
+			m_delta[c] = 0;
+		}
+		else
+		{
+			q.push(t);
+		}
+	}
+
+	while(!q.empty())
+	{
+		uint32_t s = q.front();
+		q.pop();
+
+		for(uint32_t c = 0; c < m_nclasses; c++)
+		{
+			uint32_t t = m_delta[s * m_nclasses + c];
+			uint32_t ft = m_delta[fail[s] * m_nclasses + c];
+
+			if(t == PATTERN_NO_STATE)
+			{
+				m_delta[s * m_nclasses + c] = ft;
+			}
+			else
+			{
+				fail[t] = ft;
+				m_final[t] |= m_final[ft];
+				q.push(t);
+			}
+		}
+	}
+}
+
+bool sinsp_filter_pattern_matcher::match(const uint8_t* buf, uint32_t len)
+{
+	uint32_t s = 0;
+
+	if(m_match_all)
+	{
+		return true;
+	}
+
+	for(uint32_t j = 0; j < len; j++)
+	{
+		s = m_delta[s * m_nclasses + m_classes[buf[j]]];
+
+		if(m_final[s])
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+#endif // HAS_FILTERING
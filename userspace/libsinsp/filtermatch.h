@@ -0,0 +1,99 @@
+/*
+Copyright (C) 2013-2014 Draios inc.
+
+This file is part of sysdig.
+
+sysdig is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License version 2 as
+published by the Free Software Foundation.
+
+sysdig is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sysdig.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#ifdef HAS_FILTERING
+
+///////////////////////////////////////////////////////////////////////////////
+// The set of values of an 'in' check, e.g. "proc.name in (nginx, java)".
+// The values are raw field values, compared byte by byte, and they are kept
+// in an open addressing hash table so that the field is extracted once and
+// looked up with a single hash computation, regardless of the number of
+// values.
+///////////////////////////////////////////////////////////////////////////////
+class sinsp_filter_value_set
+{
+public:
+	sinsp_filter_value_set();
+
+	void add(const uint8_t* val, uint32_t len);
+	bool contains(const uint8_t* val, uint32_t len);
+
+	uint32_t size()
+	{
+		return (uint32_t)m_values.size();
+	}
+
+	//
+	// Return the j-th value that was added to the set
+	//
+	const uint8_t* get(uint32_t j, OUT uint32_t* len)
+	{
+		*len = m_values[j].second;
+		return m_pool.data() + m_values[j].first;
+	}
+
+private:
+	static uint32_t hash(const uint8_t* val, uint32_t len);
+	int32_t find(const uint8_t* val, uint32_t len, uint32_t h);
+	void rehash(uint32_t nbuckets);
+
+	vector<uint8_t> m_pool; // The values, one after the other
+	vector<pair<uint32_t, uint32_t> > m_values; // Offset and length in m_pool
+	vector<int32_t> m_buckets; // Index in m_values, -1 if the bucket is free
+	uint32_t m_mask;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// The patterns of a 'pmatch' check, e.g. "fd.name pmatch (/etc, /usr/lib)",
+// which is true if the field contains any of them.
+// The patterns are compiled into an Aho-Corasick automaton, so the field is
+// scanned once regardless of the number of patterns. The bytes that don't
+// appear in any pattern are folded into a single input class, which keeps
+// the transition table small.
+///////////////////////////////////////////////////////////////////////////////
+class sinsp_filter_pattern_matcher
+{
+public:
+	sinsp_filter_pattern_matcher();
+
+	void add(const uint8_t* pattern, uint32_t len);
+
+	//
+	// Must be called after the last add() and before match()
+	//
+	void build();
+
+	bool match(const uint8_t* buf, uint32_t len);
+
+	uint32_t size()
+	{
+		return (uint32_t)m_patterns.size();
+	}
+
+private:
+	vector<string> m_patterns;
+	uint16_t m_classes[256]; // Input class of every byte value
+	uint32_t m_nclasses;
+	vector<uint32_t> m_delta; // Transitions, m_nclasses per state
+	vector<uint8_t> m_final; // Non zero if a pattern ends at the state
+	bool m_match_all; // One of the patterns is empty
+};
+
+#endif // HAS_FILTERING
@@ -0,0 +1,805 @@
+/*
+Copyright (C) 2013-2014 Draios inc.
+
+This file is part of sysdig.
+
+sysdig is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License version 2 as
+published by the Free Software Foundation.
+
+sysdig is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sysdig.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+
+#include "sinsp.h"
+#include "sinsp_int.h"
+
+#ifdef HAS_FILTERING
+#include "filter.h"
+#include "filterchecks.h"
+#include "filterprogram.h"
+#include "filtermatch.h"
+
+#ifndef _GNU_SOURCE
+//
+// Fallback implementation of memmem
+//
+void *memmem(const void *haystack, size_t haystacklen, const void *needle, size_t needlelen);
+#endif
+
+extern sinsp_evttables g_infotables;
+
+///////////////////////////////////////////////////////////////////////////////
+// Typed comparison functions.
+// They match what flt_compare() does for the same type and operator.
+///////////////////////////////////////////////////////////////////////////////
+template<typename T> static bool cmp_eq(uint8_t* val, uint32_t len, uint8_t* ref, uint32_t ref_len)
+{
+	return *(T*)val == *(T*)ref;
+}
+
+template<typename T> static bool cmp_ne(uint8_t* val, uint32_t len, uint8_t* ref, uint32_t ref_len)
+{
+	return *(T*)val != *(T*)ref;
+}
+
+template<typename T> static bool cmp_lt(uint8_t* val, uint32_t len, uint8_t* ref, uint32_t ref_len)
+{
+	return *(T*)val < *(T*)ref;
+}
+
+template<typename T> static bool cmp_le(uint8_t* val, uint32_t len, uint8_t* ref, uint32_t ref_len)
+{
+	return *(T*)val <= *(T*)ref;
+}
+
+template<typename T> static bool cmp_gt(uint8_t* val, uint32_t len, uint8_t* ref, uint32_t ref_len)
+{
+	return *(T*)val > *(T*)ref;
+}
+
+template<typename T> static bool cmp_ge(uint8_t* val, uint32_t len, uint8_t* ref, uint32_t ref_len)
+{
+	return *(T*)val >= *(T*)ref;
+}
+
+template<typename T> static sinsp_filter_cmp_fn select_num_cmp(ppm_cmp_operator op)
+{
+	switch(op)
+	{
+	case CO_EQ:
+		return cmp_eq<T>;
+	case CO_NE:
+		return cmp_ne<T>;
+	case CO_LT:
+		return cmp_lt<T>;
+	case CO_LE:
+		return cmp_le<T>;
+	case CO_GT:
+		return cmp_gt<T>;
+	case CO_GE:
+		return cmp_ge<T>;
+	default:
+		//
+		// flt_compare() throws for the other operators, let it do that
+		//
+		return NULL;
+	}
+}
+
+static bool cmp_str_eq(uint8_t* val, uint32_t len, uint8_t* ref, uint32_t ref_len)
+{
+	return strcmp((char*)val, (char*)ref) == 0;
+}
+
+static bool cmp_str_ne(uint8_t* val, uint32_t len, uint8_t* ref, uint32_t ref_len)
+{
+	return strcmp((char*)val, (char*)ref) != 0;
+}
+
+static bool cmp_str_contains(uint8_t* val, uint32_t len, uint8_t* ref, uint32_t ref_len)
+{
+	return strstr((char*)val, (char*)ref) != NULL;
+}
+
+static bool cmp_buf_eq(uint8_t* val, uint32_t len, uint8_t* ref, uint32_t ref_len)
+{
+	return len == ref_len && memcmp(val, ref, len) == 0;
+}
+
+static bool cmp_buf_ne(uint8_t* val, uint32_t len, uint8_t* ref, uint32_t ref_len)
+{
+	return len != ref_len || memcmp(val, ref, len) != 0;
+}
+
+static bool cmp_buf_contains(uint8_t* val, uint32_t len, uint8_t* ref, uint32_t ref_len)
+{
+	return memmem(val, len, ref, ref_len) != NULL;
+}
+
+static bool cmp_exists(uint8_t* val, uint32_t len, uint8_t* ref, uint32_t ref_len)
+{
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// sinsp_filter_program implementation
+///////////////////////////////////////////////////////////////////////////////
+sinsp_filter_program::node::node()
+{
+	m_check = NULL;
+	m_cmp = NULL;
+	m_is_and = true;
+	m_negate = false;
+	m_cost = 1;
+	m_nleaves = 0;
+	m_nevals = 0;
+	m_ntrue = 0;
+	m_prob_true = 0.5;
+	m_expected_cost = 1;
+}
+
+sinsp_filter_program::node::~node()
+{
+	for(uint32_t j = 0; j < m_children.size(); j++)
+	{
+		delete m_children[j];
+	}
+}
+
+sinsp_filter_program::sinsp_filter_program(sinsp_filter_expression* expr)
+{
+	evttype_set always;
+
+	m_nruns = 0;
+	m_root = build(expr);
+	evttypes(m_root, &m_evttypes, &always);
+	reorder();
+}
+
+sinsp_filter_program::~sinsp_filter_program()
+{
+	delete m_root;
+}
+
+sinsp_filter_cmp_fn sinsp_filter_program::select_cmp(sinsp_filter_check* chk)
+{
+	//
+	// 'in' and 'pmatch' compare with a set of values, which compare() does
+	//
+	if(!chk->has_generic_compare() || chk->m_val_set != NULL || chk->m_val_patterns != NULL)
+	{
+		return NULL;
+	}
+
+	if(chk->m_cmpop == CO_EXISTS)
+	{
+		return cmp_exists;
+	}
+
+	switch(chk->m_info.m_fields[chk->m_field_id].m_type)
+	{
+	case PT_INT8:
+		return select_num_cmp<int8_t>(chk->m_cmpop);
+	case PT_INT16:
+		return select_num_cmp<int16_t>(chk->m_cmpop);
+	case PT_INT32:
+		return select_num_cmp<int32_t>(chk->m_cmpop);
+	case PT_INT64:
+	case PT_FD:
+	case PT_PID:
+	case PT_ERRNO:
+		return select_num_cmp<int64_t>(chk->m_cmpop);
+	case PT_FLAGS8:
+	case PT_UINT8:
+	case PT_SIGTYPE:
+		return select_num_cmp<uint8_t>(chk->m_cmpop);
+	case PT_FLAGS16:
+	case PT_UINT16:
+	case PT_PORT:
+	case PT_SYSCALLID:
+		return select_num_cmp<uint16_t>(chk->m_cmpop);
+	case PT_UINT32:
+	case PT_FLAGS32:
+	case PT_BOOL:
+	case PT_IPV4ADDR:
+		return select_num_cmp<uint32_t>(chk->m_cmpop);
+	case PT_UINT64:
+	case PT_RELTIME:
+	case PT_ABSTIME:
+		return select_num_cmp<uint64_t>(chk->m_cmpop);
+	case PT_DOUBLE:
+		return select_num_cmp<double>(chk->m_cmpop);
+	case PT_CHARBUF:
+		switch(chk->m_cmpop)
+		{
+		case CO_EQ:
+			return cmp_str_eq;
+		case CO_NE:
+			return cmp_str_ne;
+		case CO_CONTAINS:
+			return cmp_str_contains;
+		default:
+			return NULL;
+		}
+	case PT_BYTEBUF:
+		switch(chk->m_cmpop)
+		{
+		case CO_EQ:
+			return cmp_buf_eq;
+		case CO_NE:
+			return cmp_buf_ne;
+		case CO_CONTAINS:
+			return cmp_buf_contains;
+		default:
+			return NULL;
+		}
+	default:
+		return NULL;
+	}
+}
+
+//
+// Rough relative cost of evaluating a check
+//
+uint32_t sinsp_filter_program::leaf_cost(sinsp_filter_check* chk)
+{
+	const filtercheck_field_info* finfo = &chk->m_info.m_fields[chk->m_field_id];
+	const string& cls = chk->m_info.m_name;
+	uint32_t cost;
+
+	//
+	// The event fields mostly come from the event header, the process ones
+	// from the thread info that is looked up anyway, the fd ones need the fd
+	// table. The other classes need lookups in other tables.
+	//
+	if(cls == "evt")
+	{
+		cost = 1;
+	}
+	else if(cls == "process")
+	{
+		cost = 2;
+	}
+	else if(cls == "fd")
+	{
+		cost = 3;
+	}
+	else
+	{
+		cost = 4;
+	}
+
+	switch(finfo->m_type)
+	{
+	case PT_CHARBUF:
+	case PT_FSPATH:
+		cost += 2;
+		break;
+	case PT_BYTEBUF:
+	case PT_DYN:
+		cost += 4;
+		break;
+	default:
+		break;
+	}
+
+	if(chk->m_cmpop == CO_CONTAINS || chk->m_cmpop == CO_PMATCH)
+	{
+		cost += 4;
+	}
+
+	//
+	// These fields parse and render the event parameters
+	//
+	if((finfo->m_flags & EPF_REQUIRES_ARGUMENT) ||
+		strcmp(finfo->m_name, "evt.args") == 0 ||
+		strcmp(finfo->m_name, "evt.info") == 0 ||
+		strcmp(finfo->m_name, "evt.res") == 0 ||
+		strcmp(finfo->m_name, "evt.buffer") == 0)
+	{
+		cost += 8;
+	}
+
+	return cost;
+}
+
+sinsp_filter_program::node* sinsp_filter_program::new_leaf(sinsp_filter_check* chk)
+{
+	node* n = new node();
+
+	n->m_check = chk;
+	n->m_cmp = select_cmp(chk);
+	n->m_cost = leaf_cost(chk);
+
+	return n;
+}
+
+//
+// Turn the left-to-right sequence of an expression into n-ary and/or nodes,
+// e.g. "a and b and c or d" becomes or(and(a, b, c), d)
+//
+sinsp_filter_program::node* sinsp_filter_program::build(sinsp_filter_expression* expr)
+{
+	node* res = NULL;
+
+	for(uint32_t j = 0; j < expr->m_checks.size(); j++)
+	{
+		sinsp_filter_check* chk = expr->m_checks[j];
+		sinsp_filter_expression* subexpr = dynamic_cast<sinsp_filter_expression*>(chk);
+		node* n;
+		bool is_and;
+
+		if(j != 0 && (chk->m_boolop & (BO_AND | BO_OR)) == 0)
+		{
+			//
+			// sinsp_filter_expression::compare() used to skip these
+			//
+			ASSERT(false);
+			continue;
+		}
+
+		n = (subexpr != NULL)? build(subexpr) : new_leaf(chk);
+
+		if(chk->m_boolop & BO_NOT)
+		{
+			n->m_negate = !n->m_negate;
+		}
+
+		if(res == NULL)
+		{
+			res = n;
+			continue;
+		}
+
+		is_and = (chk->m_boolop & BO_AND) != 0;
+
+		if(res->m_check == NULL && !res->m_children.empty() &&
+			!res->m_negate && res->m_is_and == is_and)
+		{
+			res->m_children.push_back(n);
+		}
+		else
+		{
+			node* parent = new node();
+			parent->m_is_and = is_and;
+			parent->m_children.push_back(res);
+			parent->m_children.push_back(n);
+			res = parent;
+		}
+	}
+
+	if(res == NULL)
+	{
+		//
+		// Empty expression, always true
+		//
+		res = new node();
+	}
+
+	return res;
+}
+
+void sinsp_filter_program::count_leaves(node* n)
+{
+	if(n->m_check != NULL || n->m_children.empty())
+	{
+		n->m_nleaves = 1;
+		return;
+	}
+
+	n->m_nleaves = 0;
+
+	for(uint32_t j = 0; j < n->m_children.size(); j++)
+	{
+		count_leaves(n->m_children[j]);
+		n->m_nleaves += n->m_children[j]->m_nleaves;
+	}
+}
+
+//
+// Sort the children of the and nodes by cost / probability of being false,
+// and the children of the or nodes by cost / probability of being true.
+// Either way, the children that are cheap and likely to decide the result of
+// the node go first.
+//
+struct node_order
+{
+	bool m_is_and;
+
+	node_order(bool is_and)
+	{
+		m_is_and = is_and;
+	}
+
+	template<typename N> bool operator()(N* a, N* b) const
+	{
+		return rank(a) < rank(b);
+	}
+
+	template<typename N> double rank(N* n) const
+	{
+		double p = m_is_and? 1 - n->m_prob_true : n->m_prob_true;
+		return n->m_expected_cost / MAX(p, 0.000001);
+	}
+};
+
+void sinsp_filter_program::estimate(node* n)
+{
+	if(n->m_check != NULL)
+	{
+		//
+		// Start from even odds and let the statistics take over
+		//
+		n->m_prob_true = ((double)n->m_ntrue + 1) / ((double)n->m_nevals + 2);
+		n->m_expected_cost = n->m_cost;
+	}
+	else if(n->m_children.empty())
+	{
+		n->m_prob_true = 1;
+		n->m_expected_cost = 1;
+	}
+	else
+	{
+		double prob_reach = 1;
+
+		for(uint32_t j = 0; j < n->m_children.size(); j++)
+		{
+			estimate(n->m_children[j]);
+		}
+
+		stable_sort(n->m_children.begin(), n->m_children.end(), node_order(n->m_is_and));
+
+		//
+		// Assume that the children are independent
+		//
+		n->m_expected_cost = 0;
+
+		for(uint32_t j = 0; j < n->m_children.size(); j++)
+		{
+			node* c = n->m_children[j];
+
+			n->m_expected_cost += prob_reach * c->m_expected_cost;
+			prob_reach *= n->m_is_and? c->m_prob_true : 1 - c->m_prob_true;
+		}
+
+		n->m_prob_true = n->m_is_and? prob_reach : 1 - prob_reach;
+
+		//
+		// The negation of the leaves is part of their statistics, the one of
+		// the inner nodes is not
+		//
+		if(n->m_negate)
+		{
+			n->m_prob_true = 1 - n->m_prob_true;
+		}
+	}
+}
+
+//
+// Generate the predicates of node n, starting at position start of the
+// program. The node jumps to jump_true if it's true and to jump_false if it's
+// false.
+//
+void sinsp_filter_program::emit(node* n, uint32_t start, uint32_t jump_true, uint32_t jump_false)
+{
+	if(n->m_negate)
+	{
+		uint32_t tmp = jump_true;
+		jump_true = jump_false;
+		jump_false = tmp;
+	}
+
+	if(n->m_check != NULL || n->m_children.empty())
+	{
+		predicate* p = &m_code[start];
+
+		p->m_check = n->m_check;
+		p->m_cmp = n->m_cmp;
+		p->m_negate = n->m_negate;
+		p->m_ref = NULL;
+		p->m_ref_len = 0;
+		p->m_jump_true = jump_true;
+		p->m_jump_false = jump_false;
+		p->m_leaf = n;
+
+		if(n->m_check != NULL && n->m_check->m_val_storage.size() != 0)
+		{
+			p->m_ref = &n->m_check->m_val_storage[0];
+			p->m_ref_len = n->m_check->m_val_storage_len;
+		}
+
+		return;
+	}
+
+	for(uint32_t j = 0; j < n->m_children.size(); j++)
+	{
+		node* c = n->m_children[j];
+		uint32_t next = start + c->m_nleaves;
+		bool last = (j == n->m_children.size() - 1);
+
+		if(n->m_is_and)
+		{
+			emit(c, start, last? jump_true : next, jump_false);
+		}
+		else
+		{
+			emit(c, start, jump_true, last? jump_false : next);
+		}
+
+		start = next;
+	}
+}
+
+void sinsp_filter_program::compile()
+{
+	count_leaves(m_root);
+
+	m_code.resize(m_root->m_nleaves);
+	m_accept = m_root->m_nleaves;
+	m_reject = m_root->m_nleaves + 1;
+
+	emit(m_root, 0, m_accept, m_reject);
+}
+
+//
+// Compute the event types for which the check can be true (maybe) and the ones
+// for which it's true regardless of the other fields of the event (always).
+// Return false if the check doesn't depend only on the event type.
+//
+bool sinsp_filter_program::evttypes_from_check(sinsp_filter_check* chk, evttype_set* maybe, evttype_set* always)
+{
+	const struct ppm_event_info* etable = g_infotables.m_event_info;
+	vector<const char*> names;
+
+	if(dynamic_cast<sinsp_filter_check_event*>(chk) == NULL ||
+		chk->m_field_id != sinsp_filter_check_event::TYPE_TYPE)
+	{
+		return false;
+	}
+
+	if(chk->m_cmpop == CO_EQ || chk->m_cmpop == CO_NE)
+	{
+		names.push_back((const char*)&chk->m_val_storage[0]);
+	}
+	else if(chk->m_cmpop == CO_IN && chk->m_val_set != NULL)
+	{
+		//
+		// The values of the set are not null terminated
+		//
+		for(uint32_t j = 0; j < chk->m_val_set->size(); j++)
+		{
+			uint32_t len;
+			const char* val = (const char*)chk->m_val_set->get(j, &len);
+
+			for(uint32_t k = 0; k < PPM_EVENT_MAX; k++)
+			{
+				if(strlen(etable[k].name) == len && memcmp(etable[k].name, val, len) == 0)
+				{
+					names.push_back(etable[k].name);
+					break;
+				}
+			}
+		}
+	}
+	else
+	{
+		return false;
+	}
+
+	always->reset();
+
+	for(uint32_t j = 0; j < PPM_EVENT_MAX; j++)
+	{
+		if(j == PPME_GENERIC_E || j == PPME_GENERIC_X)
+		{
+			continue;
+		}
+
+		for(uint32_t k = 0; k < names.size(); k++)
+		{
+			if(strcmp(etable[j].name, names[k]) == 0)
+			{
+				always->set(j);
+				break;
+			}
+		}
+	}
+
+	//
+	// evt.type returns the name of the system call for the generic events,
+	// so they can match any name
+	//
+	if(chk->m_cmpop != CO_NE)
+	{
+		*maybe = *always;
+		maybe->set(PPME_GENERIC_E);
+		maybe->set(PPME_GENERIC_X);
+	}
+	else
+	{
+		*maybe = ~*always;
+		*always = *maybe;
+		always->reset(PPME_GENERIC_E);
+		always->reset(PPME_GENERIC_X);
+	}
+
+	return true;
+}
+
+void sinsp_filter_program::evttypes(node* n, evttype_set* maybe, evttype_set* always)
+{
+	if(n->m_check != NULL)
+	{
+		if(!evttypes_from_check(n->m_check, maybe, always))
+		{
+			maybe->set();
+			always->reset();
+		}
+	}
+	else if(n->m_children.empty())
+	{
+		maybe->set();
+		always->set();
+	}
+	else
+	{
+		evttype_set cmaybe;
+		evttype_set calways;
+
+		for(uint32_t j = 0; j < n->m_children.size(); j++)
+		{
+			evttypes(n->m_children[j], &cmaybe, &calways);
+
+			if(j == 0)
+			{
+				*maybe = cmaybe;
+				*always = calways;
+			}
+			else if(n->m_is_and)
+			{
+				*maybe &= cmaybe;
+				*always &= calways;
+			}
+			else
+			{
+				*maybe |= cmaybe;
+				*always |= calways;
+			}
+		}
+	}
+
+	if(n->m_negate)
+	{
+		evttype_set tmp = *maybe;
+		*maybe = ~*always;
+		*always = ~tmp;
+	}
+}
+
+void sinsp_filter_program::reorder()
+{
+	vector<node*> prev_order;
+
+	for(uint32_t j = 0; j < m_code.size(); j++)
+	{
+		prev_order.push_back(m_code[j].m_leaf);
+	}
+
+	estimate(m_root);
+	compile();
+
+	//
+	// Halve the statistics, so that they follow changes in the event mix
+	//
+	for(uint32_t j = 0; j < m_code.size(); j++)
+	{
+		m_code[j].m_leaf->m_nevals /= 2;
+		m_code[j].m_leaf->m_ntrue /= 2;
+
+		if(j < prev_order.size() && prev_order[j] != m_code[j].m_leaf)
+		{
+			prev_order.clear();
+		}
+	}
+
+	if(prev_order.empty() && m_nruns != 0)
+	{
+		g_logger.log("filter predicates reordered:\n" + to_string(), sinsp_logger::SEV_DEBUG);
+	}
+}
+
+bool sinsp_filter_program::run(sinsp_evt *evt)
+{
+	uint32_t pc = 0;
+
+	if(!accepts_evttype(evt->get_type()))
+	{
+		return false;
+	}
+
+	while(pc < m_accept)
+	{
+		predicate* p = &m_code[pc];
+		bool res;
+
+		if(p->m_cmp != NULL)
+		{
+			uint32_t len;
+			uint8_t* val = p->m_check->extract(evt, &len);
+
+			res = (val != NULL && p->m_cmp(val, len, p->m_ref, p->m_ref_len));
+		}
+		else
+		{
+			res = (p->m_check == NULL || p->m_check->compare(evt));
+		}
+
+		//
+		// The jumps of a negated leaf are swapped, so res is the result of
+		// the comparison, while the statistics count the result of the leaf
+		//
+		p->m_leaf->m_nevals++;
+
+		if(res != p->m_negate)
+		{
+			p->m_leaf->m_ntrue++;
+		}
+
+		if(res)
+		{
+			pc = p->m_jump_true;
+		}
+		else
+		{
+			pc = p->m_jump_false;
+		}
+	}
+
+	if(++m_nruns % FILTER_REORDER_INTERVAL == 0)
+	{
+		reorder();
+	}
+
+	return pc == m_accept;
+}
+
+string sinsp_filter_program::to_string()
+{
+	string res;
+	char buf[256];
+
+	for(uint32_t j = 0; j < m_code.size(); j++)
+	{
+		predicate* p = &m_code[j];
+		const char* name = "true";
+
+		if(p->m_check != NULL)
+		{
+			name = p->m_check->m_info.m_fields[p->m_check->m_field_id].m_name;
+		}
+
+		snprintf(buf, sizeof(buf), "%u: %s%s cost=%u evals=%" PRIu64 " true=%" PRIu64 " T->%u F->%u\n",
+			j,
+			name,
+			(p->m_cmp != NULL)? "" : " (compare)",
+			p->m_leaf->m_cost,
+			p->m_leaf->m_nevals,
+			p->m_leaf->m_ntrue,
+			p->m_jump_true,
+			p->m_jump_false);
+
+		res += buf;
+	}
+
+	return res;
+}
+
+#endif // HAS_FILTERING
@@ -0,0 +1,145 @@
+/*
+Copyright (C) 2013-2014 Draios inc.
+
+This file is part of sysdig.
+
+sysdig is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License version 2 as
+published by the Free Software Foundation.
+
+sysdig is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sysdig.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#ifdef HAS_FILTERING
+
+#include <bitset>
+
+class sinsp_filter_check;
+class sinsp_filter_expression;
+
+//
+// Comparison of an extracted value with the constant of a check, specialized
+// for a field type and an operator
+//
+typedef bool (*sinsp_filter_cmp_fn)(uint8_t* val, uint32_t len, uint8_t* ref, uint32_t ref_len);
+
+///////////////////////////////////////////////////////////////////////////////
+// The compiled form of a filter.
+//
+// The expression tree built by the parser is evaluated left to right, e.g.
+// "a or b and c" means "(a or b) and c". The program turns it into a tree of
+// n-ary and/or nodes, and then lowers the tree into a flat array of
+// predicates, where each predicate says where to jump if it's true or false.
+//
+// The children of an and/or node can be evaluated in any order. They are
+// sorted so that the cheap checks (e.g. evt.type, proc.pid) come before the
+// expensive ones (e.g. fd.name contains, evt.arg), and the checks that are
+// more likely to short-circuit the node come first. The likelihood comes from
+// the number of times each predicate has been true, which is collected while
+// the filter runs, and the program is rebuilt every FILTER_REORDER_INTERVAL
+// runs to follow the statistics.
+//
+// The program also computes the set of event types that can possibly pass
+// the filter, looking at the evt.type checks in the tree. The events of the
+// other types are rejected without running any predicate.
+///////////////////////////////////////////////////////////////////////////////
+class sinsp_filter_program
+{
+public:
+	sinsp_filter_program(sinsp_filter_expression* expr);
+	~sinsp_filter_program();
+
+	bool run(sinsp_evt *evt);
+
+	//
+	// Return false if no event of the given type can pass the filter
+	//
+	bool accepts_evttype(uint16_t etype)
+	{
+		return etype >= PPM_EVENT_MAX || m_evttypes[etype];
+	}
+
+	//
+	// Return a description of the program and of the statistics of each
+	// predicate, in evaluation order
+	//
+	string to_string();
+
+private:
+	typedef bitset<PPM_EVENT_MAX> evttype_set;
+
+	//
+	// A node of the normalized tree. Leaves have m_check set.
+	//
+	struct node
+	{
+		node();
+		~node();
+
+		sinsp_filter_check* m_check;
+		sinsp_filter_cmp_fn m_cmp; // NULL if the check must go through compare()
+		bool m_is_and;
+		bool m_negate;
+		uint32_t m_cost; // Estimated cost of evaluating the leaf
+		uint32_t m_nleaves;
+		vector<node*> m_children;
+
+		//
+		// Statistics, for leaves only
+		//
+		uint64_t m_nevals;
+		uint64_t m_ntrue; // Number of times the leaf was true, after applying m_negate
+
+		//
+		// Estimates used to sort the children of the parent node
+		//
+		double m_prob_true;
+		double m_expected_cost;
+	};
+
+	//
+	// A predicate of the compiled program
+	//
+	struct predicate
+	{
+		sinsp_filter_check* m_check; // NULL for a predicate that is always true
+		sinsp_filter_cmp_fn m_cmp;
+		uint8_t* m_ref;
+		uint32_t m_ref_len;
+		bool m_negate; // The jumps are already swapped, this is for the statistics
+		uint32_t m_jump_true; // Index of the next predicate, or one of the exit points
+		uint32_t m_jump_false;
+		node* m_leaf;
+	};
+
+	node* build(sinsp_filter_expression* expr);
+	node* new_leaf(sinsp_filter_check* chk);
+	void count_leaves(node* n);
+	void estimate(node* n);
+	void emit(node* n, uint32_t start, uint32_t jump_true, uint32_t jump_false);
+	void compile();
+	void reorder();
+	void evttypes(node* n, evttype_set* maybe, evttype_set* always);
+
+	static bool evttypes_from_check(sinsp_filter_check* chk, evttype_set* maybe, evttype_set* always);
+
+	static uint32_t leaf_cost(sinsp_filter_check* chk);
+	static sinsp_filter_cmp_fn select_cmp(sinsp_filter_check* chk);
+
+	node* m_root;
+	vector<predicate> m_code;
+	uint32_t m_accept; // Exit points of the program
+	uint32_t m_reject;
+	uint64_t m_nruns;
+	evttype_set m_evttypes; // Event types that can pass the filter
+};
+
+#endif // HAS_FILTERING
@@ -0,0 +1,158 @@
+/*
+Copyright (C) 2013-2014 Draios inc.
+
+This file is part of sysdig.
+
+sysdig is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License version 2 as
+published by the Free Software Foundation.
+
+sysdig is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sysdig.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "sinsp.h"
+#include "sinsp_int.h"
+
+//
+// For every byte, the character that follows the backslash when the byte
+// must be escaped, 'u' if it's written as \u00XX, 0 if it's copied as it is
+//
+static const char g_json_escapes[256] =
+{
+	'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'b', 't', 'n', 'u', 'f', 'r', 'u', 'u',
+	'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u',
+	0, 0, '"', 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, '\\', 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+};
+
+static const char g_hex_digits[] = "0123456789ABCDEF";
+
+sinsp_json_writer::sinsp_json_writer()
+{
+	m_buf.resize(256);
+	clear();
+}
+
+void sinsp_json_writer::grow(uint32_t len)
+{
+	uint32_t size = (uint32_t)m_buf.size() * 2;
+
+	if(size <= m_len + len)
+	{
+		size = m_len + len + 1;
+	}
+
+	m_buf.resize(size);
+}
+
+//
+// Writes str to dst in quotes, escaping it in a single pass. dst must have
+// room for the worst case, in which every byte takes 6.
+//
+uint32_t sinsp_json_writer::escape(const char* str, uint32_t len, char* dst)
+{
+	char* start = dst;
+	uint32_t j;
+
+	*dst++ = '"';
+
+	for(j = 0; j < len; j++)
+	{
+		uint8_t c = (uint8_t)str[j];
+		char esc = g_json_escapes[c];
+
+		if(esc == 0)
+		{
+			*dst++ = (char)c;
+		}
+		else if(esc != 'u')
+		{
+			*dst++ = '\\';
+			*dst++ = esc;
+		}
+		else
+		{
+			*dst++ = '\\';
+			*dst++ = 'u';
+			*dst++ = '0';
+			*dst++ = '0';
+			*dst++ = g_hex_digits[c >> 4];
+			*dst++ = g_hex_digits[c & 0xf];
+		}
+	}
+
+	*dst++ = '"';
+
+	return (uint32_t)(dst - start);
+}
+
+void sinsp_json_writer::key(const char* name, uint32_t len)
+{
+	reserve(len * 6 + 4);
+	separator();
+	m_len += escape(name, len, &m_buf[m_len]);
+	m_buf[m_len++] = ':';
+	m_need_comma = false;
+}
+
+void sinsp_json_writer::string_value(const char* str, uint32_t len)
+{
+	reserve(len * 6 + 3);
+	separator();
+	m_len += escape(str, len, &m_buf[m_len]);
+	m_need_comma = true;
+}
+
+void sinsp_json_writer::uint_value(uint64_t val)
+{
+	char buf[24];
+	char* p = buf + sizeof(buf);
+
+	do
+	{
+		*--p = (char)('0' + val % 10);
+		val /= 10;
+	}
+	while(val != 0);
+
+	value(p, (uint32_t)(buf + sizeof(buf) - p));
+}
+
+void sinsp_json_writer::int_value(int64_t val)
+{
+	char buf[24];
+	char* p = buf + sizeof(buf);
+	uint64_t uval = (val < 0)? 0 - (uint64_t)val : (uint64_t)val;
+
+	do
+	{
+		*--p = (char)('0' + uval % 10);
+		uval /= 10;
+	}
+	while(uval != 0);
+
+	if(val < 0)
+	{
+		*--p = '-';
+	}
+
+	value(p, (uint32_t)(buf + sizeof(buf) - p));
+}
@@ -0,0 +1,185 @@
+/*
+Copyright (C) 2013-2014 Draios inc.
+
+This file is part of sysdig.
+
+sysdig is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License version 2 as
+published by the Free Software Foundation.
+
+sysdig is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sysdig.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+/** @defgroup event Event manipulation
+ *  @{
+ */
+
+/*!
+  \brief Streaming JSON writer.
+  The values are serialized as they are added, in a buffer that is reused
+  from one document to the next, without building a tree of values first.
+  Strings are escaped the same way jsoncpp does it: the bytes above 0x7f are
+  written as they are.
+*/
+class SINSP_PUBLIC sinsp_json_writer
+{
+public:
+	sinsp_json_writer();
+
+	/*!
+	  \brief Empties the buffer, to start a new document.
+	*/
+	void clear()
+	{
+		m_len = 0;
+		m_need_comma = false;
+	}
+
+	void begin_object()
+	{
+		open('{');
+	}
+
+	void end_object()
+	{
+		close('}');
+	}
+
+	void begin_array()
+	{
+		open('[');
+	}
+
+	void end_array()
+	{
+		close(']');
+	}
+
+	/*!
+	  \brief Writes the key of the next member of the current object.
+	*/
+	void key(const char* name, uint32_t len);
+
+	void key(const char* name)
+	{
+		key(name, (uint32_t)strlen(name));
+	}
+
+	void null_value()
+	{
+		value("null", 4);
+	}
+
+	void bool_value(bool val)
+	{
+		if(val)
+		{
+			value("true", 4);
+		}
+		else
+		{
+			value("false", 5);
+		}
+	}
+
+	void int_value(int64_t val);
+	void uint_value(uint64_t val);
+
+	/*!
+	  \brief Writes a string value, escaping it.
+	*/
+	void string_value(const char* str, uint32_t len);
+
+	void string_value(const char* str)
+	{
+		string_value(str, (uint32_t)strlen(str));
+	}
+
+	/*!
+	  \brief Appends text to the document as it is, e.g. to separate the
+	   documents of a stream.
+	*/
+	void raw(const char* str, uint32_t len)
+	{
+		reserve(len);
+		memcpy(&m_buf[m_len], str, len);
+		m_len += len;
+	}
+
+	/*!
+	  \brief Returns the document, NUL terminated. The pointer is valid until
+	   the next write.
+	*/
+	char* get_buffer()
+	{
+		m_buf[m_len] = 0;
+		return &m_buf[0];
+	}
+
+	uint32_t get_size()
+	{
+		return m_len;
+	}
+
+private:
+	//
+	// Makes room for len more bytes, plus the NUL that get_buffer() adds
+	//
+	inline void reserve(uint32_t len)
+	{
+		if(m_len + len >= m_buf.size())
+		{
+			grow(len);
+		}
+	}
+
+	inline void separator()
+	{
+		if(m_need_comma)
+		{
+			m_buf[m_len++] = ',';
+		}
+	}
+
+	inline void value(const char* str, uint32_t len)
+	{
+		reserve(len + 1);
+		separator();
+		memcpy(&m_buf[m_len], str, len);
+		m_len += len;
+		m_need_comma = true;
+	}
+
+	inline void open(char c)
+	{
+		reserve(2);
+		separator();
+		m_buf[m_len++] = c;
+		m_need_comma = false;
+	}
+
+	inline void close(char c)
+	{
+		reserve(1);
+		m_buf[m_len++] = c;
+		m_need_comma = true;
+	}
+
+	void grow(uint32_t len);
+	uint32_t escape(const char* str, uint32_t len, char* dst);
+
+	vector<char> m_buf;
+	uint32_t m_len;
+	// True if the next value or key must be preceded by a comma
+	bool m_need_comma;
+};
+
+/*@}*/
@@ -600,7 +600,7 @@ bool sinsp_parser::retrieve_enter_event(sinsp_evt *enter_evt, sinsp_evt *exit_ev
 		return false;
 	}
 
-	enter_evt->init(exit_evt->m_tinfo->m_lastevent_data, exit_evt->m_tinfo->m_lastevent_cpuid);
+	enter_evt->init(exit_evt->m_tinfo->m_lastevent_data.data(), exit_evt->m_tinfo->m_lastevent_cpuid);
 
 	//
 	// Make sure that we're using the right enter event, to prevent inconsistencies when events
@@ -1275,7 +1275,7 @@ void sinsp_parser::parse_execve_exit(sinsp_evt *evt)
 	// Get the pid
 	parinfo = evt->get_param(4);
 	ASSERT(parinfo->m_len == sizeof(uint64_t));
-	evt->m_tinfo->m_pid = *(uint64_t *)parinfo->m_val;
+	m_inspector->m_thread_manager->update_thread_ids(evt->m_tinfo, *(int64_t *)parinfo->m_val, evt->m_tinfo->m_ptid);
 
 	// Get the working directory
 	parinfo = evt->get_param(6);
@@ -1368,12 +1368,23 @@ void sinsp_parser::parse_execve_exit(sinsp_evt *evt)
 	// Clear the flags for this thread, making sure to propagate the inverted flag
 	//
 	bool inverted = ((evt->m_tinfo->m_flags & PPM_CL_CLONE_INVERTED) != 0);
-	evt->m_tinfo->m_flags = PPM_CL_ACTIVE;
+	bool pending = evt->m_tinfo->is_proc_pending();
+	uint32_t fds_pending = evt->m_tinfo->m_flags & PPM_CL_FDS_PENDING;
+	evt->m_tinfo->m_flags = PPM_CL_ACTIVE | fds_pending;
 	if(inverted)
 	{
 		evt->m_tinfo->m_flags |= PPM_CL_CLONE_INVERTED;
 	}
 
+	//
+	// If the /proc lookup of this thread is still in progress, its result
+	// will fill what the event doesn't carry, like the user id
+	//
+	if(pending)
+	{
+		evt->m_tinfo->m_flags |= PPM_CL_PROC_PENDING;
+	}
+
 	//
 	// This process' name changed, so we need to include it in the protocol again
 	//
@@ -1762,7 +1773,7 @@ void sinsp_parser::parse_connect_exit(sinsp_evt *evt)
 	sinsp_evt_param *parinfo;
 	uint8_t *packed_data;
 	uint8_t family;
-	unordered_map<int64_t, sinsp_fdinfo_t>::iterator fdit;
+	sinsp_fdtable::iterator fdit;
 	const char *parstr;
 	int64_t retval;
 
@@ -1906,7 +1917,7 @@ void sinsp_parser::parse_accept_exit(sinsp_evt *evt)
 	sinsp_evt_param *parinfo;
 	int64_t fd;
 	uint8_t* packed_data;
-	unordered_map<int64_t, sinsp_fdinfo_t>::iterator fdit;
+	sinsp_fdtable::iterator fdit;
 	sinsp_fdinfo_t fdi;
 	const char *parstr;
 
@@ -3186,7 +3197,12 @@ void sinsp_parser::parse_select_poll_epollwait_enter(sinsp_evt *evt)
 		return;
 	}
 
-	*(uint64_t*)evt->m_tinfo->m_lastevent_data = evt->get_ts();
+	if(evt->m_tinfo->m_lastevent_data.size() < sizeof(uint64_t))
+	{
+		evt->m_tinfo->m_lastevent_data.reserve(&m_inspector->m_thread_manager->m_lastevent_pool, sizeof(uint64_t));
+	}
+
+	*(uint64_t*)evt->m_tinfo->m_lastevent_data.data() = evt->get_ts();
 }
 
 void sinsp_parser::parse_fcntl_enter(sinsp_evt *evt)
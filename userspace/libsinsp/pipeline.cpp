@@ -0,0 +1,428 @@
+/*
+Copyright (C) 2013-2014 Draios inc.
+
+This file is part of sysdig.
+
+sysdig is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License version 2 as
+published by the Free Software Foundation.
+
+sysdig is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sysdig.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <chrono>
+
+#include "sinsp.h"
+#include "sinsp_int.h"
+#include "pipeline.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// sinsp_evt_queue implementation
+///////////////////////////////////////////////////////////////////////////////
+sinsp_evt_queue::sinsp_evt_queue(uint32_t size)
+{
+	//
+	// The size needs to be a power of two
+	//
+	m_size = 4096;
+	while(m_size < size)
+	{
+		m_size *= 2;
+	}
+
+	m_buf = new char[m_size];
+	m_head = 0;
+	m_tail = 0;
+	m_low_watermark = 0;
+}
+
+sinsp_evt_queue::~sinsp_evt_queue()
+{
+	delete[] m_buf;
+}
+
+bool sinsp_evt_queue::push(scap_evt* evt, uint16_t cpuid, uint32_t dump_flags)
+{
+	uint32_t len = (sizeof(sinsp_queued_evt) + evt->len + 7) & ~7;
+	uint64_t head = m_head.load(memory_order_relaxed);
+	uint64_t tail = m_tail.load(memory_order_acquire);
+	uint32_t off = (uint32_t)(head & (m_size - 1));
+	uint32_t pad = 0;
+
+	ASSERT(len <= m_size / 2);
+
+	//
+	// Records don't wrap around, so if there's not enough space at the end of
+	// the buffer we skip to the beginning
+	//
+	if(off + len > m_size)
+	{
+		pad = m_size - off;
+	}
+
+	if(head + pad + len - tail > m_size)
+	{
+		return false;
+	}
+
+	if(pad != 0)
+	{
+		((sinsp_queued_evt*)(m_buf + off))->m_len = 0;
+		head += pad;
+		off = 0;
+	}
+
+	sinsp_queued_evt* rec = (sinsp_queued_evt*)(m_buf + off);
+	rec->m_len = len;
+	rec->m_cpuid = cpuid;
+	rec->m_dump_flags = dump_flags;
+	memcpy(rec->get_evt(), evt, evt->len);
+
+	m_head.store(head + len, memory_order_release);
+	return true;
+}
+
+sinsp_queued_evt* sinsp_evt_queue::peek()
+{
+	uint64_t tail = m_tail.load(memory_order_relaxed);
+	uint64_t head = m_head.load(memory_order_acquire);
+
+	if(tail == head)
+	{
+		return NULL;
+	}
+
+	uint32_t off = (uint32_t)(tail & (m_size - 1));
+	sinsp_queued_evt* rec = (sinsp_queued_evt*)(m_buf + off);
+
+	if(rec->m_len == 0)
+	{
+		//
+		// End of buffer marker. The producer always publishes it together with
+		// the record that follows, which is at the beginning of the buffer.
+		//
+		m_tail.store(tail + m_size - off, memory_order_release);
+		rec = (sinsp_queued_evt*)m_buf;
+	}
+
+	return rec;
+}
+
+void sinsp_evt_queue::pop()
+{
+	uint64_t tail = m_tail.load(memory_order_relaxed);
+	sinsp_queued_evt* rec = (sinsp_queued_evt*)(m_buf + (tail & (m_size - 1)));
+
+	ASSERT(tail != m_head.load(memory_order_acquire));
+	ASSERT(rec->m_len != 0);
+
+	m_tail.store(tail + rec->m_len, memory_order_release);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// sinsp_pipeline implementation
+///////////////////////////////////////////////////////////////////////////////
+sinsp_pipeline::sinsp_pipeline(sinsp* inspector, uint32_t n_readers)
+{
+	uint32_t nqueues;
+
+	m_inspector = inspector;
+	m_h = inspector->m_h;
+	m_islive = inspector->is_live();
+	m_stop = false;
+	m_eof = false;
+	m_error = false;
+	m_readfile_offset = 0;
+	m_last_queue = NULL;
+	m_last_dump_flags = 0;
+	m_nevts = 0;
+
+	if(m_islive)
+	{
+		nqueues = scap_get_ndevs(m_h);
+		m_n_readers = (n_readers == 0)? 1 : MIN(n_readers, nqueues);
+	}
+	else
+	{
+		nqueues = 1;
+		m_n_readers = 1;
+	}
+
+	for(uint32_t j = 0; j < nqueues; j++)
+	{
+		m_queues.push_back(new sinsp_evt_queue(PIPELINE_QUEUE_SIZE));
+	}
+}
+
+sinsp_pipeline::~sinsp_pipeline()
+{
+	stop();
+
+	for(uint32_t j = 0; j < m_queues.size(); j++)
+	{
+		delete m_queues[j];
+	}
+}
+
+void sinsp_pipeline::start()
+{
+	ASSERT(m_readers.size() == 0);
+
+	m_stop = false;
+
+	if(m_islive)
+	{
+#if defined(HAS_CAPTURE)
+		for(uint32_t j = 0; j < m_n_readers; j++)
+		{
+			m_readers.push_back(std::thread(&sinsp_pipeline::read_devices, this, j));
+		}
+#endif
+	}
+	else
+	{
+		m_readers.push_back(std::thread(&sinsp_pipeline::read_file, this));
+	}
+}
+
+void sinsp_pipeline::stop()
+{
+	m_stop = true;
+
+	for(uint32_t j = 0; j < m_readers.size(); j++)
+	{
+		m_readers[j].join();
+	}
+
+	m_readers.clear();
+}
+
+void sinsp_pipeline::wait()
+{
+	std::this_thread::sleep_for(std::chrono::microseconds(PIPELINE_WAIT_US));
+}
+
+void sinsp_pipeline::read_file()
+{
+	scap_evt* pevent;
+	uint16_t cpuid;
+	uint32_t nevts = 0;
+
+	while(!m_stop.load(memory_order_relaxed))
+	{
+		int32_t res = scap_next(m_h, &pevent, &cpuid);
+
+		if(res == SCAP_SUCCESS)
+		{
+			uint32_t dump_flags = scap_event_get_dump_flags(m_h);
+
+			while(!m_queues[0]->push(pevent, cpuid, dump_flags))
+			{
+				if(m_stop.load(memory_order_relaxed))
+				{
+					return;
+				}
+
+				wait();
+			}
+
+			//
+			// Getting the offset costs a system call, so we refresh it only
+			// every now and then
+			//
+			if((++nevts & 1023) == 0)
+			{
+				m_readfile_offset.store(scap_get_readfile_offset(m_h), memory_order_relaxed);
+			}
+		}
+		else if(res == SCAP_EOF)
+		{
+			m_readfile_offset.store(scap_get_readfile_offset(m_h), memory_order_relaxed);
+			m_eof.store(true, memory_order_release);
+			return;
+		}
+		else if(res != SCAP_TIMEOUT)
+		{
+			m_reader_lasterr = scap_getlasterr(m_h);
+			m_error.store(true, memory_order_release);
+			return;
+		}
+	}
+}
+
+#if defined(HAS_CAPTURE)
+void sinsp_pipeline::read_devices(uint32_t reader_id)
+{
+	uint32_t ndevs = (uint32_t)m_queues.size();
+	uint32_t j;
+
+	//
+	// The portion of each ring that has been read but not queued yet.
+	// Every ring is owned by a single reader, which is the only one calling
+	// scap_readbuf() for it.
+	//
+	vector<pair<char*, uint32_t>> pending(ndevs, pair<char*, uint32_t>(NULL, 0));
+
+	while(!m_stop.load(memory_order_relaxed))
+	{
+		bool progress = false;
+
+		for(j = reader_id; j < ndevs; j += m_n_readers)
+		{
+			char* buf = pending[j].first;
+			uint32_t len = pending[j].second;
+
+			if(len == 0)
+			{
+				uint64_t now = sinsp_utils::get_current_time_ns();
+
+				if(scap_readbuf(m_h, j, false, &buf, &len) != SCAP_SUCCESS)
+				{
+					m_reader_lasterr = scap_getlasterr(m_h);
+					m_error.store(true, memory_order_release);
+					return;
+				}
+
+				//
+				// Everything the ring had has been queued. The events that the
+				// driver timestamped before now, minus the time they can take
+				// to reach the ring, have all been seen.
+				//
+				if(len == 0 && now > PIPELINE_WATERMARK_SLACK_NS)
+				{
+					m_queues[j]->set_low_watermark(now - PIPELINE_WATERMARK_SLACK_NS);
+				}
+			}
+
+			while(len != 0)
+			{
+				scap_evt* pevent = (scap_evt*)buf;
+
+				if(pevent->len > len)
+				{
+					m_reader_lasterr = "scap_next buffer corruption";
+					m_error.store(true, memory_order_release);
+					return;
+				}
+
+				if(!m_queues[j]->push(pevent, (uint16_t)j, 0))
+				{
+					break;
+				}
+
+				buf += pevent->len;
+				len -= pevent->len;
+				progress = true;
+			}
+
+			pending[j].first = buf;
+			pending[j].second = len;
+		}
+
+		if(!progress)
+		{
+			wait();
+		}
+	}
+}
+#endif // HAS_CAPTURE
+
+int32_t sinsp_pipeline::next(OUT scap_evt** pevent, OUT uint16_t* pcpuid)
+{
+	//
+	// Release the event returned by the previous call
+	//
+	if(m_last_queue != NULL)
+	{
+		m_last_queue->pop();
+		m_last_queue = NULL;
+	}
+
+	while(true)
+	{
+		sinsp_queued_evt* best = NULL;
+		sinsp_evt_queue* bestq = NULL;
+		uint64_t min_watermark = (uint64_t)-1;
+
+		//
+		// Pick the event with the lowest timestamp, and find the oldest event
+		// that the empty queues can still receive
+		//
+		for(vector<sinsp_evt_queue*>::iterator it = m_queues.begin(); it != m_queues.end(); ++it)
+		{
+			uint64_t watermark = (*it)->get_low_watermark();
+			sinsp_queued_evt* rec = (*it)->peek();
+
+			if(rec == NULL)
+			{
+				if(watermark < min_watermark)
+				{
+					min_watermark = watermark;
+				}
+			}
+			else if(best == NULL || rec->get_evt()->ts < best->get_evt()->ts)
+			{
+				best = rec;
+				bestq = *it;
+			}
+		}
+
+		//
+		// A CPU whose reader is behind could still deliver an older event
+		//
+		if(best != NULL && m_islive && best->get_evt()->ts >= min_watermark)
+		{
+			if(m_error.load(memory_order_acquire))
+			{
+				m_lasterr = m_reader_lasterr;
+				return SCAP_FAILURE;
+			}
+
+			wait();
+			return SCAP_TIMEOUT;
+		}
+
+		if(best != NULL)
+		{
+			*pevent = best->get_evt();
+			*pcpuid = best->m_cpuid;
+			m_last_dump_flags = best->m_dump_flags;
+			m_last_queue = bestq;
+			m_nevts++;
+			return SCAP_SUCCESS;
+		}
+
+		if(m_error.load(memory_order_acquire))
+		{
+			m_lasterr = m_reader_lasterr;
+			return SCAP_FAILURE;
+		}
+
+		if(m_islive)
+		{
+			wait();
+			return SCAP_TIMEOUT;
+		}
+
+		if(m_eof.load(memory_order_acquire))
+		{
+			//
+			// Make sure nothing was queued between our check and the EOF
+			//
+			if(m_queues[0]->empty())
+			{
+				return SCAP_EOF;
+			}
+
+			continue;
+		}
+
+		wait();
+	}
+}
@@ -0,0 +1,175 @@
+/*
+Copyright (C) 2013-2014 Draios inc.
+
+This file is part of sysdig.
+
+sysdig is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License version 2 as
+published by the Free Software Foundation.
+
+sysdig is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sysdig.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <thread>
+
+//
+// Header of an event stored in a sinsp_evt_queue.
+// The scap event follows the header.
+//
+struct sinsp_queued_evt
+{
+	uint32_t m_len; // Length of the record, header included. 0 marks the end of the buffer.
+	uint16_t m_cpuid;
+	uint16_t m_reserved;
+	uint32_t m_dump_flags;
+	uint32_t m_reserved2;
+
+	inline scap_evt* get_evt()
+	{
+		return (scap_evt*)(this + 1);
+	}
+};
+
+//
+// Lock-free, single producer/single consumer queue of scap events.
+// Records are stored contiguously in a ring of bytes, and a record never
+// wraps around the end of the ring.
+//
+class sinsp_evt_queue
+{
+public:
+	sinsp_evt_queue(uint32_t size);
+	~sinsp_evt_queue();
+
+	//
+	// Producer side. Returns false if the queue doesn't have enough space.
+	//
+	bool push(scap_evt* evt, uint16_t cpuid, uint32_t dump_flags);
+
+	//
+	// Consumer side. peek() returns NULL if the queue is empty. The returned
+	// record is valid until pop() is called.
+	//
+	sinsp_queued_evt* peek();
+	void pop();
+
+	bool empty()
+	{
+		return m_tail.load(memory_order_relaxed) == m_head.load(memory_order_acquire);
+	}
+
+	//
+	// Producer side. Tells the consumer that no event with a timestamp lower
+	// than ts will be pushed after the ones that are already in the queue.
+	//
+	void set_low_watermark(uint64_t ts)
+	{
+		m_low_watermark.store(ts, memory_order_release);
+	}
+
+	//
+	// Consumer side. Must be read before checking if the queue is empty, so
+	// that the events pushed before the watermark are visible.
+	//
+	uint64_t get_low_watermark()
+	{
+		return m_low_watermark.load(memory_order_acquire);
+	}
+
+private:
+	char* m_buf;
+	uint32_t m_size;
+	// Written by the producer only
+	atomic<uint64_t> m_head;
+	atomic<uint64_t> m_low_watermark;
+	// Written by the consumer only
+	atomic<uint64_t> m_tail;
+};
+
+//
+// Capture pipeline.
+// Reader threads move the events out of the capture source into one
+// sinsp_evt_queue per source stream, and sinsp::next() consumes them from
+// the inspector thread in timestamp order.
+// For live captures there's one stream per CPU ring buffer, and the rings are
+// spread across the reader threads. An event is consumed only when none of
+// the CPUs can still deliver an older one: either its queue has events, or
+// its reader has found the ring empty recently enough (the low watermark).
+// For trace files there's a single reader thread that takes care of
+// decompressing and reading the file.
+//
+class sinsp_pipeline
+{
+public:
+	sinsp_pipeline(sinsp* inspector, uint32_t n_readers);
+	~sinsp_pipeline();
+
+	void start();
+	void stop();
+
+	//
+	// Same semantics as scap_next(). The returned event is valid until the
+	// following call.
+	//
+	int32_t next(OUT scap_evt** pevent, OUT uint16_t* pcpuid);
+
+	uint32_t get_dump_flags()
+	{
+		return m_last_dump_flags;
+	}
+
+	uint64_t get_num_events()
+	{
+		return m_nevts;
+	}
+
+	int64_t get_readfile_offset()
+	{
+		return m_readfile_offset.load(memory_order_relaxed);
+	}
+
+	string getlasterr()
+	{
+		return m_lasterr;
+	}
+
+private:
+	void read_file();
+#if defined(HAS_CAPTURE)
+	void read_devices(uint32_t reader_id);
+#endif
+	void wait();
+
+	sinsp* m_inspector;
+	scap_t* m_h;
+	bool m_islive;
+	uint32_t m_n_readers;
+	vector<sinsp_evt_queue*> m_queues;
+	vector<std::thread> m_readers;
+	atomic<bool> m_stop;
+
+	//
+	// Reader state for trace files
+	//
+	atomic<bool> m_eof;
+	atomic<bool> m_error;
+	atomic<int64_t> m_readfile_offset;
+	string m_reader_lasterr;
+
+	//
+	// Consumer state
+	//
+	sinsp_evt_queue* m_last_queue;
+	uint32_t m_last_dump_flags;
+	uint64_t m_nevts;
+	string m_lasterr;
+};
@@ -0,0 +1,148 @@
+/*
+Copyright (C) 2013-2014 Draios inc.
+
+This file is part of sysdig.
+
+sysdig is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License version 2 as
+published by the Free Software Foundation.
+
+sysdig is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sysdig.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "sinsp.h"
+#include "sinsp_int.h"
+#include "procresolver.h"
+
+sinsp_proc_resolver::sinsp_proc_resolver(sinsp* inspector)
+{
+	m_inspector = inspector;
+	m_h = inspector->m_h;
+	m_stop = false;
+	m_has_results = false;
+	m_thread = std::thread(&sinsp_proc_resolver::run, this);
+}
+
+sinsp_proc_resolver::~sinsp_proc_resolver()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stop = true;
+	}
+
+	m_cond.notify_one();
+	m_thread.join();
+
+	for(uint32_t j = 0; j < m_results.size(); j++)
+	{
+		if(m_results[j].m_pi != NULL)
+		{
+			scap_proc_free(m_h, m_results[j].m_pi);
+		}
+	}
+}
+
+bool sinsp_proc_resolver::request(int64_t tid, bool scan_sockets)
+{
+	if(!m_pending.insert(tid).second)
+	{
+		return false;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		lookup_request req;
+		req.m_tid = tid;
+		req.m_scan_sockets = scan_sockets;
+		m_requests.push_back(req);
+	}
+
+	m_cond.notify_one();
+	return true;
+}
+
+void sinsp_proc_resolver::run()
+{
+	char error[SCAP_LASTERR_SIZE];
+
+	while(true)
+	{
+		lookup_request req;
+		lookup_result res;
+
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+
+			while(m_requests.empty() && !m_stop)
+			{
+				m_cond.wait(lock);
+			}
+
+			if(m_stop)
+			{
+				return;
+			}
+
+			req = m_requests.front();
+			m_requests.pop_front();
+		}
+
+		res.m_tid = req.m_tid;
+		res.m_pi = scap_proc_get_detached(m_h, req.m_tid, req.m_scan_sockets, error);
+
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_results.push_back(res);
+			m_has_results.store(true, memory_order_release);
+		}
+	}
+}
+
+void sinsp_proc_resolver::process_results()
+{
+	vector<lookup_result> results;
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		results.swap(m_results);
+		m_has_results.store(false, memory_order_relaxed);
+	}
+
+	for(uint32_t j = 0; j < results.size(); j++)
+	{
+		lookup_result& res = results[j];
+
+		m_pending.erase(res.m_tid);
+
+		//
+		// The placeholder may be gone (the thread exited), or may have been
+		// filled by an event in the meantime, e.g. an execve(). In both cases
+		// the result is not needed anymore.
+		//
+		sinsp_threadinfo* tinfo = m_inspector->get_thread(res.m_tid, false, true);
+
+		if(tinfo != NULL && tinfo->is_proc_pending())
+		{
+			if(res.m_pi != NULL)
+			{
+				tinfo->complete_proc_lookup(res.m_pi);
+			}
+			else
+			{
+				tinfo->m_flags &= ~PPM_CL_PROC_PENDING;
+			}
+		}
+
+		if(res.m_pi != NULL)
+		{
+			scap_proc_free(m_h, res.m_pi);
+		}
+	}
+}
@@ -0,0 +1,98 @@
+/*
+Copyright (C) 2013-2014 Draios inc.
+
+This file is part of sysdig.
+
+sysdig is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License version 2 as
+published by the Free Software Foundation.
+
+sysdig is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sysdig.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <unordered_set>
+
+//
+// Background reader of the /proc information of the threads that show up in
+// the event stream without being in the thread table.
+// sinsp::get_thread() adds a placeholder entry flagged with
+// PPM_CL_PROC_PENDING and queues a request. The resolver thread reads /proc,
+// and sinsp::next() fills the placeholder with the result before parsing the
+// next event, so that the event loop never waits for /proc.
+//
+class sinsp_proc_resolver
+{
+public:
+	sinsp_proc_resolver(sinsp* inspector);
+	~sinsp_proc_resolver();
+
+	//
+	// Queue the lookup of a thread. Returns false if a lookup for the same
+	// thread is already in progress, in which case its result will be used.
+	//
+	bool request(int64_t tid, bool scan_sockets);
+
+	//
+	// Apply the results of the completed lookups to the thread table.
+	// Must be called from the inspector thread.
+	//
+	void process_results();
+
+	inline bool has_results()
+	{
+		return m_has_results.load(memory_order_acquire);
+	}
+
+	uint32_t get_num_pending()
+	{
+		return (uint32_t)m_pending.size();
+	}
+
+private:
+	struct lookup_request
+	{
+		int64_t m_tid;
+		bool m_scan_sockets;
+	};
+
+	struct lookup_result
+	{
+		int64_t m_tid;
+		scap_threadinfo* m_pi; // NULL if the thread couldn't be read
+	};
+
+	void run();
+
+	sinsp* m_inspector;
+	scap_t* m_h;
+	std::thread m_thread;
+	std::mutex m_mutex;
+	std::condition_variable m_cond;
+
+	//
+	// Protected by m_mutex
+	//
+	deque<lookup_request> m_requests;
+	vector<lookup_result> m_results;
+	bool m_stop;
+
+	atomic<bool> m_has_results;
+
+	//
+	// The threads with a lookup in progress. Only used by the inspector thread.
+	//
+	unordered_set<int64_t> m_pending;
+};
@@ -60,6 +60,12 @@ along with sysdig.  If not, see <http://www.gnu.org/licenses/>.
 //
 #define MAX_FD_TABLE_SIZE 2048
 
+//
+// The fds below this number are stored in an array indexed by fd, the
+// other ones in a hash table
+//
+#define FDTABLE_DENSE_SIZE 1024
+
 //
 // The time after an inactive thread is removed.
 //
@@ -75,6 +81,36 @@ along with sysdig.  If not, see <http://www.gnu.org/licenses/>.
 //
 #define DEFAULT_INACTIVE_CONTAINER_SCAN_TIME_S DEFAULT_INACTIVE_THREAD_SCAN_TIME_S
 
+//
+// The inactive thread and container scans are done a slice at a time between
+// two events, so that they don't stall the event processing on big hosts.
+// A slice visits at most this number of entries...
+//
+#define DEFAULT_INACTIVE_SCAN_SLICE_ENTRIES 1024
+
+//
+// ...and stops earlier once it has taken this time checking in /proc whether
+// the threads are still alive
+//
+#define DEFAULT_INACTIVE_SCAN_SLICE_BUDGET_US 200
+
+//
+// When a Docker metadata fetch fails, the container is not queried again
+// for this number of seconds
+//
+#define DEFAULT_CONTAINER_METADATA_RETRY_TIME_S 60
+
+//
+// Timeout of the reads and writes on the Docker daemon socket
+//
+#define DOCKER_SOCKET_TIMEOUT_S 2
+
+//
+// Max number of Docker metadata requests that the background fetcher keeps
+// in flight at once
+//
+#define MAX_DOCKER_CONCURRENT_REQUESTS 16
+
 //
 // Enables Lua chisel scripts support
 //
@@ -85,11 +121,62 @@ along with sysdig.  If not, see <http://www.gnu.org/licenses/>.
 //
 #define CHISELS_INSTALLATION_DIR "/share/sysdig/chisels"
 
+//
+// Size of each of the event queues used by the capture pipeline
+//
+#define PIPELINE_QUEUE_SIZE (4 * 1024 * 1024)
+
+//
+// How long the capture pipeline threads sleep when there are no events
+// to move
+//
+#define PIPELINE_WAIT_US 100
+
+//
+// How long an event can take to show up in its ring buffer after it has been
+// timestamped. When a CPU ring is found empty, the capture pipeline assumes
+// that it won't receive any event older than this, and the events of the
+// other CPUs up to that point can be merged.
+//
+#define PIPELINE_WATERMARK_SLACK_NS 1000000
+
+//
+// How many events the formatting workers of sinsp_worker_pool get at a time,
+// and how many batches per worker can wait to be rendered or written before
+// the thread that processes the events blocks
+//
+#define WORKER_POOL_BATCH_SIZE 256
+#define WORKER_POOL_MAX_BATCHES_PER_WORKER 4
+
+//
+// How many times a filter runs before its predicates are reordered based on
+// their statistics
+//
+#define FILTER_REORDER_INTERVAL 65536
+
 //
 // Default snaplen
 //
 #define DEFAULT_SNAPLEN 80
 
+//
+// Size of the buffers of the event output of sysdig and of the chisels, see
+// sinsp_buffered_writer
+//
+#define OUTPUT_BUFFER_SIZE (256 * 1024)
+
+//
+// How often the event output is flushed by default when it doesn't go to a
+// terminal
+//
+#define DEFAULT_OUTPUT_FLUSH_INTERVAL_MS 100
+
+//
+// The flush interval of the output is checked every this many events, also
+// when they don't write anything
+//
+#define OUTPUT_FLUSH_CHECK_EVENTS 1000
+
 //
 // Is csysdig functionality included?
 //
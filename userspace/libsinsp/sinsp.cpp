@@ -34,6 +34,8 @@ along with sysdig.  If not, see <http://www.gnu.org/licenses/>.
 #include "chisel.h"
 #include "cyclewriter.h"
 #include "protodecoder.h"
+#include "pipeline.h"
+#include "procresolver.h"
 
 #ifdef HAS_ANALYZER
 #include "analyzer_int.h"
@@ -68,8 +70,19 @@ sinsp::sinsp() :
 	m_thread_timeout_ns = DEFAULT_THREAD_TIMEOUT_S * ONE_SECOND_IN_NS;
 	m_inactive_thread_scan_time_ns = DEFAULT_INACTIVE_THREAD_SCAN_TIME_S * ONE_SECOND_IN_NS;
 	m_inactive_container_scan_time_ns = DEFAULT_INACTIVE_CONTAINER_SCAN_TIME_S * ONE_SECOND_IN_NS;
+	m_inactive_scan_slice_entries = DEFAULT_INACTIVE_SCAN_SLICE_ENTRIES;
+	m_inactive_scan_slice_budget_ns = DEFAULT_INACTIVE_SCAN_SLICE_BUDGET_US * 1000;
 	m_cycle_writer = NULL;
 	m_write_cycling = false;
+	m_chunked_compression = false;
+	m_pipeline_enabled = false;
+	m_pipeline_n_readers = 0;
+	m_pipeline = NULL;
+	m_async_proc_lookup = false;
+	m_filter_eventmask = false;
+	m_async_container_metadata = false;
+	m_lazy_fd_import = false;
+	m_proc_resolver = NULL;
 #ifdef HAS_ANALYZER
 	m_analyzer = NULL;
 #endif
@@ -96,6 +109,9 @@ sinsp::sinsp() :
 	m_max_evt_output_len = 0;
 	m_filesize = -1;
 	m_import_users = true;
+	m_buffer_wait_min_us = 0;
+	m_buffer_wait_max_us = 0;
+	m_buffer_data_threshold = 0;
 	m_meta_evt_buf = new char[SP_EVT_BUF_SIZE];
 	m_meta_evt.m_pevt = (scap_evt*) m_meta_evt_buf;
 	m_meta_evt_pending = false;
@@ -217,6 +233,7 @@ void sinsp::init()
 	m_nevts = 0;
 	m_tid_to_remove = -1;
 	m_lastevent_ts = 0;
+	m_seek_ts = 0;
 #ifdef HAS_FILTERING
 	m_firstevent_ts = 0;
 #endif
@@ -270,6 +287,37 @@ void sinsp::init()
 		}
 	}
 #endif
+
+#ifdef HAS_FILTERING
+	//
+	// If the filter was set before opening the capture, this is the first
+	// chance to tell the driver about it
+	//
+	if(m_filter != NULL && m_filter_eventmask)
+	{
+		set_eventmask_from_filter();
+	}
+#endif
+
+	if(m_islive && m_async_proc_lookup)
+	{
+		m_proc_resolver = new sinsp_proc_resolver(this);
+	}
+
+	if(m_islive && m_async_container_metadata)
+	{
+		m_container_manager.start_metadata_resolver();
+	}
+
+	//
+	// Start the reader threads last, since from here on they own the scap
+	// read path
+	//
+	if(m_pipeline_enabled)
+	{
+		m_pipeline = new sinsp_pipeline(this, m_pipeline_n_readers);
+		m_pipeline->start();
+	}
 }
 
 void sinsp::set_import_users(bool import_users)
@@ -277,6 +325,13 @@ void sinsp::set_import_users(bool import_users)
 	m_import_users = import_users;
 }
 
+void sinsp::set_buffer_wait_policy(uint32_t min_us, uint32_t max_us, uint32_t data_threshold)
+{
+	m_buffer_wait_min_us = min_us;
+	m_buffer_wait_max_us = max_us;
+	m_buffer_data_threshold = data_threshold;
+}
+
 void sinsp::open(uint32_t timeout_ms)
 {
 	char error[SCAP_LASTERR_SIZE];
@@ -298,6 +353,10 @@ void sinsp::open(uint32_t timeout_ms)
 	oargs.proc_callback = ::on_new_entry_from_proc;
 	oargs.proc_callback_context = this;
 	oargs.import_users = m_import_users;
+	oargs.buffer_wait_min_us = m_buffer_wait_min_us;
+	oargs.buffer_wait_max_us = m_buffer_wait_max_us;
+	oargs.buffer_data_threshold = m_buffer_data_threshold;
+	oargs.skip_proc_fds = m_lazy_fd_import;
 
 	m_h = scap_open(oargs, error);
 
@@ -338,6 +397,10 @@ void sinsp::open(string filename)
 	oargs.proc_callback = NULL;
 	oargs.proc_callback_context = NULL;
 	oargs.import_users = m_import_users;
+	oargs.buffer_wait_min_us = 0;
+	oargs.buffer_wait_max_us = 0;
+	oargs.buffer_data_threshold = 0;
+	oargs.skip_proc_fds = false;
 
 	m_h = scap_open(oargs, error);
 
@@ -365,6 +428,20 @@ void sinsp::open(string filename)
 
 void sinsp::close()
 {
+	if(m_pipeline)
+	{
+		delete m_pipeline;
+		m_pipeline = NULL;
+	}
+
+	if(m_proc_resolver)
+	{
+		delete m_proc_resolver;
+		m_proc_resolver = NULL;
+	}
+
+	m_container_manager.stop_metadata_resolver();
+
 	if(m_h)
 	{
 		scap_close(m_h);
@@ -401,7 +478,8 @@ void sinsp::autodump_start(const string& dump_filename, bool compress)
 
 	if(compress)
 	{
-		m_dumper = scap_dump_open(m_h, dump_filename.c_str(), SCAP_COMPRESSION_GZIP);
+		m_dumper = scap_dump_open(m_h, dump_filename.c_str(),
+			m_chunked_compression? SCAP_COMPRESSION_CHUNKED : SCAP_COMPRESSION_GZIP);
 	}
 	else
 	{
@@ -469,6 +547,11 @@ void sinsp::on_new_entry_from_proc(void* context,
 		sinsp_threadinfo newti(this);
 		newti.init(tinfo);
 
+		if(m_lazy_fd_import && newti.is_main_thread())
+		{
+			newti.m_flags |= PPM_CL_FDS_PENDING;
+		}
+
 		m_thread_manager->add_thread(newti, true);
 	}
 	else
@@ -670,7 +753,14 @@ int32_t sinsp::next(OUT sinsp_evt **puevt)
 		//
 		// Get the event from libscap
 		//
-		res = scap_next(m_h, &(evt->m_pevt), &(evt->m_cpuid));
+		if(m_pipeline != NULL)
+		{
+			res = m_pipeline->next(&(evt->m_pevt), &(evt->m_cpuid));
+		}
+		else
+		{
+			res = scap_next(m_h, &(evt->m_pevt), &(evt->m_cpuid));
+		}
 
 		if(res != SCAP_SUCCESS)
 		{
@@ -696,13 +786,36 @@ int32_t sinsp::next(OUT sinsp_evt **puevt)
 			}
 			else
 			{
-				m_lasterr = scap_getlasterr(m_h);
+				if(m_pipeline != NULL)
+				{
+					m_lasterr = m_pipeline->getlasterr();
+				}
+				else
+				{
+					m_lasterr = scap_getlasterr(m_h);
+				}
 			}
 
 			return res;
 		}
 	}
 
+	//
+	// Fill the threads whose /proc lookup completed since the previous event
+	//
+	if(m_proc_resolver != NULL && m_proc_resolver->has_results())
+	{
+		m_proc_resolver->process_results();
+	}
+
+	//
+	// Same for the containers whose metadata was fetched
+	//
+	if(m_container_manager.is_metadata_resolver_running())
+	{
+		m_container_manager.process_metadata_results();
+	}
+
 	uint64_t ts = evt->get_ts();
 
 	if(m_firstevent_ts == 0)
@@ -839,6 +952,20 @@ int32_t sinsp::next(OUT sinsp_evt **puevt)
 	m_parser->process_event(evt);
 #endif
 
+	//
+	// While seeking, the events before the target time only update the state
+	//
+	if(m_seek_ts != 0)
+	{
+		if(ts < m_seek_ts)
+		{
+			*puevt = NULL;
+			return SCAP_TIMEOUT;
+		}
+
+		m_seek_ts = 0;
+	}
+
 	//
 	// If needed, dump the event to file
 	//
@@ -950,23 +1077,30 @@ int32_t sinsp::next(OUT sinsp_evt **puevt)
 
 uint64_t sinsp::get_num_events()
 {
+	if(m_pipeline != NULL)
+	{
+		return m_pipeline->get_num_events();
+	}
+
 	return scap_event_get_num(m_h);
 }
 
 sinsp_threadinfo* sinsp::find_thread(int64_t tid, bool lookup_only)
 {
 	threadinfo_map_iterator_t it;
+	sinsp_threadinfo* tinfo;
 
 	//
 	// Try looking up in our simple cache
 	//
-	if(m_thread_manager->m_last_tinfo && tid == m_thread_manager->m_last_tid)
+	if(tid == m_thread_manager->m_last_tid &&
+		(tinfo = m_thread_manager->m_threadtable.get(m_thread_manager->m_last_tinfo)) != NULL)
 	{
 #ifdef GATHER_INTERNAL_STATS
 		m_thread_manager->m_cached_lookups->increment();
 #endif
-		m_thread_manager->m_last_tinfo->m_lastaccess_ts = m_lastevent_ts;
-		return m_thread_manager->m_last_tinfo;
+		tinfo->m_lastaccess_ts = m_lastevent_ts;
+		return tinfo;
 	}
 
 	//
@@ -982,8 +1116,8 @@ sinsp_threadinfo* sinsp::find_thread(int64_t tid, bool lookup_only)
 		if(!lookup_only)
 		{
 			m_thread_manager->m_last_tid = tid;
-			m_thread_manager->m_last_tinfo = &(it->second);
-			m_thread_manager->m_last_tinfo->m_lastaccess_ts = m_lastevent_ts;
+			m_thread_manager->m_last_tinfo = m_thread_manager->m_threadtable.get_handle(it);
+			it->second.m_lastaccess_ts = m_lastevent_ts;
 		}
 		return &(it->second);
 	}
@@ -1009,6 +1143,7 @@ sinsp_threadinfo* sinsp::get_thread(int64_t tid, bool query_os_if_not_found, boo
 	{
 		scap_threadinfo* scap_proc = NULL;
 		sinsp_threadinfo newti(this);
+		bool pending = false;
 
 		if(m_thread_manager->m_threadtable.size() < m_max_thread_table_size)
 		{
@@ -1037,13 +1172,21 @@ sinsp_threadinfo* sinsp::get_thread(int64_t tid, bool query_os_if_not_found, boo
 					scan_sockets = true;
 				}
 
+				if(m_proc_resolver != NULL)
+				{
+					m_proc_resolver->request(tid, scan_sockets);
+					pending = true;
+				}
+				else
+				{
 #ifdef HAS_ANALYZER
-				uint64_t ts = sinsp_utils::get_current_time_ns();
+					uint64_t ts = sinsp_utils::get_current_time_ns();
 #endif
-				scap_proc = scap_proc_get(m_h, tid, scan_sockets);
+					scap_proc = scap_proc_get(m_h, tid, scan_sockets);
 #ifdef HAS_ANALYZER
-				m_n_proc_lookups_duration_ns += sinsp_utils::get_current_time_ns() - ts;
+					m_n_proc_lookups_duration_ns += sinsp_utils::get_current_time_ns() - ts;
 #endif
+				}
 			}
 		}
 
@@ -1065,25 +1208,20 @@ sinsp_threadinfo* sinsp::get_thread(int64_t tid, bool query_os_if_not_found, boo
 			newti.m_uid = 0xffffffff;
 			newti.m_gid = 0xffffffff;
 			newti.m_nchilds = 0;
-		}
 
-		//
-		// Since this thread is created out of thin air, we need to
-		// properly set its reference count, by scanning the table 
-		//
-		threadinfo_map_t* pttable = &m_thread_manager->m_threadtable;
-		threadinfo_map_iterator_t it;
-
-		for(it = pttable->begin(); it != pttable->end(); ++it)
-		{
-			if(it->second.m_pid == tid)
+			if(pending)
 			{
-				newti.m_nchilds++;
+				//
+				// Filled by the resolver when the lookup completes
+				//
+				newti.m_flags |= PPM_CL_PROC_PENDING;
 			}
 		}
 
 		//
-		// Done. Add the new thread to the list.
+		// Add the new thread to the list. Since it's created out of thin air,
+		// its reference count comes from the threads of this process that
+		// are already in the table, which the thread manager indexes.
 		//
 		m_thread_manager->add_thread(newti, false);
 		sinsp_proc = find_thread(tid, lookup_only);
@@ -1119,7 +1257,23 @@ void sinsp::set_snaplen(uint32_t snaplen)
 		return;
 	}
 
-	if(scap_set_snaplen(m_h, snaplen) != SCAP_SUCCESS)
+	//
+	// Changing the snaplen flushes the ring buffers, so the reader threads
+	// must be out of the way
+	//
+	if(m_pipeline != NULL)
+	{
+		m_pipeline->stop();
+	}
+
+	int32_t res = scap_set_snaplen(m_h, snaplen);
+
+	if(m_pipeline != NULL)
+	{
+		m_pipeline->start();
+	}
+
+	if(res != SCAP_SUCCESS)
 	{
 		//
 		// We know that setting the snaplen on a file doesn't do anything and
@@ -1185,6 +1339,85 @@ void sinsp::set_filter(const string& filter)
 
 	m_filter = new sinsp_filter(this, filter);
 	m_filterstring = filter;
+
+	if(m_h != NULL && m_filter_eventmask)
+	{
+		set_eventmask_from_filter();
+	}
+}
+
+void sinsp::set_filter_eventmask(bool enable)
+{
+	if(m_h != NULL)
+	{
+		throw sinsp_exception("set_filter_eventmask can't be called after capture starts");
+	}
+
+	m_filter_eventmask = enable;
+}
+
+//
+// Keep the driver from generating the events that the filter would reject.
+// The events that modify the state go through the parser before being
+// filtered, so they must be captured anyway.
+//
+void sinsp::set_eventmask_from_filter()
+{
+	uint8_t mask[PPM_EVENTMASK_SIZE];
+	uint32_t nunset = 0;
+
+	if(!m_islive)
+	{
+		return;
+	}
+
+	memset(mask, 0, sizeof(mask));
+
+	for(uint32_t j = 0; j < PPM_EVENT_MAX; j++)
+	{
+		if(m_filter->accepts_evttype(j) ||
+			(g_infotables.m_event_info[j].flags & EF_MODIFIES_STATE) ||
+			j == PPME_DROP_E || j == PPME_DROP_X)
+		{
+			mask[j / 8] |= 1 << (j % 8);
+		}
+		else
+		{
+			nunset++;
+		}
+	}
+
+	if(nunset == 0)
+	{
+		return;
+	}
+
+	//
+	// Changing the event mask flushes the ring buffers, so the reader threads
+	// must be out of the way
+	//
+	if(m_pipeline != NULL)
+	{
+		m_pipeline->stop();
+	}
+
+	//
+	// The events would be filtered in userspace anyway, so just warn
+	//
+	int32_t res = scap_set_eventmask_all(m_h, mask);
+
+	if(m_pipeline != NULL)
+	{
+		m_pipeline->start();
+	}
+
+	if(res != SCAP_SUCCESS)
+	{
+		g_logger.log(string("cannot set the driver event mask: ") + scap_getlasterr(m_h), sinsp_logger::SEV_WARNING);
+		return;
+	}
+
+	g_logger.format(sinsp_logger::SEV_INFO, "filter excludes %" PRIu32 " event types from the capture", nunset);
 }
 
 const string sinsp::get_filter()
@@ -1324,6 +1557,68 @@ void sinsp::add_chisel_dir(string dirname, bool front_add)
 #endif
 }
 
+void sinsp::set_pipeline_mode(bool enable, uint32_t n_readers)
+{
+	if(m_h != NULL)
+	{
+		throw sinsp_exception("set_pipeline_mode can't be called after capture starts");
+	}
+
+	m_pipeline_enabled = enable;
+	m_pipeline_n_readers = n_readers;
+}
+
+void sinsp::set_async_proc_lookup(bool enable)
+{
+	if(m_h != NULL)
+	{
+		throw sinsp_exception("set_async_proc_lookup can't be called after capture starts");
+	}
+
+	m_async_proc_lookup = enable;
+}
+
+void sinsp::set_lazy_fd_import(bool enable)
+{
+	if(m_h != NULL)
+	{
+		throw sinsp_exception("set_lazy_fd_import can't be called after capture starts");
+	}
+
+	m_lazy_fd_import = enable;
+}
+
+void sinsp::set_async_container_metadata(bool enable)
+{
+	if(m_h != NULL)
+	{
+		throw sinsp_exception("set_async_container_metadata can't be called after capture starts");
+	}
+
+	m_async_container_metadata = enable;
+}
+
+void sinsp::set_docker_socket_path(const string& path)
+{
+	if(m_h != NULL)
+	{
+		throw sinsp_exception("set_docker_socket_path can't be called after capture starts");
+	}
+
+	m_container_manager.set_docker_socket_path(path);
+}
+
+void sinsp::set_inactive_scan_slice(uint32_t max_entries, uint64_t budget_ns)
+{
+	if(max_entries == 0)
+	{
+		throw sinsp_exception("the inactive scan slice must visit at least one entry");
+	}
+
+	m_inactive_scan_slice_entries = max_entries;
+	m_inactive_scan_slice_budget_ns = budget_ns;
+}
+
 void sinsp::set_buffer_format(sinsp_evt::param_fmt format)
 {
 	m_buffer_format = format;
@@ -1395,7 +1690,16 @@ double sinsp::get_read_progress()
 
 	ASSERT(m_filesize != 0);
 
-	int64_t fpos = scap_get_readfile_offset(m_h);
+	int64_t fpos;
+
+	if(m_pipeline != NULL)
+	{
+		fpos = m_pipeline->get_readfile_offset();
+	}
+	else
+	{
+		fpos = scap_get_readfile_offset(m_h);
+	}
 
 	if(fpos == -1)
 	{
@@ -1405,6 +1709,78 @@ double sinsp::get_read_progress()
 	return (double)fpos * 100 / m_filesize;
 }
 
+void sinsp::seek(uint64_t ts)
+{
+	if(m_h == NULL || m_islive)
+	{
+		throw sinsp_exception("seek only works on trace files");
+	}
+
+	if(m_pipeline != NULL)
+	{
+		m_pipeline->stop();
+	}
+
+	int32_t res = scap_seek_to_ts(m_h, ts);
+
+	if(res == SCAP_NOT_SUPPORTED)
+	{
+		//
+		// Nothing moved. Going forward is done by reading through the events,
+		// including the ones that the reader threads have queued.
+		//
+		if(m_pipeline != NULL)
+		{
+			m_pipeline->start();
+		}
+
+		if(ts < m_lastevent_ts)
+		{
+			throw sinsp_exception(scap_getlasterr(m_h));
+		}
+
+		m_seek_ts = ts;
+		return;
+	}
+
+	//
+	// The reader threads have events queued from the old position, and if
+	// the seek failed, there's nothing left to read
+	//
+	if(m_pipeline != NULL)
+	{
+		delete m_pipeline;
+		m_pipeline = NULL;
+	}
+
+	if(res != SCAP_SUCCESS)
+	{
+		throw sinsp_exception(scap_getlasterr(m_h));
+	}
+
+	//
+	// Rebuild the state from the snapshot
+	//
+	m_thread_manager->clear();
+	m_tid_to_remove = -1;
+	m_tid_of_fd_to_remove = -1;
+	m_fds_to_remove->clear();
+	m_meta_evt_pending = false;
+	m_container_manager.reset_scan();
+
+	import_thread_table();
+	m_thread_manager->create_child_dependencies();
+	m_thread_manager->fix_sockets_coming_from_proc();
+
+	m_seek_ts = ts;
+
+	if(m_pipeline_enabled)
+	{
+		m_pipeline = new sinsp_pipeline(this, m_pipeline_n_readers);
+		m_pipeline->start();
+	}
+}
+
 bool sinsp::remove_inactive_threads()
 {
 	return m_thread_manager->remove_inactive_threads();
@@ -1415,8 +1791,6 @@ bool sinsp::remove_inactive_threads()
 ///////////////////////////////////////////////////////////////////////////////
 bool sinsp_thread_manager::remove_inactive_threads()
 {
-	bool res = false;
-
 	if(m_last_flush_time_ns == 0)
 	{
 		//
@@ -1435,50 +1809,28 @@ bool sinsp_thread_manager::remove_inactive_threads()
 		}
 	}
 
-	if(m_inspector->m_lastevent_ts > 
-		m_last_flush_time_ns + m_inspector->m_inactive_thread_scan_time_ns)
+	if(!m_scan_in_progress)
 	{
-		res = true;
+		if(m_inspector->m_lastevent_ts <= 
+			m_last_flush_time_ns + m_inspector->m_inactive_thread_scan_time_ns)
+		{
+			return false;
+		}
 
 		m_last_flush_time_ns = m_inspector->m_lastevent_ts;
 
 		g_logger.format(sinsp_logger::SEV_INFO, "Flushing thread table");
 
-		//
-		// Go through the table and remove dead entries.
-		//
-		for(threadinfo_map_iterator_t it = m_threadtable.begin(); it != m_threadtable.end();)
-		{
-			bool closed = (it->second.m_flags & PPM_CL_CLOSED) != 0;
-
-			if(closed || 
-				((m_inspector->m_lastevent_ts > it->second.m_lastaccess_ts + m_inspector->m_thread_timeout_ns) &&
-					!scap_is_thread_alive(m_inspector->m_h, it->second.m_pid, it->first, it->second.m_comm.c_str()))
-					)
-			{
-				//
-				// Reset the cache
-				//
-				m_last_tid = 0;
-				m_last_tinfo = NULL;
+		m_scan_in_progress = true;
+		m_scan_pos = 0;
 
 #ifdef GATHER_INTERNAL_STATS
-				m_removed_threads->increment();
+		m_scan_passes->increment();
 #endif
-				remove_thread(it++, closed);
-			}
-			else
-			{
-				++it;
-			}
-		}
-
-		//
-		// Rebalance the thread table dependency tree, so we free up threads that
-		// exited but that are stuck because of reference counting.
-		//
-		recreate_child_dependencies();
 	}
 
-	return res;
+	//
+	// Go through the next slice of the table and remove dead entries.
+	//
+	return scan_inactive_threads();
 }
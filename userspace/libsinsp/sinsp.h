@@ -57,16 +57,20 @@ along with sysdig.  If not, see <http://www.gnu.org/licenses/>.
 
 #include <string>
 #include <unordered_map>
+#include <unordered_set>
 #include <map>
+#include <memory>
 #include <queue>
 #include <vector>
 #include <set>
+#include <type_traits>
 
 using namespace std;
 
 #include <scap.h>
 #include "settings.h"
 #include "logger.h"
+#include "json_writer.h"
 #include "event.h"
 #include "filter.h"
 #include "dumper.h"
@@ -95,9 +99,12 @@ typedef enum sinsp_pd_callback_type
 
 #include "tuples.h"
 #include "fdinfo.h"
+#include "evtpool.h"
 #include "threadinfo.h"
 #include "ifinfo.h"
 #include "eventformatter.h"
+#include "bufferedwriter.h"
+#include "workerpool.h"
 
 class sinsp_partial_transaction;
 class sinsp_parser;
@@ -105,6 +112,8 @@ class sinsp_analyzer;
 class sinsp_filter;
 class cycle_writer;
 class sinsp_protodecoder;
+class sinsp_pipeline;
+class sinsp_proc_resolver;
 
 vector<string> sinsp_split(const string &s, char delim);
 
@@ -302,6 +311,21 @@ public:
 	*/
 	void set_import_users(bool import_users);
 
+	/*!
+	  \brief Tune how long a live capture waits when the ring buffers don't
+	  have enough data to be worth reading.
+
+	  \param min_us The initial wait, in microseconds.
+	  \param max_us The longest wait, reached by backing off while the
+	   buffers stay empty. This bounds the delivery latency of an event.
+	  \param data_threshold The number of bytes a buffer must contain for
+	   its events to be read without waiting.
+
+	  \note 0 selects the libscap default for any of the parameters. Takes
+	   effect at the next live open().
+	*/
+	void set_buffer_wait_policy(uint32_t min_us, uint32_t max_us, uint32_t data_threshold);
+
 	/*!
 	  \brief temporarily pauses event capture.
 
@@ -327,9 +351,26 @@ public:
 
 	  @throws a sinsp_exception containing the error string is thrown in case
 	   the filter is invalid.
+
+	  \note With \ref set_filter_eventmask(), the driver is configured to
+	   drop the event types that can't pass the filter on live captures.
 	*/
 	void set_filter(const string& filter);
 
+	/*!
+	  \brief When enabled, the driver doesn't capture the event types that
+	   can't pass the filter set with \ref set_filter(), except the ones that
+	   are needed to keep the state up to date.
+	  The event mask only applies to this capture, the other consumers of
+	   the driver keep receiving all the events.
+
+	  \param enable true to set the driver event mask from the filter.
+
+	  \note This function must be called before opening the capture, and only
+	   affects live captures.
+	*/
+	void set_filter_eventmask(bool enable);
+
 	/*!
 	  \brief Return the filter set for this capture.
 
@@ -531,6 +572,106 @@ public:
 	*/
 	sinsp_evt::param_fmt get_buffer_format();
 
+	/*!
+	  \brief Enable or disable the pipelined capture mode. In this mode, events
+	   are moved out of the capture source by background reader threads, which
+	   decouples reading (and decompressing, for trace files) the events from
+	   parsing them.
+
+	  \param enable true to turn the pipelined mode on.
+	  \param n_readers number of reader threads to use for live captures.
+	   Each CPU ring buffer is served by a single thread. 0 means one thread.
+	   Trace files are always read by one thread.
+
+	  \note This function must be called before opening the capture.
+	*/
+	void set_pipeline_mode(bool enable, uint32_t n_readers = 0);
+
+	/*!
+	  \brief Read the /proc information of the threads that are not in the
+	   thread table on a background thread, instead of stopping the event
+	   processing until it's read.
+	   A thread that is being looked up is added to the table right away,
+	   with "<NA>" name and executable, and sinsp_threadinfo::is_proc_pending()
+	   returns true for it. The information is filled in between two events
+	   when the lookup completes.
+
+	  \param enable true to turn the asynchronous lookups on.
+
+	  \note This function must be called before opening the capture, and only
+	   affects live captures.
+	*/
+	void set_async_proc_lookup(bool enable);
+
+	/*!
+	  \brief When enabled, the Docker metadata of the new containers (name,
+	   image, network and labels) is fetched from the Docker daemon on a
+	   background thread, instead of stopping the event processing until the
+	   daemon answers.
+	  A container whose metadata is being fetched is added to the table right
+	   away, and the container.ispending filter field is true for it. Its
+	   container event is generated when the fetch completes.
+
+	  \param enable true to turn the asynchronous fetches on.
+
+	  \note This function must be called before opening the capture, and only
+	   affects live captures.
+	*/
+	void set_async_container_metadata(bool enable);
+
+	/*!
+	  \brief Set the path of the socket the Docker daemon listens on, which
+	   is <host root>/var/run/docker.sock by default.
+
+	  \param path the path of the socket.
+
+	  \note This function must be called before opening the capture.
+	*/
+	void set_docker_socket_path(const string& path);
+
+	/*!
+	  \brief When enabled, the processes found in /proc when a live capture
+	   is opened are added to the thread table without their fd tables. The
+	   fd table of a process is read from /proc the first time it's needed,
+	   which makes the startup faster and the thread table smaller on hosts
+	   with processes that keep many files open.
+	  The fds that were closed before being read are never seen, and
+	   the client/server role of the sockets read later only relies on the
+	   server ports known at that time.
+
+	  \param enable true to read the fd tables on demand.
+
+	  \note This function must be called before opening the capture, and only
+	   affects live captures.
+	*/
+	void set_lazy_fd_import(bool enable);
+
+	/*!
+	  \brief Limit the work done between two events to remove the inactive
+	   threads and containers from the tables. The periodic scans of the
+	   tables are done a slice at a time, and every slice stops after visiting
+	   max_entries entries or after spending budget_ns checking in /proc
+	   whether the threads are still alive, whichever comes first.
+
+	  \param max_entries maximum number of entries visited by a slice.
+	  \param budget_ns time after which a slice stops.
+	*/
+	void set_inactive_scan_slice(uint32_t max_entries, uint64_t budget_ns);
+
+	/*!
+	  \brief When saving compressed trace files with \ref autodump_start(),
+	   compress the events in independent chunks followed by a chunk index,
+	   so that the file can be decompressed by multiple threads when it's
+	   read back.
+
+	  \note Files written this way can't be read by older versions of the
+	   library.
+	*/
+	void set_chunked_compression(bool enable)
+	{
+		m_chunked_compression = enable;
+	}
+
 	/*!
 	  \brief Returns true if the current capture is live.
 	*/
@@ -642,6 +783,24 @@ public:
 	*/
 	double get_read_progress();
 
+	/*!
+	  \brief When reading events from a trace file, move to the given time.
+	   The thread and fd tables are restored from the last state snapshot
+	   before ts, and the events between the snapshot and ts are only used
+	   to update them. The first event returned by \ref next() after this
+	   call is the first one at or after ts.
+
+	  \param ts the target time, in nanoseconds since epoch.
+
+	  \note Jumping is only possible with the files written with chunked
+	   compression. With the other files, only forward seeks are supported,
+	   and they're done by reading through the events.
+
+	  @throws a sinsp_exception containing the error string is thrown in case
+	   of failure.
+	*/
+	void seek(uint64_t ts);
+
 	//
 	// Misc internal stuff
 	//
@@ -682,6 +841,9 @@ private:
 	void import_ifaddr_list();
 	void import_user_list();
 	void add_protodecoders();
+#ifdef HAS_FILTERING
+	void set_eventmask_from_filter();
+#endif
 
 	void add_thread(const sinsp_threadinfo& ptinfo);
 	void remove_thread(int64_t tid, bool force);
@@ -707,12 +869,29 @@ private:
 	char m_output_time_flag;
 	uint32_t m_max_evt_output_len;
 	bool m_compress;
+	bool m_chunked_compression;
 	sinsp_evt m_evt;
 	string m_lasterr;
+	//
+	// The capture pipeline, if pipelined mode is enabled
+	//
+	bool m_pipeline_enabled;
+	uint32_t m_pipeline_n_readers;
+	sinsp_pipeline* m_pipeline;
+	//
+	// The background /proc reader, if asynchronous lookups are enabled
+	//
+	bool m_async_proc_lookup;
+	bool m_async_container_metadata;
+	bool m_lazy_fd_import;
+	sinsp_proc_resolver* m_proc_resolver;
+	bool m_filter_eventmask;
 	int64_t m_tid_to_remove;
 	int64_t m_tid_of_fd_to_remove;
 	vector<int64_t>* m_fds_to_remove;
 	uint64_t m_lastevent_ts;
+	// Events before this time are only used to update the state. 0 if we're not seeking.
+	uint64_t m_seek_ts;
 	// the parsing engine
 	sinsp_parser* m_parser;
 	// the statistics analysis engine
@@ -764,6 +943,8 @@ private:
 	uint32_t m_max_thread_table_size;
 	uint64_t m_thread_timeout_ns;
 	uint64_t m_inactive_thread_scan_time_ns;
+	uint32_t m_inactive_scan_slice_entries;
+	uint64_t m_inactive_scan_slice_budget_ns;
 
 	//
 	// Container limits
@@ -775,6 +956,13 @@ private:
 	//
 	sinsp_evt::param_fmt m_buffer_format;
 
+	//
+	// Ring buffer wait policy of live captures, 0 for the libscap defaults
+	//
+	uint32_t m_buffer_wait_min_us;
+	uint32_t m_buffer_wait_max_us;
+	uint32_t m_buffer_data_threshold;
+
 	//
 	// User and group tables
 	//
@@ -841,6 +1029,9 @@ private:
 	friend class curses_textbox;
 	friend class sinsp_filter_check_fd;
 	friend class sinsp_filter_check_event;
+	friend class sinsp_pipeline;
+	friend class sinsp_proc_resolver;
+	friend class sinsp_container_resolver;
 	
 	template<class TKey,class THash,class TCompare> friend class sinsp_connection_manager;
 };
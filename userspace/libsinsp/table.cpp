@@ -105,6 +105,8 @@ sinsp_table::sinsp_table(sinsp* inspector, tabletype type, uint64_t refresh_inte
 	m_zero_double = 0;
 	m_paused = false;
 	m_sample_data = NULL;
+	m_n_sorted_rows = 0;
+	m_visible_rows = 0;
 }
 
 sinsp_table::~sinsp_table()
@@ -349,33 +351,49 @@ void sinsp_table::add_row(bool merging)
 	if(m_type == sinsp_table::TT_TABLE)
 	{
 		//
-		// This is a table. Do a proper key lookup and update the entry
+		// This is a table. Do a proper key lookup and update the entry.
+		// The lookup uses the values where the extractors left them: they are
+		// copied to the buffer only when they start a new entry, so that the
+		// buffer grows with the rows of the sample and not with its events.
 		//
 		auto it = m_table->find(key);
 
 		if(it == m_table->end())
 		{
 			//
-			// New entry
+			// New entry. When merging, the values already live in the buffer.
 			//
-			key.m_val = key.m_val;
+			if(!merging)
+			{
+				key.m_val = m_buffer->copy(key.m_val, key.m_len);
+			}
+
 			key.m_cnt = 1;
 			m_vals = (sinsp_table_field*)m_buffer->reserve(m_vals_array_sz);
 
 			for(j = 1; j < m_n_fields; j++)
 			{
-				uint32_t vlen = get_field_len(j);
-				m_vals[j - 1].m_val = m_fld_pointers[j].m_val;
+				uint32_t vlen = m_fld_pointers[j].m_len;
+
+				if(merging)
+				{
+					m_vals[j - 1].m_val = m_fld_pointers[j].m_val;
+				}
+				else
+				{
+					m_vals[j - 1].m_val = m_buffer->copy(m_fld_pointers[j].m_val, vlen);
+				}
+
 				m_vals[j - 1].m_len = vlen;
 				m_vals[j - 1].m_cnt = m_fld_pointers[j].m_cnt;
 			}
 
-			(*m_table)[key] = m_vals;
+			m_table->insert(pair<sinsp_table_field, sinsp_table_field*>(key, m_vals));
 		}
 		else
 		{
 			//
-			// Existing entry
+			// Existing entry, aggregate the values into it
 			//
 			m_vals = it->second;
 
@@ -407,7 +425,7 @@ void sinsp_table::add_row(bool merging)
 		//
 		// This is a list. Create the new entry and push it back.
 		//
-		key.m_val = key.m_val;
+		key.m_val = m_buffer->copy(key.m_val, key.m_len);
 		key.m_cnt = 1;
 		row.m_key = key;
 
@@ -415,13 +433,13 @@ void sinsp_table::add_row(bool merging)
 
 		for(j = 1; j < m_n_fields; j++)
 		{
-			uint32_t vlen = get_field_len(j);
-			m_vals[j - 1].m_val = m_fld_pointers[j].m_val;
+			uint32_t vlen = m_fld_pointers[j].m_len;
+			m_vals[j - 1].m_val = m_buffer->copy(m_fld_pointers[j].m_val, vlen);
 			m_vals[j - 1].m_len = vlen;
 			m_vals[j - 1].m_cnt = 1;
-			row.m_values.push_back(m_vals[j - 1]);
 		}
 
+		row.m_values = m_vals;
 		m_full_sample_data.push_back(row);
 	}
 }
@@ -467,7 +485,6 @@ void sinsp_table::process_event(sinsp_evt* evt)
 				}
 
 				pfld->m_len = get_field_len(j);
-				pfld->m_val = m_buffer->copy(pfld->m_val, pfld->m_len);
 				pfld->m_cnt = 0;
 			}
 			else
@@ -479,7 +496,6 @@ void sinsp_table::process_event(sinsp_evt* evt)
 		{
 			pfld->m_val = val;
 			pfld->m_len = get_field_len(j);
-			pfld->m_val = m_buffer->copy(val, pfld->m_len);
 			pfld->m_cnt = 1;
 		}
 	}
@@ -631,12 +647,13 @@ void sinsp_table::stdout_print(vector<sinsp_sample_row>* sample_data, uint64_t t
 void sinsp_table::filter_sample()
 {
 	vector<filtercheck_field_info>* legend = get_legend();
+	uint32_t nvals = (uint32_t)legend->size() - 1;
 
 	m_filtered_sample_data.clear();
 
 	for(auto it : m_full_sample_data)
 	{
-		for(uint32_t j = 0; j < it.m_values.size(); j++)
+		for(uint32_t j = 0; j < nvals; j++)
 		{
 			ppm_param_type type;
 
@@ -677,21 +694,28 @@ void sinsp_table::filter_sample()
 sinsp_table_field* sinsp_table::search_in_sample(string text)
 {
 	vector<filtercheck_field_info>* legend = get_legend();
+	uint32_t nvals = (uint32_t)legend->size() - 1;
+
+	//
+	// The first match is the one closest to the top of the sorted table
+	//
+	if(m_sample_data == &m_full_sample_data)
+	{
+		sort_rows((uint32_t)m_full_sample_data.size());
+	}
 
 	for(auto it = m_full_sample_data.begin(); it != m_full_sample_data.end(); ++it)
 	{
-		for(uint32_t j = 0; j < it->m_values.size(); j++)
+		for(uint32_t j = 0; j < nvals; j++)
 		{
 			ppm_param_type type;
 
 			if(m_do_merging)
 			{
-				ASSERT(m_types->size() == it->m_values.size() + 2);
 				type = m_types->at(j + 2);
 			}
 			else
 			{
-				ASSERT(m_types->size() == it->m_values.size() + 1);
 				type = m_types->at(j + 1);
 			}
 
@@ -728,27 +752,99 @@ void sinsp_table::sort_sample()
 		}
 
 		m_just_sorted = false;
-	}
 
-	if(m_sample_data->size() != 0)
-	{
-		if(m_sorting_col >= (int32_t)m_sample_data->at(0).m_values.size())
+		//
+		// Lists keep their order as new rows are appended, so they are
+		// always sorted in full
+		//
+		if(m_sample_data->size() != 0)
 		{
-			throw sinsp_exception("invalid table sorting column");
+			table_row_cmp cc = get_row_comparator();
+
+			sort(m_sample_data->begin(),
+				m_sample_data->end(),
+				cc);
 		}
 
-		table_row_cmp cc;
-		cc.m_colid = m_sorting_col;
-		cc.m_ascending = m_is_sorting_ascending;
-		uint32_t tyid = m_do_merging? m_sorting_col + 2 : m_sorting_col + 1;
-		cc.m_type = m_premerge_types[tyid];
+		return;
+	}
 
-		sort(m_sample_data->begin(),
-			m_sample_data->end(),
-			cc);
+	m_n_sorted_rows = 0;
+
+	if(m_visible_rows == 0)
+	{
+		sort_rows((uint32_t)m_sample_data->size());
+	}
+	else
+	{
+		sort_rows(m_visible_rows);
 	}
 }
 
+void sinsp_table::sort_rows(uint32_t nrows)
+{
+	if(m_type != sinsp_table::TT_TABLE || m_sample_data == NULL)
+	{
+		return;
+	}
+
+	uint32_t size = (uint32_t)m_sample_data->size();
+
+	if(nrows > size)
+	{
+		nrows = size;
+	}
+
+	if(nrows <= m_n_sorted_rows)
+	{
+		return;
+	}
+
+	//
+	// Without a sorting column, the rows keep the order of the table
+	//
+	if(m_sorting_col == -1)
+	{
+		m_n_sorted_rows = size;
+		return;
+	}
+
+	table_row_cmp cc = get_row_comparator();
+	auto first = m_sample_data->begin() + m_n_sorted_rows;
+	auto middle = m_sample_data->begin() + nrows;
+
+	//
+	// The rows after m_n_sorted_rows are all below the sorted ones, so only
+	// they need to be looked at. Pick the top nrows ones with nth_element(),
+	// which is linear, and sort just those.
+	//
+	if(middle != m_sample_data->end())
+	{
+		nth_element(first, middle, m_sample_data->end(), cc);
+	}
+
+	sort(first, middle, cc);
+
+	m_n_sorted_rows = nrows;
+}
+
+table_row_cmp sinsp_table::get_row_comparator()
+{
+	if(m_sample_data->size() != 0 &&
+		m_sorting_col >= (int32_t)(get_legend()->size() - 1))
+	{
+		throw sinsp_exception("invalid table sorting column");
+	}
+
+	table_row_cmp cc;
+	cc.m_colid = m_sorting_col;
+	cc.m_ascending = m_is_sorting_ascending;
+	uint32_t tyid = m_do_merging? m_sorting_col + 2 : m_sorting_col + 1;
+	cc.m_type = m_premerge_types[tyid];
+
+	return cc;
+}
+
 vector<sinsp_sample_row>* sinsp_table::get_sample(uint64_t time_delta)
 {
 	//
@@ -782,6 +878,7 @@ vector<sinsp_sample_row>* sinsp_table::get_sample(uint64_t time_delta)
 	if(m_print_to_stdout)
 	{
 #endif
+		sort_rows((uint32_t)m_sample_data->size());
 		stdout_print(m_sample_data, time_delta);
 #ifndef _WIN32
 	}
@@ -919,18 +1016,12 @@ void sinsp_table::create_sample()
 		//
 		// Emit the table
 		//
+		m_full_sample_data.reserve(m_table->size());
+
 		for(auto it = m_table->begin(); it != m_table->end(); ++it)
 		{
 			row.m_key = it->first;
-
-			row.m_values.clear();
-
-			sinsp_table_field* fields = it->second;
-			for(j = 0; j < m_n_fields - 1; j++)
-			{
-				row.m_values.push_back(fields[j]);
-			}
-
+			row.m_values = it->second;
 			m_full_sample_data.push_back(row);
 		}
 	}
@@ -1322,6 +1413,8 @@ pair<filtercheck_field_info*, string> sinsp_table::get_row_key_name_and_val(uint
 	}
 	else
 	{
+		sort_rows(rownum + 1);
+
 		vector<filtercheck_field_info>* legend = get_legend();
 		res.first = (filtercheck_field_info*)((*extractors)[0])->get_field_info();
 		ASSERT(res.first != NULL);
@@ -1345,6 +1438,8 @@ sinsp_table_field* sinsp_table::get_row_key(uint32_t rownum)
 		return NULL;
 	}
 
+	sort_rows(rownum + 1);
+
 	return &m_sample_data->at(rownum).m_key;
 }
 
@@ -1352,8 +1447,18 @@ int32_t sinsp_table::get_row_from_key(sinsp_table_field* key)
 {
 	uint32_t j;
 
+	//
+	// The selected row is usually on the screen, so the rows that are already
+	// sorted are looked at first. The position of the other rows is known only
+	// after sorting them.
+	//
 	for(j = 0; j < m_sample_data->size(); j++)
 	{
+		if(j == m_n_sorted_rows)
+		{
+			sort_rows((uint32_t)m_sample_data->size());
+		}
+
 		sinsp_table_field* rowkey = &(m_sample_data->at(j).m_key);
 
 		if(rowkey->m_len == key->m_len)
@@ -20,6 +20,7 @@ along with sysdig.  If not, see <http://www.gnu.org/licenses/>.
 #define SINSP_TABLE_BUFFER_ENTRY_SIZE 16384
 
 class sinsp_filter_check_reference;
+struct table_row_cmp;
 
 typedef enum sysdig_table_action
 {
@@ -120,29 +121,65 @@ private:
 	uint32_t m_storage_len;
 };
 
+//
+// MurmurHash64A. The keys are hashed once per event, so the hash reads them
+// 8 bytes at a time, and it covers every byte of keys of any length.
+//
 struct sinsp_table_field_hasher
 {
-  size_t operator()(const sinsp_table_field& k) const
-  {
-	  size_t h = 0;
-	  uint8_t* s = k.m_val;
-	  uint32_t len = k.m_len;
-
-	  while(--len)
-	  {
-		  h = h * 101 + (unsigned) *s++;
-	  }
-
-	  return h;  
-  }
+	size_t operator()(const sinsp_table_field& k) const
+	{
+		const uint64_t m = 0xc6a4a7935bd1e995ULL;
+		const uint32_t r = 47;
+		const uint8_t* s = k.m_val;
+		uint32_t len = k.m_len;
+		uint64_t h = len * m;
+		uint64_t w;
+
+		while(len >= sizeof(uint64_t))
+		{
+			memcpy(&w, s, sizeof(uint64_t));
+			w *= m;
+			w ^= w >> r;
+			w *= m;
+
+			h ^= w;
+			h *= m;
+
+			s += sizeof(uint64_t);
+			len -= sizeof(uint64_t);
+		}
+
+		if(len != 0)
+		{
+			w = 0;
+			memcpy(&w, s, len);
+			h ^= w;
+			h *= m;
+		}
+
+		h ^= h >> r;
+		h *= m;
+		h ^= h >> r;
+
+		return (size_t)h;
+	}
 };
 
+//
+// The storage of the keys and values of a sample. The chunks are recycled
+// from one sample to the next: clear() only frees the chunks that the
+// previous sample didn't need, so that the buffer shrinks after a spike.
+//
 class sinsp_table_buffer
 {
 public:
 	sinsp_table_buffer()
 	{
-		push_buffer();
+		m_curbuf = new uint8_t[SINSP_TABLE_BUFFER_ENTRY_SIZE];
+		m_bufs.push_back(m_curbuf);
+		m_curidx = 0;
+		m_pos = 0;
 	}
 
 	~sinsp_table_buffer()
@@ -155,21 +192,21 @@ public:
 
 	void push_buffer()
 	{
-		m_curbuf = new uint8_t[SINSP_TABLE_BUFFER_ENTRY_SIZE];
-		m_bufs.push_back(m_curbuf);
+		m_curidx++;
+
+		if(m_curidx == m_bufs.size())
+		{
+			m_bufs.push_back(new uint8_t[SINSP_TABLE_BUFFER_ENTRY_SIZE]);
+		}
+
+		m_curbuf = m_bufs[m_curidx];
 		m_pos = 0;
 	}
 
 	uint8_t* copy(uint8_t* src, uint32_t len)
 	{
-		if(m_pos + len >= SINSP_TABLE_BUFFER_ENTRY_SIZE)
-		{
-			push_buffer();
-		}
-
-		uint8_t* dest = m_curbuf + m_pos;
+		uint8_t* dest = reserve(len);
 		memcpy(dest, src, len);
-		m_pos += len;
 		return dest;
 	}
 
@@ -191,28 +228,45 @@ public:
 		return dest;
 	}
 
+	//
+	// The bytes taken by the data, including the unused tails of the full
+	// chunks
+	//
+	uint64_t size()
+	{
+		return (uint64_t)m_curidx * SINSP_TABLE_BUFFER_ENTRY_SIZE + m_pos;
+	}
+
 	void clear()
 	{
-		for(auto it = m_bufs.begin(); it != m_bufs.end(); ++it)
+		for(uint32_t j = m_curidx + 1; j < m_bufs.size(); j++)
 		{
-			delete[] *it;
+			delete[] m_bufs[j];
 		}
 
-		m_bufs.clear();
-		push_buffer();
+		m_bufs.resize(m_curidx + 1);
+		m_curidx = 0;
+		m_curbuf = m_bufs[0];
 		m_pos = 0;
 	}
 
 	vector<uint8_t*> m_bufs;
 	uint8_t* m_curbuf;
+	uint32_t m_curidx;
 	uint32_t m_pos;
 };
 
+//
+// A row of a sample. The values are not copied: they point to the fixed size
+// record of the row in the table buffer, which has one field per column and
+// stays valid until the next sample is created. This keeps the rows small
+// and cheap to sort.
+//
 class sinsp_sample_row
 {
 public:
 	sinsp_table_field m_key;
-	vector<sinsp_table_field> m_values;
+	sinsp_table_field* m_values;
 };
 
 class sinsp_table
@@ -236,6 +290,12 @@ public:
 	//
 	sinsp_table_field* search_in_sample(string text);
 	void sort_sample();
+	//
+	// Makes sure that the first nrows rows of the sample are in their final
+	// order. Only the rows that the consumer asked for get sorted, so that
+	// showing the top of a very big table doesn't require sorting all of it.
+	//
+	void sort_rows(uint32_t nrows);
 	vector<sinsp_sample_row>* get_sample(uint64_t time_delta);
 	vector<filtercheck_field_info>* get_legend()
 	{
@@ -266,6 +326,14 @@ public:
 	{
 		m_refresh_interval_ns = newinterval_ns;
 	}
+	//
+	// The number of rows of every new sample that get sorted right away,
+	// typically the rows that fit on the screen. 0 sorts the whole sample.
+	//
+	void set_visible_rows(uint32_t nrows)
+	{
+		m_visible_rows = nrows;
+	}
 	void clear();
 	bool is_merging()
 	{
@@ -279,6 +347,13 @@ public:
 	{
 		m_is_sorting_ascending = is_sorting_ascending;
 	}
+	//
+	// Returns the bytes of storage taken by the sample being collected
+	//
+	uint64_t get_buffer_usage()
+	{
+		return m_buffer->size();
+	}
 
 	uint64_t m_next_flush_time_ns;
 
@@ -292,6 +367,7 @@ private:
 	inline uint32_t get_field_len(uint32_t id);
 	inline uint8_t* get_default_val(filtercheck_field_info* fld);
 	void create_sample();
+	table_row_cmp get_row_comparator();
 	void switch_buffers();
 	void stdout_print(vector<sinsp_sample_row>* sample_data, uint64_t time_delta);
 
@@ -328,6 +404,8 @@ private:
 	vector<sinsp_sample_row> m_full_sample_data;
 	vector<sinsp_sample_row> m_filtered_sample_data;
 	vector<sinsp_sample_row>* m_sample_data;
+	uint32_t m_n_sorted_rows; // The rows at the top of m_sample_data that are sorted
+	uint32_t m_visible_rows;
 	sinsp_table_field* m_vals;
 	int32_t m_sorting_col;
 	bool m_just_sorted;
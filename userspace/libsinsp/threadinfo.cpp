@@ -70,7 +70,7 @@ void sinsp_threadinfo::init()
 	m_pfminor = 0;
 	m_vtid = -1;
 	m_vpid = -1;
-	m_main_thread = NULL;
+	m_main_thread = sinsp_thread_handle();
 	m_lastevent_fd = 0;
 #ifdef HAS_FILTERING
 	m_last_latency_entertime = 0;
@@ -101,9 +101,9 @@ sinsp_threadinfo::~sinsp_threadinfo()
 
 void sinsp_threadinfo::fix_sockets_coming_from_proc()
 {
-	unordered_map<int64_t, sinsp_fdinfo_t>::iterator it;
+	sinsp_fdtable::iterator it;
 
-	for(it = m_fdtable.m_table.begin(); it != m_fdtable.m_table.end(); it++)
+	for(it = m_fdtable.begin(); it != m_fdtable.end(); it++)
 	{
 		if(it->second.m_type == SCAP_FD_IPV4_SOCK)
 		{
@@ -133,6 +133,45 @@ void sinsp_threadinfo::fix_sockets_coming_from_proc()
 	}
 }
 
+//
+// Read the fd table of a process that was added without it, see
+// sinsp::set_lazy_fd_import()
+//
+void sinsp_threadinfo::import_fds_from_proc()
+{
+	char error[SCAP_LASTERR_SIZE];
+	scap_threadinfo* pi;
+	scap_fdinfo* fdi;
+	scap_fdinfo* tfdi;
+
+	m_flags &= ~PPM_CL_FDS_PENDING;
+
+	if(m_inspector == NULL || m_inspector->m_h == NULL)
+	{
+		return;
+	}
+
+	pi = scap_proc_get_fds(m_inspector->m_h, m_pid, true, error);
+	if(pi == NULL)
+	{
+		//
+		// The process is gone
+		//
+		return;
+	}
+
+	HASH_ITER(hh, pi->fdlist, fdi, tfdi)
+	{
+		if(m_fdtable.find(fdi->fd) == NULL)
+		{
+			add_fd(fdi);
+		}
+	}
+
+	fix_sockets_coming_from_proc();
+	scap_proc_free(m_inspector->m_h, pi);
+}
+
 void sinsp_threadinfo::compute_program_hash()
 {
 	string phs = m_exe;
@@ -316,6 +355,68 @@ void sinsp_threadinfo::init(const scap_threadinfo* pi)
 	}
 }
 
+//
+// Fill a thread that was added as a placeholder while its /proc information
+// was being read in the background. What the events set in the meantime is
+// more recent than /proc, so it's kept: the program information if an
+// execve() was parsed, and the fds that are already in the table.
+//
+void sinsp_threadinfo::complete_proc_lookup(const scap_threadinfo* pi)
+{
+	scap_fdinfo *fdi;
+	scap_fdinfo *tfdi;
+
+	ASSERT(m_tid == (int64_t)pi->tid);
+
+	if(m_comm == "<NA>")
+	{
+		m_comm = pi->comm;
+		m_exe = pi->exe;
+		set_args(pi->args, pi->args_len);
+		set_env(pi->env, pi->env_len);
+		set_cwd(pi->cwd, (uint32_t)strlen(pi->cwd));
+		m_fdlimit = pi->fdlimit;
+		m_vmsize_kb = pi->vmsize_kb;
+		m_vmrss_kb = pi->vmrss_kb;
+		m_vmswap_kb = pi->vmswap_kb;
+		m_pfmajor = pi->pfmajor;
+		m_pfminor = pi->pfminor;
+	}
+
+	if(m_cgroups == NULL)
+	{
+		set_cgroups(pi->cgroups, pi->cgroups_len);
+		m_inspector->m_container_manager.resolve_container_from_cgroups(m_cgroups, m_inspector->m_islive, &m_container_id);
+	}
+
+	m_flags |= pi->flags;
+	m_flags &= ~PPM_CL_PROC_PENDING;
+	m_uid = pi->uid;
+	m_gid = pi->gid;
+	m_vtid = pi->vtid;
+	m_vpid = pi->vpid;
+	m_inspector->m_thread_manager->update_thread_ids(this, pi->pid, pi->ptid);
+
+	HASH_ITER(hh, pi->fdlist, fdi, tfdi)
+	{
+		if(m_fdtable.find(fdi->fd) == NULL)
+		{
+			add_fd(fdi);
+		}
+	}
+
+	//
+	// The placeholder was added as a process. If this turned out to be a
+	// thread, make sure that its main thread is in the table too.
+	//
+	if(m_pid != m_tid)
+	{
+		m_inspector->m_thread_manager->create_main_thread(this);
+	}
+
+	compute_program_hash();
+}
+
 string sinsp_threadinfo::get_comm()
 {
 	return m_comm;
@@ -352,40 +453,15 @@ void sinsp_threadinfo::set_env(const char* env, size_t len)
 
 void sinsp_threadinfo::set_cgroups(const char* cgroups, size_t len)
 {
-	m_cgroups.clear();
-
-	size_t offset = 0;
-	while(offset < len)
+	if(m_inspector != NULL)
 	{
-		const char* str = cgroups + offset;
-		const char* sep = strchr(str, '=');
-		if(sep == NULL)
-		{
-			ASSERT(false);
-			return;
-		}
-
-		string subsys(str, sep - str);
-		string cgroup(sep + 1);
-
-		size_t subsys_length = subsys.length();
-		size_t pos = subsys.find("_cgroup");
-		if(pos != string::npos)
-		{
-			subsys.erase(pos, sizeof("_cgroup") - 1);
-		}
-
-		if(subsys == "perf")
-		{
-			subsys = "perf_event";
-		}
-		else if(subsys == "mem")
-		{
-			subsys = "memory";
-		}
-
-		m_cgroups.push_back(std::make_pair(subsys, cgroup));
-		offset += subsys_length + 1 + cgroup.length() + 1;
+		m_cgroups = m_inspector->m_container_manager.intern_cgroups(cgroups, len);
+	}
+	else
+	{
+		std::shared_ptr<sinsp_cgroup_set> set = std::make_shared<sinsp_cgroup_set>();
+		set->parse(cgroups, len);
+		m_cgroups = set;
 	}
 }
 
@@ -413,11 +489,11 @@ void sinsp_threadinfo::remove_fd(int64_t fd)
 
 bool sinsp_threadinfo::is_bound_to_port(uint16_t number)
 {
-	unordered_map<int64_t, sinsp_fdinfo_t>::iterator it;
+	sinsp_fdtable::iterator it;
 
 	sinsp_fdtable* fdt = get_fd_table();
 
-	for(it = fdt->m_table.begin(); it != fdt->m_table.end(); ++it)
+	for(it = fdt->begin(); it != fdt->end(); ++it)
 	{
 		if(it->second.m_type == SCAP_FD_IPV4_SOCK)
 		{
@@ -440,12 +516,12 @@ bool sinsp_threadinfo::is_bound_to_port(uint16_t number)
 
 bool sinsp_threadinfo::uses_client_port(uint16_t number)
 {
-	unordered_map<int64_t, sinsp_fdinfo_t>::iterator it;
+	sinsp_fdtable::iterator it;
 
 	sinsp_fdtable* fdt = get_fd_table();
 
-	for(it = fdt->m_table.begin(); 
-		it != fdt->m_table.end(); ++it)
+	for(it = fdt->begin(); 
+		it != fdt->end(); ++it)
 	{
 		if(it->second.m_type == SCAP_FD_IPV4_SOCK)
 		{
@@ -477,13 +553,13 @@ void sinsp_threadinfo::store_event(sinsp_evt *evt)
 	//
 	// Copy the data
 	//
-	memcpy(m_lastevent_data, evt->m_pevt, elen);
+	memcpy(m_lastevent_data.reserve(&m_inspector->m_thread_manager->m_lastevent_pool, elen), evt->m_pevt, elen);
 	m_lastevent_cpuid = evt->get_cpuid();
 }
 
 bool sinsp_threadinfo::is_lastevent_data_valid()
 {
-	return (m_lastevent_cpuid != (uint16_t) - 1);
+	return (m_lastevent_cpuid != (uint16_t) - 1) && (m_lastevent_data.data() != NULL);
 }
 
 sinsp_threadinfo* sinsp_threadinfo::get_cwd_root()
@@ -616,7 +692,14 @@ double sinsp_threadinfo::get_fd_usage_pct_d()
 
 uint64_t sinsp_threadinfo::get_fd_opencount()
 {
-	return get_main_thread()->m_fdtable.size();
+	sinsp_fdtable* fdt = get_fd_table();
+
+	if(fdt == NULL)
+	{
+		return 0;
+	}
+
+	return fdt->size();
 }
 
 uint64_t sinsp_threadinfo::get_fd_limit()
@@ -630,46 +713,267 @@ sinsp_threadinfo* sinsp_threadinfo::lookup_thread()
 }
 
 //
-// Note: this is duplicated here because visual studio has trouble inlining
-//       the method.
+// The main thread is cached with a handle, which goes stale by itself when the
+// main thread is removed from the table.
+// Note: the handle is only set for threads that are in the table, so that this
+//       also works for a threadinfo that is in the stack.
 //
-#ifdef _WIN32
-sinsp_threadinfo* sinsp_threadinfo::get_main_thread()
+sinsp_threadinfo* sinsp_threadinfo::lookup_main_thread()
 {
-	if (m_main_thread == NULL)
+	sinsp_threadtable* table = &m_inspector->m_thread_manager->m_threadtable;
+	sinsp_threadinfo* ptinfo = table->get(m_main_thread);
+
+	if(ptinfo != NULL)
+	{
+		return ptinfo;
+	}
+
+	ptinfo = lookup_thread();
+	if(NULL == ptinfo)
+	{
+		return NULL;
+	}
+
+	threadinfo_map_iterator_t it = table->find(m_pid);
+	if(it != table->end())
+	{
+		m_main_thread = table->get_handle(it);
+	}
+
+	return ptinfo;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// sinsp_threadtable implementation
+///////////////////////////////////////////////////////////////////////////////
+#define THREADTABLE_MIN_BUCKETS 64
+
+sinsp_threadtable::sinsp_threadtable()
+{
+	m_nslots = 0;
+	m_size = 0;
+	m_buckets.resize(THREADTABLE_MIN_BUCKETS);
+	m_mask = THREADTABLE_MIN_BUCKETS - 1;
+
+	for(uint32_t j = 0; j < m_buckets.size(); j++)
+	{
+		m_buckets[j].m_key = 0;
+		m_buckets[j].m_slot = NO_SLOT;
+	}
+}
+
+sinsp_threadtable::~sinsp_threadtable()
+{
+	clear();
+
+	for(uint32_t j = 0; j < m_chunks.size(); j++)
+	{
+		delete[] m_chunks[j];
+	}
+}
+
+uint32_t sinsp_threadtable::next_slot(uint32_t pos)
+{
+	while(pos < m_nslots && !get_slot(pos)->m_used)
+	{
+		pos++;
+	}
+
+	return pos;
+}
+
+//
+// Reuse the slots of the erased entries first, so that the used slots stay
+// packed at the beginning of the chunks
+//
+uint32_t sinsp_threadtable::alloc_slot()
+{
+	uint32_t res;
+
+	if(!m_free_slots.empty())
+	{
+		res = m_free_slots.back();
+		m_free_slots.pop_back();
+		return res;
+	}
+
+	if(m_nslots == m_chunks.size() * CHUNK_SIZE)
 	{
+		slot* chunk = new slot[CHUNK_SIZE];
+
+		for(uint32_t j = 0; j < CHUNK_SIZE; j++)
+		{
+			chunk[j].m_generation = 0;
+			chunk[j].m_used = false;
+		}
+
+		m_chunks.push_back(chunk);
+	}
+
+	return m_nslots++;
+}
+
+void sinsp_threadtable::insert_bucket(uint32_t key, uint32_t slot)
+{
+	uint32_t idx = hash(key) & m_mask;
+
+	while(m_buckets[idx].m_slot != NO_SLOT)
+	{
+		idx = (idx + 1) & m_mask;
+	}
+
+	m_buckets[idx].m_key = key;
+	m_buckets[idx].m_slot = slot;
+}
+
+//
+// Linear probing with backward shift deletion, so that there are no
+// tombstones making the probe sequences longer as threads come and go
+//
+void sinsp_threadtable::erase_bucket(uint32_t slot)
+{
+	uint32_t key = (uint32_t)get_slot(slot)->get_entry()->first;
+	uint32_t idx = hash(key) & m_mask;
+
+	while(m_buckets[idx].m_slot != slot)
+	{
+		if(m_buckets[idx].m_slot == NO_SLOT)
+		{
+			ASSERT(false);
+			return;
+		}
+
+		idx = (idx + 1) & m_mask;
+	}
+
+	uint32_t next = (idx + 1) & m_mask;
+
+	while(m_buckets[next].m_slot != NO_SLOT)
+	{
+		uint32_t home = hash(m_buckets[next].m_key) & m_mask;
+
 		//
-		// Is this a child thread?
+		// Move the entry to the hole if the hole is between its home bucket
+		// and where it is now
 		//
-		if (m_pid == m_tid)
+		if(((next - home) & m_mask) >= ((next - idx) & m_mask))
 		{
-			//
-			// No, this is either a single thread process or the root thread of a
-			// multithread process.
-			// Note: we don't set m_main_thread because there are cases in which this is 
-			//       invoked for a threadinfo that is in the stack. Caching the this pointer
-			//       would cause future mess.
-			//
-			return this;
+			m_buckets[idx] = m_buckets[next];
+			idx = next;
 		}
-		else
+
+		next = (next + 1) & m_mask;
+	}
+
+	m_buckets[idx].m_slot = NO_SLOT;
+}
+
+void sinsp_threadtable::rehash(uint32_t nbuckets)
+{
+	vector<bucket> old;
+
+	old.swap(m_buckets);
+	m_buckets.resize(nbuckets);
+	m_mask = nbuckets - 1;
+
+	for(uint32_t j = 0; j < nbuckets; j++)
+	{
+		m_buckets[j].m_key = 0;
+		m_buckets[j].m_slot = NO_SLOT;
+	}
+
+	for(uint32_t j = 0; j < old.size(); j++)
+	{
+		if(old[j].m_slot != NO_SLOT)
 		{
-			//
-			// Yes, this is a child thread. Find the process root thread.
-			//
-			sinsp_threadinfo* ptinfo = lookup_thread();
-			if (NULL == ptinfo)
-			{
-				return NULL;
-			}
+			insert_bucket(old[j].m_key, old[j].m_slot);
+		}
+	}
+}
+
+sinsp_threadinfo* sinsp_threadtable::insert(const sinsp_threadinfo& tinfo)
+{
+	uint32_t pos = lookup(tinfo.m_tid);
+	slot* s;
+
+	if(pos != NO_SLOT)
+	{
+		//
+		// Replace the entry in place. The handles to it stay valid.
+		//
+		sinsp_threadinfo* res = &get_slot(pos)->get_entry()->second;
+		*res = tinfo;
+		return res;
+	}
+
+	//
+	// Keep the load factor of the hash table below 1/2
+	//
+	if((m_size + 1) * 2 > m_buckets.size())
+	{
+		rehash((uint32_t)m_buckets.size() * 2);
+	}
+
+	pos = alloc_slot();
+	s = get_slot(pos);
+
+	new (&s->m_storage) value_type(tinfo.m_tid, tinfo);
+	s->m_used = true;
+
+	insert_bucket((uint32_t)tinfo.m_tid, pos);
+	m_size++;
+
+	return &s->get_entry()->second;
+}
+
+void sinsp_threadtable::erase(iterator it)
+{
+	slot* s = get_slot(it.m_pos);
+
+	ASSERT(s->m_used);
+
+	erase_bucket(it.m_pos);
 
-			m_main_thread = ptinfo;
+	s->get_entry()->~value_type();
+	s->m_used = false;
+	s->m_generation++;
+
+	m_free_slots.push_back(it.m_pos);
+	m_size--;
+}
+
+void sinsp_threadtable::clear()
+{
+	//
+	// The chunks are kept, so that the handles to the erased entries stay
+	// stale
+	//
+	for(uint32_t j = 0; j < m_nslots; j++)
+	{
+		slot* s = get_slot(j);
+
+		if(s->m_used)
+		{
+			s->get_entry()->~value_type();
+			s->m_used = false;
+			s->m_generation++;
 		}
 	}
 
-	return m_main_thread;
+	m_free_slots.clear();
+
+	for(uint32_t j = m_nslots; j > 0; j--)
+	{
+		m_free_slots.push_back(j - 1);
+	}
+
+	for(uint32_t j = 0; j < m_buckets.size(); j++)
+	{
+		m_buckets[j].m_slot = NO_SLOT;
+	}
+
+	m_size = 0;
 }
-#endif
 
 ///////////////////////////////////////////////////////////////////////////////
 // sinsp_thread_manager implementation
@@ -684,9 +988,13 @@ sinsp_thread_manager::sinsp_thread_manager(sinsp* inspector)
 void sinsp_thread_manager::clear()
 {
 	m_threadtable.clear();
+	m_pid_index.clear();
+	m_ptid_index.clear();
 	m_last_tid = 0;
-	m_last_tinfo = NULL;
+	m_last_tinfo = sinsp_thread_handle();
 	m_last_flush_time_ns = 0;
+	m_scan_in_progress = false;
+	m_scan_pos = 0;
 	m_n_drops = 0;
 
 #ifdef GATHER_INTERNAL_STATS
@@ -695,6 +1003,9 @@ void sinsp_thread_manager::clear()
 	m_non_cached_lookups = &m_inspector->m_stats.get_metrics_registry().register_counter(internal_metrics::metric_name("thread_non_cached_lookups","Non cached thread lookups"));
 	m_added_threads = &m_inspector->m_stats.get_metrics_registry().register_counter(internal_metrics::metric_name("thread_added","Number of added threads"));
 	m_removed_threads = &m_inspector->m_stats.get_metrics_registry().register_counter(internal_metrics::metric_name("thread_removed","Removed threads"));
+	m_scan_passes = &m_inspector->m_stats.get_metrics_registry().register_counter(internal_metrics::metric_name("thread_scan_passes","Inactive thread table scans"));
+	m_scan_slices = &m_inspector->m_stats.get_metrics_registry().register_counter(internal_metrics::metric_name("thread_scan_slices","Inactive thread table scan slices"));
+	m_scan_proc_checks = &m_inspector->m_stats.get_metrics_registry().register_counter(internal_metrics::metric_name("thread_scan_proc_checks","Threads checked in /proc by the inactive thread table scans"));
 #endif
 }
 
@@ -703,26 +1014,101 @@ void sinsp_thread_manager::set_listener(sinsp_threadtable_listener* listener)
 	m_listener = listener;
 }
 
-void sinsp_thread_manager::increment_mainthread_childcount(sinsp_threadinfo* threadinfo)
+void sinsp_thread_manager::create_main_thread(sinsp_threadinfo* threadinfo)
 {
 	if(threadinfo->m_flags & PPM_CL_CLONE_THREAD)
 	{
 		//
-		// Increment the refcount of the main thread so it won't
-		// be deleted (if it calls pthread_exit()) until we are done
+		// Make sure that the main thread is in the table, looking it up in
+		// /proc if needed. Its refcount, which keeps it from being deleted
+		// (if it calls pthread_exit()) until we are done, comes from the index.
 		//
 		ASSERT(threadinfo->m_pid != threadinfo->m_tid);
 
 		sinsp_threadinfo* main_thread = m_inspector->get_thread(threadinfo->m_pid, true, true);
-		if(main_thread)
+		if(main_thread == NULL)
 		{
-			++main_thread->m_nchilds;
+			ASSERT(false);
 		}
-		else
+	}
+}
+
+void sinsp_thread_manager::index_thread(sinsp_threadinfo* tinfo)
+{
+	if(tinfo->m_pid != tinfo->m_tid)
+	{
+		unordered_set<int64_t>& threads = m_pid_index[tinfo->m_pid];
+		threads.insert(tinfo->m_tid);
+
+		threadinfo_map_iterator_t it = m_threadtable.find(tinfo->m_pid);
+		if(it != m_threadtable.end())
 		{
-			ASSERT(false);
+			it->second.m_nchilds = threads.size();
 		}
 	}
+	else
+	{
+		thread_index_t::iterator it = m_pid_index.find(tinfo->m_tid);
+		tinfo->m_nchilds = (it != m_pid_index.end())? it->second.size() : 0;
+	}
+
+	if(tinfo->m_ptid != -1)
+	{
+		m_ptid_index[tinfo->m_ptid].insert(tinfo->m_tid);
+	}
+}
+
+void sinsp_thread_manager::unindex_thread(sinsp_threadinfo* tinfo)
+{
+	thread_index_t::iterator it;
+
+	if(tinfo->m_pid != tinfo->m_tid)
+	{
+		it = m_pid_index.find(tinfo->m_pid);
+		if(it != m_pid_index.end())
+		{
+			it->second.erase(tinfo->m_tid);
+
+			threadinfo_map_iterator_t mit = m_threadtable.find(tinfo->m_pid);
+			if(mit != m_threadtable.end())
+			{
+				mit->second.m_nchilds = it->second.size();
+			}
+
+			if(it->second.empty())
+			{
+				m_pid_index.erase(it);
+			}
+		}
+	}
+
+	if(tinfo->m_ptid != -1)
+	{
+		it = m_ptid_index.find(tinfo->m_ptid);
+		if(it != m_ptid_index.end())
+		{
+			it->second.erase(tinfo->m_tid);
+
+			if(it->second.empty())
+			{
+				m_ptid_index.erase(it);
+			}
+		}
+	}
+}
+
+void sinsp_thread_manager::update_thread_ids(sinsp_threadinfo* tinfo, int64_t pid, int64_t ptid)
+{
+	if(tinfo->m_pid == pid && tinfo->m_ptid == ptid)
+	{
+		return;
+	}
+
+	unindex_thread(tinfo);
+	tinfo->m_pid = pid;
+	tinfo->m_ptid = ptid;
+	tinfo->m_main_thread = sinsp_thread_handle();
+	index_thread(tinfo);
 }
 
 void sinsp_thread_manager::add_thread(sinsp_threadinfo& threadinfo, bool from_scap_proctable)
@@ -731,8 +1117,6 @@ void sinsp_thread_manager::add_thread(sinsp_threadinfo& threadinfo, bool from_sc
 	m_added_threads->increment();
 #endif
 
-	m_last_tinfo = NULL;
-
 	if(m_threadtable.size() >= m_inspector->m_max_thread_table_size)
 	{
 		m_n_drops++;
@@ -741,18 +1125,29 @@ void sinsp_thread_manager::add_thread(sinsp_threadinfo& threadinfo, bool from_sc
 
 	if(!from_scap_proctable)
 	{
-		increment_mainthread_childcount(&threadinfo);
+		create_main_thread(&threadinfo);
 	}
 
 	threadinfo.compute_program_hash();
 
-	sinsp_threadinfo& newentry = (m_threadtable[threadinfo.m_tid] = threadinfo);
+	//
+	// If an entry with the same tid is being replaced, drop it from the
+	// indexes first
+	//
+	threadinfo_map_iterator_t it = m_threadtable.find(threadinfo.m_tid);
+	if(it != m_threadtable.end())
+	{
+		unindex_thread(&it->second);
+	}
+
+	sinsp_threadinfo* newentry = m_threadtable.insert(threadinfo);
 
-	newentry.allocate_private_state();
+	index_thread(newentry);
+	newentry->allocate_private_state();
 
 	if(m_listener)
 	{
-		m_listener->on_thread_created(&newentry);
+		m_listener->on_thread_created(newentry);
 	}
 }
 
@@ -763,8 +1158,6 @@ void sinsp_thread_manager::remove_thread(int64_t tid, bool force)
 
 void sinsp_thread_manager::remove_thread(threadinfo_map_iterator_t it, bool force)
 {
-	uint64_t nchilds;
-
 	if(it == m_threadtable.end())
 	{
 		//
@@ -778,40 +1171,22 @@ void sinsp_thread_manager::remove_thread(threadinfo_map_iterator_t it, bool forc
 #endif
 		return;
 	}
-	else if((nchilds = it->second.m_nchilds) == 0 || force)
+	else if(it->second.m_nchilds == 0 || force)
 	{
 		//
-		// Decrement the refcount of the main thread/program because
-		// this reference is gone
+		// Drop the thread from the indexes. This decrements the refcount of
+		// the main thread, because this reference is gone.
 		//
-		if(it->second.m_flags & PPM_CL_CLONE_THREAD)
-		{
-			ASSERT(it->second.m_pid != it->second.m_tid);
-			sinsp_threadinfo* main_thread = m_inspector->get_thread(it->second.m_pid, false, true);
-			if(main_thread)
-			{
-				if(main_thread->m_nchilds > 0)
-				{
-					--main_thread->m_nchilds;
-				}
-				else
-				{
-					ASSERT(false);
-				}
-			}
-			else
-			{
-				ASSERT(false);
-			}
-		}
+		unindex_thread(&it->second);
 
 		//
-		// If this is the main thread of a process, erase all the FDs that the process owns
+		// If this is the main thread of a process, erase all the FDs that the process owns.
+		// There's nothing to erase if they were never read from /proc.
 		//
-		if(it->second.m_pid == it->second.m_tid)
+		if(it->second.m_pid == it->second.m_tid && !(it->second.m_flags & PPM_CL_FDS_PENDING))
 		{
-			unordered_map<int64_t, sinsp_fdinfo_t>* fdtable = &(it->second.get_fd_table()->m_table);
-			unordered_map<int64_t, sinsp_fdinfo_t>::iterator fdit;
+			sinsp_fdtable* fdtable = it->second.get_fd_table();
+			sinsp_fdtable::iterator fdit;
 
 			erase_fd_params eparams;
 			eparams.m_remove_from_table = false;
@@ -834,29 +1209,82 @@ void sinsp_thread_manager::remove_thread(threadinfo_map_iterator_t it, bool forc
 			}
 		}
 
+#ifdef GATHER_INTERNAL_STATS
+		m_removed_threads->increment();
+#endif
+
 		//
-		// Reset the cache
+		// The handles to this thread, including the cache and the ones that
+		// its threads keep to their main thread, go stale by themselves
 		//
-		m_last_tid = 0;
-		m_last_tinfo = NULL;
+		m_threadtable.erase(it);
+	}
+}
+
+//
+// Visit the next slice of the table for remove_inactive_threads(). Returns
+// true when the scan is complete.
+//
+bool sinsp_thread_manager::scan_inactive_threads()
+{
+	uint64_t start = 0;
+	uint32_t nvisited = 0;
+	threadinfo_map_iterator_t it = m_threadtable.seek(m_scan_pos);
 
 #ifdef GATHER_INTERNAL_STATS
-		m_removed_threads->increment();
+	m_scan_slices->increment();
 #endif
 
-		m_threadtable.erase(it);
+	while(it != m_threadtable.end() && nvisited < m_inspector->m_inactive_scan_slice_entries)
+	{
+		bool closed = (it->second.m_flags & PPM_CL_CLOSED) != 0;
+		bool remove = closed;
 
-		//
-		// If the thread has a nonzero refcount, it means that we are forcing the removal
-		// of a main process or program that some childs refer to.
-		// We need to recalculate the child relationships, or the table will become 
-		// corrupted.
-		//
-		if(nchilds != 0)
+		nvisited++;
+
+		if(!closed && m_inspector->m_lastevent_ts > it->second.m_lastaccess_ts + m_inspector->m_thread_timeout_ns)
 		{
-			recreate_child_dependencies();
+			//
+			// Checking /proc is what takes time, so the time budget only
+			// starts with it
+			//
+			if(start == 0)
+			{
+				start = sinsp_utils::get_current_time_ns();
+			}
+
+#ifdef GATHER_INTERNAL_STATS
+			m_scan_proc_checks->increment();
+#endif
+			remove = !scap_is_thread_alive(m_inspector->m_h, it->second.m_pid, it->first, it->second.m_comm.c_str());
+		}
+
+		if(remove)
+		{
+#ifdef GATHER_INTERNAL_STATS
+			m_removed_threads->increment();
+#endif
+			remove_thread(it++, closed);
+		}
+		else
+		{
+			++it;
+		}
+
+		if(start != 0 && sinsp_utils::get_current_time_ns() - start > m_inspector->m_inactive_scan_slice_budget_ns)
+		{
+			break;
 		}
 	}
+
+	if(it == m_threadtable.end())
+	{
+		m_scan_in_progress = false;
+		return true;
+	}
+
+	m_scan_pos = it.get_pos();
+	return false;
 }
 
 void sinsp_thread_manager::fix_sockets_coming_from_proc()
@@ -871,13 +1299,13 @@ void sinsp_thread_manager::fix_sockets_coming_from_proc()
 
 void sinsp_thread_manager::clear_thread_pointers(threadinfo_map_iterator_t it)
 {
-	it->second.m_main_thread = NULL;
+	it->second.m_main_thread = sinsp_thread_handle();
 
-	sinsp_fdtable* fdt = it->second.get_fd_table();
-	if(fdt != NULL)
-	{
-		fdt->reset_cache();
-	}
+	//
+	// Every table is reached through the thread that owns it. This doesn't
+	// go through get_fd_table(), which would read the pending fd tables.
+	//
+	it->second.m_fdtable.reset_cache();
 }
 
 /*
@@ -894,23 +1322,40 @@ void sinsp_thread_manager::reset_child_dependencies()
 {
 	threadinfo_map_iterator_t it;
 
-	m_last_tinfo = NULL;
+	m_last_tinfo = sinsp_thread_handle();
 	m_last_tid = 0;
 
 	for(it = m_threadtable.begin(); it != m_threadtable.end(); ++it)
 	{
-		it->second.m_nchilds = 0;
 		clear_thread_pointers(it);
 	}
 }
 
+//
+// The refcounts are kept up to date by the index. This makes sure that every
+// thread has its main thread in the table, which is not the case after
+// importing the threads from /proc or from a trace file.
+//
 void sinsp_thread_manager::create_child_dependencies()
 {
+	vector<sinsp_threadinfo*> threads;
 	threadinfo_map_iterator_t it;
 
+	//
+	// create_main_thread() can add entries to the table, so the threads are
+	// collected first
+	//
 	for(it = m_threadtable.begin(); it != m_threadtable.end(); ++it)
 	{
-		increment_mainthread_childcount(&it->second);
+		if(it->second.m_flags & PPM_CL_CLONE_THREAD)
+		{
+			threads.push_back(&it->second);
+		}
+	}
+
+	for(uint32_t j = 0; j < threads.size(); j++)
+	{
+		create_main_thread(threads[j]);
 	}
 }
 
@@ -928,7 +1373,7 @@ void sinsp_thread_manager::update_statistics()
 	m_inspector->m_stats.m_n_fds = 0;
 	for(threadinfo_map_iterator_t it = m_threadtable.begin(); it != m_threadtable.end(); it++)
 	{
-		m_inspector->m_stats.m_n_fds += it->second.get_fd_table()->size();
+		m_inspector->m_stats.m_n_fds += it->second.m_fdtable.size();
 	}
 #endif
 }
@@ -36,6 +36,22 @@ typedef struct erase_fd_params
 	uint64_t m_ts;
 }erase_fd_params;
 
+//
+// Reference to an entry of the thread table that can be checked for
+// staleness. See sinsp_threadtable.
+//
+struct sinsp_thread_handle
+{
+	sinsp_thread_handle()
+	{
+		m_slot = 0xffffffff;
+		m_generation = 0;
+	}
+
+	uint32_t m_slot;
+	uint32_t m_generation;
+};
+
 /** @defgroup state State management 
  *  @{
  */
@@ -81,48 +97,40 @@ public:
 		return m_tid == m_pid;
 	}
 
+	/*!
+	  \brief Return true if the thread was added to the table while its /proc
+	   information is still being read in the background (see
+	   \ref sinsp::set_async_proc_lookup()). Until the lookup completes, the
+	   thread looks like one that couldn't be found in /proc: its name and
+	   executable are "<NA>" and its pid is equal to its tid.
+	*/
+	inline bool is_proc_pending()
+	{
+		return (m_flags & PPM_CL_PROC_PENDING) != 0;
+	}
+
 	/*!
 	  \brief Get the main thread of the process containing this thread.
 	*/
-#ifndef _WIN32
 	inline sinsp_threadinfo* get_main_thread()
 	{
-		if(m_main_thread == NULL)
+		//
+		// Is this a child thread?
+		//
+		if(m_pid == m_tid)
 		{
 			//
-			// Is this a child thread?
+			// No, this is either a single thread process or the root thread of a
+			// multithread process.
 			//
-			if(m_pid == m_tid)
-			{
-				//
-				// No, this is either a single thread process or the root thread of a
-				// multithread process.
-				// Note: we don't set m_main_thread because there are cases in which this is 
-				//       invoked for a threadinfo that is in the stack. Caching the this pointer
-				//       would cause future mess.
-				//
-				return this;
-			}
-			else
-			{
-				//
-				// Yes, this is a child thread. Find the process root thread.
-				//
-				sinsp_threadinfo* ptinfo = lookup_thread();
-				if(NULL == ptinfo)
-				{
-					return NULL;
-				}
-
-				m_main_thread = ptinfo;
-			}
+			return this;
 		}
 
-		return m_main_thread;
+		//
+		// Yes, this is a child thread. Find the process root thread.
+		//
+		return lookup_main_thread();
 	}
-#else
-	sinsp_threadinfo* get_main_thread();
-#endif
 
 	/*!
 	  \brief Get the process that launched this thread's process.
@@ -192,7 +200,7 @@ public:
 	string m_exe; ///< argv[0] (e.g. "sshd: user@pts/4")
 	vector<string> m_args; ///< Command line arguments (e.g. "-d1")
 	vector<string> m_env; ///< Environment variables
-	vector<pair<string, string>> m_cgroups; ///< subsystem-cgroup pairs
+	sinsp_cgroup_set_ptr m_cgroups; ///< subsystem-cgroup pairs, shared by the threads with the same cgroups. NULL if unknown.
 	string m_container_id; ///< heuristic-based container id
 	uint32_t m_flags; ///< The thread flags. See the PPM_CL_* declarations in ppm_events_public.h.
 	int64_t m_fdlimit;  ///< The maximum number of FDs this thread can open
@@ -234,7 +242,9 @@ public:
 VISIBILITY_PRIVATE
 	void init();
 	void init(const scap_threadinfo* pi);
+	void complete_proc_lookup(const scap_threadinfo* pi);
 	void fix_sockets_coming_from_proc();
+	void import_fds_from_proc();
 	sinsp_fdinfo_t* add_fd(int64_t fd, sinsp_fdinfo_t *fdinfo);
 	void add_fd(scap_fdinfo *fdinfo);
 	void remove_fd(int64_t fd);
@@ -255,6 +265,11 @@ VISIBILITY_PRIVATE
 			}
 		}
 
+		if(root->m_flags & PPM_CL_FDS_PENDING)
+		{
+			root->import_fds_from_proc();
+		}
+
 		return &(root->m_fdtable);
 	}
 	void set_cwd(const char *cwd, uint32_t cwdlen);
@@ -278,6 +293,7 @@ VISIBILITY_PRIVATE
 	void allocate_private_state();
 	void compute_program_hash();
 	sinsp_threadinfo* lookup_thread();
+	sinsp_threadinfo* lookup_main_thread();
 
 	//  void push_fdop(sinsp_fdop* op);
 	// the queue of recent fd operations
@@ -289,8 +305,8 @@ VISIBILITY_PRIVATE
 	//
 	sinsp_fdtable m_fdtable; // The fd table of this thread
 	string m_cwd; // current working directory
-	sinsp_threadinfo* m_main_thread;
-	uint8_t m_lastevent_data[SP_EVT_BUF_SIZE]; // Used by some event parsers to store the last enter event
+	sinsp_thread_handle m_main_thread;
+	sinsp_evt_buffer m_lastevent_data; // Used by some event parsers to store the last enter event
 	vector<void*> m_private_state;
 
 	uint16_t m_lastevent_type;
@@ -307,12 +323,244 @@ VISIBILITY_PRIVATE
 	friend class sinsp_transaction_table;
 	friend class thread_analyzer_info;
 	friend class lua_cbacks;
+	friend class sinsp_proc_resolver;
 };
 
 /*@}*/
 
-typedef unordered_map<int64_t, sinsp_threadinfo> threadinfo_map_t;
-typedef threadinfo_map_t::iterator threadinfo_map_iterator_t;
+///////////////////////////////////////////////////////////////////////////////
+// Thread table
+//
+// The entries live in slots that are allocated in chunks and never move, so
+// pointers to the entries stay valid until they are erased, and iterating
+// goes through mostly contiguous memory. Every slot has a generation that is
+// bumped when its entry is erased, which makes it possible to keep handles
+// to the entries that are checked for staleness with a single compare
+// instead of resetting every cached pointer when a thread goes away.
+// The tids are mapped to the slots by an open addressing hash table.
+///////////////////////////////////////////////////////////////////////////////
+class SINSP_PUBLIC sinsp_threadtable
+{
+public:
+	typedef pair<const int64_t, sinsp_threadinfo> value_type;
+
+	//
+	// Iterates over the threads in slot order. Entries can be erased while
+	// iterating, as long as it's not the one the iterator points to.
+	//
+	class iterator
+	{
+	public:
+		iterator()
+		{
+			m_table = NULL;
+			m_pos = 0;
+		}
+
+		value_type& operator*()
+		{
+			return *m_table->get_slot(m_pos)->get_entry();
+		}
+
+		value_type* operator->()
+		{
+			return m_table->get_slot(m_pos)->get_entry();
+		}
+
+		iterator& operator++()
+		{
+			m_pos = m_table->next_slot(m_pos + 1);
+			return *this;
+		}
+
+		iterator operator++(int)
+		{
+			iterator res = *this;
+			m_pos = m_table->next_slot(m_pos + 1);
+			return res;
+		}
+
+		bool operator==(const iterator& other) const
+		{
+			return m_pos == other.m_pos;
+		}
+
+		bool operator!=(const iterator& other) const
+		{
+			return m_pos != other.m_pos;
+		}
+
+		//
+		// The slot of the entry, that can be used to resume an iteration
+		// with seek()
+		//
+		uint32_t get_pos() const
+		{
+			return m_pos;
+		}
+
+	private:
+		iterator(sinsp_threadtable* table, uint32_t pos)
+		{
+			m_table = table;
+			m_pos = pos;
+		}
+
+		sinsp_threadtable* m_table;
+		uint32_t m_pos;
+
+		friend class sinsp_threadtable;
+	};
+
+	sinsp_threadtable();
+	~sinsp_threadtable();
+
+	inline iterator find(int64_t tid)
+	{
+		uint32_t slot = lookup(tid);
+		return iterator(this, (slot != NO_SLOT)? slot : m_nslots);
+	}
+
+	//
+	// Copy a thread in the table, replacing the entry with the same tid if
+	// there's one, and return the entry
+	//
+	sinsp_threadinfo* insert(const sinsp_threadinfo& tinfo);
+	void erase(iterator it);
+	void clear();
+
+	inline size_t size()
+	{
+		return m_size;
+	}
+
+	iterator begin()
+	{
+		return iterator(this, next_slot(0));
+	}
+
+	iterator end()
+	{
+		return iterator(this, m_nslots);
+	}
+
+	//
+	// Return the first entry at or after a slot. The entries inserted in the
+	// slots before it since the position was taken are skipped.
+	//
+	iterator seek(uint32_t pos)
+	{
+		return iterator(this, next_slot(pos));
+	}
+
+	inline sinsp_thread_handle get_handle(const iterator& it)
+	{
+		sinsp_thread_handle res;
+
+		res.m_slot = it.m_pos;
+		res.m_generation = get_slot(it.m_pos)->m_generation;
+		return res;
+	}
+
+	//
+	// Return the entry of a handle, or NULL if it has been erased
+	//
+	inline sinsp_threadinfo* get(const sinsp_thread_handle& handle)
+	{
+		if(handle.m_slot >= m_nslots)
+		{
+			return NULL;
+		}
+
+		slot* s = get_slot(handle.m_slot);
+
+		if(s->m_generation != handle.m_generation)
+		{
+			return NULL;
+		}
+
+		return &s->get_entry()->second;
+	}
+
+private:
+	static const uint32_t NO_SLOT = 0xffffffff;
+	static const uint32_t CHUNK_BITS = 8;
+	static const uint32_t CHUNK_SIZE = 1 << CHUNK_BITS;
+
+	struct slot
+	{
+		value_type* get_entry()
+		{
+			return (value_type*)&m_storage;
+		}
+
+		aligned_storage<sizeof(value_type), alignof(value_type)>::type m_storage;
+		uint32_t m_generation;
+		bool m_used;
+	};
+
+	//
+	// Only the low 32 bits of the tid are kept in the buckets, to make them
+	// smaller. The full tid is checked in the slot.
+	//
+	struct bucket
+	{
+		uint32_t m_key;
+		uint32_t m_slot;
+	};
+
+	// Not copyable
+	sinsp_threadtable(const sinsp_threadtable&);
+	sinsp_threadtable& operator=(const sinsp_threadtable&);
+
+	inline slot* get_slot(uint32_t pos)
+	{
+		return &m_chunks[pos >> CHUNK_BITS][pos & (CHUNK_SIZE - 1)];
+	}
+
+	inline uint32_t lookup(int64_t tid)
+	{
+		uint32_t idx = hash((uint32_t)tid) & m_mask;
+
+		while(true)
+		{
+			bucket* b = &m_buckets[idx];
+
+			if(b->m_slot == NO_SLOT)
+			{
+				return NO_SLOT;
+			}
+
+			if(b->m_key == (uint32_t)tid && get_slot(b->m_slot)->get_entry()->first == tid)
+			{
+				return b->m_slot;
+			}
+
+			idx = (idx + 1) & m_mask;
+		}
+	}
+
+	static inline uint32_t hash(uint32_t key)
+	{
+		return (uint32_t)(((uint64_t)key * 0x9E3779B97F4A7C15ULL) >> 32);
+	}
+
+	uint32_t next_slot(uint32_t pos);
+	uint32_t alloc_slot();
+	void insert_bucket(uint32_t key, uint32_t slot);
+	void erase_bucket(uint32_t slot);
+	void rehash(uint32_t nbuckets);
+
+	vector<slot*> m_chunks;
+	vector<uint32_t> m_free_slots;
+	uint32_t m_nslots; // Slots that have been used at least once
+	vector<bucket> m_buckets;
+	uint32_t m_mask;
+	uint32_t m_size;
+};
+
+typedef sinsp_threadtable threadinfo_map_t;
+typedef sinsp_threadtable::iterator threadinfo_map_iterator_t;
 
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -353,7 +601,8 @@ public:
 	void set_listener(sinsp_threadtable_listener* listener);
 	void add_thread(sinsp_threadinfo& threadinfo, bool from_scap_proctable);
 	void remove_thread(int64_t tid, bool force);
-	// Returns true if the table is actually scanned
+	// Returns true when a scan of the table completes. The table is scanned a
+	// slice at a time, see sinsp::set_inactive_scan_slice().
 	// NOTE: this is implemented in sinsp.cpp so we can inline it from there
 	inline bool remove_inactive_threads();
 	void fix_sockets_coming_from_proc();
@@ -373,18 +622,67 @@ public:
 		return &m_threadtable;
 	}
 
+	//
+	// Return the tids of the threads of a process, its main thread excluded,
+	// or NULL if the process has no other threads in the table
+	//
+	const unordered_set<int64_t>* get_process_threads(int64_t pid)
+	{
+		thread_index_t::iterator it = m_pid_index.find(pid);
+		return (it != m_pid_index.end())? &it->second : NULL;
+	}
+
+	//
+	// Return the tids of the threads started by a thread, or NULL if it has
+	// no children in the table
+	//
+	const unordered_set<int64_t>* get_children(int64_t ptid)
+	{
+		thread_index_t::iterator it = m_ptid_index.find(ptid);
+		return (it != m_ptid_index.end())? &it->second : NULL;
+	}
+
+	//
+	// Change the pid and parent of a thread that is in the table. Use this
+	// instead of setting m_pid and m_ptid, so that the indexes stay consistent.
+	//
+	void update_thread_ids(sinsp_threadinfo* tinfo, int64_t pid, int64_t ptid);
+
 	set<uint16_t> m_server_ports;
 
 private:
+	typedef unordered_map<int64_t, unordered_set<int64_t>> thread_index_t;
+
 	void remove_thread(threadinfo_map_iterator_t it, bool force);
-	void increment_mainthread_childcount(sinsp_threadinfo* threadinfo);
+	bool scan_inactive_threads();
+	void create_main_thread(sinsp_threadinfo* threadinfo);
 	inline void clear_thread_pointers(threadinfo_map_iterator_t it);
+	void index_thread(sinsp_threadinfo* tinfo);
+	void unindex_thread(sinsp_threadinfo* tinfo);
 
 	sinsp* m_inspector;
+	//
+	// Declared before the table, so that it outlives the threads that lease
+	// their enter event buffers from it
+	//
+	sinsp_evt_buffer_pool m_lastevent_pool;
 	threadinfo_map_t m_threadtable;
+	//
+	// pid -> tids of the other threads of the process, and ptid -> tids of
+	// the children. m_nchilds of the main threads is the size of their entry
+	// in m_pid_index.
+	//
+	thread_index_t m_pid_index;
+	thread_index_t m_ptid_index;
+	//
+	// Simple thread cache. The handle becomes stale by itself when the thread
+	// is removed.
+	//
 	int64_t m_last_tid;
-	sinsp_threadinfo* m_last_tinfo;
+	sinsp_thread_handle m_last_tinfo;
 	uint64_t m_last_flush_time_ns;
+	bool m_scan_in_progress;
+	uint32_t m_scan_pos; // Slot where the next scan slice starts
 	uint32_t m_n_drops;
 	uint32_t m_n_proc_lookups;
 
@@ -395,6 +693,9 @@ private:
 	INTERNAL_COUNTER(m_non_cached_lookups);
 	INTERNAL_COUNTER(m_added_threads);
 	INTERNAL_COUNTER(m_removed_threads);
+	INTERNAL_COUNTER(m_scan_passes);
+	INTERNAL_COUNTER(m_scan_slices);
+	INTERNAL_COUNTER(m_scan_proc_checks);
 
 	friend class sinsp_parser;
 	friend class sinsp_analyzer;
@@ -0,0 +1,334 @@
+/*
+Copyright (C) 2013-2014 Draios inc.
+
+This file is part of sysdig.
+
+sysdig is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License version 2 as
+published by the Free Software Foundation.
+
+sysdig is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sysdig.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "sinsp.h"
+#include "sinsp_int.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// sinsp_value_snapshot implementation
+///////////////////////////////////////////////////////////////////////////////
+sinsp_value_snapshot::sinsp_value_snapshot()
+{
+	m_buf.resize(4096);
+	m_len = 0;
+}
+
+void sinsp_value_snapshot::add(value_type type, const uint8_t* data, uint32_t size, uint32_t len)
+{
+	uint32_t recsize = (sizeof(value) + size + 1 + 7) & ~7;
+
+	if(m_len + recsize > m_buf.size())
+	{
+		m_buf.resize(MAX(m_buf.size() * 2, m_len + recsize));
+	}
+
+	value* v = (value*)&m_buf[m_len];
+
+	v->m_type = type;
+	v->m_len = len;
+	v->m_size = recsize;
+	v->m_reserved = 0;
+
+	if(size != 0)
+	{
+		memcpy(v->get_data(), data, size);
+	}
+
+	v->get_data()[size] = 0;
+	m_len += recsize;
+}
+
+bool sinsp_value_snapshot::add_raw(const uint8_t* val, uint32_t len, ppm_param_type type)
+{
+	uint32_t size;
+
+	switch(type)
+	{
+	case PT_INT8:
+	case PT_UINT8:
+	case PT_FLAGS8:
+	case PT_SIGTYPE:
+	case PT_L4PROTO:
+		size = 1;
+		break;
+	case PT_INT16:
+	case PT_UINT16:
+	case PT_FLAGS16:
+	case PT_PORT:
+	case PT_SYSCALLID:
+		size = 2;
+		break;
+	case PT_INT32:
+	case PT_UINT32:
+	case PT_FLAGS32:
+	case PT_BOOL:
+	case PT_IPV4ADDR:
+		size = 4;
+		break;
+	case PT_INT64:
+	case PT_FD:
+	case PT_PID:
+	case PT_ERRNO:
+	case PT_UINT64:
+	case PT_RELTIME:
+	case PT_ABSTIME:
+	case PT_DOUBLE:
+		size = 8;
+		break;
+	case PT_CHARBUF:
+		size = (uint32_t)strlen((char*)val);
+		break;
+	case PT_BYTEBUF:
+		size = len;
+		break;
+	default:
+		return false;
+	}
+
+	add(VT_RAW, val, size, len);
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// sinsp_worker_pool implementation
+///////////////////////////////////////////////////////////////////////////////
+sinsp_worker_pool::sinsp_worker_pool(sinsp* inspector, sinsp_filter* filter, const string& fmt, sinsp_writer* writer, uint32_t nworkers)
+{
+	m_writer = writer;
+	m_filter = filter;
+	m_cur = NULL;
+	m_stop = false;
+
+	if(nworkers == 0)
+	{
+		nworkers = 1;
+	}
+
+	m_formatter = new sinsp_evt_formatter(inspector, fmt);
+
+	for(uint32_t j = 0; j < nworkers; j++)
+	{
+		m_renderers.push_back(m_formatter->new_renderer());
+	}
+
+	for(uint32_t j = 0; j < nworkers; j++)
+	{
+		m_threads.push_back(std::thread(&sinsp_worker_pool::run, this, j));
+	}
+}
+
+sinsp_worker_pool::~sinsp_worker_pool()
+{
+	flush();
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stop = true;
+	}
+
+	m_cond.notify_all();
+
+	for(uint32_t j = 0; j < m_threads.size(); j++)
+	{
+		m_threads[j].join();
+	}
+
+	for(uint32_t j = 0; j < m_renderers.size(); j++)
+	{
+		delete m_renderers[j];
+	}
+
+	for(uint32_t j = 0; j < m_free.size(); j++)
+	{
+		delete m_free[j];
+	}
+
+	delete m_cur;
+	delete m_formatter;
+}
+
+void sinsp_worker_pool::process(sinsp_evt* evt)
+{
+	if(m_filter != NULL && !m_filter->run(evt))
+	{
+		return;
+	}
+
+	if(m_cur == NULL)
+	{
+		if(m_free.empty())
+		{
+			m_cur = new batch();
+		}
+		else
+		{
+			m_cur = m_free.back();
+			m_free.pop_back();
+		}
+
+		m_cur->m_values.clear();
+		m_cur->m_events.clear();
+		m_cur->m_outlen = 0;
+		m_cur->m_done = false;
+	}
+
+	uint32_t start = m_cur->m_values.get_size();
+
+	if(!m_formatter->snapshot(evt, &m_cur->m_values))
+	{
+		m_cur->m_values.truncate(start);
+		return;
+	}
+
+	m_cur->m_events.push_back(start);
+
+	if(m_cur->m_events.size() >= WORKER_POOL_BATCH_SIZE)
+	{
+		submit();
+		write_done(false);
+	}
+}
+
+void sinsp_worker_pool::flush()
+{
+	submit();
+	write_done(true);
+}
+
+void sinsp_worker_pool::submit()
+{
+	if(m_cur == NULL || m_cur->m_events.empty())
+	{
+		return;
+	}
+
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+
+		//
+		// Don't let the workers fall behind without bounds, so that the
+		// memory used by the snapshots stays bounded too
+		//
+		while(m_inflight.size() >= m_threads.size() * WORKER_POOL_MAX_BATCHES_PER_WORKER &&
+			!m_inflight.front()->m_done)
+		{
+			m_done_cond.wait(lock);
+		}
+
+		m_todo.push_back(m_cur);
+		m_inflight.push_back(m_cur);
+	}
+
+	m_cond.notify_one();
+	m_cur = NULL;
+}
+
+//
+// Writes the output of the batches at the front of m_inflight that have been
+// rendered. With wait, waits for all of them.
+//
+void sinsp_worker_pool::write_done(bool wait)
+{
+	while(true)
+	{
+		batch* b;
+
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+
+			while(wait && !m_inflight.empty() && !m_inflight.front()->m_done)
+			{
+				m_done_cond.wait(lock);
+			}
+
+			if(m_inflight.empty() || !m_inflight.front()->m_done)
+			{
+				return;
+			}
+
+			b = m_inflight.front();
+			m_inflight.pop_front();
+		}
+
+		//
+		// The batch isn't in the pool anymore, so the writer can be called
+		// without holding the lock
+		//
+		if(b->m_outlen != 0)
+		{
+			m_writer->write(&b->m_out[0], b->m_outlen);
+		}
+
+		m_free.push_back(b);
+	}
+}
+
+void sinsp_worker_pool::render(batch* b, sinsp_evt_formatter* renderer)
+{
+	for(uint32_t j = 0; j < b->m_events.size(); j++)
+	{
+		uint32_t pos = b->m_events[j];
+		char* str;
+		uint32_t len;
+
+		if(!renderer->render_snapshot(&b->m_values, &pos, &str, &len))
+		{
+			continue;
+		}
+
+		if(b->m_outlen + len + 1 > b->m_out.size())
+		{
+			b->m_out.resize(MAX(b->m_out.size() * 2, b->m_outlen + len + 1));
+		}
+
+		memcpy(&b->m_out[b->m_outlen], str, len);
+		b->m_out[b->m_outlen + len] = '\n';
+		b->m_outlen += len + 1;
+	}
+}
+
+void sinsp_worker_pool::run(uint32_t id)
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	while(true)
+	{
+		while(m_todo.empty() && !m_stop)
+		{
+			m_cond.wait(lock);
+		}
+
+		if(m_todo.empty())
+		{
+			break;
+		}
+
+		batch* b = m_todo.front();
+		m_todo.pop_front();
+
+		//
+		// Nobody else touches the batch until m_done is set
+		//
+		lock.unlock();
+		render(b, m_renderers[id]);
+		lock.lock();
+
+		b->m_done = true;
+		m_done_cond.notify_all();
+	}
+}
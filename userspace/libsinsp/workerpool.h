@@ -0,0 +1,196 @@
+/*
+Copyright (C) 2013-2014 Draios inc.
+
+This file is part of sysdig.
+
+sysdig is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License version 2 as
+published by the Free Software Foundation.
+
+sysdig is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sysdig.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+/** @defgroup event Event manipulation
+ *  @{
+ */
+
+/*!
+  \brief The values of the fields of a sequence of events, copied out of the
+   events and of the thread and fd tables, so that they can be rendered
+   after the inspector has moved on, e.g. by another thread.
+  Each value is a record header followed by the bytes of the value, NUL
+  terminated and padded to 8 bytes, so that the values are aligned.
+*/
+class SINSP_PUBLIC sinsp_value_snapshot
+{
+public:
+	enum value_type
+	{
+		VT_NULL = 0, ///< The event doesn't have the field.
+		VT_RAW = 1, ///< The value returned by extract().
+		VT_STRING = 2, ///< A value that has been converted to a string while taking the snapshot.
+	};
+
+	struct value
+	{
+		uint32_t m_type;
+		uint32_t m_len; // The length returned by extract()
+		uint32_t m_size; // The size of the record, header included
+		uint32_t m_reserved;
+
+		inline uint8_t* get_data()
+		{
+			return (uint8_t*)(this + 1);
+		}
+	};
+
+	sinsp_value_snapshot();
+
+	/*!
+	  \brief Removes all the values.
+	*/
+	void clear()
+	{
+		m_len = 0;
+	}
+
+	/*!
+	  \brief Returns the size of the values, which can be passed to
+	   truncate() to remove the values added after this call.
+	*/
+	uint32_t get_size()
+	{
+		return m_len;
+	}
+
+	void truncate(uint32_t size)
+	{
+		m_len = size;
+	}
+
+	/*!
+	  \brief Appends a value of size bytes.
+	*/
+	void add(value_type type, const uint8_t* data, uint32_t size, uint32_t len);
+
+	/*!
+	  \brief Appends a value returned by extract(). Returns false, without
+	   adding anything, if the values of the field type can't be copied,
+	   e.g. because they contain pointers.
+	*/
+	bool add_raw(const uint8_t* val, uint32_t len, ppm_param_type type);
+
+	/*!
+	  \brief Returns the value at offset *pos, and moves *pos to the next one.
+	*/
+	inline value* next(uint32_t* pos)
+	{
+		value* v = (value*)&m_buf[*pos];
+
+		*pos += v->m_size;
+		return v;
+	}
+
+private:
+	vector<uint8_t> m_buf;
+	uint32_t m_len;
+};
+
+/*!
+  \brief Formats the events that pass a display filter on a pool of worker
+   threads.
+  The fields read the thread and fd tables, which change with every event,
+  and some of them, e.g. evt.delta, depend on the previous events that were
+  formatted, so the filter runs and the fields are extracted on the thread
+  that calls process(), into a snapshot. The workers render the output from
+  the snapshots, a batch of events at a time, and the output of the batches
+  is passed to the writer in the order of the events, by the thread that
+  calls process() and flush().
+  Only the text output is supported.
+*/
+class SINSP_PUBLIC sinsp_worker_pool
+{
+public:
+	/*!
+	  \brief Constructs the pool and starts the workers.
+
+	  \param inspector The inspector that generates the events.
+	  \param filter The display filter, or NULL. It's not owned by the pool.
+	  \param fmt The output format, like for sinsp_evt_formatter.
+	  \param writer Receives the output of the events, with a newline after
+	   each of them.
+	  \param nworkers The number of worker threads.
+	*/
+	sinsp_worker_pool(sinsp* inspector, sinsp_filter* filter, const string& fmt, sinsp_writer* writer, uint32_t nworkers);
+	~sinsp_worker_pool();
+
+	/*!
+	  \brief Runs the filter on an event and takes its snapshot, and writes
+	   the output of the batches that the workers have completed.
+	*/
+	void process(sinsp_evt* evt);
+
+	/*!
+	  \brief Hands the events collected so far to the workers, and waits
+	   until their output has been written. Call it before flushing the
+	   writer, e.g. on capture timeouts and at the end of the capture.
+	*/
+	void flush();
+
+private:
+	struct batch
+	{
+		sinsp_value_snapshot m_values;
+		vector<uint32_t> m_events; // Offset of the values of each event
+		vector<char> m_out;
+		uint32_t m_outlen;
+		bool m_done;
+	};
+
+	void submit();
+	void write_done(bool wait);
+	void run(uint32_t id);
+	void render(batch* b, sinsp_evt_formatter* renderer);
+
+	sinsp_writer* m_writer;
+	sinsp_filter* m_filter;
+
+	//
+	// m_formatter extracts the fields, each worker renders them with its
+	// own formatter
+	//
+	sinsp_evt_formatter* m_formatter;
+	vector<sinsp_evt_formatter*> m_renderers;
+	batch* m_cur;
+
+	vector<std::thread> m_threads;
+	std::mutex m_mutex;
+	std::condition_variable m_cond;
+	std::condition_variable m_done_cond;
+
+	//
+	// Protected by m_mutex. m_inflight holds the submitted batches in the
+	// order of the events, m_todo the ones that no worker has taken yet.
+	//
+	std::deque<batch*> m_todo;
+	std::deque<batch*> m_inflight;
+	bool m_stop;
+
+	// Batches that can be reused, only used by the caller's thread
+	vector<batch*> m_free;
+};
+
+/*@}*/
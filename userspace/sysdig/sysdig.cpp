@@ -41,6 +41,15 @@ along with sysdig.  If not, see <http://www.gnu.org/licenses/>.
 #endif
 
 static bool g_terminate = false;
+//
+// The event output. It's shared by all the runs, since it owns the buffer of
+// stdout.
+//
+static sinsp_buffered_writer* g_writer = NULL;
+//
+// Formats the events on background threads, with --workers
+//
+static sinsp_worker_pool* g_pool = NULL;
 #ifdef HAS_CHISELS
 vector<sinsp_chisel*> g_chisels;
 #endif
@@ -116,6 +125,10 @@ static void usage()
 "                    'hidden' so that they won't appear when reading the file.\n"
 "                    Be aware that using this flag might generate substantially\n"
 "                    bigger traces files.\n"
+" --filter-eventmask\n"
+"                    On live captures, tell the driver not to capture the event\n"
+"                    types that can't pass the filter. Other sysdig instances\n"
+"                    are not affected.\n"
 " -G <num_seconds>, --seconds=<num_seconds>\n"
 "                    Rotates the dump file specified with the -w option every\n"
 "                    num_seconds seconds. Savefiles will have the name specified\n"
@@ -139,6 +152,16 @@ static void usage()
 " -n <num>, --numevents=<num>\n"
 "                    Stop capturing after <num> events\n"
 " -P, --progress     Print progress on stderr while processing trace files\n"
+" --pipeline         Read the events on background threads, so that reading\n"
+"                    and decompressing them overlaps with parsing. Combine\n"
+"                    with -q -v to measure the event throughput.\n"
+" --flush-interval=<ms>\n"
+"                    When the output is not a terminal, flush it at most every\n"
+"                    <ms> milliseconds. The default is 100.\n"
+" --flush-lines=<num>\n"
+"                    Flush the output every <num> events.\n"
+" --output-thread    Write the output on a background thread. Ignored when\n"
+"                    chisels are running.\n"
 " -p <output_format>, --print=<output_format>\n"
 "                    Specify the format to be used when printing the events.\n"
 "                    With -pc or -pcontainer will use a container-friendly format.\n"
@@ -159,6 +182,8 @@ static void usage()
 "                    epoch, r for relative time from the beginning of the\n"
 "                    capture, d for delta between event enter and exit, and\n"
 "                    D for delta from the previous event.\n"
+" --unbuffered       Flush the output after every event. This is the default\n"
+"                    when the output is a terminal.\n"
 " -v, --verbose      Verbose output.\n"
 "                    This flag will cause the full content of text and binary\n"
 "                    buffers to be printed on screen, instead of being truncated\n"
@@ -167,6 +192,8 @@ static void usage()
 "                    -v will also make sysdig print some summary information at\n"
 "                    the end of the capture.\n"
 " --version          Print version number.\n"
+" --workers=<num>    Run the output formatting on <num> background threads.\n"
+"                    Ignored when chisels are running and with -j.\n"
 " -w <writefile>, --write=<writefile>\n"
 "                    Write the captured events to <writefile>.\n"
 " -W <num>, --limit <num>\n"
@@ -182,6 +209,10 @@ static void usage()
 " -X, --print-hex-ascii\n"
 "                    Print data buffers in hex and ASCII.\n"
 " -z, --compress     Used with -w, enables compression for tracefiles.\n"
+" --chunked          Used with -z, compresses the tracefile in independent\n"
+"                    chunks, which are decompressed in parallel when the file\n"
+"                    is read back. These files can't be read by older versions\n"
+"                    of sysdig.\n"
 "\n"
 "Output format:\n\n"
 "By default, sysdig prints the information for each captured event on a single\n"
@@ -293,6 +324,7 @@ static void initialize_chisels()
 #ifdef HAS_CHISELS
 	for(uint32_t j = 0; j < g_chisels.size(); j++)
 	{
+		g_chisels[j]->set_output_writer(g_writer);
 		g_chisels[j]->on_init();
 	}
 #endif
@@ -423,14 +455,22 @@ void handle_end_of_file(bool print_progress, sinsp_evt_formatter* formatter = NU
 {
 	string line;
 
+	if(g_pool != NULL)
+	{
+		g_pool->flush();
+	}
+
 	// Notify the formatter that we are at the
 	// end of the capture in case it needs to
 	// write any terminating characters
 	if(formatter != NULL && formatter->on_capture_end(&line))
 	{
-		cout << line << endl;
+		line += '\n';
+		g_writer->write(line.c_str(), (uint32_t)line.size());
 	}
 
+	g_writer->flush();
+
 	//
 	// Reached the end of a trace file.
 	// If we are reporting prgress, this is 100%
@@ -468,7 +508,6 @@ captureinfo do_inspect(sinsp* inspector,
 	captureinfo retval;
 	int32_t res;
 	sinsp_evt* ev;
-	string line;
 	double last_printed_progress_pct = 0;
 
 	//
@@ -499,6 +538,15 @@ captureinfo do_inspect(sinsp* inspector,
 				chisels_do_timeout(ev);
 			}
 
+			//
+			// Don't let the output sit in the buffer while the capture is idle
+			//
+			if(g_pool != NULL)
+			{
+				g_pool->flush();
+			}
+
+			g_writer->check_flush();
 			continue;
 		}
 		else if(res == SCAP_EOF)
@@ -519,6 +567,16 @@ captureinfo do_inspect(sinsp* inspector,
 
 		retval.m_nevts++;
 
+		//
+		// Most events don't write anything, since they are skipped below or
+		// the chisels print on their own. Check the flush interval anyway,
+		// so that the output doesn't sit in the buffer.
+		//
+		if(retval.m_nevts % OUTPUT_FLUSH_CHECK_EVENTS == 0)
+		{
+			g_writer->check_flush();
+		}
+
 		if(print_progress)
 		{
 			if(ev->get_num() % 10000 == 0)
@@ -591,29 +649,33 @@ captureinfo do_inspect(sinsp* inspector,
 				continue;
 			}
 
-			if(formatter->tostring(ev, &line))
+			//
+			// The pool runs the display filter too
+			//
+			if(g_pool != NULL)
 			{
-				//
-				// Output the line
-				//
-				if(display_filter)
-				{
-					if(!display_filter->run(ev))
-					{
-						continue;
-					}
-				}
+				g_pool->process(ev);
+				continue;
+			}
 
-				cout << line;
-				if(!json)
-				{
-					cout << endl;
-				}
-				else
+			//
+			// Filter before formatting, so the events that are dropped don't
+			// pay for it. It also keeps the separators of the JSON output
+			// right, since they depend on the events that were formatted.
+			//
+			if(display_filter)
+			{
+				if(!display_filter->run(ev))
 				{
-					cout << flush;
+					continue;
 				}
 			}
+
+			//
+			// Output the line. In JSON mode the separator comes before the
+			// next object.
+			//
+			formatter->write(ev, g_writer, !json);
 		}
 	}
 
@@ -649,6 +711,8 @@ sysdig_init_res sysdig_init(int argc, char **argv)
 	bool jflag = false;
 	string cname;
 	vector<summary_table_entry>* summary_table = NULL;
+	bool output_thread = false;
+	uint64_t nworkers = 0;
 
 	// These variables are for the cycle_writer engine
 	int duration_seconds = 0;	
@@ -669,6 +733,7 @@ sysdig_init_res sysdig_init(int argc, char **argv)
 		{"exclude-users", no_argument, 0, 'E' },
 		{"event-limit", required_argument, 0, 'e'},
 		{"fatfile", no_argument, 0, 'F'},
+		{"filter-eventmask", no_argument, 0, 0 },
 		{"seconds", required_argument, 0, 'G' },
 		{"help", no_argument, 0, 'h' },
 #ifdef HAS_CHISELS
@@ -680,24 +745,36 @@ sysdig_init_res sysdig_init(int argc, char **argv)
 		{"list-events", no_argument, 0, 'L' },
 		{"numevents", required_argument, 0, 'n' },
 		{"progress", required_argument, 0, 'P' },
+		{"flush-interval", required_argument, 0, 0 },
+		{"flush-lines", required_argument, 0, 0 },
+		{"output-thread", no_argument, 0, 0 },
 		{"print", required_argument, 0, 'p' },
+		{"pipeline", no_argument, 0, 0 },
 		{"quiet", no_argument, 0, 'q' },
 		{"readfile", required_argument, 0, 'r' },
 		{"snaplen", required_argument, 0, 's' },
 		{"summary", no_argument, 0, 'S' },
 		{"timetype", required_argument, 0, 't' },
+		{"unbuffered", no_argument, 0, 0 },
 		{"verbose", no_argument, 0, 'v' },
 		{"version", no_argument, 0, 0 },
+		{"workers", required_argument, 0, 0 },
 		{"writefile", required_argument, 0, 'w' },
 		{"limit", required_argument, 0, 'W' },
 		{"print-hex", no_argument, 0, 'x'},
 		{"print-hex-ascii", no_argument, 0, 'X'},
 		{"compress", no_argument, 0, 'z' },
+		{"chunked", no_argument, 0, 0 },
 		{0, 0, 0, 0}
 	};
 
 	output_format = "*%evt.num %evt.outputtime %evt.cpu %proc.name (%thread.tid) %evt.dir %evt.type %evt.info";
 
+	if(g_writer == NULL)
+	{
+		g_writer = new sinsp_buffered_writer(stdout);
+	}
+
 	try
 	{
 		inspector = new sinsp();
@@ -1008,6 +1085,75 @@ sysdig_init_res sysdig_init(int argc, char **argv)
 				break;
 			}
 
+			if(op == 0 && string(long_options[long_index].name) == "pipeline")
+			{
+				inspector->set_pipeline_mode(true);
+			}
+
+			if(op == 0 && string(long_options[long_index].name) == "filter-eventmask")
+			{
+				inspector->set_filter_eventmask(true);
+			}
+
+			if(op == 0 && string(long_options[long_index].name) == "chunked")
+			{
+				inspector->set_chunked_compression(true);
+			}
+
+			if(op == 0 && string(long_options[long_index].name) == "unbuffered")
+			{
+				g_writer->set_flush_policy(sinsp_buffered_writer::FP_IMMEDIATE, 0);
+			}
+
+			if(op == 0 && string(long_options[long_index].name) == "flush-lines")
+			{
+				uint64_t nlines;
+
+				try
+				{
+					nlines = sinsp_numparser::parseu64(optarg);
+				}
+				catch(...)
+				{
+					throw sinsp_exception("can't parse the --flush-lines argument, make sure it's a number");
+				}
+
+				g_writer->set_flush_policy(sinsp_buffered_writer::FP_LINES, nlines);
+			}
+
+			if(op == 0 && string(long_options[long_index].name) == "flush-interval")
+			{
+				uint64_t interval_ms;
+
+				try
+				{
+					interval_ms = sinsp_numparser::parseu64(optarg);
+				}
+				catch(...)
+				{
+					throw sinsp_exception("can't parse the --flush-interval argument, make sure it's a number");
+				}
+
+				g_writer->set_flush_policy(sinsp_buffered_writer::FP_TIME, interval_ms);
+			}
+
+			if(op == 0 && string(long_options[long_index].name) == "output-thread")
+			{
+				output_thread = true;
+			}
+
+			if(op == 0 && string(long_options[long_index].name) == "workers")
+			{
+				try
+				{
+					nworkers = sinsp_numparser::parseu64(optarg);
+				}
+				catch(...)
+				{
+					throw sinsp_exception("can't parse the --workers argument, make sure it's a number");
+				}
+			}
+
 			if(string(long_options[long_index].name) == "version")
 			{
 				printf("sysdig version %s\n", SYSDIG_VERSION);
@@ -1123,6 +1269,24 @@ sysdig_init_res sysdig_init(int argc, char **argv)
 			inspector->set_max_evt_output_len(80);
 		}
 
+		//
+		// The chisels print to stdout on their own, so the output can be
+		// moved to another thread only when there are none
+		//
+		if(output_thread && g_chisels.size() == 0)
+		{
+			g_writer->start_thread();
+		}
+
+		//
+		// The pool takes the place of the formatter, and it only renders the
+		// text output
+		//
+		if(nworkers != 0 && g_chisels.size() == 0 && !jflag)
+		{
+			g_pool = new sinsp_worker_pool(inspector, display_filter, output_format, g_writer, (uint32_t)nworkers);
+		}
+
 		for(uint32_t j = 0; j < infiles.size() || infiles.size() == 0; j++)
 		{
 #ifdef HAS_FILTERING
@@ -1209,7 +1373,7 @@ sysdig_init_res sysdig_init(int argc, char **argv)
 				inspector->set_snaplen(snaplen);
 			}
 
-			duration = ((double)clock()) / CLOCKS_PER_SEC;
+			uint64_t start_ns = sinsp_utils::get_current_time_ns();
 
 			if(outfile != "")
 			{
@@ -1231,7 +1395,12 @@ sysdig_init_res sysdig_init(int argc, char **argv)
 				summary_table,
 				&formatter);
 
-			duration = ((double)clock()) / CLOCKS_PER_SEC - duration;
+			//
+			// Wall clock time: with --pipeline and the worker pool, the events
+			// are processed by more than one thread, and the CPU time of the
+			// process doesn't tell how fast they went through
+			//
+			duration = (double)(sinsp_utils::get_current_time_ns() - start_ns) / ONE_SECOND_IN_NS;
 
 			scap_stats cstats;
 			inspector->get_capture_stats(&cstats);
@@ -1271,6 +1440,18 @@ sysdig_init_res sysdig_init(int argc, char **argv)
 	}
 
 exit:
+	//
+	// Make sure the event output is out before anything else gets printed
+	//
+	if(g_pool != NULL)
+	{
+		delete g_pool;
+		g_pool = NULL;
+	}
+
+	g_writer->stop_thread();
+	g_writer->flush();
+
 	//
 	// If any of the chisels is requesting another run,
 	//